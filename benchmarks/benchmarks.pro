@@ -0,0 +1,5 @@
+TEMPLATE = subdirs
+SUBDIRS = processpool \
+          coroutines \
+          processsetup \
+          sftppipeline
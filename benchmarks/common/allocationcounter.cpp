@@ -0,0 +1,52 @@
+#include <stdlib.h>
+#include <new>
+
+#include "allocationcounter.h"
+
+quint64 allocation_count = 0;
+
+// Replaced deallocation functions must not throw, throw() is not valid in
+// C++17 and newer
+#if __cplusplus >= 201103L
+#define NOTHROW noexcept
+#else
+#define NOTHROW throw()
+#endif
+
+void *operator new(size_t size)
+{
+    allocation_count++;
+    void *ptr = malloc(size ? size : 1);
+    if ( ! ptr ) throw std::bad_alloc();
+    return ptr;
+}
+
+void *operator new[](size_t size)
+{
+    allocation_count++;
+    void *ptr = malloc(size ? size : 1);
+    if ( ! ptr ) throw std::bad_alloc();
+    return ptr;
+}
+
+void operator delete(void *ptr) NOTHROW
+{
+    free(ptr);
+}
+
+void operator delete[](void *ptr) NOTHROW
+{
+    free(ptr);
+}
+
+#ifdef __cpp_sized_deallocation
+void operator delete(void *ptr, size_t) NOTHROW
+{
+    free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) NOTHROW
+{
+    free(ptr);
+}
+#endif
@@ -0,0 +1,12 @@
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+#include <QtGlobal>
+
+// Number of allocations made with operator new, counted by the replacement
+// operators in allocationcounter.cpp. Covers QObjects, their private data
+// and signal connections. QByteArray and QString data is allocated with
+// malloc() and is not counted.
+extern quint64 allocation_count;
+
+#endif // ALLOCATIONCOUNTER_H
@@ -0,0 +1,6 @@
+# Allocation counting shared by the benchmarks
+
+HEADERS += $$PWD/allocationcounter.h
+SOURCES += $$PWD/allocationcounter.cpp
+
+INCLUDEPATH += $$PWD
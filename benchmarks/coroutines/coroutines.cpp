@@ -0,0 +1,185 @@
+
+#include <QDebug>
+#include <QCoreApplication>
+#include <QStringList>
+#include <QUrl>
+
+#include "coroutines.h"
+#include "libsshqtquestionconsole.h"
+
+void CoroutineBenchmark::runBenchmark()
+{
+    QStringList args = qApp->arguments();
+
+    if ( args.count() < 2 || args.count() > 4 ) {
+        qDebug() << "Usage:"
+                 << qPrintable(args.at(0))
+                 << "SSH_URL [COMMANDS] [LINES]";
+        qDebug() << "Example:"
+                 << qPrintable(args.at(0))
+                 << QString("ssh://user@hostname:port/")
+                 << QString("1000")
+                 << QString("1000000");
+        qApp->quit();
+        return;
+    }
+
+    count = args.value(2, "1000").toInt();
+    lines = args.value(3, "1000000").toInt();
+
+    client = new LibsshQtClient(this);
+    client->setUrl(QUrl(args.at(1)));
+    client->useDefaultAuths();
+
+    new LibsshQtQuestionConsole(client);
+
+    connect(client, SIGNAL(opened()),         this, SLOT(handleOpened()));
+    connect(client, SIGNAL(allAuthsFailed()), qApp, SLOT(quit()));
+    connect(client, SIGNAL(error()),          qApp, SLOT(quit()));
+
+    client->connectToHost();
+}
+
+void CoroutineBenchmark::handleOpened()
+{
+    client->disconnect(this);
+
+    qDebug() << "Running" << count << "commands one at a time and reading"
+             << lines << "lines of output";
+
+    startSignalCommands();
+}
+
+/*!
+    Run commands one after another, driven by process signals.
+*/
+void CoroutineBenchmark::startSignalCommands()
+{
+    finished = 0;
+    round_timer.start();
+    startSignalCommand();
+}
+
+void CoroutineBenchmark::startSignalCommand()
+{
+    LibsshQtProcess *process = client->runCommand("true");
+    process->setStdoutBehaviour(LibsshQtProcess::OutputManual);
+    process->setStderrBehaviour(LibsshQtProcess::OutputManual);
+
+    connect(process, SIGNAL(finished(int)), this, SLOT(handleFinished()));
+    connect(process, SIGNAL(error()),       this, SLOT(handleProcessError()));
+}
+
+void CoroutineBenchmark::handleFinished()
+{
+    LibsshQtProcess *process = qobject_cast<LibsshQtProcess *>(sender());
+    process->disconnect(this);
+    process->deleteLater();
+
+    if ( ++finished < count ) {
+        startSignalCommand();
+    } else {
+        printRound("Signal commands:   ", count, "commands");
+        startSignalLines();
+    }
+}
+
+/*!
+    Read lines of one command with readyRead signal and canReadLine().
+*/
+void CoroutineBenchmark::startSignalLines()
+{
+    lines_read = 0;
+    round_timer.start();
+
+    LibsshQtProcess *process =
+            client->runCommand(QString("seq %1").arg(lines));
+    process->setStdoutBehaviour(LibsshQtProcess::OutputManual);
+    process->setStderrBehaviour(LibsshQtProcess::OutputManual);
+
+    connect(process, SIGNAL(readyRead()),   this, SLOT(handleReadyRead()));
+    connect(process, SIGNAL(readChannelFinished()),
+            this,    SLOT(handleReadyRead()));
+    connect(process, SIGNAL(finished(int)), this, SLOT(handleLinesFinished()));
+    connect(process, SIGNAL(error()),       this, SLOT(handleProcessError()));
+}
+
+void CoroutineBenchmark::handleReadyRead()
+{
+    LibsshQtProcess *process = qobject_cast<LibsshQtProcess *>(sender());
+    while ( process->canReadLine()) {
+        process->readLine();
+        lines_read++;
+    }
+}
+
+void CoroutineBenchmark::handleLinesFinished()
+{
+    LibsshQtProcess *process = qobject_cast<LibsshQtProcess *>(sender());
+    process->disconnect(this);
+    process->deleteLater();
+
+    printRound("Signal lines:      ", lines_read, "lines");
+    runCoroutineCommands();
+}
+
+/*!
+    Run the same commands from a coroutine.
+*/
+LibsshQt::Task CoroutineBenchmark::runCoroutineCommands()
+{
+    round_timer.start();
+
+    for ( int i = 0; i < count; i++ ) {
+        LibsshQtResult result = co_await LibsshQt::exec(client, "true");
+        if ( ! result.ok ) {
+            qDebug() << "Command failed:" << qPrintable(result.errorMessage);
+            qApp->quit();
+            co_return;
+        }
+    }
+
+    printRound("Coroutine commands:", count, "commands");
+    runCoroutineLines();
+}
+
+/*!
+    Read the same lines from a coroutine with one await per line.
+*/
+LibsshQt::Task CoroutineBenchmark::runCoroutineLines()
+{
+    lines_read = 0;
+    round_timer.start();
+
+    LibsshQtProcess *process =
+            client->runCommand(QString("seq %1").arg(lines));
+    process->setStdoutBehaviour(LibsshQtProcess::OutputManual);
+    process->setStderrBehaviour(LibsshQtProcess::OutputManual);
+
+    while ( ! (co_await LibsshQt::readLine(process)).isEmpty()) {
+        lines_read++;
+    }
+
+    process->deleteLater();
+    printRound("Coroutine lines:   ", lines_read, "lines");
+    qApp->quit();
+}
+
+void CoroutineBenchmark::handleProcessError()
+{
+    LibsshQtProcess *process = qobject_cast<LibsshQtProcess *>(sender());
+    if ( ! process->isClientError()) {
+        qDebug() << "Process error:"
+                 << qPrintable(process->errorCodeAndMessage());
+    }
+    qApp->quit();
+}
+
+void CoroutineBenchmark::printRound(const char *name, int n, const char *unit)
+{
+    qint64 elapsed = round_timer.nsecsElapsed();
+
+    qDebug() << name << n << unit << "in" << elapsed / 1000000 << "ms,"
+             << double(n) * 1000000000 / qMax(elapsed, qint64(1))
+             << unit << "per second";
+}
@@ -0,0 +1,43 @@
+#ifndef COROUTINES_H
+#define COROUTINES_H
+
+#include <QObject>
+#include <QElapsedTimer>
+
+#include "libsshqtclient.h"
+#include "libsshqtprocess.h"
+#include "libsshqtcoro.h"
+
+class CoroutineBenchmark : public QObject
+{
+    Q_OBJECT
+
+public slots:
+    void runBenchmark();
+
+private slots:
+    void handleOpened();
+    void handleFinished();
+    void handleReadyRead();
+    void handleLinesFinished();
+    void handleProcessError();
+
+private:
+    void startSignalCommands();
+    void startSignalCommand();
+    void startSignalLines();
+    LibsshQt::Task runCoroutineCommands();
+    LibsshQt::Task runCoroutineLines();
+    void printRound(const char *name, int n, const char *unit);
+
+private:
+    LibsshQtClient     *client;
+    int                 count;
+    int                 lines;
+
+    int                 finished;
+    int                 lines_read;
+    QElapsedTimer       round_timer;
+};
+
+#endif // COROUTINES_H
@@ -0,0 +1,32 @@
+#-------------------------------------------------
+#
+# libsshqt coroutine benchmark
+#
+#-------------------------------------------------
+
+QT       += core
+
+QT       -= gui
+
+TARGET = libsshqt-benchmark-coroutines
+CONFIG   += console
+CONFIG   -= app_bundle
+
+# Coroutines need C++20. Qt 5 adds the standard selected by CONFIG after
+# QMAKE_CXXFLAGS, so the flag must come from CONFIG there.
+greaterThan(QT_MAJOR_VERSION, 4) {
+    CONFIG += c++2a
+} else {
+    QMAKE_CXXFLAGS += -std=c++20
+}
+
+TEMPLATE = app
+
+include( ../../libsshqt.pri )
+include( ../../libssh.pri )
+
+SOURCES += main.cpp \
+    coroutines.cpp
+
+HEADERS += \
+    coroutines.h
@@ -0,0 +1,14 @@
+#include <QtCore/QCoreApplication>
+#include <QTimer>
+
+#include "coroutines.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    CoroutineBenchmark *benchmark = new CoroutineBenchmark;
+    QTimer::singleShot(0, benchmark, SLOT(runBenchmark()));
+    int ret = a.exec();
+    delete benchmark;
+    return ret;
+}
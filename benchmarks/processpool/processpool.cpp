@@ -0,0 +1,129 @@
+
+#include <QDebug>
+#include <QCoreApplication>
+#include <QStringList>
+#include <QUrl>
+
+#include "processpool.h"
+#include "libsshqtquestionconsole.h"
+
+void ProcessPoolBenchmark::runBenchmark()
+{
+    QStringList args = qApp->arguments();
+
+    if ( args.count() < 2 || args.count() > 4 ) {
+        qDebug() << "Usage:"
+                 << qPrintable(args.at(0))
+                 << "SSH_URL [COUNT] [COMMAND]";
+        qDebug() << "Example:"
+                 << qPrintable(args.at(0))
+                 << QString("ssh://user@hostname:port/")
+                 << QString("10000")
+                 << QString("true");
+        qApp->quit();
+        return;
+    }
+
+    count   = args.value(2, "10000").toInt();
+    command = args.value(3, "true");
+
+    client = new LibsshQtClient(this);
+    client->setUrl(QUrl(args.at(1)));
+    client->useDefaultAuths();
+
+    new LibsshQtQuestionConsole(client);
+
+    connect(client, SIGNAL(opened()),         this, SLOT(handleOpened()));
+    connect(client, SIGNAL(allAuthsFailed()), qApp, SLOT(quit()));
+    connect(client, SIGNAL(error()),          qApp, SLOT(quit()));
+
+    client->connectToHost();
+}
+
+void ProcessPoolBenchmark::handleOpened()
+{
+    qDebug() << "Running" << count << "commands," << client->maxChannels()
+             << "at a time:" << qPrintable(command);
+
+    startRound(false);
+}
+
+void ProcessPoolBenchmark::startRound(bool use_pool)
+{
+    pooled        = use_pool;
+    started       = 0;
+    finished      = 0;
+    total_latency = 0;
+    allocations   = allocation_count;
+    start_times.clear();
+
+    client->setProcessPoolSize(pooled ? client->maxChannels() : 0);
+    round_timer.start();
+
+    // Keep every channel slot busy
+    int concurrent = client->maxChannels() > 0 ? client->maxChannels() : 10;
+    while ( started < count && started < concurrent ) {
+        startCommand();
+    }
+}
+
+void ProcessPoolBenchmark::startCommand()
+{
+    LibsshQtProcess *process = client->runCommand(command);
+    process->setStdoutBehaviour(LibsshQtProcess::OutputToDevNull);
+    process->setStderrBehaviour(LibsshQtProcess::OutputToDevNull);
+
+    connect(process, SIGNAL(finished(int)), this, SLOT(handleFinished()));
+    connect(process, SIGNAL(error()),       this, SLOT(handleProcessError()));
+
+    start_times.insert(process, round_timer.nsecsElapsed());
+    started++;
+}
+
+void ProcessPoolBenchmark::handleFinished()
+{
+    LibsshQtProcess *process = qobject_cast<LibsshQtProcess *>(sender());
+    total_latency += round_timer.nsecsElapsed() - start_times.take(process);
+    finished++;
+
+    if ( pooled ) {
+        client->recycleProcess(process);
+    } else {
+        process->disconnect(this);
+        process->deleteLater();
+    }
+
+    if ( started < count ) {
+        startCommand();
+
+    } else if ( finished == count ) {
+        printRound();
+
+        if ( ! pooled ) {
+            startRound(true);
+        } else {
+            qApp->quit();
+        }
+    }
+}
+
+void ProcessPoolBenchmark::handleProcessError()
+{
+    LibsshQtProcess *process = qobject_cast<LibsshQtProcess *>(sender());
+    if ( ! process->isClientError()) {
+        qDebug() << "Process error:"
+                 << qPrintable(process->errorCodeAndMessage());
+    }
+    qApp->quit();
+}
+
+void ProcessPoolBenchmark::printRound()
+{
+    qint64  elapsed = round_timer.elapsed();
+    quint64 allocs  = allocation_count - allocations;
+
+    qDebug() << qPrintable(pooled ? "With pool:   " : "Without pool:")
+             << count << "commands in" << elapsed << "ms,"
+             << "latency" << total_latency / count / 1000 << "us/command,"
+             << "allocations" << double(allocs) / count << "/command";
+}
@@ -0,0 +1,43 @@
+#ifndef PROCESSPOOL_H
+#define PROCESSPOOL_H
+
+#include <QObject>
+#include <QHash>
+#include <QElapsedTimer>
+
+#include "libsshqtclient.h"
+#include "libsshqtprocess.h"
+#include "allocationcounter.h"
+
+class ProcessPoolBenchmark : public QObject
+{
+    Q_OBJECT
+
+public slots:
+    void runBenchmark();
+
+private slots:
+    void handleOpened();
+    void handleFinished();
+    void handleProcessError();
+
+private:
+    void startRound(bool pooled);
+    void startCommand();
+    void printRound();
+
+private:
+    LibsshQtClient                 *client;
+    QString                         command;
+    int                             count;
+
+    bool                            pooled;
+    int                             started;
+    int                             finished;
+    quint64                         allocations;
+    qint64                          total_latency;
+    QElapsedTimer                   round_timer;
+    QHash<LibsshQtProcess *, qint64> start_times;
+};
+
+#endif // PROCESSPOOL_H
@@ -0,0 +1,25 @@
+#-------------------------------------------------
+#
+# libsshqt process pool benchmark
+#
+#-------------------------------------------------
+
+QT       += core
+
+QT       -= gui
+
+TARGET = libsshqt-benchmark-processpool
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+include( ../../libsshqt.pri )
+include( ../../libssh.pri )
+include( ../common/common.pri )
+
+SOURCES += main.cpp \
+    processpool.cpp
+
+HEADERS += \
+    processpool.h
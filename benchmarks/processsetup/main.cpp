@@ -0,0 +1,15 @@
+#include <QtCore/QCoreApplication>
+#include <QTimer>
+
+#include "processsetup.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    ProcessSetupBenchmark *benchmark = new ProcessSetupBenchmark;
+    a.installEventFilter(benchmark);
+    QTimer::singleShot(0, benchmark, SLOT(runBenchmark()));
+    int ret = a.exec();
+    delete benchmark;
+    return ret;
+}
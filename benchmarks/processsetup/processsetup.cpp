@@ -0,0 +1,140 @@
+
+#include <QDebug>
+#include <QCoreApplication>
+#include <QStringList>
+#include <QEvent>
+#include <QUrl>
+
+#include "processsetup.h"
+#include "libsshqtquestionconsole.h"
+
+ProcessSetupBenchmark::ProcessSetupBenchmark() :
+    client(0),
+    count(0),
+    started(0),
+    timer_events(0),
+    start_allocations(0),
+    start_timer_events(0),
+    total_allocations(0),
+    total_timer_events(0),
+    total_setup_time(0)
+{
+}
+
+/*!
+    Count timer events of all objects, zero interval QTimers of clients and
+    channels are delivered as timer events.
+*/
+bool ProcessSetupBenchmark::eventFilter(QObject *object, QEvent *event)
+{
+    Q_UNUSED(object);
+
+    if ( event->type() == QEvent::Timer ) {
+        timer_events++;
+    }
+    return false;
+}
+
+void ProcessSetupBenchmark::runBenchmark()
+{
+    QStringList args = qApp->arguments();
+
+    if ( args.count() < 2 || args.count() > 4 ) {
+        qDebug() << "Usage:"
+                 << qPrintable(args.at(0))
+                 << "SSH_URL [COUNT] [COMMAND]";
+        qDebug() << "Example:"
+                 << qPrintable(args.at(0))
+                 << QString("ssh://user@hostname:port/")
+                 << QString("1000")
+                 << QString("true");
+        qApp->quit();
+        return;
+    }
+
+    count   = args.value(2, "1000").toInt();
+    command = args.value(3, "true");
+
+    client = new LibsshQtClient(this);
+    client->setUrl(QUrl(args.at(1)));
+    client->useDefaultAuths();
+
+    new LibsshQtQuestionConsole(client);
+
+    connect(client, SIGNAL(opened()),         this, SLOT(handleClientOpened()));
+    connect(client, SIGNAL(allAuthsFailed()), qApp, SLOT(quit()));
+    connect(client, SIGNAL(error()),          qApp, SLOT(quit()));
+
+    client->connectToHost();
+}
+
+void ProcessSetupBenchmark::handleClientOpened()
+{
+    qDebug() << "Measuring setup of" << count
+             << "processes from runCommand() to opened():"
+             << qPrintable(command);
+
+    startCommand();
+}
+
+/*!
+    Start one process at a time, so that the measurements of different
+    processes do not overlap. Processes are recycled, so the numbers show the
+    steady state cost of a command.
+*/
+void ProcessSetupBenchmark::startCommand()
+{
+    start_allocations  = allocation_count;
+    start_timer_events = timer_events;
+    setup_timer.start();
+
+    LibsshQtProcess *process = client->runCommand(command);
+    process->setStdoutBehaviour(LibsshQtProcess::OutputToDevNull);
+    process->setStderrBehaviour(LibsshQtProcess::OutputToDevNull);
+
+    connect(process, SIGNAL(opened()),      this, SLOT(handleProcessOpened()));
+    connect(process, SIGNAL(finished(int)), this, SLOT(handleFinished()));
+    connect(process, SIGNAL(error()),       this, SLOT(handleProcessError()));
+
+    started++;
+}
+
+void ProcessSetupBenchmark::handleProcessOpened()
+{
+    total_setup_time   += setup_timer.nsecsElapsed();
+    total_allocations  += allocation_count - start_allocations;
+    total_timer_events += timer_events - start_timer_events;
+}
+
+void ProcessSetupBenchmark::handleFinished()
+{
+    LibsshQtProcess *process = qobject_cast<LibsshQtProcess *>(sender());
+    client->recycleProcess(process);
+
+    if ( started < count ) {
+        startCommand();
+    } else {
+        printResults();
+        qApp->quit();
+    }
+}
+
+void ProcessSetupBenchmark::handleProcessError()
+{
+    LibsshQtProcess *process = qobject_cast<LibsshQtProcess *>(sender());
+    if ( ! process->isClientError()) {
+        qDebug() << "Process error:"
+                 << qPrintable(process->errorCodeAndMessage());
+    }
+    qApp->quit();
+}
+
+void ProcessSetupBenchmark::printResults()
+{
+    qDebug() << "Setup time:  " << total_setup_time / count / 1000
+             << "us/process";
+    qDebug() << "Allocations: " << double(total_allocations) / count
+             << "/process";
+    qDebug() << "Timer events:" << double(total_timer_events) / count
+             << "/process";
+}
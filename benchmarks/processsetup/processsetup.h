@@ -0,0 +1,49 @@
+#ifndef PROCESSSETUP_H
+#define PROCESSSETUP_H
+
+#include <QObject>
+#include <QElapsedTimer>
+
+#include "libsshqtclient.h"
+#include "libsshqtprocess.h"
+#include "allocationcounter.h"
+
+class ProcessSetupBenchmark : public QObject
+{
+    Q_OBJECT
+
+public:
+    ProcessSetupBenchmark();
+
+    bool eventFilter(QObject *object, QEvent *event);
+
+public slots:
+    void runBenchmark();
+
+private slots:
+    void handleClientOpened();
+    void handleProcessOpened();
+    void handleFinished();
+    void handleProcessError();
+
+private:
+    void startCommand();
+    void printResults();
+
+private:
+    LibsshQtClient     *client;
+    QString             command;
+    int                 count;
+    int                 started;
+
+    quint64             timer_events;
+    quint64             start_allocations;
+    quint64             start_timer_events;
+    QElapsedTimer       setup_timer;
+
+    quint64             total_allocations;
+    quint64             total_timer_events;
+    qint64              total_setup_time;
+};
+
+#endif // PROCESSSETUP_H
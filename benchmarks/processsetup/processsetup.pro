@@ -0,0 +1,25 @@
+#-------------------------------------------------
+#
+# libsshqt process setup benchmark
+#
+#-------------------------------------------------
+
+QT       += core
+
+QT       -= gui
+
+TARGET = libsshqt-benchmark-processsetup
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+include( ../../libsshqt.pri )
+include( ../../libssh.pri )
+include( ../common/common.pri )
+
+SOURCES += main.cpp \
+    processsetup.cpp
+
+HEADERS += \
+    processsetup.h
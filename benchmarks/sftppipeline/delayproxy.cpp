@@ -0,0 +1,110 @@
+
+#include <QDebug>
+#include <QHostAddress>
+
+#include "delayproxy.h"
+
+DelayProxy::DelayProxy(QString host, quint16 port, int delay, QObject *parent) :
+    QObject(parent),
+    host(host),
+    target_port(port),
+    delay(delay),
+    client(0),
+    server(0)
+{
+    clock.start();
+    timer.setSingleShot(true);
+
+    connect(&listener, SIGNAL(newConnection()),
+            this,      SLOT(handleNewConnection()));
+    connect(&timer,    SIGNAL(timeout()),
+            this,      SLOT(deliver()));
+}
+
+bool DelayProxy::listen()
+{
+    return listener.listen(QHostAddress::LocalHost);
+}
+
+quint16 DelayProxy::port() const
+{
+    return listener.serverPort();
+}
+
+void DelayProxy::handleNewConnection()
+{
+    QTcpSocket *socket = listener.nextPendingConnection();
+    if ( client ) {
+        qDebug() << "Proxy accepts only one connection";
+        socket->deleteLater();
+        return;
+    }
+
+    client = socket;
+    server = new QTcpSocket(this);
+
+    // Data written before the connection has been made is buffered
+    server->connectToHost(host, target_port);
+
+    connect(client, SIGNAL(readyRead()),
+            this,   SLOT(handleClientReadyRead()));
+    connect(server, SIGNAL(readyRead()),
+            this,   SLOT(handleServerReadyRead()));
+    connect(client, SIGNAL(disconnected()),
+            this,   SLOT(handleDisconnected()));
+    connect(server, SIGNAL(disconnected()),
+            this,   SLOT(handleDisconnected()));
+}
+
+void DelayProxy::handleClientReadyRead()
+{
+    schedule(to_server, client);
+}
+
+void DelayProxy::handleServerReadyRead()
+{
+    schedule(to_client, server);
+}
+
+void DelayProxy::handleDisconnected()
+{
+    if ( client ) client->disconnectFromHost();
+    if ( server ) server->disconnectFromHost();
+}
+
+void DelayProxy::schedule(QQueue<Packet> &queue, QTcpSocket *from)
+{
+    Packet packet;
+    packet.due  = clock.elapsed() + delay;
+    packet.data = from->readAll();
+    queue.enqueue(packet);
+
+    if ( ! timer.isActive()) {
+        deliver();
+    }
+}
+
+void DelayProxy::deliverQueue(QQueue<Packet> &queue, QTcpSocket *to, qint64 now)
+{
+    while ( ! queue.isEmpty() && queue.head().due <= now ) {
+        to->write(queue.dequeue().data);
+    }
+}
+
+void DelayProxy::deliver()
+{
+    qint64 now = clock.elapsed();
+    deliverQueue(to_server, server, now);
+    deliverQueue(to_client, client, now);
+
+    qint64 next = -1;
+    if ( ! to_server.isEmpty()) next = to_server.head().due;
+    if ( ! to_client.isEmpty() &&
+         ( next < 0 || to_client.head().due < next )) {
+        next = to_client.head().due;
+    }
+
+    if ( next >= 0 ) {
+        timer.start(int(qMax(qint64(0), next - now)));
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef DELAYPROXY_H
+#define DELAYPROXY_H
+
+#include <QObject>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QQueue>
+#include <QTimer>
+#include <QElapsedTimer>
+
+/*!
+    TCP proxy for one connection which delays data in both directions, so a
+    local server can be used to emulate a long distance link. The round trip
+    time added by the proxy is twice the delay. Bandwidth is not limited.
+*/
+class DelayProxy : public QObject
+{
+    Q_OBJECT
+
+public:
+    DelayProxy(QString host, quint16 port, int delay, QObject *parent = 0);
+
+    bool listen();
+    quint16 port() const;
+
+private slots:
+    void handleNewConnection();
+    void handleClientReadyRead();
+    void handleServerReadyRead();
+    void handleDisconnected();
+    void deliver();
+
+private:
+    class Packet
+    {
+    public:
+        qint64      due;
+        QByteArray  data;
+    };
+
+    void schedule(QQueue<Packet> &queue, QTcpSocket *from);
+    void deliverQueue(QQueue<Packet> &queue, QTcpSocket *to, qint64 now);
+
+private:
+    QTcpServer      listener;
+    QString         host;
+    quint16         target_port;
+    int             delay;
+
+    QTcpSocket     *client;
+    QTcpSocket     *server;
+    QQueue<Packet>  to_server;
+    QQueue<Packet>  to_client;
+
+    QElapsedTimer   clock;
+    QTimer          timer;
+};
+
+#endif // DELAYPROXY_H
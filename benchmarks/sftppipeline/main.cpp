@@ -0,0 +1,12 @@
+#include <QtCore/QCoreApplication>
+#include <QTimer>
+
+#include "sftppipeline.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    SftpPipelineBenchmark benchmark;
+    QTimer::singleShot(0, &benchmark, SLOT(runBenchmark()));
+    return a.exec();
+}
@@ -0,0 +1,161 @@
+
+#include <QDebug>
+#include <QCoreApplication>
+#include <QStringList>
+#include <QDir>
+#include <QFile>
+#include <QUrl>
+
+#include "sftppipeline.h"
+#include "libsshqtquestionconsole.h"
+
+SftpPipelineBenchmark::SftpPipelineBenchmark() :
+    client(0),
+    sftp(0),
+    transfer(0),
+    proxy(0),
+    size(0),
+    delay(0),
+    round(0)
+{
+    depths << 1 << 2 << 4 << 8 << 16 << 32 << 64;
+}
+
+void SftpPipelineBenchmark::runBenchmark()
+{
+    QStringList args = qApp->arguments();
+
+    if ( args.count() < 2 || args.count() > 4 ) {
+        qDebug() << "Usage:"
+                 << qPrintable(args.at(0))
+                 << "SSH_URL [SIZE_MB] [RTT_MS]";
+        qDebug() << "Example:"
+                 << qPrintable(args.at(0))
+                 << QString("ssh://user@hostname:port/")
+                 << QString("32")
+                 << QString("50");
+        qApp->quit();
+        return;
+    }
+
+    QUrl url(args.at(1));
+    size  = args.value(2, "32").toLongLong() * 1024 * 1024;
+    delay = args.value(3, "50").toInt() / 2;
+
+    // The client connects to the server through the proxy, which adds half
+    // of the round trip time in both directions
+    proxy = new DelayProxy(url.host(), url.port(22), delay, this);
+    if ( ! proxy->listen()) {
+        qDebug() << "Could not start proxy";
+        qApp->quit();
+        return;
+    }
+
+    url.setHost("127.0.0.1");
+    url.setPort(proxy->port());
+
+    remote_file = "libsshqt-benchmark-sftppipeline";
+    local_file  = QDir::temp().filePath("libsshqt-benchmark-sftppipeline");
+
+    client = new LibsshQtClient(this);
+    client->setUrl(url);
+    client->useDefaultAuths();
+
+    new LibsshQtQuestionConsole(client);
+
+    connect(client, SIGNAL(opened()),         this, SLOT(handleClientOpened()));
+    connect(client, SIGNAL(allAuthsFailed()), qApp, SLOT(quit()));
+    connect(client, SIGNAL(error()),          qApp, SLOT(quit()));
+
+    client->connectToHost();
+}
+
+void SftpPipelineBenchmark::handleClientOpened()
+{
+    qDebug() << "Creating" << size / 1024 / 1024 << "MiB remote file";
+
+    LibsshQtProcess *process = client->runCommand(
+                QString("head -c %1 /dev/urandom > %2")
+                .arg(size).arg(remote_file));
+    connect(process, SIGNAL(finished(int)),
+            this,    SLOT(handleFileCreated(int)));
+    connect(process, SIGNAL(error()),
+            qApp,    SLOT(quit()));
+}
+
+void SftpPipelineBenchmark::handleFileCreated(int exit_code)
+{
+    if ( exit_code != 0 ) {
+        qDebug() << "Could not create remote file, exit code:" << exit_code;
+        qApp->quit();
+        return;
+    }
+
+    qDebug() << "Downloading over a link with" << delay * 2 << "ms RTT";
+
+    sftp = new LibsshQtSftp(client);
+    startTransfer();
+}
+
+void SftpPipelineBenchmark::startTransfer()
+{
+    transfer = new LibsshQtSftpTransfer(sftp, this);
+    transfer->setDownload(remote_file, local_file);
+    transfer->setPipelineDepth(depths.at(round));
+
+    connect(transfer, SIGNAL(finished()),
+            this,     SLOT(handleTransferFinished()));
+    connect(transfer, SIGNAL(error()),
+            this,     SLOT(handleTransferError()));
+
+    transfer->start();
+}
+
+void SftpPipelineBenchmark::handleTransferFinished()
+{
+    qint64 msecs = qMax(qint64(1), transfer->elapsed());
+    double mib_per_sec = transfer->bytesTransferred() * 1000.0 / msecs /
+                         1024 / 1024;
+    double bound = transfer->chunkSize() * transfer->pipelineDepth() *
+                   1000.0 / qMax(1, delay * 2) / 1024 / 1024;
+
+    qDebug() << "Depth" << qPrintable(QString("%1:").arg(depths.at(round), 3))
+             << qPrintable(QString("%1 MiB/s").arg(mib_per_sec, 8, 'f', 2))
+             << qPrintable(QString("%1 ms").arg(msecs, 7))
+             << qPrintable(QString("(RTT bound %1 MiB/s)")
+                           .arg(bound, 0, 'f', 2));
+
+    if ( transfer->bytesTransferred() != size ) {
+        qDebug() << "Transferred" << transfer->bytesTransferred()
+                 << "bytes instead of" << size;
+    }
+
+    transfer->deleteLater();
+    transfer = 0;
+
+    if ( ++round < depths.count()) {
+        startTransfer();
+    } else {
+        cleanUp();
+    }
+}
+
+void SftpPipelineBenchmark::handleTransferError()
+{
+    qDebug() << "Transfer failed:" << qPrintable(transfer->errorMessage());
+    cleanUp();
+}
+
+void SftpPipelineBenchmark::cleanUp()
+{
+    QFile::remove(local_file);
+
+    LibsshQtSftpRequest *request = sftp->remove(remote_file);
+    connect(request, SIGNAL(finished()), this, SLOT(handleCleanedUp()));
+    connect(request, SIGNAL(error()),    this, SLOT(handleCleanedUp()));
+}
+
+void SftpPipelineBenchmark::handleCleanedUp()
+{
+    qApp->quit();
+}
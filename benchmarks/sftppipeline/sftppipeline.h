@@ -0,0 +1,48 @@
+#ifndef SFTPPIPELINE_H
+#define SFTPPIPELINE_H
+
+#include <QObject>
+#include <QList>
+
+#include "libsshqtclient.h"
+#include "libsshqtprocess.h"
+#include "libsshqtsftp.h"
+#include "libsshqtsftptransfer.h"
+#include "delayproxy.h"
+
+class SftpPipelineBenchmark : public QObject
+{
+    Q_OBJECT
+
+public:
+    SftpPipelineBenchmark();
+
+public slots:
+    void runBenchmark();
+
+private slots:
+    void handleClientOpened();
+    void handleFileCreated(int exit_code);
+    void handleTransferFinished();
+    void handleTransferError();
+    void handleCleanedUp();
+
+private:
+    void startTransfer();
+    void cleanUp();
+
+private:
+    LibsshQtClient         *client;
+    LibsshQtSftp           *sftp;
+    LibsshQtSftpTransfer   *transfer;
+    DelayProxy             *proxy;
+
+    QString                 remote_file;
+    QString                 local_file;
+    qint64                  size;
+    int                     delay;
+    QList<int>              depths;
+    int                     round;
+};
+
+#endif // SFTPPIPELINE_H
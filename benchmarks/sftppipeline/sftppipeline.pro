@@ -0,0 +1,26 @@
+#-------------------------------------------------
+#
+# libsshqt SFTP pipeline benchmark
+#
+#-------------------------------------------------
+
+QT       += core network
+
+QT       -= gui
+
+TARGET = libsshqt-benchmark-sftppipeline
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+include( ../../libsshqt.pri )
+include( ../../libssh.pri )
+
+SOURCES += main.cpp \
+    delayproxy.cpp \
+    sftppipeline.cpp
+
+HEADERS += \
+    delayproxy.h \
+    sftppipeline.h
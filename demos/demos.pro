@@ -1,2 +1,2 @@
 TEMPLATE = subdirs
-SUBDIRS = runprocess processtofile filetoprocess runprocessgui
+SUBDIRS = runprocess processtofile filetoprocess runprocessgui fanout
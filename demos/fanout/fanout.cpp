@@ -0,0 +1,78 @@
+
+#include <QDebug>
+#include <QCoreApplication>
+#include <QStringList>
+#include <QUrl>
+
+#include "fanout.h"
+
+void Fanout::runFanout()
+{
+    QStringList args = qApp->arguments();
+
+    if ( args.count() < 4) {
+        qDebug() << "Usage:"
+                 << qPrintable(args.at(0))
+                 <<"MAX_CONCURRENT COMMAND SSH_URL...";
+        qDebug() << "Example:"
+                 << qPrintable(args.at(0))
+                 << QString("10")
+                 << QString("uptime")
+                 << QString("ssh://user@host1/")
+                 << QString("ssh://user@host2:2222/");
+        qApp->quit();
+        return;
+    }
+
+    QList<QUrl> hosts;
+    for ( int i = 3; i < args.count(); i++ ) {
+        hosts << QUrl(args.at(i));
+    }
+
+    fanout = new LibsshQtFanout(this);
+    fanout->setMaxConcurrent(args.at(1).toInt());
+    fanout->setCommand(args.at(2));
+    fanout->setHosts(hosts);
+
+    connect(fanout, SIGNAL(hostStdout(int,QByteArray)),
+            this,   SLOT(handleStdout(int,QByteArray)));
+    connect(fanout, SIGNAL(hostStderr(int,QByteArray)),
+            this,   SLOT(handleStderr(int,QByteArray)));
+    connect(fanout, SIGNAL(hostFinished(int,int)),
+            this,   SLOT(handleFinished(int,int)));
+    connect(fanout, SIGNAL(hostError(int,QString)),
+            this,   SLOT(handleError(int,QString)));
+    connect(fanout, SIGNAL(allFinished()),
+            qApp,   SLOT(quit()));
+
+    fanout->start();
+}
+
+void Fanout::handleStdout(int host, QByteArray data)
+{
+    qDebug() << qPrintable(fanout->hosts().at(host).host())
+             << "stdout:" << data.trimmed().constData();
+}
+
+void Fanout::handleStderr(int host, QByteArray data)
+{
+    qDebug() << qPrintable(fanout->hosts().at(host).host())
+             << "stderr:" << data.trimmed().constData();
+}
+
+void Fanout::handleFinished(int host, int exit_code)
+{
+    LibsshQtFanout::HostResult result = fanout->result(host);
+    qDebug() << qPrintable(result.url.host())
+             << "exit code:" << exit_code
+             << "connect:" << result.connectTime << "ms"
+             << "total:" << result.totalTime << "ms";
+}
+
+void Fanout::handleError(int host, QString message)
+{
+    LibsshQtFanout::HostResult result = fanout->result(host);
+    qDebug() << qPrintable(result.url.host())
+             << "error:" << qPrintable(message)
+             << "after" << result.totalTime << "ms";
+}
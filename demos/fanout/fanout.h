@@ -0,0 +1,22 @@
+#ifndef FANOUT_H
+#define FANOUT_H
+
+#include <QObject>
+#include "libsshqtfanout.h"
+
+class Fanout : public QObject
+{
+    Q_OBJECT
+
+public slots:
+    void runFanout();
+    void handleStdout(int host, QByteArray data);
+    void handleStderr(int host, QByteArray data);
+    void handleFinished(int host, int exit_code);
+    void handleError(int host, QString message);
+
+private:
+    LibsshQtFanout *fanout;
+};
+
+#endif // FANOUT_H
@@ -0,0 +1,24 @@
+#-------------------------------------------------
+#
+# libsshqt fanout demo
+#
+#-------------------------------------------------
+
+QT       += core
+
+QT       -= gui
+
+TARGET = libsshqt-fanout
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+include( ../../libsshqt.pri )
+include( ../../libssh.pri )
+
+SOURCES += main.cpp \
+    fanout.cpp
+
+HEADERS += \
+    fanout.h
@@ -0,0 +1,15 @@
+
+#include <QtCore/QCoreApplication>
+#include <QTimer>
+
+#include "fanout.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    Fanout *fanout = new Fanout;
+    QTimer::singleShot(0, fanout, SLOT(runFanout()));
+    int ret = a.exec();
+    delete fanout;
+    return ret;
+}
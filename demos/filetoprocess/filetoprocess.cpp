@@ -47,14 +47,13 @@ void FileToProcess::fileToProcess()
     connect(client, SIGNAL(error()),          qApp, SLOT(quit()));
     connect(client, SIGNAL(closed()),         qApp, SLOT(quit()));
 
-    connect(process, SIGNAL(opened()),             this, SLOT(sendData()));
-    connect(process, SIGNAL(bytesWritten(qint64)), this, SLOT(sendData()));
-    connect(process, SIGNAL(finished(int)),        this, SLOT(endCheck()));
-    connect(process, SIGNAL(closed()),             qApp, SLOT(quit()));
-    connect(process, SIGNAL(error()),              this, SLOT(handleProcessError()));
+    // The process reads the file as fast as the channel accepts data and
+    // sends EOF at the end of the file
+    process->setStdinSource(file);
 
-    connect(file, SIGNAL(readyRead()),           this, SLOT(sendData()));
-    connect(file, SIGNAL(readChannelFinished()), this, SLOT(endCheck()));
+    connect(process, SIGNAL(finished(int)), qApp, SLOT(quit()));
+    connect(process, SIGNAL(closed()),      qApp, SLOT(quit()));
+    connect(process, SIGNAL(error()),       this, SLOT(handleProcessError()));
 }
 
 void FileToProcess::handleProcessError()
@@ -65,33 +64,3 @@ void FileToProcess::handleProcessError()
         qApp->quit();
     }
 }
-
-void FileToProcess::sendData()
-{
-    const int size = 1024 * 4;
-
-    if ( process->isOpen() &&
-         process->bytesToWrite() <= size &&
-         file->isOpen() &&
-         file->atEnd() == false ) {
-
-        QByteArray data = file->read(size);
-        if ( ! process->write(data)) {
-            qDebug() << "Could not write data to process";
-            qApp->exit(-1);
-        } else {
-            qDebug() << "Sent" << data.size() << "bytes to process";
-        }
-    }
-
-    if ( file->atEnd()) {
-        process->sendEof();
-    }
-}
-
-void FileToProcess::endCheck()
-{
-    if ( ! process->isOpen()) {
-        qApp->exit();
-    }
-}
@@ -14,8 +14,6 @@ class FileToProcess : public QObject
 public slots:
     void fileToProcess();
     void handleProcessError();
-    void sendData();
-    void endCheck();
 
 private:
     LibsshQtClient  *client;
@@ -30,17 +30,16 @@ void ProcessToFile::processToFile()
     client->connectToHost();
 
     process = client->runCommand(args.at(2));
-    process->setStdoutBehaviour(LibsshQtProcess::OutputManual);
 
-    file = new QFile(this);
-    file->setFileName(args.at(3));
-    connect(file, SIGNAL(bytesWritten(qint64)), this, SLOT(endcheck()));
-
-    if ( ! file->open(QIODevice::ReadWrite | QIODevice::Truncate)) {
-        qDebug() << "Could not open file:" << file->fileName();
+    // Output is written to the file straight from the channel read buffer
+    // in large batches, the file is flushed when the process is closed
+    file = new LibsshQtFileSink(this);
+    if ( ! file->open(args.at(3))) {
+        qDebug() << qPrintable(file->errorString());
         qApp->exit(-1);
         return;
     }
+    file->attach(process);
 
     new LibsshQtQuestionConsole(client);
 
@@ -48,9 +47,9 @@ void ProcessToFile::processToFile()
     connect(client, SIGNAL(error()),          qApp, SLOT(quit()));
     connect(client, SIGNAL(closed()),         qApp, SLOT(quit()));
 
-    connect(process, SIGNAL(readyRead()),     this, SLOT(copydata()));
-    connect(process, SIGNAL(closed()),        this, SLOT(endcheck()));
+    connect(process, SIGNAL(closed()),        qApp, SLOT(quit()));
     connect(process, SIGNAL(error()),         this, SLOT(handleProcessError()));
+    connect(file,    SIGNAL(error()),         qApp, SLOT(quit()));
 }
 
 void ProcessToFile::handleProcessError()
@@ -61,23 +60,3 @@ void ProcessToFile::handleProcessError()
         qApp->quit();
     }
 }
-
-void ProcessToFile::copydata()
-{
-    QByteArray data = process->read(process->bytesAvailable());
-    if ( file->write(data) != data.size()) {
-        qDebug() << "Data write error";
-        qApp->exit(-1);
-    } else {
-        qDebug() << "Wrote" << data.size() << "bytes to file";
-    }
-}
-
-void ProcessToFile::endcheck()
-{
-    if ( file->bytesToWrite() == 0 &&
-         process->bytesAvailable() == 0 ) {
-        file->close();
-        qApp->exit();
-    }
-}
@@ -2,10 +2,10 @@
 #define PROCESSTOFILE_H
 
 #include <QObject>
-#include <QFile>
 
 #include "libsshqtclient.h"
 #include "libsshqtprocess.h"
+#include "libsshqtfilesink.h"
 
 class ProcessToFile : public QObject
 {
@@ -14,13 +14,11 @@ class ProcessToFile : public QObject
 public slots:
     void processToFile();
     void handleProcessError();
-    void copydata();
-    void endcheck();
 
 private:
-    LibsshQtClient  *client;
-    LibsshQtProcess *process;
-    QFile           *file;
+    LibsshQtClient   *client;
+    LibsshQtProcess  *process;
+    LibsshQtFileSink *file;
 };
 
 #endif // PROCESSTOFILE_H
@@ -83,8 +83,8 @@ void RunProcessGui::on_run_button_clicked()
     client->connectToHost();
 
     process = client->runCommand(ui->command_edit->text());
-    process->setStdoutBehaviour(LibsshQtProcess::OutputManual);
-    process->setStderrBehaviour(LibsshQtProcess::OutputManual);
+    process->setStdoutBehaviour(LibsshQtProcess::OutputToLines);
+    process->setStderrBehaviour(LibsshQtProcess::OutputToLines);
 
     connect(process, SIGNAL(opened()),      this, SLOT(handleProcessOpened()));
     connect(process, SIGNAL(closed()),      this, SLOT(handleProcessClosed()));
@@ -92,8 +92,10 @@ void RunProcessGui::on_run_button_clicked()
     connect(process, SIGNAL(finished(int)), this, SLOT(handleProcessFinished(int)));
 
     LibsshQtProcessStderr *stderr = process->stderr();
-    connect(process, SIGNAL(readyRead()), this, SLOT(readProcessStdout()));
-    connect(stderr,  SIGNAL(readyRead()), this, SLOT(readProcessStderr()));
+    connect(process, SIGNAL(linesReady(LibsshQtLines)),
+            this,    SLOT(readProcessStdout(LibsshQtLines)));
+    connect(stderr,  SIGNAL(linesReady(LibsshQtLines)),
+            this,    SLOT(readProcessStderr(LibsshQtLines)));
 }
 
 void RunProcessGui::handleProcessOpened()
@@ -116,27 +118,22 @@ void RunProcessGui::handleProcessFinished(int exit_code)
     statusBar()->showMessage("Process finished with exit code " + exit_code);
 }
 
-void RunProcessGui::readProcessStdout()
+void RunProcessGui::readProcessStdout(const LibsshQtLines &lines)
 {
-    while ( process->canReadLine()) {
-        QString line = process->readLine();
+    // Append the whole batch at once
+    int first = lines.lineOffset(0);
+    int last  = lines.count() - 1;
+    int len   = lines.lineOffset(last) + lines.lineLength(last) - first;
 
-        if ( line.endsWith('\n')) {
-            line.remove(line.length() - 1, 1);
-        }
-
-        ui->output_edit->appendPlainText(line);
-    }
+    ui->output_edit->appendPlainText(
+                QString::fromLocal8Bit(lines.lineData(0), len));
 }
 
-void RunProcessGui::readProcessStderr()
+void RunProcessGui::readProcessStderr(const LibsshQtLines &lines)
 {
-    while ( process->stderr()->canReadLine()) {
-        QString line = process->stderr()->readLine();
-
-        if ( line.endsWith('\n')) {
-            line.remove(line.length() - 1, 1);
-        }
+    for ( int i = 0; i < lines.count(); i++ ) {
+        QString line = QString::fromLocal8Bit(lines.lineData(i),
+                                              lines.lineLength(i));
 
         ui->output_edit->appendHtml(
                     QString("<font color=red>%1</font>")
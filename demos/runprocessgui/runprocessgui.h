@@ -30,8 +30,8 @@ private slots:
     void handleProcessError();
     void handleProcessFinished(int exit_code);
 
-    void readProcessStdout();
-    void readProcessStderr();
+    void readProcessStdout(const LibsshQtLines &lines);
+    void readProcessStderr(const LibsshQtLines &lines);
 
 private:
     Ui::runprocessgui       *ui;
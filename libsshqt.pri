@@ -1,11 +1,48 @@
+HEADERS += $$PWD/src/libsshqtagent.h
 HEADERS += $$PWD/src/libsshqtchannel.h
+HEADERS += $$PWD/src/libsshqtchunks.h
 HEADERS += $$PWD/src/libsshqtclient.h
+HEADERS += $$PWD/src/libsshqtcoro.h
+HEADERS += $$PWD/src/libsshqtfanout.h
+HEADERS += $$PWD/src/libsshqtfilesink.h
+HEADERS += $$PWD/src/libsshqtframer.h
+HEADERS += $$PWD/src/libsshqtlines.h
+HEADERS += $$PWD/src/libsshqtpipe.h
 HEADERS += $$PWD/src/libsshqtprocess.h
 HEADERS += $$PWD/src/libsshqtquestionconsole.h
+HEADERS += $$PWD/src/libsshqtresult.h
+HEADERS += $$PWD/src/libsshqtsftp.h
+HEADERS += $$PWD/src/libsshqtsftpscheduler.h
+HEADERS += $$PWD/src/libsshqtsftpstriped.h
+HEADERS += $$PWD/src/libsshqtsftptransfer.h
+HEADERS += $$PWD/src/libsshqtshell.h
+HEADERS += $$PWD/src/libsshqtsubsystem.h
+HEADERS += $$PWD/src/libsshqttail.h
+HEADERS += $$PWD/src/libsshqttunnel.h
 
+SOURCES += $$PWD/src/libsshqtagent.cpp
 SOURCES += $$PWD/src/libsshqtchannel.cpp
+SOURCES += $$PWD/src/libsshqtchunks.cpp
 SOURCES += $$PWD/src/libsshqtclient.cpp
+SOURCES += $$PWD/src/libsshqtcoro.cpp
+SOURCES += $$PWD/src/libsshqtfanout.cpp
+SOURCES += $$PWD/src/libsshqtfilesink.cpp
+SOURCES += $$PWD/src/libsshqtframer.cpp
+SOURCES += $$PWD/src/libsshqtlines.cpp
+SOURCES += $$PWD/src/libsshqtpipe.cpp
 SOURCES += $$PWD/src/libsshqtprocess.cpp
 SOURCES += $$PWD/src/libsshqtquestionconsole.cpp
+SOURCES += $$PWD/src/libsshqtresult.cpp
+SOURCES += $$PWD/src/libsshqtsftp.cpp
+SOURCES += $$PWD/src/libsshqtsftpscheduler.cpp
+SOURCES += $$PWD/src/libsshqtsftpstriped.cpp
+SOURCES += $$PWD/src/libsshqtsftptransfer.cpp
+SOURCES += $$PWD/src/libsshqtshell.cpp
+SOURCES += $$PWD/src/libsshqtsubsystem.cpp
+SOURCES += $$PWD/src/libsshqttail.cpp
+SOURCES += $$PWD/src/libsshqttunnel.cpp
 
 INCLUDEPATH += $$PWD/src
+
+# QtConcurrent is a module of its own since Qt 5
+greaterThan(QT_MAJOR_VERSION, 4): QT += concurrent
@@ -0,0 +1,614 @@
+
+#include <QDebug>
+#include <QMetaEnum>
+#include <QCryptographicHash>
+#include <QtEndian>
+#include <QStringList>
+
+#include <algorithm>
+
+#include "libsshqtagent.h"
+#include "libsshqtclient.h"
+#include "libsshqtprocess.h"
+#include "libsshqtdebug.h"
+
+// Exit code of the start command when the helper has not been uploaded
+static const int helper_missing = 121;
+
+static const quint8 reply_hello = 0x80;
+static const quint8 reply_ok    = 0x81;
+static const quint8 reply_error = 0xFF;
+
+/*
+    The remote helper. Keep it compatible with old perl 5 versions and use
+    only core modules, it runs on whatever perl the remote host has.
+*/
+static const char helper_script[] =
+    "use strict;\n"
+    "use warnings;\n"
+    "use Fcntl;\n"
+    "use IO::Select;\n"
+    "use IPC::Open3;\n"
+    "use Symbol 'gensym';\n"
+    "\n"
+    "binmode STDIN;\n"
+    "binmode STDOUT;\n"
+    "\n"
+    "sub readn {\n"
+    "    my ($n) = @_;\n"
+    "    my $buf = '';\n"
+    "    while ( length($buf) < $n ) {\n"
+    "        my $r = sysread(STDIN, $buf, $n - length($buf), length($buf));\n"
+    "        return undef unless $r;\n"
+    "    }\n"
+    "    return $buf;\n"
+    "}\n"
+    "\n"
+    "sub reply {\n"
+    "    my ($id, $type, $payload) = @_;\n"
+    "    my $frame = pack('NNC', 5 + length($payload), $id, $type) . $payload;\n"
+    "    my $off = 0;\n"
+    "    while ( $off < length($frame) ) {\n"
+    "        my $w = syswrite(STDOUT, $frame, length($frame) - $off, $off);\n"
+    "        exit 1 unless defined $w;\n"
+    "        $off += $w;\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "sub fail {\n"
+    "    my ($id, $msg) = @_;\n"
+    "    reply($id, 0xFF, pack('N', $! + 0) . $msg);\n"
+    "}\n"
+    "\n"
+    "sub split64 {\n"
+    "    my ($v) = @_;\n"
+    "    return (int($v / 4294967296), $v % 4294967296);\n"
+    "}\n"
+    "\n"
+    "sub do_exec {\n"
+    "    my ($id, $cmd) = @_;\n"
+    "    my ($out, $err) = ('', '');\n"
+    "    my $errfh = gensym;\n"
+    "    my ($infh, $outfh);\n"
+    "    my $pid = eval { open3($infh, $outfh, $errfh, '/bin/sh', '-c', $cmd) };\n"
+    "    return fail($id, \"Could not run command: $@\") unless $pid;\n"
+    "    close($infh);\n"
+    "    my $sel = IO::Select->new($outfh, $errfh);\n"
+    "    while ( $sel->count ) {\n"
+    "        for my $fh ( $sel->can_read ) {\n"
+    "            my $buf;\n"
+    "            my $r = sysread($fh, $buf, 65536);\n"
+    "            if ( ! $r ) { $sel->remove($fh); next; }\n"
+    "            if ( $fh == $outfh ) { $out .= $buf; } else { $err .= $buf; }\n"
+    "        }\n"
+    "    }\n"
+    "    waitpid($pid, 0);\n"
+    "    my $code = ($? & 127) ? 128 + ($? & 127) : $? >> 8;\n"
+    "    reply($id, 0x81, pack('NN', $code, length($out)) . $out . $err);\n"
+    "}\n"
+    "\n"
+    "sub do_stat {\n"
+    "    my ($id, $path) = @_;\n"
+    "    my @st = stat($path);\n"
+    "    return fail($id, \"$path: $!\") unless @st;\n"
+    "    reply($id, 0x81, pack('NNNNNNN', $st[2], $st[4], $st[5],\n"
+    "                          split64($st[7]), split64($st[9])));\n"
+    "}\n"
+    "\n"
+    "sub do_read {\n"
+    "    my ($id, $payload) = @_;\n"
+    "    my ($hi, $lo, $len) = unpack('NNN', $payload);\n"
+    "    my $path = substr($payload, 12);\n"
+    "    my $fh;\n"
+    "    sysopen($fh, $path, O_RDONLY) or return fail($id, \"$path: $!\");\n"
+    "    binmode $fh;\n"
+    "    sysseek($fh, $hi * 4294967296 + $lo, 0) or return fail($id, \"$path: $!\");\n"
+    "    my $data = '';\n"
+    "    while ( $len == 0xFFFFFFFF || length($data) < $len ) {\n"
+    "        my $want = $len == 0xFFFFFFFF ? 65536 : $len - length($data);\n"
+    "        my $r = sysread($fh, $data, $want, length($data));\n"
+    "        return fail($id, \"$path: $!\") unless defined $r;\n"
+    "        last if $r == 0;\n"
+    "    }\n"
+    "    close($fh);\n"
+    "    reply($id, 0x81, $data);\n"
+    "}\n"
+    "\n"
+    "sub do_write {\n"
+    "    my ($id, $payload) = @_;\n"
+    "    my ($mode, $path_len) = unpack('NN', $payload);\n"
+    "    my $path = substr($payload, 8, $path_len);\n"
+    "    my $fh;\n"
+    "    sysopen($fh, $path, O_WRONLY | O_CREAT | O_TRUNC, $mode)\n"
+    "        or return fail($id, \"$path: $!\");\n"
+    "    binmode $fh;\n"
+    "    my $off = 8 + $path_len;\n"
+    "    while ( $off < length($payload) ) {\n"
+    "        my $w = syswrite($fh, $payload, length($payload) - $off, $off);\n"
+    "        return fail($id, \"$path: $!\") unless defined $w;\n"
+    "        $off += $w;\n"
+    "    }\n"
+    "    close($fh) or return fail($id, \"$path: $!\");\n"
+    "    reply($id, 0x81, '');\n"
+    "}\n"
+    "\n"
+    "reply(0, 0x80, 'LIBSSHQT-AGENT 1');\n"
+    "\n"
+    "while ( defined(my $header = readn(4)) ) {\n"
+    "    my $body = readn(unpack('N', $header));\n"
+    "    last unless defined $body;\n"
+    "    my ($id, $type) = unpack('NC', $body);\n"
+    "    my $payload = substr($body, 5);\n"
+    "    if    ( $type == 1 ) { do_exec($id, $payload); }\n"
+    "    elsif ( $type == 2 ) { do_stat($id, $payload); }\n"
+    "    elsif ( $type == 3 ) { do_read($id, $payload); }\n"
+    "    elsif ( $type == 4 ) { do_write($id, $payload); }\n"
+    "    else  { $! = 22; fail($id, \"Unknown request type $type\"); }\n"
+    "}\n";
+
+static void appendU32(QByteArray &buffer, quint32 value)
+{
+    uchar data[4];
+    qToBigEndian(value, data);
+    buffer.append(reinterpret_cast<const char *>(data), 4);
+}
+
+static quint32 readU32(const char *data)
+{
+    return qFromBigEndian<quint32>(reinterpret_cast<const uchar *>(data));
+}
+
+static quint64 readU64(const char *data)
+{
+    return (quint64(readU32(data)) << 32) | readU32(data + 4);
+}
+
+static QString shellQuote(QString text)
+{
+    return "'" + text.replace("'", "'\\''") + "'";
+}
+
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// LibsshQtAgentReply
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+LibsshQtAgentReply::LibsshQtAgentReply() :
+    id(0),
+    type(0),
+    ok(false),
+    errorCode(0),
+    exitCode(-1),
+    mode(0),
+    uid(0),
+    gid(0),
+    size(0),
+    mtime(0)
+{
+}
+
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// LibsshQtAgent
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+LibsshQtAgent::LibsshQtAgent(LibsshQtClient *parent) :
+    QObject(parent),
+    debug_prefix_(LibsshQt::debugPrefix(this)),
+    debug_output_(parent->isDebugEnabled()),
+    client_(parent),
+    process_(0),
+    state_(StateClosed),
+    directory_(".cache/libsshqt"),
+    next_id_(1)
+{
+    connect(client_, SIGNAL(debugChanged()),
+            this,    SLOT(handleDebugChanged()));
+
+    LIBSSHQT_DEBUG("Constructor");
+}
+
+LibsshQtAgent::~LibsshQtAgent()
+{
+    LIBSSHQT_DEBUG("Destructor");
+
+    if ( process_ ) {
+        process_->disconnect(this);
+        delete process_;
+        process_ = 0;
+    }
+}
+
+const char *LibsshQtAgent::enumToString(const State value)
+{
+    return staticMetaObject.enumerator(
+                staticMetaObject.indexOfEnumerator("State"))
+                    .valueToKey(value);
+}
+
+/*!
+    Set the remote directory where the helper is uploaded, the default is
+    .cache/libsshqt in the home directory of the remote user.
+*/
+void LibsshQtAgent::setDirectory(QString directory)
+{
+    directory_ = directory;
+}
+
+QString LibsshQtAgent::directory() const
+{
+    return directory_;
+}
+
+/*!
+    Get the remote path of the helper, the file name contains a hash of the
+    helper.
+*/
+QString LibsshQtAgent::helperPath() const
+{
+    QByteArray hash = QCryptographicHash::hash(
+                QByteArray(helper_script), QCryptographicHash::Sha1);
+
+    return QString("%1/agent-%2.pl")
+            .arg(directory_)
+            .arg(QString(hash.toHex().left(16)));
+}
+
+LibsshQtAgent::State LibsshQtAgent::state() const
+{
+    return state_;
+}
+
+/*!
+    Get the number of requests which have not received a reply yet.
+*/
+int LibsshQtAgent::pendingCount() const
+{
+    return requests_.count();
+}
+
+/*!
+    Run command with /bin/sh on the remote host. Stdin of the command is
+    closed, the reply contains exit code, stdout and stderr of the command.
+*/
+quint32 LibsshQtAgent::exec(QString command)
+{
+    return queueRequest(LibsshQtAgentReply::TypeExec, command.toLocal8Bit());
+}
+
+/*!
+    Get mode, owner, size and modification time of a remote file.
+*/
+quint32 LibsshQtAgent::statFile(QString path)
+{
+    return queueRequest(LibsshQtAgentReply::TypeStat, path.toLocal8Bit());
+}
+
+/*!
+    Read at most length bytes starting from offset from a remote file, by
+    default the whole file is read.
+*/
+quint32 LibsshQtAgent::readFile(QString path, quint64 offset, quint32 length)
+{
+    QByteArray payload;
+    appendU32(payload, quint32(offset >> 32));
+    appendU32(payload, quint32(offset));
+    appendU32(payload, length);
+    payload.append(path.toLocal8Bit());
+    return queueRequest(LibsshQtAgentReply::TypeRead, payload);
+}
+
+/*!
+    Replace the contents of a remote file, the file is created with mode if
+    it does not exist.
+*/
+quint32 LibsshQtAgent::writeFile(QString path, const QByteArray &data, int mode)
+{
+    QByteArray encoded_path = path.toLocal8Bit();
+
+    QByteArray payload;
+    payload.reserve(8 + encoded_path.size() + data.size());
+    appendU32(payload, mode);
+    appendU32(payload, encoded_path.size());
+    payload.append(encoded_path);
+    payload.append(data);
+    return queueRequest(LibsshQtAgentReply::TypeWrite, payload);
+}
+
+/*!
+    Start the helper on the remote host, the helper is uploaded first if
+    needed. Making a request starts the agent automatically.
+*/
+void LibsshQtAgent::start()
+{
+    if ( state_ == StateClosed ||
+         state_ == StateError ) {
+        setState(StateStarting);
+        runHelper();
+    }
+}
+
+/*!
+    Stop the helper, requests which have not received a reply fail.
+*/
+void LibsshQtAgent::stop()
+{
+    if ( state_ != StateClosed ) {
+        releaseProcess();
+        failRequests(tr("Agent was stopped"));
+        setState(StateClosed);
+    }
+}
+
+void LibsshQtAgent::setState(State state)
+{
+    if ( state_ == state ) {
+        LIBSSHQT_DEBUG("State is already" << state);
+        return;
+    }
+
+    LIBSSHQT_DEBUG("Changing state to" << state);
+    state_ = state;
+
+    switch ( state_ ) {
+    case StateClosed:       emit closed();          break;
+    case StateStarting:                             break;
+    case StateUploading:                            break;
+    case StateOpen:         emit opened();          break;
+    case StateError:        emit error();           break;
+    }
+}
+
+void LibsshQtAgent::runHelper()
+{
+    Q_ASSERT( ! process_ );
+
+    QString path = shellQuote(helperPath());
+    QString command = QString("[ -f %1 ] || exit %2; exec perl %1")
+            .arg(path)
+            .arg(helper_missing);
+
+    LIBSSHQT_DEBUG("Starting helper:" << command);
+
+    read_buffer_.clear();
+    process_ = client_->runCommand(command);
+    process_->setStdoutBehaviour(LibsshQtProcess::OutputManual);
+    process_->setStderrBehaviour(LibsshQtProcess::OutputToQDebug,
+                                 "Agent stderr:");
+
+    connect(process_, SIGNAL(readyRead()),
+            this,     SLOT(handleReadyRead()));
+    connect(process_, SIGNAL(finished(int)),
+            this,     SLOT(handleProcessFinished(int)));
+    connect(process_, SIGNAL(error()),
+            this,     SLOT(handleProcessError()));
+}
+
+void LibsshQtAgent::uploadHelper()
+{
+    Q_ASSERT( ! process_ );
+
+    QString path = shellQuote(helperPath());
+    QString command = QString("mkdir -p %1 && cat > %2.$$ && mv -f %2.$$ %2")
+            .arg(shellQuote(directory_))
+            .arg(path);
+
+    LIBSSHQT_DEBUG("Uploading helper:" << command);
+
+    setState(StateUploading);
+    process_ = client_->runCommand(command);
+    process_->setStdoutBehaviour(LibsshQtProcess::OutputToQDebug,
+                                 "Agent upload stdout:");
+    process_->setStderrBehaviour(LibsshQtProcess::OutputToQDebug,
+                                 "Agent upload stderr:");
+
+    connect(process_, SIGNAL(opened()),
+            this,     SLOT(handleUploadOpened()));
+    connect(process_, SIGNAL(finished(int)),
+            this,     SLOT(handleProcessFinished(int)));
+    connect(process_, SIGNAL(error()),
+            this,     SLOT(handleProcessError()));
+}
+
+void LibsshQtAgent::releaseProcess()
+{
+    if ( process_ ) {
+        // Process may be released from inside its own signal handlers
+        process_->disconnect(this);
+        process_->closeChannel();
+        process_->deleteLater();
+        process_ = 0;
+    }
+
+    read_buffer_.clear();
+}
+
+quint32 LibsshQtAgent::queueRequest(int type, const QByteArray &payload)
+{
+    quint32 id = next_id_++;
+    if ( next_id_ == 0 ) {
+        // Id 0 is reserved for the hello frame
+        next_id_ = 1;
+    }
+
+    QByteArray frame;
+    frame.reserve(9 + payload.size());
+    appendU32(frame, 5 + payload.size());
+    appendU32(frame, id);
+    frame.append(char(type));
+    frame.append(payload);
+
+    requests_.insert(id, type);
+
+    if ( state_ == StateOpen ) {
+        process_->write(frame);
+    } else {
+        unsent_.append(frame);
+        start();
+    }
+
+    return id;
+}
+
+void LibsshQtAgent::handleFrame(quint32 id, int type, const char *data, int len)
+{
+    if ( type == reply_hello ) {
+        LIBSSHQT_DEBUG("Helper is running:" << QByteArray(data, len));
+
+        if ( state_ == StateStarting ) {
+            setState(StateOpen);
+            if ( process_ && ! unsent_.isEmpty()) {
+                process_->write(unsent_);
+                unsent_.clear();
+            }
+        }
+        return;
+    }
+
+    if ( ! requests_.contains(id)) {
+        LIBSSHQT_CRITICAL("Received reply to unknown request" << id);
+        return;
+    }
+
+    LibsshQtAgentReply reply;
+    reply.id   = id;
+    reply.type = requests_.take(id);
+
+    if ( type == reply_error && len >= 4 ) {
+        reply.errorCode    = readU32(data);
+        reply.errorMessage = QString::fromLocal8Bit(data + 4, len - 4);
+
+    } else if ( type != reply_ok ) {
+        reply.errorMessage = tr("Invalid reply type %1").arg(type);
+
+    } else if ( reply.type == LibsshQtAgentReply::TypeExec ) {
+        quint32 stdout_len = len >= 8 ? readU32(data + 4) : 0;
+        if ( len >= 8 && stdout_len <= quint32(len - 8)) {
+            reply.ok         = true;
+            reply.exitCode   = readU32(data);
+            reply.stdoutData = QByteArray(data + 8, stdout_len);
+            reply.stderrData = QByteArray(data + 8 + stdout_len,
+                                          len - 8 - stdout_len);
+        } else {
+            reply.errorMessage = tr("Invalid exec reply");
+        }
+
+    } else if ( reply.type == LibsshQtAgentReply::TypeStat ) {
+        if ( len == 28 ) {
+            reply.ok    = true;
+            reply.mode  = readU32(data);
+            reply.uid   = readU32(data + 4);
+            reply.gid   = readU32(data + 8);
+            reply.size  = readU64(data + 12);
+            reply.mtime = readU64(data + 20);
+        } else {
+            reply.errorMessage = tr("Invalid stat reply");
+        }
+
+    } else {
+        reply.ok   = true;
+        reply.data = QByteArray(data, len);
+    }
+
+    emit finished(reply);
+}
+
+void LibsshQtAgent::failRequests(QString message)
+{
+    QList<quint32> ids = requests_.keys();
+    std::sort(ids.begin(), ids.end());
+
+    QHash<quint32, int> failed = requests_;
+    requests_.clear();
+    unsent_.clear();
+
+    LIBSSHQT_DEBUG("Failing" << ids.count() << "requests:" << message);
+
+    foreach ( quint32 id, ids ) {
+        LibsshQtAgentReply reply;
+        reply.id           = id;
+        reply.type         = failed.value(id);
+        reply.errorMessage = message;
+        emit finished(reply);
+    }
+}
+
+void LibsshQtAgent::handleDebugChanged()
+{
+    debug_output_ = client_->isDebugEnabled();
+}
+
+void LibsshQtAgent::handleReadyRead()
+{
+    read_buffer_.append(process_->readAll());
+
+    int pos = 0;
+    while ( read_buffer_.size() - pos >= 4 ) {
+        const char *data = read_buffer_.constData() + pos;
+        quint32 len = readU32(data);
+
+        if ( len < 5 ) {
+            LIBSSHQT_CRITICAL("Invalid frame length" << len);
+            releaseProcess();
+            failRequests(tr("Invalid data received from agent"));
+            setState(StateError);
+            return;
+        }
+
+        if ( quint32(read_buffer_.size() - pos - 4) < len ) {
+            break;
+        }
+
+        pos += 4 + len;
+        handleFrame(readU32(data + 4), uchar(data[8]), data + 9, len - 5);
+
+        // Agent was stopped from a finished() handler
+        if ( ! process_ ) return;
+    }
+
+    read_buffer_.remove(0, pos);
+}
+
+void LibsshQtAgent::handleUploadOpened()
+{
+    LIBSSHQT_DEBUG("Sending helper");
+    process_->write(helper_script);
+    process_->sendEof();
+}
+
+void LibsshQtAgent::handleProcessFinished(int exit_code)
+{
+    LIBSSHQT_DEBUG("Process finished in state" << state_ <<
+                   "exit code:" << exit_code);
+
+    State state = state_;
+    releaseProcess();
+
+    if ( state == StateStarting && exit_code == helper_missing ) {
+        uploadHelper();
+
+    } else if ( state == StateUploading && exit_code == 0 ) {
+        setState(StateStarting);
+        runHelper();
+
+    } else if ( state == StateOpen ) {
+        failRequests(tr("Agent exited with exit code %1").arg(exit_code));
+        setState(StateClosed);
+
+    } else {
+        failRequests(tr("Could not start agent, exit code %1").arg(exit_code));
+        setState(StateError);
+    }
+}
+
+void LibsshQtAgent::handleProcessError()
+{
+    QString message = process_->errorCodeAndMessage();
+    LIBSSHQT_DEBUG("Process error:" << message);
+
+    releaseProcess();
+    failRequests(message);
+    setState(StateError);
+}
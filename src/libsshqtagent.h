@@ -0,0 +1,166 @@
+#ifndef LIBSSHQTAGENT_H
+#define LIBSSHQTAGENT_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QHash>
+#include <QMetaType>
+
+class LibsshQtClient;
+class LibsshQtProcess;
+
+/*!
+
+    LibsshQtAgentReply - Result of a LibsshQtAgent request
+
+    Only the fields of the request type are set. If ok is false, the request
+    failed and errorCode contains the remote errno value, if any, and
+    errorMessage a description of the error.
+
+*/
+class LibsshQtAgentReply
+{
+public:
+    enum Type
+    {
+        TypeExec    = 1,
+        TypeStat    = 2,
+        TypeRead    = 3,
+        TypeWrite   = 4
+    };
+
+    LibsshQtAgentReply();
+
+    quint32     id;
+    int         type;
+    bool        ok;
+    int         errorCode;
+    QString     errorMessage;
+
+    int         exitCode;       //!< TypeExec
+    QByteArray  stdoutData;     //!< TypeExec
+    QByteArray  stderrData;     //!< TypeExec
+
+    quint32     mode;           //!< TypeStat
+    quint32     uid;            //!< TypeStat
+    quint32     gid;            //!< TypeStat
+    quint64     size;           //!< TypeStat
+    quint64     mtime;          //!< TypeStat, seconds since epoch
+
+    QByteArray  data;           //!< TypeRead
+};
+
+Q_DECLARE_METATYPE(LibsshQtAgentReply)
+
+/*!
+
+    LibsshQtAgent - Binary RPC with a helper program on the remote host
+
+    LibsshQtAgent starts a small Perl helper program on the remote host and
+    sends requests to it over the stdin and stdout of one LibsshQtProcess.
+    Requests do not open channels, so thousands of operations can be done on
+    a host at the cost of one channel.
+
+    The helper is uploaded to directory() the first time it is needed. The
+    file name contains a hash of the helper, so an uploaded helper is reused
+    by later connections and replaced when the library is updated. Relative
+    directories are relative to the home directory of the remote user. The
+    remote host needs perl and a POSIX shell.
+
+    Requests can be made before the agent has started, they are sent once the
+    helper is running. Any number of requests can be in flight, the helper
+    handles them in order and replies with finished(). The id of a reply is
+    the id returned by the function that made the request.
+
+    Frames in both directions are a 32-bit big-endian length of the rest of
+    the frame, 32-bit request id, 8-bit type and a type specific payload.
+
+*/
+class LibsshQtAgent : public QObject
+{
+    Q_OBJECT
+
+public:
+    Q_ENUMS(State)
+    enum State
+    {
+        StateClosed,
+        StateStarting,
+        StateUploading,
+        StateOpen,
+        StateError
+    };
+
+    explicit LibsshQtAgent(LibsshQtClient *parent);
+    ~LibsshQtAgent();
+
+    static const char *enumToString(const State value);
+
+    void setDirectory(QString directory);
+    QString directory() const;
+    QString helperPath() const;
+
+    State state() const;
+    int pendingCount() const;
+
+    quint32 exec(QString command);
+    quint32 statFile(QString path);
+    quint32 readFile(QString path,
+                     quint64 offset = 0,
+                     quint32 length = 0xFFFFFFFF);
+    quint32 writeFile(QString path, const QByteArray &data, int mode = 0644);
+
+public slots:
+    void start();
+    void stop();
+
+signals:
+    void opened();
+    void closed();
+    void error();
+    void finished(const LibsshQtAgentReply &reply);
+
+private:
+    void setState(State state);
+    void runHelper();
+    void uploadHelper();
+    void releaseProcess();
+    quint32 queueRequest(int type, const QByteArray &payload);
+    void handleFrame(quint32 id, int type, const char *data, int len);
+    void failRequests(QString message);
+
+private slots:
+    void handleDebugChanged();
+    void handleReadyRead();
+    void handleUploadOpened();
+    void handleProcessFinished(int exit_code);
+    void handleProcessError();
+
+private:
+    QString                 debug_prefix_;
+    bool                    debug_output_;
+
+    LibsshQtClient         *client_;
+    LibsshQtProcess        *process_;
+    State                   state_;
+    QString                 directory_;
+
+    quint32                 next_id_;
+    QHash<quint32, int>     requests_;
+    QByteArray              unsent_;
+    QByteArray              read_buffer_;
+};
+
+
+// Include <QDebug> before "libsshqt.h" if you want to use these operators
+#ifdef QDEBUG_H
+
+inline QDebug operator<<(QDebug dbg, const LibsshQtAgent::State value)
+{
+    dbg << LibsshQtAgent::enumToString(value);
+    return dbg;
+}
+
+#endif
+
+#endif // LIBSSHQTAGENT_H
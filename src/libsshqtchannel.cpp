@@ -5,6 +5,8 @@
 #include <QCoreApplication>
 #include <QUrl>
 
+#include <string.h>
+
 #include "libsshqtchannel.h"
 #include "libsshqtclient.h"
 #include "libsshqtdebug.h"
@@ -20,14 +22,16 @@ LibsshQtChannel::LibsshQtChannel(bool            is_stderr,
                                  LibsshQtClient *client,
                                  QObject        *parent) :
     QIODevice(parent),
-    debug_prefix_(LibsshQt::debugPrefix(this)),
     debug_output_(client->isDebugEnabled()),
     client_(client),
     channel_(0),
     is_stderr_(is_stderr),
     eof_state_(EofNotSent),
+    priority_(0),
     buffer_size_(1024 * 16),
-    write_size_(1024 * 16)
+    write_size_(1024 * 16),
+    max_line_batch_(0),
+    ready_read_(true)
 {
     connect(client_, SIGNAL(debugChanged()),
             this,    SLOT(handleDebugChanged()));
@@ -42,13 +46,12 @@ LibsshQtChannel::LibsshQtChannel(bool            is_stderr,
 */
 bool LibsshQtChannel::atEnd() const
 {
-    // Channel is NULL
     // IODevice is closed
-    // Buffer is empty AND ( Channel closed OR Channel is EOF )
-    return channel_ == 0 ||
-            isOpen() == false ||
+    // Buffer is empty AND ( Channel NULL OR Channel closed OR Channel is EOF )
+    return isOpen() == false ||
             ( read_buffer_.isEmpty() &&
-              ( ssh_channel_is_open(channel_) == false ||
+              ( channel_ == 0 ||
+                ssh_channel_is_open(channel_) == false ||
                 ssh_channel_poll(channel_, is_stderr_) == SSH_EOF ));
 }
 
@@ -144,17 +147,19 @@ void LibsshQtChannel::checkIo()
         }
 
         if ( read_available > 0 ) {
-            char data[read_available + 1];
-            data[read_available] = 0;
+            // Read directly into the read buffer
+            int old_size = read_buffer_.size();
+            read_buffer_.reserve(buffer_size_);
+            read_buffer_.resize(old_size + read_available);
 
             read_size = ssh_channel_read_nonblocking(channel_,
-                                                     data,
+                                                     read_buffer_.data() +
+                                                        old_size,
                                                      read_available,
                                                      is_stderr_);
             Q_ASSERT(read_size >= 0);
 
-            read_buffer_.reserve(buffer_size_);
-            read_buffer_.append(data, read_size);
+            read_buffer_.resize(old_size + qMax(0, read_size));
 
             LIBSSHQT_DEBUG("Read:" << read_size <<
                            " Data in buffer:" << read_buffer_.size() <<
@@ -203,7 +208,7 @@ void LibsshQtChannel::checkIo()
 
     // Emit signals here, so that somebody wont call closeChannel() while
     // when we are reading from it.
-    if ( emit_ready_read ) {
+    if ( emit_ready_read && ready_read_ ) {
         emit readyRead();
     }
     if ( emit_bytes_written ) {
@@ -211,6 +216,67 @@ void LibsshQtChannel::checkIo()
     }
 }
 
+/*!
+    Emit all complete lines in the read buffer with linesReady signal.
+
+    The read buffer is handed over to LibsshQtLines as is, only an incomplete
+    last line is copied back to the read buffer. If the read buffer is full,
+    or more data won't be forthcoming, the incomplete last line is emitted
+    too.
+*/
+void LibsshQtChannel::emitLines()
+{
+    if ( read_buffer_.isEmpty()) return;
+
+    bool read_finished = read_buffer_.size() >= buffer_size_ ||
+                         isOpen() == false ||
+                         channel_ == 0 ||
+                         ssh_channel_is_open(channel_) == false ||
+                         ssh_channel_poll(channel_, is_stderr_) == SSH_EOF;
+
+    QVector<int> ends;
+    const char *begin = read_buffer_.constData();
+    const char *end   = begin + read_buffer_.size();
+    const char *pos   = begin;
+
+    while ( pos < end ) {
+        const char *newline =
+                static_cast< const char* >( memchr(pos, '\n', end - pos));
+        if ( ! newline ) {
+            break;
+        }
+        ends.append(newline - begin);
+        pos = newline + 1;
+    }
+
+    if ( pos < end && read_finished ) {
+        ends.append(end - begin);
+        pos = end;
+    }
+
+    if ( ends.isEmpty()) return;
+
+    // Take the buffer without copying, keep the incomplete line
+    QByteArray data = read_buffer_;
+    if ( pos < end ) {
+        read_buffer_ = QByteArray(pos, end - pos);
+    } else {
+        read_buffer_.clear();
+    }
+
+    LIBSSHQT_DEBUG("Emitting" << ends.count() << "lines," <<
+                   read_buffer_.size() << "bytes left in buffer");
+
+    int batch = max_line_batch_ > 0 ? max_line_batch_ : ends.count();
+    for ( int first = 0; first < ends.count(); first += batch ) {
+        int count = qMin(batch, ends.count() - first);
+        emit linesReady(LibsshQtLines(data, ends, first, count));
+    }
+
+    // Read more data from the channel
+    queueCheckIo();
+}
+
 /*!
     Get parent LibsshQtClient object.
 */
@@ -260,6 +326,37 @@ int LibsshQtChannel::getWriteSize()
     return write_size_;
 }
 
+/*!
+    Set the priority which is used if the channel has to wait for a free
+    channel slot, see LibsshQtClient::setMaxChannels(). Channels with higher
+    priority are opened first. The priority must be set before the channel is
+    opened.
+*/
+void LibsshQtChannel::setPriority(int priority)
+{
+    priority_ = priority;
+}
+
+int LibsshQtChannel::priority() const
+{
+    return priority_;
+}
+
+/*!
+    Set the maximum number of lines emitted in one linesReady signal, 0 means
+    no limit. All batches share the same buffer.
+*/
+void LibsshQtChannel::setMaxLineBatch(int max_lines)
+{
+    Q_ASSERT( max_lines >= 0 );
+    max_line_batch_ = qMax(0, max_lines);
+}
+
+int LibsshQtChannel::maxLineBatch() const
+{
+    return max_line_batch_;
+}
+
 /*!
     Send EOF to the channel once write buffer has been written to the channel.
  */
@@ -271,6 +368,16 @@ void LibsshQtChannel::sendEof()
     }
 }
 
+/*!
+    Run the work queued with queueCheckIo() immediately, used by
+    LibsshQtClient::waitForActivity() when there is no event loop. Returns
+    true if anything was run.
+*/
+bool LibsshQtChannel::runPendingWork()
+{
+    return false;
+}
+
 LibsshQtChannel::EofState LibsshQtChannel::eofState()
 {
     return eof_state_;
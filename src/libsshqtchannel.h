@@ -7,6 +7,8 @@
 #include <QSocketNotifier>
 #include <libssh/libssh.h>
 
+#include "libsshqtlines.h"
+
 class LibsshQtClient;
 
 /*!
@@ -17,6 +19,8 @@ class LibsshQtClient;
 class LibsshQtChannel : public QIODevice
 {
     Q_OBJECT
+    friend class LibsshQtClient;
+    friend class LibsshQtPipe;
 
 public:
     Q_FLAGS(EofState)
@@ -54,6 +58,12 @@ public:
     int getWriteSize();
     int getBufferSize();
 
+    void setPriority(int priority);
+    int priority() const;
+
+    void setMaxLineBatch(int max_lines);
+    int maxLineBatch() const;
+
     void sendEof();
     EofState eofState();
 
@@ -63,26 +73,34 @@ public:
     QString errorMessage() const;
     int errorCode() const;
 
+signals:
+    void linesReady(const LibsshQtLines &lines);
+
 protected:
     void checkIo();
+    void emitLines();
     virtual void queueCheckIo() = 0;
+    virtual bool runPendingWork();
 
 private slots:
     void handleDebugChanged();
 
 protected:
-    QString         debug_prefix_;
+    QString         debug_prefix_;     //!< Set by subclass constructors
     bool            debug_output_;
     LibsshQtClient *client_;
 
     ssh_channel     channel_;
     bool            is_stderr_;
     EofState        eof_state_;
+    int             priority_;
 
     int             buffer_size_;
     int             write_size_;
+    int             max_line_batch_;
     QByteArray      read_buffer_;
     QByteArray      write_buffer_;
+    bool            ready_read_;        //!< Emit readyRead() after reads
 };
 
 
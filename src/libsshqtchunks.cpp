@@ -0,0 +1,80 @@
+
+#include "libsshqtchunks.h"
+
+LibsshQtChunks::LibsshQtChunks()
+{
+}
+
+/*!
+    Create chunks from data, chunks must be in the order of their data.
+*/
+LibsshQtChunks::LibsshQtChunks(const QByteArray     &data,
+                               const QVector<Chunk> &chunks) :
+    data_(data),
+    chunks_(chunks)
+{
+    Q_ASSERT( chunks.isEmpty() || chunks.last().end == data.size());
+}
+
+int LibsshQtChunks::count() const
+{
+    return chunks_.count();
+}
+
+bool LibsshQtChunks::isEmpty() const
+{
+    return chunks_.isEmpty();
+}
+
+LibsshQtChunks::Stream LibsshQtChunks::stream(int index) const
+{
+    return chunks_.at(index).stream;
+}
+
+/*!
+    Get the time the chunk was read from the channel, in milliseconds since
+    1970-01-01T00:00:00 UTC.
+*/
+qint64 LibsshQtChunks::timestamp(int index) const
+{
+    return chunks_.at(index).time;
+}
+
+/*!
+    Get the offset of the chunk in data().
+*/
+int LibsshQtChunks::chunkOffset(int index) const
+{
+    Q_ASSERT( index >= 0 && index < chunks_.count());
+    return index == 0 ? 0 : chunks_.at(index - 1).end;
+}
+
+int LibsshQtChunks::chunkLength(int index) const
+{
+    return chunks_.at(index).end - chunkOffset(index);
+}
+
+/*!
+    Get a pointer to the chunk, the chunk is not null terminated.
+*/
+const char *LibsshQtChunks::chunkData(int index) const
+{
+    return data_.constData() + chunkOffset(index);
+}
+
+/*!
+    Get the chunk as QByteArray. The data is not copied, so the returned
+    QByteArray is valid only as long as this LibsshQtChunks object exists.
+*/
+QByteArray LibsshQtChunks::chunk(int index) const
+{
+    return QByteArray::fromRawData(chunkData(index), chunkLength(index));
+}
+
+/*!
+    Get the buffer which contains the data of all chunks.
+*/
+QByteArray LibsshQtChunks::data() const
+{
+    return data_;
+}
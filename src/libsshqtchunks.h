@@ -0,0 +1,57 @@
+#ifndef LIBSSHQTCHUNKS_H
+#define LIBSSHQTCHUNKS_H
+
+#include <QByteArray>
+#include <QVector>
+#include <QMetaType>
+
+/*!
+
+    LibsshQtChunks - Stdout and stderr output of a process in arrival order
+
+    Each chunk is the data of one read from the channel, tagged with the
+    stream it was read from and the time it was received. The data of all
+    chunks is stored in one buffer, chunkData() and chunk() return views to
+    the buffer without copying.
+
+*/
+class LibsshQtChunks
+{
+public:
+    enum Stream
+    {
+        Stdout,
+        Stderr
+    };
+
+    class Chunk
+    {
+    public:
+        int     end;        //!< Offset of the end of the chunk in data()
+        Stream  stream;
+        qint64  time;       //!< Milliseconds since epoch
+    };
+
+    LibsshQtChunks();
+    LibsshQtChunks(const QByteArray &data, const QVector<Chunk> &chunks);
+
+    int count() const;
+    bool isEmpty() const;
+
+    Stream stream(int index) const;
+    qint64 timestamp(int index) const;
+    int chunkOffset(int index) const;
+    int chunkLength(int index) const;
+    const char *chunkData(int index) const;
+    QByteArray chunk(int index) const;
+
+    QByteArray data() const;
+
+private:
+    QByteArray      data_;
+    QVector<Chunk>  chunks_;
+};
+
+Q_DECLARE_METATYPE(LibsshQtChunks)
+
+#endif // LIBSSHQTCHUNKS_H
@@ -4,11 +4,33 @@
 #include <QProcessEnvironment>
 #include <QCoreApplication>
 #include <QUrl>
+#include <QPointer>
+#include <QElapsedTimer>
+
+#include <poll.h>
+#include <errno.h>
 
 #include "libsshqtclient.h"
+#include "libsshqtagent.h"
 #include "libsshqtprocess.h"
+#include "libsshqtsubsystem.h"
+#include "libsshqttunnel.h"
 #include "libsshqtdebug.h"
 
+// Types of queued signal arguments. Every channel and agent has a client,
+// and clients are created in many threads, so the client registers them
+// all, and Q_GLOBAL_STATIC does it exactly once.
+class LibsshQtMetaTypes
+{
+public:
+    LibsshQtMetaTypes()
+    {
+        qRegisterMetaType<LibsshQtLines>("LibsshQtLines");
+        qRegisterMetaType<LibsshQtChunks>("LibsshQtChunks");
+        qRegisterMetaType<LibsshQtAgentReply>("LibsshQtAgentReply");
+    }
+};
+Q_GLOBAL_STATIC(LibsshQtMetaTypes, metaTypes)
 
 LibsshQtClient::LibsshQtClient(QObject *parent) :
     QObject(parent),
@@ -18,12 +40,18 @@ LibsshQtClient::LibsshQtClient(QObject *parent) :
     process_state_running_(false),
     enable_writable_nofifier_(false),
     port_(22),
+    jump_client_(0),
+    proxy_jump_(0),
+    tunnel_(0),
+    max_channels_(10),
+    process_pool_size_(16),
     read_notifier_(0),
     write_notifier_(0),
     unknown_host_type_(HostKnown),
     password_set_(false)
 {
     debug_prefix_ = LibsshQt::debugPrefix(this);
+    metaTypes();
 
     if ( QProcessEnvironment::systemEnvironment().contains("LIBSSHQT_DEBUG")) {
         debug_output_ = true;
@@ -34,6 +62,11 @@ LibsshQtClient::LibsshQtClient(QObject *parent) :
     timer_.setInterval(0);
     connect(&timer_, SIGNAL(timeout()), this, SLOT(processStateGuard()));
 
+    channel_timer_.setSingleShot(true);
+    channel_timer_.setInterval(0);
+    connect(&channel_timer_, SIGNAL(timeout()),
+            this,            SLOT(grantChannelSlots()));
+
     if (debug_output_) {
         setVerbosity(LogProtocol);
     } else {
@@ -49,6 +82,10 @@ LibsshQtClient::~LibsshQtClient()
     LIBSSHQT_DEBUG("Destructor");
 
     disconnectFromHost();
+
+    // Child objects must not use the client after this
+    emit doCleanup();
+
     if ( session_ ) {
         ssh_free(session_);
         session_ = 0;
@@ -155,6 +192,37 @@ QString LibsshQtClient::flagsToString(const UseAuths flags)
     return QString("UseAuths( %1 )").arg(list.join(", "));
 }
 
+/*!
+    Create a chain of jump clients from a ProxyJump style string.
+
+    The chain is a comma separated list of jump hosts, for example
+    "user@bastion1,user@bastion2:2222". Each client in the chain connects
+    through the previous one and the last client in the chain is returned.
+    Use setJumpClient() to tunnel any number of clients through the returned
+    client, so that the jump hosts are connected only once.
+
+    All default authentication methods are enabled in the created clients.
+    Returns 0 if the chain is empty.
+*/
+LibsshQtClient *LibsshQtClient::createJumpChain(QString chain, QObject *parent)
+{
+    LibsshQtClient *previous = 0;
+
+    foreach ( QString host, chain.split(',', QString::SkipEmptyParts)) {
+        QUrl url(QString("ssh://%1").arg(host.trimmed()));
+
+        LibsshQtClient *client = new LibsshQtClient(parent);
+        client->setUrl(url);
+        client->useDefaultAuths();
+        if ( previous ) {
+            client->setJumpClient(previous);
+        }
+        previous = client;
+    }
+
+    return previous;
+}
+
 /*!
     Enable or disable debug messages.
 
@@ -275,6 +343,60 @@ void LibsshQtClient::setUrl(const QUrl &url)
     }
 }
 
+/*!
+    Connect to the host through a direct-tcpip channel opened by jump_client.
+
+    If jump_client is closed it is connected automatically. The same jump
+    client can be shared by any number of LibsshQtClient objects.
+*/
+void LibsshQtClient::setJumpClient(LibsshQtClient *jump_client)
+{
+    Q_ASSERT( state_ == StateClosed );
+    Q_ASSERT( jump_client != this );
+
+    if ( state_ == StateClosed ) {
+        LIBSSHQT_DEBUG("Setting jump client to" <<
+                       ( jump_client ? LIBSSHQT_HEXNAME(jump_client) : "0" ));
+        jump_client_ = jump_client;
+    } else {
+        LIBSSHQT_CRITICAL("Cannot set jump client when state is" << state_);
+    }
+}
+
+/*!
+    Create a private chain of jump clients with createJumpChain() and connect
+    through it.
+
+    The chain is owned by this client and is not shared, every client that
+    calls setProxyJump() connects to the jump hosts on its own. To connect
+    many clients through the same jump hosts, create the chain once with
+    createJumpChain() and give it to each of them with setJumpClient().
+    Calling setProxyJump() again deletes the previous chain.
+*/
+void LibsshQtClient::setProxyJump(QString chain)
+{
+    Q_ASSERT( state_ == StateClosed );
+
+    if ( state_ != StateClosed ) {
+        LIBSSHQT_CRITICAL("Cannot set proxy jump when state is" << state_);
+        return;
+    }
+
+    // Deleted later, the tunnel of the last connection was deleted later too
+    // and must go first
+    if ( proxy_jump_ ) {
+        proxy_jump_->deleteLater();
+    }
+
+    proxy_jump_ = new QObject(this);
+    setJumpClient(createJumpChain(chain, proxy_jump_));
+}
+
+LibsshQtClient *LibsshQtClient::jumpClient() const
+{
+    return jump_client_;
+}
+
 /*!
     Returns true if connection is successfully connected and authenticated.
 */
@@ -339,6 +461,13 @@ void LibsshQtClient::disconnectFromHost()
         ssh_free(session_);
         session_ = 0;
 
+        if ( tunnel_ ) {
+            tunnel_->disconnect(this);
+            tunnel_->closeTunnel();
+            tunnel_->deleteLater();
+            tunnel_ = 0;
+        }
+
         setState(StateClosed);
     }
 }
@@ -507,15 +636,200 @@ LibsshQtClient::UseAuths LibsshQtClient::failedAuths()
 
 /*!
     Run a command
+
+    Processes with higher priority are started first if the number of open
+    channels is limited, see setMaxChannels().
+
+    If a process has been returned with recycleProcess(), it is reused
+    instead of creating a new process.
 */
-LibsshQtProcess *LibsshQtClient::runCommand(QString command)
+LibsshQtProcess *LibsshQtClient::runCommand(QString command, int priority)
 {
-    LibsshQtProcess *process = new LibsshQtProcess(this);
+    LibsshQtProcess *process = 0;
+    if ( process_pool_.isEmpty()) {
+        process = new LibsshQtProcess(this);
+    } else {
+        process = process_pool_.takeLast();
+    }
+
     process->setCommand(command);
+    process->setPriority(priority);
     process->openChannel();
     return process;
 }
 
+/*!
+    Open a channel for a named subsystem, for example "sftp" or "netconf".
+*/
+LibsshQtSubsystem *LibsshQtClient::openSubsystem(QString subsystem, int priority)
+{
+    LibsshQtSubsystem *channel = new LibsshQtSubsystem(this);
+    channel->setSubsystem(subsystem);
+    channel->setPriority(priority);
+    channel->openChannel();
+    return channel;
+}
+
+/*!
+    Run command and return a future that gets the result of the command.
+
+    Output of the command is collected to the result, and the stdin of the
+    command is closed once the channel has been opened. Use QFutureWatcher to
+    get notified when the command has finished. Do not call
+    QFuture::result() or waitForFinished() from the thread of the client,
+    the command can only make progress while the event loop is running.
+*/
+QFuture<LibsshQtResult> LibsshQtClient::runCommandAsync(QString command)
+{
+    return runCommandAsync(command, QByteArray());
+}
+
+/*!
+    Run command with stdin_data as its stdin and return a future that gets the
+    result of the command.
+*/
+QFuture<LibsshQtResult> LibsshQtClient::runCommandAsync(
+        QString command,
+        const QByteArray &stdin_data)
+{
+    LibsshQtAsyncCommand *async = new LibsshQtAsyncCommand(this, command,
+                                                           stdin_data);
+    return async->future();
+}
+
+/*!
+    Set the maximum number of closed processes kept for reuse by runCommand(),
+    0 disables the pool. The default is 16.
+*/
+void LibsshQtClient::setProcessPoolSize(int pool_size)
+{
+    Q_ASSERT( pool_size >= 0 );
+    process_pool_size_ = qMax(0, pool_size);
+
+    while ( process_pool_.count() > process_pool_size_ ) {
+        process_pool_.takeLast()->deleteLater();
+    }
+}
+
+int LibsshQtClient::processPoolSize() const
+{
+    return process_pool_size_;
+}
+
+/*!
+    Get the number of processes waiting for reuse.
+*/
+int LibsshQtClient::pooledProcessCount() const
+{
+    return process_pool_.count();
+}
+
+/*!
+    Give a process that is no longer needed back to the client for reuse.
+
+    The process is closed and reset, all signal connections from the process
+    are removed. If the pool is full, the process is deleted later. The caller
+    must not use the process after this call. It is safe to recycle a process
+    from a slot connected to the finished() signal of the process.
+*/
+void LibsshQtClient::recycleProcess(LibsshQtProcess *process)
+{
+    Q_ASSERT( process->client() == this );
+
+    if ( process_pool_.contains(process)) {
+        LIBSSHQT_CRITICAL("Process" << LIBSSHQT_HEXNAME(process) <<
+                          "has already been recycled");
+        return;
+    }
+
+    process->reset();
+
+    if ( process_pool_.count() < process_pool_size_ ) {
+        process_pool_.append(process);
+    } else {
+        process->deleteLater();
+    }
+}
+
+/*!
+    Set the maximum number of session channels that are open at the same time.
+
+    Servers limit the number of session channels per connection, OpenSSH
+    allows 10 by default (MaxSessions). Channels that are opened while the
+    limit is reached are queued and opened, highest priority first, when
+    other channels are closed. The default limit is 10, 0 means no limit.
+*/
+void LibsshQtClient::setMaxChannels(int max_channels)
+{
+    Q_ASSERT( max_channels >= 0 );
+
+    LIBSSHQT_DEBUG("Setting maximum number of channels to" << max_channels);
+    max_channels_ = qMax(0, max_channels);
+    grantChannelSlots();
+}
+
+int LibsshQtClient::maxChannels() const
+{
+    return max_channels_;
+}
+
+/*!
+    Get the number of channels which are using a channel slot.
+*/
+int LibsshQtClient::openChannelCount() const
+{
+    return channel_slots_.count();
+}
+
+/*!
+    Get the number of channels waiting for a free channel slot.
+*/
+int LibsshQtClient::queuedChannelCount() const
+{
+    return channel_queue_.count();
+}
+
+/*!
+    Ask for permission to open a session channel.
+
+    Returns true if the channel may be opened. Otherwise the channel is queued
+    by its priority and the processState() of the channel is queued once a
+    slot has been reserved for it. The slot must be released with
+    releaseChannelSlot() once the channel has been closed.
+
+    Slots are granted from Qt's main loop, so that all channels requesting a
+    slot at the same time are queued by their priority.
+*/
+bool LibsshQtClient::requestChannelSlot(LibsshQtChannel *channel)
+{
+    if ( channel_slots_.contains(channel)) {
+        return true;
+    }
+
+    if ( ! channel_queue_.contains(channel)) {
+        int pos = 0;
+        while ( pos < channel_queue_.count() &&
+                channel_queue_.at(pos)->priority() >= channel->priority()) {
+            pos++;
+        }
+        channel_queue_.insert(pos, channel);
+        channel_timer_.start();
+    }
+
+    return false;
+}
+
+/*!
+    Release a channel slot or remove the channel from the queue.
+*/
+void LibsshQtClient::releaseChannelSlot(LibsshQtChannel *channel)
+{
+    channel_queue_.removeAll(channel);
+    if ( channel_slots_.removeAll(channel) > 0 ) {
+        grantChannelSlots();
+    }
+}
+
 LibsshQtClient::HostState LibsshQtClient::unknownHostType()
 {
     return unknown_host_type_;
@@ -646,6 +960,144 @@ void LibsshQtClient::enableWritableNotifier()
     }
 }
 
+/*!
+    Connect to the host and wait until the connection has been opened, for
+    use in threads which do not run an event loop.
+
+    Returns true if the connection was opened. Returns false if msecs
+    milliseconds have passed, if an error occurred, or if the connection
+    needs input from the user, for example a password. In the last case the
+    input can be given and waitForConnected() called again. If msecs is -1,
+    this function does not time out.
+
+    Connecting through a jump client is not supported in blocking mode,
+    since only the socket of this client is polled.
+*/
+bool LibsshQtClient::waitForConnected(int msecs)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    connectToHost();
+
+    forever {
+        switch ( state_ ) {
+        case StateOpened:
+            return true;
+
+        case StateClosed:
+        case StateClosing:
+        case StateUnknownHost:
+        case StateAuthChoose:
+        case StateAuthNeedPassword:
+        case StateAuthKbiQuestions:
+        case StateAuthAllFailed:
+        case StateError:
+            return false;
+
+        default:
+            break;
+        }
+
+        int remaining = msecs;
+        if ( msecs >= 0 ) {
+            remaining = qMax(qint64(0), msecs - timer.elapsed());
+        }
+
+        if ( ! waitForActivity(remaining)) {
+            return state_ == StateOpened;
+        }
+    }
+}
+
+/*!
+    Drive the client and its channels for blocking waits.
+
+    Work queued for Qt's main loop is run directly. If there was no queued
+    work, poll() is used to wait at most msecs milliseconds for the session
+    socket to become readable, or writable if libssh is waiting to write,
+    and the state of the client and all channels is processed. msecs -1
+    waits forever.
+
+    Returns false if nothing happened before msecs passed, or if there is
+    nothing to wait for. Must not be called from slots connected to
+    libsshqt signals.
+*/
+bool LibsshQtClient::waitForActivity(int msecs)
+{
+    if ( runPendingWork()) {
+        return true;
+    }
+
+    socket_t fd = session_ ? ssh_get_fd(session_) : -1;
+    if ( fd < 0 ) {
+        return false;
+    }
+
+    struct pollfd pfd;
+    pfd.fd      = fd;
+    pfd.events  = POLLIN;
+    pfd.revents = 0;
+    if ( enable_writable_nofifier_ ||
+         ( write_notifier_ && write_notifier_->isEnabled())) {
+        pfd.events |= POLLOUT;
+    }
+
+    int rc = 0;
+    do {
+        rc = ::poll(&pfd, 1, msecs);
+    } while ( rc < 0 && errno == EINTR );
+
+    if ( rc <= 0 ) {
+        return false;
+    }
+
+    if ( pfd.revents & POLLOUT ) {
+        enable_writable_nofifier_ = false;
+        if ( write_notifier_ ) {
+            write_notifier_->setEnabled(false);
+        }
+    }
+
+    processStateGuard();
+    return true;
+}
+
+/*!
+    Run the slots of zero interval timers which would be activated by Qt's
+    main loop, returns true if anything was run.
+*/
+bool LibsshQtClient::runPendingWork()
+{
+    bool ran = false;
+
+    if ( timer_.isActive()) {
+        timer_.stop();
+        processStateGuard();
+        ran = true;
+    }
+
+    if ( channel_timer_.isActive()) {
+        channel_timer_.stop();
+        grantChannelSlots();
+        ran = true;
+    }
+
+    // Channels may be deleted by slots connected to their signals
+    QList< QPointer<LibsshQtChannel> > channels;
+    foreach ( LibsshQtChannel *channel, findChildren<LibsshQtChannel *>()) {
+        channels << channel;
+    }
+
+    foreach ( QPointer<LibsshQtChannel> channel, channels ) {
+        if ( channel && channel->runPendingWork()) {
+            ran = true;
+        }
+    }
+
+    return ran;
+}
+
 /*!
     Change session state and send appropriate signals.
 */
@@ -818,6 +1270,21 @@ void LibsshQtClient::destroyNotifiers()
     }
 }
 
+void LibsshQtClient::grantChannelSlots()
+{
+    while ( ! channel_queue_.isEmpty() &&
+            ( max_channels_ == 0 || channel_slots_.count() < max_channels_ )) {
+
+        LibsshQtChannel *channel = channel_queue_.takeFirst();
+        channel_slots_.append(channel);
+        channel->queueCheckIo();
+
+        LIBSSHQT_DEBUG("Channel slot granted to" << LIBSSHQT_HEXNAME(channel) <<
+                       "Open:"   << channel_slots_.count() <<
+                       "Queued:" << channel_queue_.count());
+    }
+}
+
 void LibsshQtClient::handleSocketReadable(int socket)
 {
     Q_UNUSED( socket );
@@ -852,6 +1319,15 @@ void LibsshQtClient::processStateGuard()
     }
 }
 
+void LibsshQtClient::handleTunnelError()
+{
+    LIBSSHQT_DEBUG("Tunnel through jump client failed");
+    if ( state_ != StateClosed &&
+         state_ != StateClosing ) {
+        setState(StateError);
+    }
+}
+
 void LibsshQtClient::processState()
 {
     switch ( state_ ) {
@@ -892,6 +1368,24 @@ void LibsshQtClient::processState()
             setLibsshOption(SSH_OPTIONS_PORT, "SSH_OPTIONS_PORT",
                             &tmp_port, QString::number(port_)))
         {
+            if ( jump_client_ ) {
+                Q_ASSERT( tunnel_ == 0 );
+
+                tunnel_ = new LibsshQtTunnel(jump_client_, hostname_, port_,
+                                             this);
+                connect(tunnel_, SIGNAL(error()),
+                        this,    SLOT(handleTunnelError()));
+                tunnel_->openTunnel();
+
+                socket_t socket = tunnel_->takeSessionSocket();
+                if ( socket == -1 ||
+                     ! setLibsshOption(SSH_OPTIONS_FD, "SSH_OPTIONS_FD",
+                                       &socket, QString::number(socket))) {
+                    setState(StateError);
+                    return;
+                }
+            }
+
             setState(StateConnecting);
             timer_.start();
             return;
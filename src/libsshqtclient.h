@@ -5,10 +5,16 @@
 #include <QTimer>
 #include <QIODevice>
 #include <QSocketNotifier>
+#include <QFuture>
 #include <libssh/libssh.h>
 
+#include "libsshqtresult.h"
+
 class QUrl;
+class LibsshQtChannel;
 class LibsshQtProcess;
+class LibsshQtSubsystem;
+class LibsshQtTunnel;
 
 /*!
 
@@ -107,6 +113,8 @@ public:
     static QString flagsToString(const AuthMethods flags);
     static QString flagsToString(const UseAuths    flags);
 
+    static LibsshQtClient *createJumpChain(QString chain, QObject *parent = 0);
+
 
     // Options
     void setDebug(bool enabled);
@@ -115,12 +123,15 @@ public:
     void setPort(quint16 port);
     void setVerbosity(LogVerbosity loglevel);
     void setUrl(const QUrl &url);
+    void setJumpClient(LibsshQtClient *jump_client);
+    void setProxyJump(QString chain);
 
     bool isDebugEnabled() const;
     QString username() const;
     QString hostname() const;
     quint16 port() const;
     QUrl url() const;
+    LibsshQtClient *jumpClient() const;
 
     // Connection
     bool isOpen();
@@ -148,7 +159,25 @@ public:
     UseAuths failedAuths();
 
     // Doing something
-    LibsshQtProcess *runCommand(QString command);
+    LibsshQtProcess *runCommand(QString command, int priority = 0);
+    LibsshQtSubsystem *openSubsystem(QString subsystem, int priority = 0);
+    QFuture<LibsshQtResult> runCommandAsync(QString command);
+    QFuture<LibsshQtResult> runCommandAsync(QString command,
+                                            const QByteArray &stdin_data);
+
+    // Process pool
+    void setProcessPoolSize(int pool_size);
+    int processPoolSize() const;
+    int pooledProcessCount() const;
+    void recycleProcess(LibsshQtProcess *process);
+
+    // Channel limits
+    void setMaxChannels(int max_channels);
+    int maxChannels() const;
+    int openChannelCount() const;
+    int queuedChannelCount() const;
+    bool requestChannelSlot(LibsshQtChannel *channel);
+    void releaseChannelSlot(LibsshQtChannel *channel);
 
     // Functions for handling unknown hosts
     HostState unknownHostType();
@@ -165,6 +194,10 @@ public:
     ssh_session sshSession();
     void enableWritableNotifier();
 
+    // Blocking use without an event loop
+    bool waitForConnected(int msecs = 30000);
+    bool waitForActivity(int msecs);
+
 signals:
     void debugChanged();
     void unknownHost();
@@ -187,6 +220,7 @@ private:
     void setUpNotifiers();
     void destroyNotifiers();
     void processState();
+    bool runPendingWork();
     void handleAuthResponse(int rc, const char *func, UseAuthFlag auth);
     bool setLibsshOption(enum ssh_options_e type,
                          QString type_debug,
@@ -197,6 +231,8 @@ private slots:
     void handleSocketReadable(int socket);
     void handleSocketWritable(int socket);
     void processStateGuard();
+    void handleTunnelError();
+    void grantChannelSlots();
 
 private:
     QString         debug_prefix_;
@@ -213,6 +249,18 @@ private:
     QString         hostname_;
     QString         username_;
 
+    LibsshQtClient *jump_client_;
+    QObject        *proxy_jump_;        //!< Parent of setProxyJump() chain
+    LibsshQtTunnel *tunnel_;
+
+    int                         max_channels_;
+    QTimer                      channel_timer_;
+    QList<LibsshQtChannel *>    channel_queue_;
+    QList<LibsshQtChannel *>    channel_slots_;
+
+    int                         process_pool_size_;
+    QList<LibsshQtProcess *>    process_pool_;
+
     QSocketNotifier *read_notifier_;
     QSocketNotifier *write_notifier_;
 
@@ -0,0 +1,300 @@
+
+#include "libsshqtcoro.h"
+#include "libsshqtclient.h"
+#include "libsshqtprocess.h"
+
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// LibsshQtResumer
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+LibsshQtResumer::LibsshQtResumer(QObject *parent) :
+    QObject(parent),
+    awaiter_(0)
+{
+}
+
+/*!
+    Get the resumer of object, the resumer is created if the object does not
+    have one yet.
+*/
+LibsshQtResumer *LibsshQtResumer::forObject(QObject *object)
+{
+    // findChild() would search the children of all processes of a client
+    foreach ( QObject *child, object->children()) {
+        LibsshQtResumer *resumer = qobject_cast<LibsshQtResumer *>(child);
+        if ( resumer ) return resumer;
+    }
+
+    return new LibsshQtResumer(object);
+}
+
+/*!
+    Call awaiter when the object emits signals until awaiter has been resumed
+    or cancel() is called.
+*/
+void LibsshQtResumer::wait(LibsshQtAwaiter *awaiter)
+{
+    Q_ASSERT( ! awaiter_ );
+    awaiter_ = awaiter;
+
+    // LibsshQtProcess::reset() disconnects all signals of a recycled process,
+    // so connections are checked on every wait. Existing unique connections
+    // are found without allocating memory.
+    connectSignals();
+}
+
+void LibsshQtResumer::cancel(LibsshQtAwaiter *awaiter)
+{
+    if ( awaiter_ == awaiter ) {
+        awaiter_ = 0;
+    }
+}
+
+void LibsshQtResumer::connectSignals()
+{
+    QObject *object = parent();
+    Qt::ConnectionType type = Qt::UniqueConnection;
+
+    if ( qobject_cast<LibsshQtClient *>(object)) {
+        connect(object, SIGNAL(opened()),         this, SLOT(wake()), type);
+        connect(object, SIGNAL(closed()),         this, SLOT(wake()), type);
+        connect(object, SIGNAL(error()),          this, SLOT(wake()), type);
+        connect(object, SIGNAL(allAuthsFailed()), this, SLOT(wake()), type);
+
+    } else if ( LibsshQtProcess *process =
+                qobject_cast<LibsshQtProcess *>(object)) {
+        connect(process, SIGNAL(opened()),        this, SLOT(wake()), type);
+        connect(process, SIGNAL(closed()),        this, SLOT(wake()), type);
+        connect(process, SIGNAL(error()),         this, SLOT(wake()), type);
+        connect(process, SIGNAL(readyRead()),     this, SLOT(wake()), type);
+        connect(process, SIGNAL(bytesWritten(qint64)),
+                this,    SLOT(wake()), type);
+        connect(process, SIGNAL(readChannelFinished()),
+                this,    SLOT(wake()), type);
+        if ( process->isMergedOutput()) {
+            connect(process, SIGNAL(outputReady(LibsshQtChunks)),
+                    this,    SLOT(wake()), type);
+        } else {
+            connect(process->stderr(), SIGNAL(readyRead()),
+                    this,              SLOT(wake()), type);
+        }
+
+    } else {
+        Q_ASSERT_X(false, "LibsshQtResumer",
+                   "Only clients and processes can be awaited");
+    }
+}
+
+void LibsshQtResumer::wake()
+{
+    if ( awaiter_ && awaiter_->update()) {
+        LibsshQtAwaiter *awaiter = awaiter_;
+        awaiter_ = 0;
+        awaiter->resume();
+    }
+}
+
+
+
+#if defined(__cpp_impl_coroutine)
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// LibsshQt awaitables
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+namespace LibsshQt
+{
+
+ConnectAwaitable::ConnectAwaitable(LibsshQtClient *client) :
+    Awaitable(client),
+    client_(client)
+{
+}
+
+bool ConnectAwaitable::await_ready()
+{
+    client_->connectToHost();
+    return update();
+}
+
+bool ConnectAwaitable::await_resume() const
+{
+    return client_->state() == LibsshQtClient::StateOpened;
+}
+
+bool ConnectAwaitable::update()
+{
+    // Unknown host and password questions are left to the application, for
+    // example to LibsshQtQuestionConsole
+    switch ( client_->state()) {
+    case LibsshQtClient::StateOpened:
+    case LibsshQtClient::StateError:
+    case LibsshQtClient::StateAuthAllFailed:
+    case LibsshQtClient::StateClosed:
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+StartedAwaitable::StartedAwaitable(LibsshQtProcess *process) :
+    Awaitable(process),
+    process_(process)
+{
+}
+
+bool StartedAwaitable::await_resume() const
+{
+    return process_->state() == LibsshQtProcess::StateOpen;
+}
+
+bool StartedAwaitable::update()
+{
+    switch ( process_->state()) {
+    case LibsshQtProcess::StateWaitClient:
+    case LibsshQtProcess::StateOpening:
+    case LibsshQtProcess::StateExec:
+        return false;
+
+    default:
+        return true;
+    }
+}
+
+ReadLineAwaitable::ReadLineAwaitable(LibsshQtProcess *process) :
+    Awaitable(process),
+    process_(process)
+{
+}
+
+QByteArray ReadLineAwaitable::await_resume()
+{
+    return process_->readLine();
+}
+
+bool ReadLineAwaitable::update()
+{
+    if ( process_->canReadLine()) {
+        return true;
+    }
+
+    // Once the channel is closing the rest of the output is returned even
+    // if it does not end with a newline
+    switch ( process_->state()) {
+    case LibsshQtProcess::StateWaitClient:
+    case LibsshQtProcess::StateOpening:
+    case LibsshQtProcess::StateExec:
+    case LibsshQtProcess::StateOpen:
+        return false;
+
+    default:
+        return true;
+    }
+}
+
+WriteAwaitable::WriteAwaitable(LibsshQtProcess *process,
+                               const QByteArray &data) :
+    Awaitable(process),
+    process_(process),
+    data_(data)
+{
+}
+
+bool WriteAwaitable::await_ready()
+{
+    process_->write(data_);
+    return update();
+}
+
+bool WriteAwaitable::await_resume() const
+{
+    return process_->state() == LibsshQtProcess::StateOpen &&
+            process_->bytesToWrite() == 0;
+}
+
+bool WriteAwaitable::update()
+{
+    return process_->state() != LibsshQtProcess::StateOpen ||
+            process_->bytesToWrite() == 0;
+}
+
+ExecAwaitable::ExecAwaitable(LibsshQtClient *client, QString command) :
+    Awaitable(0),
+    client_(client),
+    process_(0),
+    eof_sent_(false)
+{
+    result_.command = command;
+}
+
+bool ExecAwaitable::await_ready()
+{
+    timer_.start();
+    process_ = client_->runCommand(result_.command);
+    process_->setStdoutBehaviour(LibsshQtProcess::OutputManual);
+    process_->setStderrBehaviour(LibsshQtProcess::OutputManual);
+    return false;
+}
+
+void ExecAwaitable::await_suspend(std::coroutine_handle<> handle)
+{
+    object_ = process_;
+    Awaitable::await_suspend(handle);
+}
+
+LibsshQtResult ExecAwaitable::await_resume()
+{
+    result_.totalTime = timer_.elapsed();
+
+    // A process closed by a disconnect or a deadline never exited
+    if ( process_->isFinished()) {
+        result_.ok       = true;
+        result_.exitCode = process_->exitCode();
+    } else if ( process_->timeoutReason() != LibsshQtProcess::TimeoutNone ) {
+        result_.errorMessage = QObject::tr("Command timed out");
+    } else if ( process_->state() == LibsshQtProcess::StateClosed ) {
+        result_.errorMessage =
+                QObject::tr("Process was closed before it finished");
+    } else if ( process_->isClientError()) {
+        result_.errorMessage = client_->errorCodeAndMessage();
+    } else {
+        result_.errorMessage = process_->errorCodeAndMessage();
+    }
+
+    // Resumed from inside the signal handlers of the process, recycling is
+    // safe there
+    client_->recycleProcess(process_);
+    process_ = 0;
+    return result_;
+}
+
+bool ExecAwaitable::update()
+{
+    result_.stdoutData += process_->readAll();
+    result_.stderrData += process_->stderr()->readAll();
+
+    switch ( process_->state()) {
+    case LibsshQtProcess::StateOpen:
+        if ( ! eof_sent_ ) {
+            result_.openTime = timer_.elapsed();
+            eof_sent_ = true;
+            process_->sendEof();
+        }
+        return false;
+
+    case LibsshQtProcess::StateClosed:
+    case LibsshQtProcess::StateError:
+    case LibsshQtProcess::StateClientError:
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+} // namespace LibsshQt
+
+#endif // __cpp_impl_coroutine
@@ -0,0 +1,227 @@
+#ifndef LIBSSHQTCORO_H
+#define LIBSSHQTCORO_H
+
+#include <QObject>
+#include <QByteArray>
+
+#include "libsshqtresult.h"
+
+class LibsshQtClient;
+class LibsshQtProcess;
+
+/*!
+
+    LibsshQtAwaiter - Interface of objects waiting for LibsshQtResumer
+
+    update() is called every time the awaited object emits a signal, it must
+    return true when the wait is over. resume() is then called once.
+
+*/
+class LibsshQtAwaiter
+{
+public:
+    virtual ~LibsshQtAwaiter() {}
+
+    virtual bool update() = 0;
+    virtual void resume() = 0;
+};
+
+/*!
+
+    LibsshQtResumer - Resumes an awaiter when a client or process changes
+
+    Each awaited client or process gets one resumer as its child, created the
+    first time the object is awaited and reused for all later waits, so
+    waiting does not allocate memory. The resumer is connected to the signals
+    of the object and calls the awaiter from them, in the thread of the
+    object. Only one awaiter can wait for an object at a time.
+
+*/
+class LibsshQtResumer : public QObject
+{
+    Q_OBJECT
+
+public:
+    static LibsshQtResumer *forObject(QObject *object);
+
+    void wait(LibsshQtAwaiter *awaiter);
+    void cancel(LibsshQtAwaiter *awaiter);
+
+public slots:
+    void wake();
+
+private:
+    explicit LibsshQtResumer(QObject *parent);
+    void connectSignals();
+
+private:
+    LibsshQtAwaiter    *awaiter_;
+};
+
+
+
+// The awaitables need a C++20 compiler, the rest of libsshqt does not
+#if defined(__cpp_impl_coroutine)
+
+#include <coroutine>
+#include <exception>
+
+/*!
+
+    Awaitables for C++20 coroutines
+
+    These functions return awaitables that suspend a coroutine until a
+    client or process has done something, for example:
+
+        LibsshQt::Task run(LibsshQtClient *client)
+        {
+            if ( ! co_await LibsshQt::connectToHost(client)) co_return;
+            LibsshQtResult r = co_await LibsshQt::exec(client, "uptime");
+        }
+
+    Coroutines are resumed from inside the signal handlers of the awaited
+    object, so a coroutine must not delete the object it was waiting for,
+    use deleteLater() instead. The awaitables live in the coroutine frame and
+    do not allocate memory, except that exec() may open a new process. exec()
+    takes the process from the pool of the client and recycles it when the
+    command is done.
+
+    LibsshQt::Task is a coroutine type that starts immediately and is not
+    awaited by anyone, its frame is freed when the coroutine returns.
+
+*/
+namespace LibsshQt
+{
+    class Task
+    {
+    public:
+        class promise_type
+        {
+        public:
+            Task get_return_object() { return Task(); }
+            std::suspend_never initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() { std::terminate(); }
+        };
+    };
+
+    class Awaitable : public LibsshQtAwaiter
+    {
+    public:
+        explicit Awaitable(QObject *object) : object_(object) {}
+
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            handle_ = handle;
+            LibsshQtResumer::forObject(object_)->wait(this);
+        }
+
+        void resume() { handle_.resume(); }
+
+    protected:
+        QObject                    *object_;
+        std::coroutine_handle<>     handle_;
+    };
+
+    //! Connect client to host, returns true when the client has been opened
+    class ConnectAwaitable : public Awaitable
+    {
+    public:
+        explicit ConnectAwaitable(LibsshQtClient *client);
+        bool await_ready();
+        bool await_resume() const;
+        bool update();
+
+    private:
+        LibsshQtClient *client_;
+    };
+
+    //! Wait until process has been opened, returns false if it failed
+    class StartedAwaitable : public Awaitable
+    {
+    public:
+        explicit StartedAwaitable(LibsshQtProcess *process);
+        bool await_ready() { return update(); }
+        bool await_resume() const;
+        bool update();
+
+    private:
+        LibsshQtProcess *process_;
+    };
+
+    //! Read one line of stdout, returns empty line at the end of output
+    class ReadLineAwaitable : public Awaitable
+    {
+    public:
+        explicit ReadLineAwaitable(LibsshQtProcess *process);
+        bool await_ready() { return update(); }
+        QByteArray await_resume();
+        bool update();
+
+    private:
+        LibsshQtProcess *process_;
+    };
+
+    //! Write data to stdin, returns when all of it has been sent
+    class WriteAwaitable : public Awaitable
+    {
+    public:
+        WriteAwaitable(LibsshQtProcess *process, const QByteArray &data);
+        bool await_ready();
+        bool await_resume() const;
+        bool update();
+
+    private:
+        LibsshQtProcess    *process_;
+        QByteArray          data_;
+    };
+
+    //! Run command with stdin closed, returns its output and exit code
+    class ExecAwaitable : public Awaitable
+    {
+    public:
+        ExecAwaitable(LibsshQtClient *client, QString command);
+        bool await_ready();
+        void await_suspend(std::coroutine_handle<> handle);
+        LibsshQtResult await_resume();
+        bool update();
+
+    private:
+        LibsshQtClient     *client_;
+        LibsshQtProcess    *process_;
+        bool                eof_sent_;
+        QElapsedTimer       timer_;
+        LibsshQtResult      result_;
+    };
+
+    inline ConnectAwaitable connectToHost(LibsshQtClient *client)
+    {
+        return ConnectAwaitable(client);
+    }
+
+    inline StartedAwaitable started(LibsshQtProcess *process)
+    {
+        return StartedAwaitable(process);
+    }
+
+    inline ReadLineAwaitable readLine(LibsshQtProcess *process)
+    {
+        return ReadLineAwaitable(process);
+    }
+
+    inline WriteAwaitable write(LibsshQtProcess *process,
+                                const QByteArray &data)
+    {
+        return WriteAwaitable(process, data);
+    }
+
+    inline ExecAwaitable exec(LibsshQtClient *client, QString command)
+    {
+        return ExecAwaitable(client, command);
+    }
+}
+
+#endif // __cpp_impl_coroutine
+
+#endif // LIBSSHQTCORO_H
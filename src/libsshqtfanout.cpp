@@ -0,0 +1,353 @@
+
+#include <QDebug>
+
+#include "libsshqtfanout.h"
+#include "libsshqtprocess.h"
+#include "libsshqtdebug.h"
+
+LibsshQtFanout::HostResult::HostResult() :
+    finished(false),
+    exitCode(-1),
+    connectTime(-1),
+    totalTime(-1)
+{
+}
+
+LibsshQtFanout::LibsshQtFanout(QObject *parent) :
+    QObject(parent),
+    debug_prefix_(LibsshQt::debugPrefix(this)),
+    debug_output_(false),
+    max_concurrent_(16),
+    password_set_(false),
+    jump_client_(0),
+    running_(false),
+    running_count_(0),
+    next_host_(0),
+    finished_count_(0)
+{
+}
+
+LibsshQtFanout::~LibsshQtFanout()
+{
+    abort();
+}
+
+void LibsshQtFanout::setHosts(const QList<QUrl> &hosts)
+{
+    Q_ASSERT( ! running_ );
+    hosts_ = hosts;
+}
+
+void LibsshQtFanout::setCommand(QString command)
+{
+    Q_ASSERT( ! running_ );
+    command_ = command;
+}
+
+/*!
+    Set the maximum number of hosts that are connected at the same time.
+*/
+void LibsshQtFanout::setMaxConcurrent(int max_concurrent)
+{
+    Q_ASSERT( max_concurrent > 0 );
+    max_concurrent_ = qMax(1, max_concurrent);
+
+    if ( running_ ) {
+        startNext();
+    }
+}
+
+/*!
+    Set password for password authentication, the same password is used
+    for all hosts.
+*/
+void LibsshQtFanout::setPassword(QString password)
+{
+    password_set_ = true;
+    password_ = password;
+}
+
+/*!
+    Connect all hosts through jump_client, see
+    LibsshQtClient::setJumpClient().
+*/
+void LibsshQtFanout::setJumpClient(LibsshQtClient *jump_client)
+{
+    jump_client_ = jump_client;
+}
+
+void LibsshQtFanout::setDebug(bool enabled)
+{
+    debug_output_ = enabled;
+}
+
+QList<QUrl> LibsshQtFanout::hosts() const
+{
+    return hosts_;
+}
+
+QString LibsshQtFanout::command() const
+{
+    return command_;
+}
+
+int LibsshQtFanout::maxConcurrent() const
+{
+    return max_concurrent_;
+}
+
+bool LibsshQtFanout::isRunning() const
+{
+    return running_;
+}
+
+/*!
+    Get the number of hosts currently connected.
+*/
+int LibsshQtFanout::runningCount() const
+{
+    return running_count_;
+}
+
+int LibsshQtFanout::finishedCount() const
+{
+    return finished_count_;
+}
+
+/*!
+    Get the result of a host, the result is complete once hostFinished() or
+    hostError() has been emitted for the host.
+*/
+LibsshQtFanout::HostResult LibsshQtFanout::result(int host) const
+{
+    return results_.value(host);
+}
+
+/*!
+    Start running the command on all hosts.
+*/
+void LibsshQtFanout::start()
+{
+    if ( running_ ) {
+        LIBSSHQT_CRITICAL("Cannot start because fanout is already running");
+        return;
+    }
+
+    LIBSSHQT_DEBUG("Running" << command_ << "on" << hosts_.count() <<
+                   "hosts," << max_concurrent_ << "at a time");
+
+    running_        = true;
+    next_host_      = 0;
+    finished_count_ = 0;
+
+    results_.clear();
+    foreach ( QUrl url, hosts_ ) {
+        HostResult result;
+        result.url = url;
+        results_ << result;
+    }
+
+    startNext();
+}
+
+/*!
+    Disconnect all running hosts, hosts that have not been started are not
+    started. No further signals are emitted.
+*/
+void LibsshQtFanout::abort()
+{
+    // Every job is in jobs_ once for each of its objects
+    QSet<Job *> jobs;
+    foreach ( Job *job, jobs_ ) {
+        jobs.insert(job);
+    }
+
+    foreach ( Job *job, jobs ) {
+        job->client->disconnect(this);
+        job->process->disconnect(this);
+        job->process->stderr()->disconnect(this);
+        job->client->deleteLater();
+        delete job;
+    }
+
+    jobs_.clear();
+    running_count_ = 0;
+    running_ = false;
+}
+
+void LibsshQtFanout::startNext()
+{
+    while ( running_ &&
+            runningCount() < max_concurrent_ &&
+            next_host_ < hosts_.count() ) {
+        startHost(next_host_++);
+    }
+
+    if ( running_ &&
+         finished_count_ == hosts_.count() ) {
+        LIBSSHQT_DEBUG("All hosts finished");
+        running_ = false;
+        emit allFinished();
+    }
+}
+
+void LibsshQtFanout::startHost(int host)
+{
+    LIBSSHQT_DEBUG("Starting host" << host << hosts_.at(host));
+
+    Job *job = new Job;
+    job->host = host;
+    job->timer.start();
+
+    job->client = new LibsshQtClient(this);
+    job->client->setDebug(debug_output_);
+    job->client->setUrl(hosts_.at(host));
+    if ( jump_client_ ) {
+        job->client->setJumpClient(jump_client_);
+    }
+    job->client->useDefaultAuths();
+    if ( password_set_ ) {
+        job->client->setPassword(password_);
+    }
+
+    job->process = job->client->runCommand(command_);
+    job->process->setStdoutBehaviour(LibsshQtProcess::OutputManual);
+    job->process->setStderrBehaviour(LibsshQtProcess::OutputManual);
+
+    running_count_++;
+    jobs_.insert(job->client, job);
+    jobs_.insert(job->process, job);
+    jobs_.insert(job->process->stderr(), job);
+
+    connect(job->client, SIGNAL(opened()),
+            this,        SLOT(handleClientOpened()));
+    connect(job->client, SIGNAL(unknownHost()),
+            this,        SLOT(handleClientFailed()));
+    connect(job->client, SIGNAL(needPassword()),
+            this,        SLOT(handleClientFailed()));
+    connect(job->client, SIGNAL(needKbiAnswers()),
+            this,        SLOT(handleClientFailed()));
+    connect(job->client, SIGNAL(allAuthsFailed()),
+            this,        SLOT(handleClientFailed()));
+    connect(job->client, SIGNAL(error()),
+            this,        SLOT(handleClientFailed()));
+
+    connect(job->process, SIGNAL(readyRead()),
+            this,         SLOT(handleStdout()));
+    connect(job->process->stderr(), SIGNAL(readyRead()),
+            this,                   SLOT(handleStderr()));
+    connect(job->process, SIGNAL(finished(int)),
+            this,         SLOT(handleProcessFinished(int)));
+    connect(job->process, SIGNAL(error()),
+            this,         SLOT(handleProcessError()));
+
+    job->client->connectToHost();
+    emit hostStarted(host);
+}
+
+void LibsshQtFanout::finishJob(Job *job, int exit_code, QString error_message)
+{
+    HostResult &result  = results_[job->host];
+    result.finished     = true;
+    result.exitCode     = exit_code;
+    result.errorMessage = error_message;
+    result.totalTime    = job->timer.elapsed();
+
+    LIBSSHQT_DEBUG("Host" << job->host << "finished in" << result.totalTime <<
+                   "ms, exit code:" << exit_code << error_message);
+
+    // The job may be finished from inside client or process signal handlers,
+    // so the client is deleted later.
+    job->client->disconnect(this);
+    job->process->disconnect(this);
+    job->process->stderr()->disconnect(this);
+    job->client->deleteLater();
+
+    jobs_.remove(job->client);
+    jobs_.remove(job->process);
+    jobs_.remove(job->process->stderr());
+
+    int host = job->host;
+    delete job;
+
+    running_count_--;
+    finished_count_++;
+    if ( error_message.isEmpty()) {
+        emit hostFinished(host, exit_code);
+    } else {
+        emit hostError(host, error_message);
+    }
+
+    startNext();
+}
+
+LibsshQtFanout::Job *LibsshQtFanout::jobForSender()
+{
+    Job *job = jobs_.value(sender());
+    Q_ASSERT( job );
+    return job;
+}
+
+void LibsshQtFanout::handleClientOpened()
+{
+    Job *job = jobForSender();
+    results_[job->host].connectTime = job->timer.elapsed();
+}
+
+void LibsshQtFanout::handleClientFailed()
+{
+    Job *job = jobForSender();
+    LibsshQtClient *client = job->client;
+
+    QString message;
+    switch ( client->state()) {
+    case LibsshQtClient::StateUnknownHost:
+        message = client->unknownHostMessage();
+        break;
+
+    case LibsshQtClient::StateAuthNeedPassword:
+    case LibsshQtClient::StateAuthKbiQuestions:
+    case LibsshQtClient::StateAuthAllFailed:
+        message = tr("Authentication failed");
+        break;
+
+    default:
+        message = client->errorCodeAndMessage();
+        break;
+    }
+
+    finishJob(job, -1, message);
+}
+
+void LibsshQtFanout::handleStdout()
+{
+    Job *job = jobForSender();
+    QByteArray data = job->process->readAll();
+    if ( ! data.isEmpty()) {
+        emit hostStdout(job->host, data);
+    }
+}
+
+void LibsshQtFanout::handleStderr()
+{
+    Job *job = jobForSender();
+    QByteArray data = job->process->stderr()->readAll();
+    if ( ! data.isEmpty()) {
+        emit hostStderr(job->host, data);
+    }
+}
+
+void LibsshQtFanout::handleProcessFinished(int exit_code)
+{
+    finishJob(jobForSender(), exit_code, QString());
+}
+
+void LibsshQtFanout::handleProcessError()
+{
+    Job *job = jobForSender();
+
+    // Client errors are handled in handleClientFailed()
+    if ( ! job->process->isClientError()) {
+        finishJob(job, -1, job->process->errorCodeAndMessage());
+    }
+}
@@ -0,0 +1,124 @@
+#ifndef LIBSSHQTFANOUT_H
+#define LIBSSHQTFANOUT_H
+
+#include <QObject>
+#include <QList>
+#include <QHash>
+#include <QSet>
+#include <QUrl>
+#include <QElapsedTimer>
+
+#include "libsshqtclient.h"
+
+class LibsshQtProcess;
+
+/*!
+
+    LibsshQtFanout - Run one command on many hosts
+
+    LibsshQtFanout connects to every host in the host list and runs the same
+    command on each of them. At most maxConcurrent() hosts are connected at the
+    same time, a new host is started whenever a previous one finishes.
+
+    Output is streamed as it arrives with hostStdout() and hostStderr()
+    signals, hosts are identified by their index in the host list. Once a host
+    has finished either hostFinished() or hostError() is emitted and the exit
+    code and timings of the host are available from result(). allFinished() is
+    emitted when every host has been handled.
+
+    Hosts are never asked questions, if a host is unknown or needs a password
+    that has not been set with setPassword(), the host fails with hostError().
+
+*/
+class LibsshQtFanout : public QObject
+{
+    Q_OBJECT
+
+public:
+    class HostResult
+    {
+    public:
+        HostResult();
+
+        QUrl    url;
+        bool    finished;
+        int     exitCode;       //!< -1 if the command was not run
+        QString errorMessage;   //!< Empty if the command was run
+        qint64  connectTime;    //!< Milliseconds from start to open client
+        qint64  totalTime;      //!< Milliseconds from start to finish
+    };
+
+    explicit LibsshQtFanout(QObject *parent = 0);
+    ~LibsshQtFanout();
+
+    void setHosts(const QList<QUrl> &hosts);
+    void setCommand(QString command);
+    void setMaxConcurrent(int max_concurrent);
+    void setPassword(QString password);
+    void setJumpClient(LibsshQtClient *jump_client);
+    void setDebug(bool enabled);
+
+    QList<QUrl> hosts() const;
+    QString command() const;
+    int maxConcurrent() const;
+
+    bool isRunning() const;
+    int runningCount() const;
+    int finishedCount() const;
+    HostResult result(int host) const;
+
+public slots:
+    void start();
+    void abort();
+
+signals:
+    void hostStarted(int host);
+    void hostStdout(int host, QByteArray data);
+    void hostStderr(int host, QByteArray data);
+    void hostFinished(int host, int exit_code);
+    void hostError(int host, QString message);
+    void allFinished();
+
+private:
+    class Job
+    {
+    public:
+        int              host;
+        LibsshQtClient  *client;
+        LibsshQtProcess *process;
+        QElapsedTimer    timer;
+    };
+
+    void startNext();
+    void startHost(int host);
+    void finishJob(Job *job, int exit_code, QString error_message);
+    Job *jobForSender();
+
+private slots:
+    void handleClientOpened();
+    void handleClientFailed();
+    void handleStdout();
+    void handleStderr();
+    void handleProcessFinished(int exit_code);
+    void handleProcessError();
+
+private:
+    QString                     debug_prefix_;
+    bool                        debug_output_;
+
+    QList<QUrl>                 hosts_;
+    QString                     command_;
+    int                         max_concurrent_;
+    bool                        password_set_;
+    QString                     password_;
+    LibsshQtClient             *jump_client_;
+
+    bool                        running_;
+    int                         running_count_;
+    int                         next_host_;
+    int                         finished_count_;
+    QList<HostResult>           results_;
+    QHash<QObject *, Job *>     jobs_;
+};
+
+#endif // LIBSSHQTFANOUT_H
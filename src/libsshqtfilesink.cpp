@@ -0,0 +1,347 @@
+
+#include <QDebug>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "libsshqtfilesink.h"
+#include "libsshqtprocess.h"
+#include "libsshqtclient.h"
+#include "libsshqtdebug.h"
+
+// O_DIRECT needs buffers, offsets and lengths aligned to the logical block
+// size of the device, page size covers all common devices
+static const int direct_io_alignment = 4096;
+
+LibsshQtFileSink::LibsshQtFileSink(QObject *parent) :
+    QObject(parent),
+    debug_prefix_(LibsshQt::debugPrefix(this)),
+    debug_output_(false),
+    fd_(-1),
+    direct_io_(false),
+    batch_size_(1024 * 1024),
+    buffer_(0),
+    buffered_(0),
+    written_(0)
+{
+}
+
+LibsshQtFileSink::~LibsshQtFileSink()
+{
+    close();
+    free(buffer_);
+}
+
+/*!
+    Open file for writing, the file is created if it does not exist.
+
+    DirectIo is ignored together with Append, because appended data would
+    not start at an aligned offset.
+*/
+bool LibsshQtFileSink::open(QString file_name, OpenFlags flags)
+{
+    close();
+
+    file_name_    = file_name;
+    written_      = 0;
+    buffered_     = 0;
+    error_string_.clear();
+
+    int mode = O_WRONLY | O_CREAT;
+    mode |= flags & Append ? O_APPEND : O_TRUNC;
+
+    QByteArray path = file_name.toLocal8Bit();
+    direct_io_ = false;
+
+#ifdef O_DIRECT
+    if ( flags & DirectIo && ! ( flags & Append )) {
+        fd_ = ::open(path.constData(), mode | O_DIRECT, 0644);
+        if ( fd_ >= 0 ) {
+            direct_io_ = true;
+        } else if ( errno == EINVAL ) {
+            LIBSSHQT_DEBUG("File system does not support O_DIRECT");
+        }
+    }
+#endif
+
+    if ( fd_ < 0 ) {
+        fd_ = ::open(path.constData(), mode, 0644);
+    }
+
+    if ( fd_ < 0 ) {
+        setError(tr("Could not open %1: %2")
+                 .arg(file_name, QString::fromLocal8Bit(strerror(errno))));
+        return false;
+    }
+
+    LIBSSHQT_DEBUG("Opened" << file_name << "direct I/O:" << direct_io_);
+    allocateBuffer();
+    return true;
+}
+
+bool LibsshQtFileSink::isOpen() const
+{
+    return fd_ >= 0;
+}
+
+bool LibsshQtFileSink::isDirectIo() const
+{
+    return direct_io_;
+}
+
+QString LibsshQtFileSink::fileName() const
+{
+    return file_name_;
+}
+
+/*!
+    Set the size of one write, the default is 1 MiB. The size is rounded up
+    to a multiple of 4096 bytes.
+*/
+void LibsshQtFileSink::setBatchSize(int bytes)
+{
+    Q_ASSERT( bytes > 0 );
+    bytes = qMax(bytes, direct_io_alignment);
+    bytes = ( bytes + direct_io_alignment - 1 ) & ~( direct_io_alignment - 1 );
+
+    if ( bytes == batch_size_ ) return;
+
+    // With direct I/O an unaligned tail stays staged, it is smaller than
+    // any batch size and is moved to the new buffer
+    flush();
+    char *old_buffer = buffer_;
+    batch_size_ = bytes;
+    buffer_ = 0;
+    if ( isOpen()) {
+        allocateBuffer();
+        if ( buffered_ > 0 ) {
+            memcpy(buffer_, old_buffer, buffered_);
+        }
+    }
+    free(old_buffer);
+}
+
+int LibsshQtFileSink::batchSize() const
+{
+    return batch_size_;
+}
+
+/*!
+    Reserve disk space for bytes of output, so that the file system can
+    allocate the file in one extent. The size of the file is not changed.
+    Only supported on Linux.
+*/
+bool LibsshQtFileSink::preallocate(qint64 bytes)
+{
+    if ( ! isOpen()) return false;
+
+#ifdef FALLOC_FL_KEEP_SIZE
+    if ( fallocate(fd_, FALLOC_FL_KEEP_SIZE, 0, bytes) == 0 ) {
+        LIBSSHQT_DEBUG("Preallocated" << bytes << "bytes");
+        return true;
+    }
+    LIBSSHQT_DEBUG("Could not preallocate:" << strerror(errno));
+#else
+    Q_UNUSED(bytes);
+#endif
+
+    return false;
+}
+
+/*!
+    Write stdout of process to the sink, and finish the sink when the
+    process is closed.
+*/
+void LibsshQtFileSink::attach(LibsshQtProcess *process)
+{
+    followDebug(process);
+    process->setStdoutSink(writeCallback, this);
+    connect(process, SIGNAL(closed()), this, SLOT(finish()));
+    connect(process, SIGNAL(error()),  this, SLOT(finish()));
+}
+
+/*!
+    Write stderr of process to the sink.
+*/
+void LibsshQtFileSink::attachStderr(LibsshQtProcess *process)
+{
+    followDebug(process);
+    process->setStderrSink(writeCallback, this);
+    connect(process, SIGNAL(closed()), this, SLOT(finish()));
+    connect(process, SIGNAL(error()),  this, SLOT(finish()));
+}
+
+/*!
+    Print debug output when the client of process has debug output enabled.
+*/
+void LibsshQtFileSink::followDebug(LibsshQtProcess *process)
+{
+    debug_output_ = process->client()->isDebugEnabled();
+    connect(process->client(), SIGNAL(debugChanged()),
+            this,              SLOT(handleDebugChanged()),
+            Qt::UniqueConnection);
+}
+
+void LibsshQtFileSink::handleDebugChanged()
+{
+    LibsshQtClient *client = qobject_cast<LibsshQtClient *>(sender());
+    if ( client ) {
+        debug_output_ = client->isDebugEnabled();
+    }
+}
+
+/*!
+    Get the number of bytes written to the file, not counting data in the
+    staging buffer.
+*/
+qint64 LibsshQtFileSink::bytesWritten() const
+{
+    return written_;
+}
+
+bool LibsshQtFileSink::hasError() const
+{
+    return ! error_string_.isEmpty();
+}
+
+QString LibsshQtFileSink::errorString() const
+{
+    return error_string_;
+}
+
+/*!
+    LibsshQtProcess::OutputCallback which writes data to the sink given as
+    user_data.
+*/
+void LibsshQtFileSink::writeCallback(const char *data, int len,
+                                     void *user_data)
+{
+    static_cast<LibsshQtFileSink *>(user_data)->append(data, len);
+}
+
+/*!
+    Write the staging buffer to the file. With direct I/O the last partial
+    block stays in the buffer, so more output can still be written with
+    O_DIRECT.
+*/
+bool LibsshQtFileSink::flush()
+{
+    if ( ! isOpen() || buffered_ == 0 ) return ! hasError();
+    return writeBatch(false);
+}
+
+/*!
+    Write all data in the staging buffer to the file, including the last
+    partial block. Call only at the end of the output, direct I/O is turned
+    off for the rest of the file.
+*/
+bool LibsshQtFileSink::finish()
+{
+    if ( ! isOpen() || buffered_ == 0 ) return ! hasError();
+    return writeBatch(true);
+}
+
+void LibsshQtFileSink::close()
+{
+    if ( ! isOpen()) return;
+
+    finish();
+    ::close(fd_);
+    fd_ = -1;
+    direct_io_ = false;
+
+    LIBSSHQT_DEBUG("Closed" << file_name_ << "after" << written_ << "bytes");
+}
+
+void LibsshQtFileSink::append(const char *data, int len)
+{
+    if ( ! isOpen() || hasError()) return;
+
+    while ( len > 0 ) {
+        int copy = qMin(len, batch_size_ - buffered_);
+        memcpy(buffer_ + buffered_, data, copy);
+        buffered_ += copy;
+        data      += copy;
+        len       -= copy;
+
+        if ( buffered_ == batch_size_ && ! writeBatch(false)) {
+            return;
+        }
+    }
+}
+
+bool LibsshQtFileSink::writeAll(const char *data, int len)
+{
+    while ( len > 0 ) {
+        ssize_t rc = ::write(fd_, data, len);
+        if ( rc < 0 ) {
+            if ( errno == EINTR ) continue;
+            setError(tr("Could not write to %1: %2")
+                     .arg(file_name_,
+                          QString::fromLocal8Bit(strerror(errno))));
+            return false;
+        }
+        data     += rc;
+        len      -= rc;
+        written_ += rc;
+    }
+    return true;
+}
+
+/*!
+    Write the staging buffer to the file. With direct I/O only whole blocks
+    are written, unless final is true, the rest is kept in the buffer.
+*/
+bool LibsshQtFileSink::writeBatch(bool final)
+{
+    int len = buffered_;
+    if ( direct_io_ ) {
+        len &= ~( direct_io_alignment - 1 );
+    }
+
+    if ( len > 0 && ! writeAll(buffer_, len)) {
+        buffered_ = 0;
+        return false;
+    }
+
+    buffered_ -= len;
+    if ( buffered_ > 0 ) {
+        memmove(buffer_, buffer_ + len, buffered_);
+    }
+
+#ifdef O_DIRECT
+    // The unaligned end of the output must be written without O_DIRECT
+    if ( final && direct_io_ && buffered_ > 0 ) {
+        int flags = fcntl(fd_, F_GETFL);
+        fcntl(fd_, F_SETFL, flags & ~O_DIRECT);
+        direct_io_ = false;
+
+        bool ok = writeAll(buffer_, buffered_);
+        buffered_ = 0;
+        return ok;
+    }
+#endif
+
+    return true;
+}
+
+void LibsshQtFileSink::allocateBuffer()
+{
+    if ( buffer_ ) return;
+
+    void *ptr = 0;
+    if ( posix_memalign(&ptr, direct_io_alignment, batch_size_) != 0 ) {
+        LIBSSHQT_FATAL("Could not allocate staging buffer");
+    }
+    buffer_ = static_cast<char *>(ptr);
+}
+
+void LibsshQtFileSink::setError(QString message)
+{
+    LIBSSHQT_CRITICAL(qPrintable(message));
+    error_string_ = message;
+    emit error();
+}
@@ -0,0 +1,104 @@
+#ifndef LIBSSHQTFILESINK_H
+#define LIBSSHQTFILESINK_H
+
+#include <QObject>
+#include <QString>
+
+class LibsshQtProcess;
+
+/*!
+
+    LibsshQtFileSink - Write process output to a local file in large batches
+
+    LibsshQtFileSink is attached to a process as a raw output callback, so
+    the data is passed to it straight from the read buffer of the channel,
+    without creating a QByteArray for every read. Reads are much smaller
+    than a batch, so the data is copied once, to a staging buffer of
+    batchSize() bytes, which is written to the file with one write() call
+    per batch. Compared to setStdoutSink() with a file descriptor, which
+    writes every read as it arrives, the sink makes far fewer system calls
+    and can bypass the page cache.
+
+    With DirectIo the file is opened with O_DIRECT and written from a page
+    aligned staging buffer in multiples of the block size, which keeps the
+    output out of the page cache. The last partial block is written without
+    O_DIRECT. If the file system does not support O_DIRECT, the file is
+    opened normally.
+
+    flush() can be called at any time, with DirectIo it writes only whole
+    blocks. finish() writes the last partial block, and is called when the
+    process is closed and by close(). Writing is blocking, which is not a
+    problem for local files.
+
+*/
+class LibsshQtFileSink : public QObject
+{
+    Q_OBJECT
+
+public:
+    Q_FLAGS(OpenFlag)
+    enum OpenFlag
+    {
+        NoFlags     = 0,
+        DirectIo    = 1<<0,     //!< Bypass page cache with O_DIRECT
+        Append      = 1<<1      //!< Append instead of truncating
+    };
+    Q_DECLARE_FLAGS(OpenFlags, OpenFlag)
+
+    explicit LibsshQtFileSink(QObject *parent = 0);
+    ~LibsshQtFileSink();
+
+    bool open(QString file_name, OpenFlags flags = NoFlags);
+    bool isOpen() const;
+    bool isDirectIo() const;
+    QString fileName() const;
+
+    void setBatchSize(int bytes);
+    int batchSize() const;
+    bool preallocate(qint64 bytes);
+
+    void attach(LibsshQtProcess *process);
+    void attachStderr(LibsshQtProcess *process);
+
+    qint64 bytesWritten() const;
+    bool hasError() const;
+    QString errorString() const;
+
+    static void writeCallback(const char *data, int len, void *user_data);
+
+public slots:
+    bool flush();
+    bool finish();
+    void close();
+
+signals:
+    void error();
+
+private:
+    void followDebug(LibsshQtProcess *process);
+    void append(const char *data, int len);
+    bool writeAll(const char *data, int len);
+    bool writeBatch(bool final);
+    void allocateBuffer();
+    void setError(QString message);
+
+private slots:
+    void handleDebugChanged();
+
+private:
+    QString     debug_prefix_;
+    bool        debug_output_;
+
+    QString     file_name_;
+    int         fd_;
+    bool        direct_io_;
+    int         batch_size_;
+    char       *buffer_;
+    int         buffered_;
+    qint64      written_;
+    QString     error_string_;
+};
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(LibsshQtFileSink::OpenFlags)
+
+#endif // LIBSSHQTFILESINK_H
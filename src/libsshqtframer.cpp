@@ -0,0 +1,264 @@
+
+#include <QtEndian>
+
+#include "libsshqtframer.h"
+
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// LibsshQtFramer
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+LibsshQtFramer::~LibsshQtFramer()
+{
+}
+
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// LibsshQtDelimiterFramer
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+LibsshQtDelimiterFramer::LibsshQtDelimiterFramer(const QByteArray &delimiter) :
+    delimiter_(delimiter),
+    scan_pos_(0)
+{
+    Q_ASSERT( ! delimiter.isEmpty());
+}
+
+/*!
+    Get the NETCONF 1.0 end of message delimiter.
+*/
+QByteArray LibsshQtDelimiterFramer::netconfDelimiter()
+{
+    return QByteArray("]]>]]>");
+}
+
+QByteArray LibsshQtDelimiterFramer::delimiter() const
+{
+    return delimiter_;
+}
+
+bool LibsshQtDelimiterFramer::parse(const char        *data,
+                                    int                len,
+                                    QList<QByteArray> &messages)
+{
+    pending_.append(data, len);
+
+    int start = 0;
+    forever {
+        int pos = pending_.indexOf(delimiter_, scan_pos_);
+        if ( pos < 0 ) {
+            // The delimiter may start in the last bytes of the buffer
+            scan_pos_ = qMax(start, pending_.size() - delimiter_.size() + 1);
+            break;
+        }
+
+        messages << pending_.mid(start, pos - start);
+        start = pos + delimiter_.size();
+        scan_pos_ = start;
+    }
+
+    if ( start > 0 ) {
+        pending_.remove(0, start);
+        scan_pos_ -= start;
+    }
+
+    return true;
+}
+
+QByteArray LibsshQtDelimiterFramer::frame(const QByteArray &message) const
+{
+    return message + delimiter_;
+}
+
+void LibsshQtDelimiterFramer::reset()
+{
+    pending_.clear();
+    scan_pos_ = 0;
+}
+
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// LibsshQtChunkedFramer
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+LibsshQtChunkedFramer::LibsshQtChunkedFramer() :
+    state_(StateChunkLf),
+    chunk_size_(0)
+{
+}
+
+bool LibsshQtChunkedFramer::parse(const char        *data,
+                                  int                len,
+                                  QList<QByteArray> &messages)
+{
+    // Largest chunk size allowed by RFC 6242
+    const quint64 max_chunk_size = Q_UINT64_C(4294967295);
+
+    int pos = 0;
+    while ( pos < len ) {
+        char c = data[pos];
+
+        switch ( state_ ) {
+        case StateChunkLf:
+            if ( c != '\n' ) return false;
+            state_ = StateChunkHash;
+            pos++;
+            break;
+
+        case StateChunkHash:
+            if ( c != '#' ) return false;
+            state_ = StateSizeStart;
+            pos++;
+            break;
+
+        case StateSizeStart:
+            if ( c == '#' ) {
+                // Messages must contain at least one chunk
+                if ( message_.isEmpty()) return false;
+                state_ = StateEndLf;
+            } else if ( c >= '1' && c <= '9' ) {
+                chunk_size_ = c - '0';
+                state_ = StateSize;
+            } else {
+                return false;
+            }
+            pos++;
+            break;
+
+        case StateSize:
+            if ( c == '\n' ) {
+                state_ = StateData;
+            } else if ( c >= '0' && c <= '9' ) {
+                chunk_size_ = chunk_size_ * 10 + ( c - '0' );
+                if ( chunk_size_ > max_chunk_size ) return false;
+            } else {
+                return false;
+            }
+            pos++;
+            break;
+
+        case StateData:
+        {
+            int copy_len = int(qMin(chunk_size_, quint64(len - pos)));
+            message_.append(data + pos, copy_len);
+            chunk_size_ -= copy_len;
+            pos += copy_len;
+            if ( chunk_size_ == 0 ) {
+                state_ = StateChunkLf;
+            }
+        } break;
+
+        case StateEndLf:
+            if ( c != '\n' ) return false;
+            messages << message_;
+            message_.clear();
+            state_ = StateChunkLf;
+            pos++;
+            break;
+        }
+    }
+
+    return true;
+}
+
+QByteArray LibsshQtChunkedFramer::frame(const QByteArray &message) const
+{
+    // Chunked framing cannot represent an empty message
+    if ( message.isEmpty()) {
+        return QByteArray();
+    }
+
+    QByteArray framed;
+    framed.reserve(message.size() + 24);
+    framed.append("\n#");
+    framed.append(QByteArray::number(message.size()));
+    framed.append('\n');
+    framed.append(message);
+    framed.append("\n##\n");
+    return framed;
+}
+
+void LibsshQtChunkedFramer::reset()
+{
+    state_ = StateChunkLf;
+    chunk_size_ = 0;
+    message_.clear();
+}
+
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// LibsshQtLengthFramer
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+LibsshQtLengthFramer::LibsshQtLengthFramer(quint32 max_length) :
+    max_length_(max_length),
+    header_size_(0),
+    message_length_(0)
+{
+}
+
+quint32 LibsshQtLengthFramer::maxLength() const
+{
+    return max_length_;
+}
+
+bool LibsshQtLengthFramer::parse(const char        *data,
+                                 int                len,
+                                 QList<QByteArray> &messages)
+{
+    int pos = 0;
+    while ( pos < len ) {
+
+        if ( header_size_ < 4 ) {
+            header_[header_size_++] = data[pos++];
+            if ( header_size_ < 4 ) continue;
+
+            message_length_ = qFromBigEndian<quint32>(header_);
+            if ( message_length_ > max_length_ ) return false;
+
+            if ( message_length_ == 0 ) {
+                messages << QByteArray();
+                header_size_ = 0;
+            } else {
+                message_.reserve(message_length_);
+            }
+            continue;
+        }
+
+        int copy_len = int(qMin(quint32(message_length_ - message_.size()),
+                                quint32(len - pos)));
+        message_.append(data + pos, copy_len);
+        pos += copy_len;
+
+        if ( quint32(message_.size()) == message_length_ ) {
+            messages << message_;
+            message_.clear();
+            header_size_ = 0;
+        }
+    }
+
+    return true;
+}
+
+QByteArray LibsshQtLengthFramer::frame(const QByteArray &message) const
+{
+    uchar len[4];
+    qToBigEndian<quint32>(message.size(), len);
+
+    QByteArray framed;
+    framed.reserve(message.size() + 4);
+    framed.append(reinterpret_cast<const char *>(len), 4);
+    framed.append(message);
+    return framed;
+}
+
+void LibsshQtLengthFramer::reset()
+{
+    header_size_ = 0;
+    message_length_ = 0;
+    message_.clear();
+}
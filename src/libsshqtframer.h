@@ -0,0 +1,135 @@
+#ifndef LIBSSHQTFRAMER_H
+#define LIBSSHQTFRAMER_H
+
+#include <QByteArray>
+#include <QList>
+
+/*!
+
+    LibsshQtFramer - Message framing for LibsshQtSubsystem
+
+    A framer splits the byte stream received from a channel into messages and
+    adds framing to outgoing messages. Data is given to parse() as it arrives,
+    in pieces of any size, and the framer keeps incomplete messages until the
+    rest of them has been received.
+
+    Subclass LibsshQtFramer to implement framing for custom subsystems.
+
+*/
+class LibsshQtFramer
+{
+public:
+    virtual ~LibsshQtFramer();
+
+    /*!
+        Parse len bytes of data, complete messages are appended to messages.
+        Returns false if the data violates the framing, the channel should
+        be closed in that case.
+    */
+    virtual bool parse(const char *data, int len,
+                       QList<QByteArray> &messages) = 0;
+
+    /*!
+        Return message with framing added, or an empty array if the framing
+        cannot represent the message.
+    */
+    virtual QByteArray frame(const QByteArray &message) const = 0;
+
+    /*!
+        Discard any partially received message.
+    */
+    virtual void reset() = 0;
+};
+
+/*!
+
+    LibsshQtDelimiterFramer - Messages end with a delimiter
+
+    Used for example by NETCONF 1.0, which ends messages with ]]>]]>. Data is
+    only scanned once, even if a message arrives in many pieces.
+
+*/
+class LibsshQtDelimiterFramer : public LibsshQtFramer
+{
+public:
+    explicit LibsshQtDelimiterFramer(const QByteArray &delimiter);
+
+    static QByteArray netconfDelimiter();
+
+    QByteArray delimiter() const;
+
+    bool parse(const char *data, int len, QList<QByteArray> &messages);
+    QByteArray frame(const QByteArray &message) const;
+    void reset();
+
+private:
+    QByteArray  delimiter_;
+    QByteArray  pending_;
+    int         scan_pos_;
+};
+
+/*!
+
+    LibsshQtChunkedFramer - NETCONF 1.1 chunked framing (RFC 6242)
+
+    Messages are sent as one or more chunks, each prefixed with LF # size LF,
+    and ended with LF ## LF. The framer is a byte level state machine, chunk
+    data is copied directly to the message being built. Empty messages
+    cannot be framed.
+
+*/
+class LibsshQtChunkedFramer : public LibsshQtFramer
+{
+public:
+    LibsshQtChunkedFramer();
+
+    bool parse(const char *data, int len, QList<QByteArray> &messages);
+    QByteArray frame(const QByteArray &message) const;
+    void reset();
+
+private:
+    enum State
+    {
+        StateChunkLf,       //!< Expecting LF before # of a chunk
+        StateChunkHash,     //!< Expecting # of a chunk
+        StateSizeStart,     //!< Expecting first digit of size or second #
+        StateSize,          //!< Reading chunk size digits
+        StateData,          //!< Reading chunk data
+        StateEndLf          //!< Expecting LF after ##
+    };
+
+    State       state_;
+    quint64     chunk_size_;
+    QByteArray  message_;
+};
+
+/*!
+
+    LibsshQtLengthFramer - Messages prefixed with a 32-bit length
+
+    Each message is preceded by its length as a 32-bit big-endian integer,
+    which is the framing used by SFTP. Messages longer than maxLength() are
+    treated as a framing violation, so that a corrupted length does not make
+    the framer buffer gigabytes of data.
+
+*/
+class LibsshQtLengthFramer : public LibsshQtFramer
+{
+public:
+    explicit LibsshQtLengthFramer(quint32 max_length = 16 * 1024 * 1024);
+
+    quint32 maxLength() const;
+
+    bool parse(const char *data, int len, QList<QByteArray> &messages);
+    QByteArray frame(const QByteArray &message) const;
+    void reset();
+
+private:
+    quint32     max_length_;
+    uchar       header_[4];
+    int         header_size_;       //!< Bytes of length received
+    quint32     message_length_;
+    QByteArray  message_;
+};
+
+#endif // LIBSSHQTFRAMER_H
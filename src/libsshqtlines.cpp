@@ -0,0 +1,77 @@
+
+#include "libsshqtlines.h"
+
+LibsshQtLines::LibsshQtLines() :
+    first_(0),
+    count_(0)
+{
+}
+
+/*!
+    Create a batch of count lines starting from line first.
+
+    ends contains the offset of the newline character, or the end of the data,
+    of every line in data.
+*/
+LibsshQtLines::LibsshQtLines(const QByteArray   &data,
+                             const QVector<int> &ends,
+                             int                 first,
+                             int                 count) :
+    data_(data),
+    ends_(ends),
+    first_(first),
+    count_(count)
+{
+    Q_ASSERT( first >= 0 && first + count <= ends.count());
+}
+
+int LibsshQtLines::count() const
+{
+    return count_;
+}
+
+bool LibsshQtLines::isEmpty() const
+{
+    return count_ == 0;
+}
+
+/*!
+    Get the offset of the line in data().
+*/
+int LibsshQtLines::lineOffset(int index) const
+{
+    Q_ASSERT( index >= 0 && index < count_ );
+
+    int pos = first_ + index;
+    return pos == 0 ? 0 : ends_.at(pos - 1) + 1;
+}
+
+int LibsshQtLines::lineLength(int index) const
+{
+    return ends_.at(first_ + index) - lineOffset(index);
+}
+
+/*!
+    Get a pointer to the line, the line is not null terminated.
+*/
+const char *LibsshQtLines::lineData(int index) const
+{
+    return data_.constData() + lineOffset(index);
+}
+
+/*!
+    Get the line as QByteArray. The data is not copied, so the returned
+    QByteArray is valid only as long as this LibsshQtLines object exists.
+*/
+QByteArray LibsshQtLines::line(int index) const
+{
+    return QByteArray::fromRawData(lineData(index), lineLength(index));
+}
+
+/*!
+    Get the buffer which contains the lines.
+*/
+QByteArray LibsshQtLines::data() const
+{
+    return data_;
+}
@@ -0,0 +1,48 @@
+#ifndef LIBSSHQTLINES_H
+#define LIBSSHQTLINES_H
+
+#include <QByteArray>
+#include <QVector>
+#include <QMetaType>
+
+/*!
+
+    LibsshQtLines - A batch of complete lines read from a channel
+
+    LibsshQtLines does not copy the line data. All lines in a batch, and all
+    batches emitted from the same read, refer to one implicitly shared buffer.
+    Lines are accessed by index, lineData() and lineLength() return a view to
+    the buffer and line() wraps the view in a QByteArray without copying.
+
+    Line lengths do not include the newline character.
+
+*/
+class LibsshQtLines
+{
+public:
+    LibsshQtLines();
+    LibsshQtLines(const QByteArray   &data,
+                  const QVector<int> &ends,
+                  int                 first,
+                  int                 count);
+
+    int count() const;
+    bool isEmpty() const;
+
+    int lineOffset(int index) const;
+    int lineLength(int index) const;
+    const char *lineData(int index) const;
+    QByteArray line(int index) const;
+
+    QByteArray data() const;
+
+private:
+    QByteArray      data_;
+    QVector<int>    ends_;
+    int             first_;
+    int             count_;
+};
+
+Q_DECLARE_METATYPE(LibsshQtLines)
+
+#endif // LIBSSHQTLINES_H
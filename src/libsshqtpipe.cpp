@@ -0,0 +1,206 @@
+
+#include <QDebug>
+
+#include "libsshqtpipe.h"
+#include "libsshqtprocess.h"
+#include "libsshqtclient.h"
+#include "libsshqtdebug.h"
+
+LibsshQtPipe::LibsshQtPipe(LibsshQtProcess *source,
+                           LibsshQtProcess *sink,
+                           QObject         *parent) :
+    QObject(parent),
+    debug_prefix_(LibsshQt::debugPrefix(this)),
+    debug_output_(false),
+    source_(source),
+    sink_(sink),
+    max_backlog_(1024 * 256),
+    transferred_(0),
+    finished_(false)
+{
+    Q_ASSERT( source && sink && source != sink );
+
+    handleDebugChanged();
+    connect(source->client(), SIGNAL(debugChanged()),
+            this,             SLOT(handleDebugChanged()));
+    connect(sink->client(),   SIGNAL(debugChanged()),
+            this,             SLOT(handleDebugChanged()));
+
+    source->setStdoutBehaviour(LibsshQtProcess::OutputManual);
+
+    connect(source, SIGNAL(readyRead()),
+            this,   SLOT(handleSourceReadyRead()));
+    connect(source, SIGNAL(finished(int)),
+            this,   SLOT(handleSourceFinished()));
+    connect(source, SIGNAL(closed()),
+            this,   SLOT(handleSourceClosed()));
+    connect(source, SIGNAL(error()),
+            this,   SLOT(handleSourceFailed()));
+
+    connect(sink,   SIGNAL(opened()),
+            this,   SLOT(handleSinkReady()));
+    connect(sink,   SIGNAL(bytesWritten(qint64)),
+            this,   SLOT(handleSinkReady()));
+    connect(sink,   SIGNAL(closed()),
+            this,   SLOT(handleSinkFailed()));
+    connect(sink,   SIGNAL(error()),
+            this,   SLOT(handleSinkFailed()));
+
+    transfer(false);
+}
+
+LibsshQtProcess *LibsshQtPipe::source() const
+{
+    return source_;
+}
+
+LibsshQtProcess *LibsshQtPipe::sink() const
+{
+    return sink_;
+}
+
+/*!
+    Set the number of bytes the sink may have waiting to be written before
+    the pipe stops taking data from the source. The default is 256 KiB.
+*/
+void LibsshQtPipe::setMaxBacklog(int bytes)
+{
+    Q_ASSERT( bytes > 0 );
+    max_backlog_ = qMax(1, bytes);
+    transfer(false);
+}
+
+int LibsshQtPipe::maxBacklog() const
+{
+    return max_backlog_;
+}
+
+qint64 LibsshQtPipe::bytesTransferred() const
+{
+    return transferred_;
+}
+
+bool LibsshQtPipe::isFinished() const
+{
+    return finished_;
+}
+
+/*!
+    Move the read buffer of the source to the write buffer of the sink.
+
+    If flush is true, the data is moved even if the sink backlog is full,
+    because the source is about to clear its buffers.
+*/
+void LibsshQtPipe::transfer(bool flush)
+{
+    if ( finished_ || ! source_ || ! sink_ ) return;
+
+    // Buffers are accessed through LibsshQtChannel, which LibsshQtPipe
+    // is a friend of
+    LibsshQtChannel *from = source_;
+    LibsshQtChannel *to   = sink_;
+
+    if ( from->read_buffer_.isEmpty()) return;
+    if ( to->eof_state_ != LibsshQtChannel::EofNotSent ) return;
+
+    if ( ! flush ) {
+        if ( sink_->state() != LibsshQtProcess::StateOpen ) return;
+        if ( to->write_buffer_.size() >= max_backlog_ ) return;
+    }
+
+    int len = from->read_buffer_.size();
+    if ( to->write_buffer_.isEmpty()) {
+        to->write_buffer_ = from->read_buffer_;
+    } else {
+        to->write_buffer_.append(from->read_buffer_);
+    }
+    from->read_buffer_ = QByteArray();
+    transferred_ += len;
+
+    LIBSSHQT_DEBUG("Moved" << len << "bytes, sink backlog" <<
+                   to->write_buffer_.size());
+
+    to->client()->enableWritableNotifier();
+    to->queueCheckIo();
+
+    // The source stops reading when its read buffer is full, continue now
+    // that the buffer is empty
+    if ( ! flush ) {
+        from->queueCheckIo();
+    }
+}
+
+void LibsshQtPipe::handleSourceReadyRead()
+{
+    transfer(false);
+}
+
+/*!
+    Output that arrived with the exit of the source stays in its read buffer
+    until finished() has been emitted, move it before queueing EOF.
+*/
+void LibsshQtPipe::handleSourceFinished()
+{
+    if ( finished_ || ! sink_ ) return;
+
+    transfer(true);
+    sink_->sendEof();
+    finished_ = true;
+
+    LIBSSHQT_DEBUG("Source finished after" << transferred_ << "bytes");
+    emit finished();
+}
+
+/*!
+    Close the sink without EOF, so that the sink command does not mistake
+    partial output for complete output.
+*/
+void LibsshQtPipe::handleSourceFailed()
+{
+    if ( finished_ ) return;
+
+    LIBSSHQT_DEBUG("Source failed after" << transferred_ << "bytes");
+    finished_ = true;
+
+    if ( sink_ ) {
+        sink_->disconnect(this);
+        sink_->closeChannel();
+    }
+    emit error();
+}
+
+/*!
+    closed() is emitted before finished() when the command exits. Any other
+    close, by closeChannel(), a deadline or a disconnect, cuts the output
+    short.
+*/
+void LibsshQtPipe::handleSourceClosed()
+{
+    if ( source_ && source_->isFinished()) return;
+    handleSourceFailed();
+}
+
+void LibsshQtPipe::handleSinkReady()
+{
+    transfer(false);
+}
+
+void LibsshQtPipe::handleSinkFailed()
+{
+    if ( finished_ ) return;
+
+    LIBSSHQT_DEBUG("Sink closed before source finished");
+    finished_ = true;
+
+    if ( source_ ) {
+        source_->disconnect(this);
+        source_->closeChannel();
+    }
+    emit error();
+}
+
+void LibsshQtPipe::handleDebugChanged()
+{
+    debug_output_ = ( source_ && source_->client()->isDebugEnabled()) ||
+                    ( sink_   && sink_->client()->isDebugEnabled());
+}
@@ -0,0 +1,78 @@
+#ifndef LIBSSHQTPIPE_H
+#define LIBSSHQTPIPE_H
+
+#include <QObject>
+#include <QPointer>
+
+class LibsshQtChannel;
+class LibsshQtProcess;
+
+/*!
+
+    LibsshQtPipe - Pipe stdout of one process to stdin of another
+
+    The processes can be on different clients. Data is moved from the read
+    buffer of the source to the write buffer of the sink without copying
+    whenever the write buffer of the sink is empty.
+
+    When the sink has more than maxBacklog() bytes waiting to be written, the
+    pipe stops taking data from the source. The read buffer of the source
+    then fills up, the source stops reading from its channel, and the SSH
+    channel window stops the remote command. Reading continues once the sink
+    has written its backlog.
+
+    When the source command has exited, the rest of its output is moved to
+    the sink, EOF is queued to the sink and finished() is emitted. If the
+    source fails or is closed before its command exits, for example by a
+    deadline, closeChannel() or a disconnect, the sink channel is closed
+    without EOF, and if the sink fails or closes first, the source channel
+    is closed. In both cases error() is
+    emitted. The stdout behaviour of the source is set to OutputManual.
+
+*/
+class LibsshQtPipe : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit LibsshQtPipe(LibsshQtProcess *source,
+                          LibsshQtProcess *sink,
+                          QObject         *parent = 0);
+
+    LibsshQtProcess *source() const;
+    LibsshQtProcess *sink() const;
+
+    void setMaxBacklog(int bytes);
+    int maxBacklog() const;
+
+    qint64 bytesTransferred() const;
+    bool isFinished() const;
+
+signals:
+    void finished();
+    void error();
+
+private:
+    void transfer(bool flush);
+
+private slots:
+    void handleDebugChanged();
+    void handleSourceReadyRead();
+    void handleSourceFinished();
+    void handleSourceClosed();
+    void handleSourceFailed();
+    void handleSinkReady();
+    void handleSinkFailed();
+
+private:
+    QString                     debug_prefix_;
+    bool                        debug_output_;
+
+    QPointer<LibsshQtProcess>   source_;
+    QPointer<LibsshQtProcess>   sink_;
+    int                         max_backlog_;
+    qint64                      transferred_;
+    bool                        finished_;
+};
+
+#endif // LIBSSHQTPIPE_H
@@ -1,9 +1,21 @@
 
 #include <QDebug>
+#include <QDateTime>
 #include <QMetaEnum>
 #include <QProcessEnvironment>
 #include <QCoreApplication>
 #include <QUrl>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTimerEvent>
+
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "libsshqtprocess.h"
 #include "libsshqtclient.h"
@@ -19,7 +31,23 @@ LibsshQtProcess::LibsshQtProcess(LibsshQtClient *parent) :
     LibsshQtChannel(false, parent, parent),
     state_(StateClosed),
     exit_code_(-1),
-    stderr_(new LibsshQtProcessStderr(this))
+    finished_(false),
+    last_output_(0),
+    kill_at_(0),
+    timeout_(0),
+    idle_timeout_(0),
+    kill_grace_period_(5000),
+    kill_stage_(0),
+    timeout_reason_(TimeoutNone),
+    stderr_(0),
+    merged_output_(false),
+    stdin_source_(0),
+    stdin_finished_(false),
+    stdin_file_(false),
+    stdin_map_(0),
+    stdin_map_size_(0),
+    stdin_map_pos_(0),
+    stdin_map_dropped_(0)
 {
     debug_prefix_ = LibsshQt::debugPrefix(this);
 
@@ -41,6 +69,16 @@ LibsshQtProcess::~LibsshQtProcess()
 {
     LIBSSHQT_DEBUG("Destructor");
     closeChannel();
+    releaseStdinFile();
+}
+
+LibsshQtProcess::OutputSink::OutputSink() :
+    device(0),
+    fd(-1),
+    fd_notifier(0),
+    callback(0),
+    callback_data(0)
+{
 }
 
 const char *LibsshQtProcess::enumToString(const State value)
@@ -57,9 +95,17 @@ const char *LibsshQtProcess::enumToString(const OutputBehaviour value)
                     .valueToKey(value);
 }
 
+const char *LibsshQtProcess::enumToString(const TimeoutReason value)
+{
+    return staticMetaObject.enumerator(
+                staticMetaObject.indexOfEnumerator("TimeoutReason"))
+                    .valueToKey(value);
+}
+
 void LibsshQtProcess::setCommand(QString command)
 {
     command_ = command;
+    command_bytes_ = command.toLocal8Bit();
     LIBSSHQT_DEBUG("Setting command to" << command);
 }
 
@@ -73,6 +119,16 @@ int LibsshQtProcess::exitCode() const
     return exit_code_;
 }
 
+/*!
+    Returns true if the command exited and finished() was emitted, or is
+    about to be emitted from closed(). A process closed with closeChannel(),
+    stopped by a deadline or closed by a disconnect has not finished.
+*/
+bool LibsshQtProcess::isFinished() const
+{
+    return finished_;
+}
+
 void LibsshQtProcess::setStdoutBehaviour(OutputBehaviour behaviour,
                                          QString         prefix)
 {
@@ -101,6 +157,9 @@ void LibsshQtProcess::setStderrBehaviour(OutputBehaviour behaviour,
     stderr_behaviour_     = behaviour;
     stderr_output_prefix_ = prefix;
 
+    // The stderr object is connected when it is created
+    if ( ! stderr_ ) return;
+
     if ( behaviour == OutputManual ) {
         disconnect(stderr_, SIGNAL(readyRead()),
                    this, SLOT(handleStderrOutput()));
@@ -113,11 +172,338 @@ void LibsshQtProcess::setStderrBehaviour(OutputBehaviour behaviour,
     }
 }
 
+/*!
+    Write raw stdout data to device. The device must stay valid until the
+    process has been closed.
+*/
+void LibsshQtProcess::setStdoutSink(QIODevice *device)
+{
+    Q_ASSERT( device );
+    stdout_sink_.device = device;
+    setStdoutBehaviour(OutputToDevice);
+}
+
+/*!
+    Write raw stdout data to file descriptor fd. If fd is non-blocking, data
+    is kept in the read buffer until fd is writable again. When the channel
+    is closed, the rest of the data is written before the process finishes,
+    blocking until fd accepts it. The file descriptor is not closed by
+    LibsshQtProcess.
+*/
+void LibsshQtProcess::setStdoutSink(int fd)
+{
+    Q_ASSERT( fd >= 0 );
+    setSinkFd(stdout_sink_, fd);
+    setStdoutBehaviour(OutputToFd);
+}
+
+/*!
+    Pass raw stdout data to callback function, user_data is passed to the
+    callback as is. The data is only valid while the callback is running.
+*/
+void LibsshQtProcess::setStdoutSink(OutputCallback callback, void *user_data)
+{
+    Q_ASSERT( callback );
+    stdout_sink_.callback      = callback;
+    stdout_sink_.callback_data = user_data;
+    setStdoutBehaviour(OutputToCallback);
+}
+
+/*!
+    Same as setStdoutSink(QIODevice *) but for stderr.
+*/
+void LibsshQtProcess::setStderrSink(QIODevice *device)
+{
+    Q_ASSERT( device );
+    stderr_sink_.device = device;
+    setStderrBehaviour(OutputToDevice);
+}
+
+/*!
+    Same as setStdoutSink(int) but for stderr.
+*/
+void LibsshQtProcess::setStderrSink(int fd)
+{
+    Q_ASSERT( fd >= 0 );
+    setSinkFd(stderr_sink_, fd);
+    setStderrBehaviour(OutputToFd);
+}
+
+/*!
+    Same as setStdoutSink(OutputCallback, void *) but for stderr.
+*/
+void LibsshQtProcess::setStderrSink(OutputCallback callback, void *user_data)
+{
+    Q_ASSERT( callback );
+    stderr_sink_.callback      = callback;
+    stderr_sink_.callback_data = user_data;
+    setStderrBehaviour(OutputToCallback);
+}
+
+/*!
+    Get the stderr of the process. The stderr object is created when it is
+    first needed. Returns 0 for a merged process, its stderr is emitted with
+    outputReady().
+*/
 LibsshQtProcessStderr *LibsshQtProcess::stderr()
 {
+    if ( merged_output_ ) return 0;
+    if ( ! stderr_ ) {
+        createStderr();
+    }
     return stderr_;
 }
 
+/*!
+    Read stdout and stderr into one buffer and emit them with outputReady()
+    in the order they were read from the channel, instead of using the
+    stdout and stderr behaviours. Must be set before the channel is opened.
+
+    The server sends stdout and stderr as separate messages, and libssh
+    buffers the streams separately, so data that arrives between two reads
+    is ordered stdout first. Do not read the process with QIODevice functions
+    when merged output is enabled.
+*/
+void LibsshQtProcess::setMergedOutput(bool merged)
+{
+    Q_ASSERT( state_ == StateClosed );
+    LIBSSHQT_DEBUG("Setting merged output to" << merged);
+    merged_output_ = merged;
+
+    // Stdout is moved to the merged buffer right after it is read, users
+    // would find nothing to read on readyRead()
+    ready_read_ = ! merged;
+}
+
+bool LibsshQtProcess::isMergedOutput() const
+{
+    return merged_output_;
+}
+
+/*!
+    Feed the stdin of the process from device, 0 removes the source.
+
+    Data is read from the device only when the write buffer has room for it,
+    so a large file or a fast pipe does not fill the memory. EOF is sent to
+    the process once a random access device is at end, or a sequential device
+    has emitted readChannelFinished() or has been closed, and all data has
+    been written. The device must be open for reading, it is not closed or
+    deleted by LibsshQtProcess. Do not write to the process with write()
+    when a source is set.
+*/
+void LibsshQtProcess::setStdinSource(QIODevice *device)
+{
+    releaseStdinFile();
+
+    if ( stdin_source_ ) {
+        stdin_source_->disconnect(this);
+    }
+
+    stdin_source_   = device;
+    stdin_finished_ = false;
+
+    if ( ! device ) return;
+
+    Q_ASSERT( device->isReadable());
+    LIBSSHQT_DEBUG("Setting stdin source to" << LIBSSHQT_HEXNAME(device));
+
+    connect(device, SIGNAL(readyRead()),
+            this,   SLOT(handleStdinReadyRead()));
+    connect(device, SIGNAL(readChannelFinished()),
+            this,   SLOT(handleStdinFinished()));
+    connect(device, SIGNAL(aboutToClose()),
+            this,   SLOT(handleStdinFinished()));
+    connect(device, SIGNAL(destroyed()),
+            this,   SLOT(handleStdinDestroyed()));
+
+    if ( state_ == StateOpen ) {
+        queueCheckIo();
+    }
+}
+
+QIODevice *LibsshQtProcess::stdinSource() const
+{
+    return stdin_source_;
+}
+
+/*!
+    Feed the stdin of the process from a local file, replacing any source set
+    with setStdinSource().
+
+    The file is memory mapped, and slices of the mapping are passed directly
+    to ssh_channel_write(), so the only copy of the data is made by libssh
+    when it encrypts the data. Pages that have been written are released as
+    the upload progresses. EOF is sent once the whole file has been written.
+    Do not write to the process with write() while the file is being sent.
+
+    Returns false if the file could not be opened or mapped.
+*/
+bool LibsshQtProcess::setStdinFile(QString file_name)
+{
+    setStdinSource(0);
+
+    QByteArray path = QFile::encodeName(file_name);
+    int fd = ::open(path.constData(), O_RDONLY);
+    if ( fd < 0 ) {
+        LIBSSHQT_CRITICAL("Could not open stdin file" << file_name <<
+                          ":" << strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if ( fstat(fd, &st) != 0 ) {
+        LIBSSHQT_CRITICAL("Could not stat stdin file" << file_name <<
+                          ":" << strerror(errno));
+        ::close(fd);
+        return false;
+    }
+
+    if ( quint64(st.st_size) > quint64(size_t(-1))) {
+        LIBSSHQT_CRITICAL("Stdin file" << file_name <<
+                          "is too large to be mapped");
+        ::close(fd);
+        return false;
+    }
+
+    // Empty files cannot be mapped, EOF is sent right away for them
+    const char *map = 0;
+    if ( st.st_size > 0 ) {
+        void *addr = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if ( addr == MAP_FAILED ) {
+            LIBSSHQT_CRITICAL("Could not map stdin file" << file_name <<
+                              ":" << strerror(errno));
+            ::close(fd);
+            return false;
+        }
+
+        madvise(addr, st.st_size, MADV_SEQUENTIAL);
+        map = static_cast< const char* >( addr );
+    }
+
+    // The mapping stays valid after the descriptor has been closed
+    ::close(fd);
+
+    LIBSSHQT_DEBUG("Setting stdin file to" << file_name <<
+                   "size:" << qint64(st.st_size));
+
+    stdin_file_         = true;
+    stdin_map_          = map;
+    stdin_map_size_     = st.st_size;
+    stdin_map_pos_      = 0;
+    stdin_map_dropped_  = 0;
+
+    if ( state_ == StateOpen ) {
+        queueCheckIo();
+    }
+
+    return true;
+}
+
+/*!
+    Set the number of bytes and lines kept by OutputToTail behaviour, for both
+    stdout and stderr. Captured output is cleared.
+*/
+void LibsshQtProcess::setTailSize(int max_bytes, int max_lines)
+{
+    stdout_tail_.setMaxSize(max_bytes, max_lines);
+    stderr_tail_.setMaxSize(max_bytes, max_lines);
+}
+
+/*!
+    Get the end of stdout captured with OutputToTail behaviour. The tail is
+    cleared when the process is opened again.
+*/
+const LibsshQtTail &LibsshQtProcess::stdoutTail() const
+{
+    return stdout_tail_;
+}
+
+/*!
+    Get the end of stderr captured with OutputToTail behaviour.
+*/
+const LibsshQtTail &LibsshQtProcess::stderrTail() const
+{
+    return stderr_tail_;
+}
+
+/*!
+    Stop the process if it has been running for more than msecs milliseconds,
+    0 disables the deadline. Takes effect when the process is opened.
+*/
+void LibsshQtProcess::setTimeout(int msecs)
+{
+    Q_ASSERT( msecs >= 0 );
+    timeout_ = qMax(0, msecs);
+}
+
+/*!
+    Stop the process if no stdout or stderr output has been received in msecs
+    milliseconds, 0 disables the deadline. Takes effect when the process is
+    opened.
+*/
+void LibsshQtProcess::setIdleTimeout(int msecs)
+{
+    Q_ASSERT( msecs >= 0 );
+    idle_timeout_ = qMax(0, msecs);
+}
+
+/*!
+    Set how long to wait after TERM signal before KILL signal is sent, and
+    after KILL signal before error() is emitted and the channel is closed.
+*/
+void LibsshQtProcess::setKillGracePeriod(int msecs)
+{
+    Q_ASSERT( msecs >= 0 );
+    kill_grace_period_ = qMax(0, msecs);
+}
+
+int LibsshQtProcess::timeout() const
+{
+    return timeout_;
+}
+
+int LibsshQtProcess::idleTimeout() const
+{
+    return idle_timeout_;
+}
+
+int LibsshQtProcess::killGracePeriod() const
+{
+    return kill_grace_period_;
+}
+
+/*!
+    Get the reason why the process was stopped, TimeoutNone if the process
+    was not stopped because of a deadline.
+*/
+LibsshQtProcess::TimeoutReason LibsshQtProcess::timeoutReason() const
+{
+    return timeout_reason_;
+}
+
+/*!
+    Send a signal to the remote process. The signal name is given without the
+    SIG prefix, for example "TERM".
+*/
+bool LibsshQtProcess::sendSignal(QString signal)
+{
+    if ( state_ != StateOpen ) {
+        LIBSSHQT_CRITICAL("Cannot send signal" << signal <<
+                          "because state is" << state_);
+        return false;
+    }
+
+    LIBSSHQT_DEBUG("Sending signal" << signal);
+    int rc = ssh_channel_request_send_signal(channel_, qPrintable(signal));
+    if ( rc == SSH_ERROR ) {
+        LIBSSHQT_DEBUG("Could not send signal:" << errorCodeAndMessage());
+        return false;
+    }
+
+    client_->enableWritableNotifier();
+    return true;
+}
+
 LibsshQtProcess::State LibsshQtProcess::state() const
 {
     return state_;
@@ -149,32 +535,266 @@ void LibsshQtProcess::close()
     }
 }
 
+static int remainingTime(const QElapsedTimer &timer, int msecs)
+{
+    if ( msecs < 0 ) return -1;
+    return int(qMax(qint64(0), msecs - timer.elapsed()));
+}
+
+/*!
+    Wait until the process has been started and stdin can be written, for use
+    in threads which do not run an event loop.
+
+    Returns true if the process is open. Returns false if msecs milliseconds
+    passed or if the process failed or was not being opened.
+*/
+bool LibsshQtProcess::waitForStarted(int msecs)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    forever {
+        if ( state_ == StateOpen ) {
+            return true;
+        }
+
+        if ( state_ == StateClosed ||
+             state_ == StateClosing ||
+             state_ == StateError ||
+             state_ == StateClientError ) {
+            return false;
+        }
+
+        if ( ! client_->waitForActivity(remainingTime(timer, msecs))) {
+            return state_ == StateOpen;
+        }
+    }
+}
+
+/*!
+    Wait until stdout data is available to read, for use in threads which do
+    not run an event loop. Use OutputManual stdout behaviour, other
+    behaviours consume the data as soon as it has been read.
+
+    Returns true if data is available. Returns false if msecs milliseconds
+    passed or if the process has finished or failed. If msecs is -1, this
+    function does not time out.
+*/
+bool LibsshQtProcess::waitForReadyRead(int msecs)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    forever {
+        if ( ! read_buffer_.isEmpty()) {
+            return true;
+        }
+
+        if ( state_ == StateClosed ||
+             state_ == StateError ||
+             state_ == StateClientError ) {
+            return false;
+        }
+
+        if ( ! client_->waitForActivity(remainingTime(timer, msecs))) {
+            return ! read_buffer_.isEmpty();
+        }
+    }
+}
+
+/*!
+    Wait until data written to stdin has been sent to the channel, for use in
+    threads which do not run an event loop.
+
+    Returns true once some of the buffered data has been written. Returns
+    false if there is no data to write, if msecs milliseconds passed or if
+    the process has finished or failed.
+*/
+bool LibsshQtProcess::waitForBytesWritten(int msecs)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    int initial_size = write_buffer_.size();
+    if ( initial_size == 0 ) {
+        return false;
+    }
+
+    forever {
+        if ( write_buffer_.size() < initial_size ) {
+            return true;
+        }
+
+        if ( state_ == StateClosed ||
+             state_ == StateError ||
+             state_ == StateClientError ) {
+            return false;
+        }
+
+        if ( ! client_->waitForActivity(remainingTime(timer, msecs))) {
+            return write_buffer_.size() < initial_size;
+        }
+    }
+}
+
+/*!
+    Wait until the process has finished, for use in threads which do not run
+    an event loop. finished() signal is emitted before this function returns.
+
+    Returns true if the process finished, also if it finished during an
+    earlier wait. Returns false if msecs milliseconds passed, if the process
+    failed or if it was not started.
+*/
+bool LibsshQtProcess::waitForFinished(int msecs)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    if ( state_ == StateClosed ) {
+        return finished_;
+    }
+
+    forever {
+        if ( state_ == StateClosed ) {
+            return finished_;
+        }
+
+        if ( state_ == StateError ||
+             state_ == StateClientError ) {
+            return false;
+        }
+
+        if ( ! client_->waitForActivity(remainingTime(timer, msecs))) {
+            return state_ == StateClosed;
+        }
+    }
+}
+
 /*!
     Open SSH channel and start the process.
 */
 void LibsshQtProcess::openChannel()
 {
     if ( state_ == StateClosed ) {
+        discardOutput();
+        stdout_tail_.clear();
+        stderr_tail_.clear();
+        timeout_reason_ = TimeoutNone;
+        finished_       = false;
+
+        if ( ! merged_output_ && ! stderr_ ) {
+            createStderr();
+        }
+
         setState(StateWaitClient);
         timer_.start();
     }
 }
 
+/*!
+    Close the channel and restore all settings to their defaults, so that the
+    object can be reused for another command.
+
+    Objects attached to the previous command, like LibsshQtPipe and
+    LibsshQtFileSink, see the channel close before their connections are
+    removed. Only the connections of the process to itself are kept, all
+    other receivers of the process and its stderr object belong to the
+    previous command.
+*/
+void LibsshQtProcess::reset()
+{
+    LIBSSHQT_DEBUG("Resetting process");
+
+    closeChannel();
+    discardOutput();
+
+    disconnect();
+    if ( stderr_ ) {
+        stderr_->disconnect();
+    }
+
+    command_.clear();
+    command_bytes_.clear();
+    exit_code_          = -1;
+    finished_           = false;
+    timeout_            = 0;
+    idle_timeout_       = 0;
+    kill_grace_period_  = 5000;
+    kill_stage_         = 0;
+    timeout_reason_     = TimeoutNone;
+
+    resetSink(stdout_sink_);
+    resetSink(stderr_sink_);
+    // Keeps the ring buffers of the previous command
+    stdout_tail_.setMaxSize(LibsshQtTail::DefaultMaxBytes,
+                            LibsshQtTail::DefaultMaxLines);
+    stderr_tail_.setMaxSize(LibsshQtTail::DefaultMaxBytes,
+                            LibsshQtTail::DefaultMaxLines);
+
+    eof_state_               = EofNotSent;
+    priority_                = 0;
+    buffer_size_             = 1024 * 16;
+    write_size_              = 1024 * 16;
+    max_line_batch_          = 0;
+    merged_output_           = false;
+    ready_read_              = true;
+
+    setStdinSource(0);
+
+    if ( stderr_ ) {
+        stderr_->eof_state_      = EofNotSent;
+        stderr_->buffer_size_    = 1024 * 16;
+        stderr_->write_size_     = 1024 * 16;
+        stderr_->max_line_batch_ = 0;
+    }
+
+    setStdoutBehaviour(OutputToQDebug, "Remote stdout:");
+    setStderrBehaviour(OutputToQDebug, "Remote stderr:");
+}
+
 /*!
     This function closes the SSH channel immediadly and prepares the object for
     reuse, any possible data in buffers is discarded.
 */
 void LibsshQtProcess::closeChannel()
+{
+    if ( state_ == StateClosed ) {
+        // Output kept after the process finished
+        discardOutput();
+    } else {
+        releaseChannel(false);
+    }
+}
+
+/*!
+    Free the SSH channel. If keep_output is true, output that has not been
+    read stays in the read buffers and the process and its stderr stay open
+    for reading, until the output is discarded by closeChannel() or by
+    opening the process again.
+*/
+void LibsshQtProcess::releaseChannel(bool keep_output)
 {
     if ( state_ != StateClosed &&
          state_ != StateClosing ){
 
         // Prevent recursion
         setState(StateClosing);
+        stopDeadlines();
 
         emit readChannelFinished();
         handleStdoutOutput();
         handleStderrOutput();
+        if ( merged_output_ ) {
+            readMergedOutput();
+        }
+
+        // Nothing reads the channel after this, write what fd sinks left
+        if ( stdout_behaviour_ == OutputToFd && ! merged_output_ ) {
+            drainSink(stdout_sink_, read_buffer_);
+        }
+        if ( stderr_ && stderr_behaviour_ == OutputToFd ) {
+            drainSink(stderr_sink_, stderr_->read_buffer_);
+        }
 
         if ( channel_ ) {
             if ( ssh_channel_is_open(channel_) != 0 ) {
@@ -185,18 +805,50 @@ void LibsshQtProcess::closeChannel()
             channel_ = 0;
         }
 
-        QIODevice::close();
-        reinterpret_cast< QIODevice* >( stderr_ )->close();
-
-        read_buffer_.clear();
         write_buffer_.clear();
-        stderr_->read_buffer_.clear();
-        stderr_->write_buffer_.clear();
+        merged_data_.clear();
+        releaseStdinFile();
+        merged_chunks_.clear();
+
+        if ( stderr_ ) {
+            stderr_->channel_ = 0;
+            stderr_->write_buffer_.clear();
+        }
+
+        if ( keep_output ) {
+            if ( isOpen()) {
+                setOpenMode(ReadOnly | Unbuffered);
+            }
+            if ( stderr_ && stderr_->isOpen()) {
+                stderr_->setOpenMode(ReadOnly | Unbuffered);
+            }
+        } else {
+            discardOutput();
+        }
 
         setState(StateClosed);
     }
 }
 
+/*!
+    Clear the read buffers and close the process and its stderr.
+*/
+void LibsshQtProcess::discardOutput()
+{
+    if ( isOpen()) {
+        QIODevice::close();
+    }
+    read_buffer_.clear();
+
+    // LibsshQtProcessStderr::close() would close the process
+    if ( stderr_ ) {
+        if ( stderr_->isOpen()) {
+            stderr_->QIODevice::close();
+        }
+        stderr_->read_buffer_.clear();
+    }
+}
+
 void LibsshQtProcess::setState(State state)
 {
     if ( state_ == state ) {
@@ -207,6 +859,13 @@ void LibsshQtProcess::setState(State state)
     LIBSSHQT_DEBUG("Changing state to" << state);
     state_ = state;
 
+    // Free the channel slot for queued processes
+    if ( state_ == StateClosed ||
+         state_ == StateError ||
+         state_ == StateClientError ) {
+        client_->releaseChannelSlot(this);
+    }
+
     switch (  state_ ) {
     case StateClosed:       emit closed();          break;
     case StateClosing:                              break;
@@ -219,9 +878,19 @@ void LibsshQtProcess::setState(State state)
     }
 }
 
-void LibsshQtProcess::queueCheckIo()
+void LibsshQtProcess::queueCheckIo()
+{
+    timer_.start();
+}
+
+bool LibsshQtProcess::runPendingWork()
 {
-    timer_.start();
+    if ( timer_.isActive()) {
+        timer_.stop();
+        processState();
+        return true;
+    }
+    return false;
 }
 
 void LibsshQtProcess::processState()
@@ -236,12 +905,15 @@ void LibsshQtProcess::processState()
 
     case StateWaitClient:
     {
-        if ( client_->state() == LibsshQtClient::StateOpened ) {
-            setState(StateOpening);
-            timer_.start();
+        if ( client_->state() != LibsshQtClient::StateOpened ||
+             ! client_->requestChannelSlot(this)) {
+            return;
         }
-        return;
-    } break;
+
+        // Open the channel right away, waiting for the timer would cost an
+        // extra event loop iteration for every process
+        setState(StateOpening);
+    } // Fall through
 
     case StateOpening:
     {
@@ -250,7 +922,9 @@ void LibsshQtProcess::processState()
 
             if ( channel ) {
                 channel_ = channel;
-                stderr_->channel_ = channel;
+                if ( stderr_ ) {
+                    stderr_->channel_ = channel;
+                }
 
             } else {
                 LIBSSHQT_FATAL("Could not create SSH channel");
@@ -270,20 +944,23 @@ void LibsshQtProcess::processState()
             return;
 
         case SSH_OK:
+            // Send the exec request right away
             setState(StateExec);
-            timer_.start();
-            return;
+            break;
 
         default:
             LIBSSHQT_CRITICAL("Unknown result code" << rc <<
                               "received from ssh_channel_open_session()");
             return;
         }
-    } break;
+    } // Fall through
 
     case StateExec:
     {
-        int rc = ssh_channel_request_exec(channel_, qPrintable(command_));
+        // The command is encoded once in setCommand(), the request is
+        // retried until it does not return SSH_AGAIN
+        int rc = ssh_channel_request_exec(channel_,
+                                          command_bytes_.constData());
 
         switch ( rc ) {
         case SSH_AGAIN:
@@ -301,7 +978,10 @@ void LibsshQtProcess::processState()
                 LIBSSHQT_FATAL("QIODevice::open() failed");
             }
 
-            stderr_->open();
+            if ( stderr_ ) {
+                stderr_->open();
+            }
+            startDeadlines();
             setState(StateOpen);
             timer_.start();
             return;
@@ -315,8 +995,25 @@ void LibsshQtProcess::processState()
 
     case StateOpen:
     {
+        readStdinSource();
+        writeStdinFile();
+        if ( state_ != StateOpen ) return;
+
         checkIo();
-        stderr_->checkIo();
+        if ( merged_output_ ) {
+            readMergedOutput();
+        } else {
+            stderr_->checkIo();
+        }
+
+        // Refill the buffer that was just written, and write it as soon as
+        // the socket is writable again
+        if ( stdin_source_ && state_ == StateOpen ) {
+            readStdinSource();
+            if ( ! write_buffer_.isEmpty()) {
+                client_->enableWritableNotifier();
+            }
+        }
 
         if ( state_ == StateOpen &&
              ssh_channel_poll(channel_, false) == SSH_EOF &&
@@ -327,7 +1024,7 @@ void LibsshQtProcess::processState()
             if ( ! read_buffer_.isEmpty()) {
                 emit readyRead();
             }
-            if ( ! stderr_->read_buffer_.isEmpty()) {
+            if ( stderr_ && ! stderr_->read_buffer_.isEmpty()) {
                 emit stderr_->readyRead();
             }
 
@@ -337,11 +1034,20 @@ void LibsshQtProcess::processState()
             LIBSSHQT_DEBUG("Command exit code:"     << exit_code_);
             LIBSSHQT_DEBUG("Data in read buffer:"   << read_buffer_.size());
             LIBSSHQT_DEBUG("Data in write buffer:"  << write_buffer_.size());
-            LIBSSHQT_DEBUG("Data in stderr buffer:" <<
-                           stderr_->read_buffer_.size());
+            if ( stderr_ ) {
+                LIBSSHQT_DEBUG("Data in stderr buffer:" <<
+                               stderr_->read_buffer_.size());
+            }
+
+            // Output that arrived with EOF stays readable, there may be no
+            // event loop that would have read it during readyRead()
+            finished_ = true;
+            releaseChannel(true);
 
-            closeChannel();
-            emit finished(exit_code_);
+            // A slot connected to closed() may have recycled the process
+            if ( finished_ ) {
+                emit finished(exit_code_);
+            }
             return;
         }
 
@@ -361,6 +1067,22 @@ void LibsshQtProcess::handleClientError()
 void LibsshQtProcess::handleStdoutOutput()
 {
     if ( stdout_behaviour_ == OutputManual) return;
+    if ( merged_output_ ) return;
+
+    if ( stdout_behaviour_ == OutputToDevice ||
+         stdout_behaviour_ == OutputToCallback ||
+         stdout_behaviour_ == OutputToFd ) {
+        writeToSink(stdout_behaviour_, stdout_sink_, read_buffer_);
+        return;
+
+    } else if ( stdout_behaviour_ == OutputToLines ) {
+        emitLines();
+        return;
+
+    } else if ( stdout_behaviour_ == OutputToTail ) {
+        writeToTail(stdout_tail_, read_buffer_);
+        return;
+    }
 
     while ( canReadLine()) {
         QString line = QString(readLine());
@@ -371,8 +1093,22 @@ void LibsshQtProcess::handleStdoutOutput()
 void LibsshQtProcess::handleStderrOutput()
 {
     if ( stderr_behaviour_ == OutputManual) return;
+    if ( ! stderr_ ) return;
+    if ( stderr_behaviour_ == OutputToDevice ||
+         stderr_behaviour_ == OutputToCallback ||
+         stderr_behaviour_ == OutputToFd ) {
+        writeToSink(stderr_behaviour_, stderr_sink_, stderr_->read_buffer_);
+        return;
+
+    } else if ( stderr_behaviour_ == OutputToLines ) {
+        stderr_->emitLines();
+        return;
+
+    } else if ( stderr_behaviour_ == OutputToTail ) {
+        writeToTail(stderr_tail_, stderr_->read_buffer_);
+        return;
+    }
 
-    Q_ASSERT(stderr_);
     while ( stderr_->canReadLine()) {
         QString line = QString(stderr()->readLine());
         handleOutput(stderr_behaviour_, stderr_output_prefix_, line);
@@ -386,6 +1122,11 @@ void LibsshQtProcess::handleOutput(OutputBehaviour &behaviour,
     switch ( behaviour ) {
     case OutputManual:
     case OutputToDevNull:
+    case OutputToDevice:
+    case OutputToCallback:
+    case OutputToFd:
+    case OutputToLines:
+    case OutputToTail:
         // Do nothing
         return;
 
@@ -404,6 +1145,532 @@ void LibsshQtProcess::handleOutput(OutputBehaviour &behaviour,
     }
 }
 
+void LibsshQtProcess::handleSinkWritable()
+{
+    if ( stdout_sink_.fd_notifier ) {
+        stdout_sink_.fd_notifier->setEnabled(false);
+    }
+    if ( stderr_sink_.fd_notifier ) {
+        stderr_sink_.fd_notifier->setEnabled(false);
+    }
+
+    handleStdoutOutput();
+    handleStderrOutput();
+}
+
+void LibsshQtProcess::handleKillTimer()
+{
+    if ( state_ != StateOpen ) return;
+
+    if ( kill_stage_ == 1 ) {
+        LIBSSHQT_DEBUG("Process did not exit after TERM signal");
+        kill_stage_ = 2;
+        sendSignal("KILL");
+        kill_at_ = deadline_clock_.elapsed() + kill_grace_period_;
+        scheduleDeadline();
+
+    } else {
+        LIBSSHQT_DEBUG("Process did not exit after KILL signal");
+
+        // Users waiting for finished() or error() must not wait forever.
+        // The process may have been closed or recycled from error().
+        setState(StateError);
+        if ( state_ == StateError ) {
+            releaseChannel(false);
+        }
+    }
+}
+
+/*!
+    Note the time of output for the idle deadline. The timer is not touched,
+    it checks the time when it fires.
+*/
+void LibsshQtProcess::restartIdleTimer()
+{
+    if ( idle_timeout_ > 0 && deadline_clock_.isValid()) {
+        last_output_ = deadline_clock_.elapsed();
+    }
+}
+
+void LibsshQtProcess::startDeadlines()
+{
+    kill_stage_ = 0;
+    if ( timeout_ == 0 && idle_timeout_ == 0 ) return;
+
+    deadline_clock_.start();
+    last_output_ = 0;
+
+    if ( idle_timeout_ > 0 ) {
+        connect(this, SIGNAL(readyRead()),
+                this, SLOT(restartIdleTimer()),
+                Qt::UniqueConnection);
+        if ( stderr_ ) {
+            connect(stderr_, SIGNAL(readyRead()),
+                    this,    SLOT(restartIdleTimer()),
+                    Qt::UniqueConnection);
+        }
+    }
+
+    scheduleDeadline();
+}
+
+void LibsshQtProcess::stopDeadlines()
+{
+    deadline_timer_.stop();
+    deadline_clock_.invalidate();
+
+    disconnect(this, SIGNAL(readyRead()),
+               this, SLOT(restartIdleTimer()));
+    if ( stderr_ ) {
+        disconnect(stderr_, SIGNAL(readyRead()),
+                   this,    SLOT(restartIdleTimer()));
+    }
+}
+
+/*!
+    Start the deadline timer for the nearest deadline, one timer serves the
+    wall clock, idle and kill deadlines.
+*/
+void LibsshQtProcess::scheduleDeadline()
+{
+    qint64 next = -1;
+    if ( kill_stage_ > 0 ) {
+        next = kill_at_;
+    } else {
+        if ( timeout_ > 0 ) {
+            next = timeout_;
+        }
+        if ( idle_timeout_ > 0 &&
+             ( next < 0 || last_output_ + idle_timeout_ < next )) {
+            next = last_output_ + idle_timeout_;
+        }
+    }
+
+    if ( next < 0 ) {
+        deadline_timer_.stop();
+        return;
+    }
+
+    qint64 delay = qMax<qint64>(0, next - deadline_clock_.elapsed());
+    deadline_timer_.start(int(delay), this);
+}
+
+void LibsshQtProcess::timerEvent(QTimerEvent *event)
+{
+    if ( event->timerId() != deadline_timer_.timerId()) {
+        LibsshQtChannel::timerEvent(event);
+        return;
+    }
+
+    deadline_timer_.stop();
+    if ( state_ != StateOpen ) return;
+
+    qint64 now = deadline_clock_.elapsed();
+    if ( kill_stage_ > 0 ) {
+        if ( now >= kill_at_ ) {
+            handleKillTimer();
+            return;
+        }
+
+    } else if ( timeout_ > 0 && now >= timeout_ ) {
+        handleTimeout(TimeoutWallClock);
+        return;
+
+    } else if ( idle_timeout_ > 0 && now >= last_output_ + idle_timeout_ ) {
+        handleTimeout(TimeoutIdle);
+        return;
+    }
+
+    // Output was received after the timer was started
+    scheduleDeadline();
+}
+
+void LibsshQtProcess::handleTimeout(TimeoutReason reason)
+{
+    if ( state_ != StateOpen || kill_stage_ != 0 ) return;
+
+    LIBSSHQT_DEBUG("Deadline expired:" << reason);
+    timeout_reason_ = reason;
+
+    kill_stage_ = 1;
+    sendSignal("TERM");
+    kill_at_ = deadline_clock_.elapsed() + kill_grace_period_;
+    scheduleDeadline();
+
+    emit timedOut(reason);
+}
+
+/*!
+    Read data from the stdin source directly to the write buffer, until the
+    buffer holds two writes worth of data.
+*/
+void LibsshQtProcess::readStdinSource()
+{
+    if ( ! stdin_source_ || eof_state_ != EofNotSent ) return;
+
+    if ( ! stdin_source_->isOpen()) {
+        LIBSSHQT_DEBUG("Stdin source has been closed");
+        sendEof();
+        return;
+    }
+
+    const int target = write_size_ * 2;
+    write_buffer_.reserve(target);
+
+    while ( write_buffer_.size() < target &&
+            stdin_source_->bytesAvailable() > 0 ) {
+        int old_size = write_buffer_.size();
+        write_buffer_.resize(target);
+
+        qint64 read_size = stdin_source_->read(write_buffer_.data() + old_size,
+                                               target - old_size);
+        write_buffer_.resize(old_size + qMax(qint64(0), read_size));
+
+        if ( read_size < 0 ) {
+            LIBSSHQT_CRITICAL("Could not read stdin source:" <<
+                              stdin_source_->errorString());
+            stdin_finished_ = true;
+            break;
+        } else if ( read_size == 0 ) {
+            break;
+        }
+    }
+
+    // Random access devices do not emit readChannelFinished()
+    if ( ! stdin_source_->isSequential() && stdin_source_->atEnd()) {
+        stdin_finished_ = true;
+    }
+
+    if ( stdin_finished_ && stdin_source_->bytesAvailable() <= 0 ) {
+        LIBSSHQT_DEBUG("Stdin source finished");
+        sendEof();
+    }
+}
+
+/*!
+    Write the stdin file straight from the mapping to the channel.
+
+    Data written with write() is sent first. At most a few slices are written
+    per call, so that the output of the process and other channels of the
+    client are not starved by a large upload.
+*/
+void LibsshQtProcess::writeStdinFile()
+{
+    if ( ! stdin_file_ || eof_state_ != EofNotSent ) return;
+    if ( ! write_buffer_.isEmpty()) return;
+
+    const int max_slices = 8;
+    const qint64 drop_size = 1024 * 1024;
+    qint64 total = 0;
+
+    for ( int i = 0; i < max_slices && stdin_map_pos_ < stdin_map_size_; i++ ) {
+        int len = qMin(qint64(write_size_), stdin_map_size_ - stdin_map_pos_);
+        int written = ssh_channel_write(channel_,
+                                        stdin_map_ + stdin_map_pos_,
+                                        len);
+        Q_ASSERT(written >= 0);
+        if ( written <= 0 ) break;
+
+        stdin_map_pos_ += written;
+        total += written;
+
+        // Channel window is full
+        if ( written < len ) break;
+    }
+
+    LIBSSHQT_DEBUG("Wrote" << total << "bytes from stdin file," <<
+                   stdin_map_size_ - stdin_map_pos_ << "bytes left");
+
+    // Pages that have been sent will not be needed again, dropping them keeps
+    // the resident size of the process flat during the upload
+    const qint64 page_size = sysconf(_SC_PAGESIZE);
+    qint64 consumed = stdin_map_pos_ - stdin_map_dropped_;
+    if ( consumed >= drop_size ) {
+        consumed -= consumed % page_size;
+        madvise(const_cast< char* >( stdin_map_ + stdin_map_dropped_ ),
+                consumed, MADV_DONTNEED);
+        stdin_map_dropped_ += consumed;
+    }
+
+    if ( stdin_map_pos_ >= stdin_map_size_ ) {
+        LIBSSHQT_DEBUG("Stdin file finished");
+        releaseStdinFile();
+        sendEof();
+    } else {
+        client_->enableWritableNotifier();
+    }
+
+    if ( total > 0 ) {
+        emit bytesWritten(total);
+    }
+}
+
+void LibsshQtProcess::releaseStdinFile()
+{
+    if ( stdin_map_ ) {
+        munmap(const_cast< char* >( stdin_map_ ), stdin_map_size_);
+    }
+
+    stdin_file_         = false;
+    stdin_map_          = 0;
+    stdin_map_size_     = 0;
+    stdin_map_pos_      = 0;
+    stdin_map_dropped_  = 0;
+}
+
+void LibsshQtProcess::handleStdinReadyRead()
+{
+    if ( state_ == StateOpen ) {
+        queueCheckIo();
+    }
+}
+
+void LibsshQtProcess::handleStdinFinished()
+{
+    stdin_finished_ = true;
+    handleStdinReadyRead();
+}
+
+void LibsshQtProcess::handleStdinDestroyed()
+{
+    LIBSSHQT_DEBUG("Stdin source was destroyed");
+    stdin_source_   = 0;
+    stdin_finished_ = false;
+
+    // A queued EOF would outlive a closed or failed process and end the
+    // stdin of the next command
+    if ( state_ >= StateWaitClient && state_ <= StateOpen ) {
+        sendEof();
+    }
+    handleStdinReadyRead();
+}
+
+void LibsshQtProcess::createStderr()
+{
+    LIBSSHQT_DEBUG("Creating stderr");
+
+    stderr_ = new LibsshQtProcessStderr(this);
+
+    if ( idle_timeout_ > 0 && deadline_clock_.isValid()) {
+        connect(stderr_, SIGNAL(readyRead()),
+                this,    SLOT(restartIdleTimer()));
+    }
+    if ( stderr_behaviour_ != OutputManual ) {
+        connect(stderr_, SIGNAL(readyRead()),
+                this,    SLOT(handleStderrOutput()));
+    }
+}
+
+/*!
+    Move stdout read by checkIo() and stderr read directly from the channel
+    to the merged buffer, and emit them.
+*/
+void LibsshQtProcess::readMergedOutput()
+{
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+    if ( ! read_buffer_.isEmpty()) {
+        int len = read_buffer_.size();
+        if ( merged_data_.isEmpty()) {
+            merged_data_ = read_buffer_;
+        } else {
+            merged_data_.append(read_buffer_);
+        }
+        read_buffer_.clear();
+        appendChunk(LibsshQtChunks::Stdout, len, now);
+        restartIdleTimer();
+    }
+
+    int available = channel_ ? ssh_channel_poll(channel_, true) : 0;
+    if ( available > 0 ) {
+        available = qMin(available, buffer_size_);
+
+        int old_size = merged_data_.size();
+        merged_data_.resize(old_size + available);
+
+        int read_size = ssh_channel_read_nonblocking(channel_,
+                                                     merged_data_.data() +
+                                                        old_size,
+                                                     available,
+                                                     true);
+        Q_ASSERT(read_size >= 0);
+        merged_data_.resize(old_size + qMax(0, read_size));
+
+        if ( read_size > 0 ) {
+            appendChunk(LibsshQtChunks::Stderr, read_size, now);
+            restartIdleTimer();
+        }
+    }
+
+    emitChunks();
+}
+
+/*!
+    Add chunk for the last len bytes of the merged buffer.
+*/
+void LibsshQtProcess::appendChunk(LibsshQtChunks::Stream stream,
+                                  int len, qint64 time)
+{
+    Q_UNUSED(len);
+    Q_ASSERT( merged_chunks_.isEmpty() ||
+              merged_chunks_.last().end + len == merged_data_.size());
+
+    LibsshQtChunks::Chunk chunk;
+    chunk.end    = merged_data_.size();
+    chunk.stream = stream;
+    chunk.time   = time;
+    merged_chunks_.append(chunk);
+}
+
+void LibsshQtProcess::emitChunks()
+{
+    if ( merged_chunks_.isEmpty()) return;
+
+    LibsshQtChunks chunks(merged_data_, merged_chunks_);
+    merged_data_.clear();
+    merged_chunks_.clear();
+
+    LIBSSHQT_DEBUG("Emitting" << chunks.count() << "output chunks");
+    emit outputReady(chunks);
+}
+
+void LibsshQtProcess::setSinkFd(OutputSink &sink, int fd)
+{
+    if ( sink.fd_notifier ) {
+        sink.fd_notifier->deleteLater();
+        sink.fd_notifier = 0;
+    }
+
+    sink.fd = fd;
+    sink.fd_notifier = new QSocketNotifier(fd, QSocketNotifier::Write, this);
+    sink.fd_notifier->setEnabled(false);
+    connect(sink.fd_notifier, SIGNAL(activated(int)),
+            this,             SLOT(handleSinkWritable()));
+}
+
+void LibsshQtProcess::resetSink(OutputSink &sink)
+{
+    if ( sink.fd_notifier ) {
+        sink.fd_notifier->deleteLater();
+    }
+
+    sink = OutputSink();
+}
+
+/*!
+    Forward all data in buffer to the sink without any conversions.
+*/
+void LibsshQtProcess::writeToSink(OutputBehaviour  behaviour,
+                                  OutputSink      &sink,
+                                  QByteArray      &buffer)
+{
+    if ( buffer.isEmpty()) return;
+
+    qint64 written = 0;
+    switch ( behaviour ) {
+    case OutputToDevice:
+        written = sink.device->write(buffer.constData(), buffer.size());
+        if ( written < 0 ) {
+            LIBSSHQT_CRITICAL("Could not write output to device:" <<
+                              sink.device->errorString());
+            written = buffer.size();
+        }
+        break;
+
+    case OutputToCallback:
+        sink.callback(buffer.constData(), buffer.size(), sink.callback_data);
+        written = buffer.size();
+        break;
+
+    case OutputToFd:
+        while ( written < buffer.size()) {
+            ssize_t rc = ::write(sink.fd,
+                                 buffer.constData() + written,
+                                 buffer.size() - written);
+            if ( rc >= 0 ) {
+                written += rc;
+
+            } else if ( errno == EINTR ) {
+                continue;
+
+            } else if ( errno == EAGAIN || errno == EWOULDBLOCK ) {
+                // Keep the rest of the data until fd is writable
+                sink.fd_notifier->setEnabled(true);
+                break;
+
+            } else {
+                LIBSSHQT_CRITICAL("Could not write output to file descriptor" <<
+                                  sink.fd << ":" << strerror(errno));
+                written = buffer.size();
+            }
+        }
+        break;
+
+    case OutputManual:
+    case OutputToQDebug:
+    case OutputToDevNull:
+    case OutputToLines:
+    case OutputToTail:
+        Q_ASSERT_X(false, __func__, "Not a raw output behaviour");
+        return;
+    }
+
+    LIBSSHQT_DEBUG("Forwarded" << written << "bytes to" << behaviour);
+    buffer.remove(0, written);
+
+    // Read more data from the channel
+    queueCheckIo();
+}
+
+/*!
+    Write all data in buffer to the file descriptor of the sink, waiting for
+    a non-blocking fd to become writable when needed.
+*/
+void LibsshQtProcess::drainSink(OutputSink &sink, QByteArray &buffer)
+{
+    if ( sink.fd_notifier ) {
+        sink.fd_notifier->setEnabled(false);
+    }
+
+    while ( ! buffer.isEmpty()) {
+        ssize_t rc = ::write(sink.fd, buffer.constData(), buffer.size());
+        if ( rc >= 0 ) {
+            buffer.remove(0, rc);
+            continue;
+
+        } else if ( errno == EINTR ) {
+            continue;
+
+        } else if ( errno == EAGAIN || errno == EWOULDBLOCK ) {
+            struct pollfd pfd;
+            pfd.fd      = sink.fd;
+            pfd.events  = POLLOUT;
+            pfd.revents = 0;
+            if ( ::poll(&pfd, 1, -1) >= 0 || errno == EINTR ) {
+                continue;
+            }
+        }
+
+        LIBSSHQT_CRITICAL("Could not write output to file descriptor" <<
+                          sink.fd << ":" << strerror(errno));
+        break;
+    }
+
+    LIBSSHQT_DEBUG("Drained output to file descriptor" << sink.fd);
+    buffer.clear();
+}
+
+void LibsshQtProcess::writeToTail(LibsshQtTail &tail, QByteArray &buffer)
+{
+    if ( buffer.isEmpty()) return;
+
+    tail.append(buffer.constData(), buffer.size());
+    buffer.clear();
+
+    // Read more data from the channel
+    queueCheckIo();
+}
+
 
 
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
@@ -421,6 +1688,34 @@ void LibsshQtProcessStderr::close()
     reinterpret_cast<LibsshQtProcess *>(parent())->close();
 }
 
+/*!
+    Same as LibsshQtProcess::waitForReadyRead() but for stderr, use
+    OutputManual stderr behaviour.
+*/
+bool LibsshQtProcessStderr::waitForReadyRead(int msecs)
+{
+    LibsshQtProcess *process = reinterpret_cast<LibsshQtProcess *>(parent());
+
+    QElapsedTimer timer;
+    timer.start();
+
+    forever {
+        if ( ! read_buffer_.isEmpty()) {
+            return true;
+        }
+
+        if ( process->state_ == LibsshQtProcess::StateClosed ||
+             process->state_ == LibsshQtProcess::StateError ||
+             process->state_ == LibsshQtProcess::StateClientError ) {
+            return false;
+        }
+
+        if ( ! client_->waitForActivity(remainingTime(timer, msecs))) {
+            return ! read_buffer_.isEmpty();
+        }
+    }
+}
+
 bool LibsshQtProcessStderr::open(OpenMode ignored)
 {
     Q_UNUSED( ignored );
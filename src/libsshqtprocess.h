@@ -3,9 +3,13 @@
 
 #include <QObject>
 #include <QTimer>
+#include <QBasicTimer>
+#include <QElapsedTimer>
 #include <QIODevice>
 #include <QSocketNotifier>
 #include "libsshqtchannel.h"
+#include "libsshqttail.h"
+#include "libsshqtchunks.h"
 
 class LibsshQtProcessStderr;
 
@@ -16,6 +20,54 @@ class LibsshQtProcessStderr;
     By default LibsshQtProcess will send all process output to QDebug(), to
     change this behaviour see setStderrBehaviour() and setStdoutBehaviour().
 
+    Processes created with LibsshQtClient::runCommand() can be given back to
+    the client with LibsshQtClient::recycleProcess() once they are no longer
+    needed, so that later commands reuse them instead of allocating new
+    objects.
+
+    Raw output can be forwarded to a QIODevice, a callback function or a file
+    descriptor with setStdoutSink() and setStderrSink(). Sinks receive the
+    data exactly as it was read from the channel, without line splitting or
+    text conversion.
+
+    With OutputToLines behaviour all complete lines received in one read are
+    emitted at once with linesReady() signal, stdout lines from
+    LibsshQtProcess and stderr lines from LibsshQtProcessStderr. Lines are
+    views to a shared buffer, so no data is copied per line.
+
+    With OutputToTail behaviour only the last bytes and lines of the output
+    are kept, see setTailSize(). The tail is available from stdoutTail() and
+    stderrTail() after the process has finished, and memory use stays constant
+    regardless of the amount of output.
+
+    A process can be given a wall-clock deadline with setTimeout() and an
+    output inactivity deadline with setIdleTimeout(). When a deadline
+    expires, TERM signal is sent to the remote process, followed by KILL
+    signal after killGracePeriod(), and finally error() is emitted and the
+    channel is closed after another grace period if the process still has
+    not exited. The server must support signal channel requests for the
+    signals to have any effect.
+
+    Stdin can be fed from any QIODevice with setStdinSource(). Data is read
+    from the device directly to the write buffer as the channel accepts it,
+    and EOF is sent once the device ends.
+
+    Local files can be uploaded with setStdinFile() instead. The file is
+    memory mapped and written to the channel straight from the mapping, so
+    the file is not copied to the write buffer, and pages that have been
+    sent are dropped so that memory use stays flat for any file size.
+
+    With setMergedOutput() stdout and stderr are read into one buffer in the
+    order they were read from the channel, and emitted as tagged and
+    timestamped chunks with outputReady(). Merged processes do not have a
+    LibsshQtProcessStderr object, stderr() returns 0, and readyRead() is not
+    emitted for stdout.
+
+    In threads which do not run an event loop, waitForStarted(),
+    waitForReadyRead(), waitForBytesWritten() and waitForFinished() drive the
+    client and the process with LibsshQtClient::waitForActivity(). Deadlines
+    use a timer of the process and do not expire in such threads.
+
 */
 class LibsshQtProcess : public LibsshQtChannel
 {
@@ -38,30 +90,82 @@ public:
     Q_ENUMS(OutputBehaviour)
     enum OutputBehaviour
     {
-        OutputManual,   //!< No automatic handling, read output manually
-        OutputToQDebug, //!< All output is sent to QDebug()
-        OutputToDevNull //!< All output is completely ignored
+        OutputManual,       //!< No automatic handling, read output manually
+        OutputToQDebug,     //!< All output is sent to QDebug()
+        OutputToDevNull,    //!< All output is completely ignored
+        OutputToDevice,     //!< Raw output is written to a QIODevice
+        OutputToCallback,   //!< Raw output is passed to a callback function
+        OutputToFd,         //!< Raw output is written to a file descriptor
+        OutputToLines,      //!< Lines are emitted in batches, see linesReady()
+        OutputToTail        //!< Only the end of the output is kept
+    };
+
+    Q_ENUMS(TimeoutReason)
+    enum TimeoutReason
+    {
+        TimeoutNone,        //!< No deadline has expired
+        TimeoutWallClock,   //!< Process ran longer than timeout()
+        TimeoutIdle         //!< No output was received in idleTimeout()
     };
 
+    // A function pointer with user data, like the callbacks of libssh. Only
+    // the optional coroutine awaitables need a newer standard, the default
+    // build does not require C++11 for std::function.
+    typedef void (*OutputCallback)(const char *data, int len, void *user_data);
+
     explicit LibsshQtProcess(LibsshQtClient *parent);
     ~LibsshQtProcess();
 
     static const char *enumToString(const State value);
     static const char *enumToString(const OutputBehaviour value);
+    static const char *enumToString(const TimeoutReason value);
 
     void setCommand(QString command);
     QString command() const;
     int exitCode() const;
+    bool isFinished() const;
 
     void setStdoutBehaviour(OutputBehaviour behaviour, QString prefix = "");
     void setStderrBehaviour(OutputBehaviour behaviour, QString prefix = "");
+    void setStdoutSink(QIODevice *device);
+    void setStdoutSink(int fd);
+    void setStdoutSink(OutputCallback callback, void *user_data);
+    void setStderrSink(QIODevice *device);
+    void setStderrSink(int fd);
+    void setStderrSink(OutputCallback callback, void *user_data);
     LibsshQtProcessStderr *stderr();
 
+    void setMergedOutput(bool merged);
+    bool isMergedOutput() const;
+
+    void setStdinSource(QIODevice *device);
+    QIODevice *stdinSource() const;
+    bool setStdinFile(QString file_name);
+
+    void setTailSize(int max_bytes, int max_lines);
+    const LibsshQtTail &stdoutTail() const;
+    const LibsshQtTail &stderrTail() const;
+
+    void setTimeout(int msecs);
+    void setIdleTimeout(int msecs);
+    void setKillGracePeriod(int msecs);
+    int timeout() const;
+    int idleTimeout() const;
+    int killGracePeriod() const;
+    TimeoutReason timeoutReason() const;
+    bool sendSignal(QString signal);
+
     State state() const;
+    void reset();
 
     bool open(OpenMode ignored = 0);
     void close();
 
+    bool waitForStarted(int msecs = 30000);
+    bool waitForReadyRead(int msecs);
+    bool waitForBytesWritten(int msecs);
+    bool waitForFinished(int msecs = 30000);
+
 public slots:
     void openChannel();
     void closeChannel();
@@ -71,10 +175,14 @@ signals:
     void closed();
     void error();
     void finished(int exit_code);
+    void timedOut(int reason);  //!< TimeoutReason, process is being stopped
+    void outputReady(const LibsshQtChunks &chunks); //!< Merged output only
 
 protected:
     void setState(State state);
     void queueCheckIo();
+    bool runPendingWork();
+    void timerEvent(QTimerEvent *event);
 
 private slots:
     void processState();
@@ -83,19 +191,87 @@ private slots:
     void handleStderrOutput();
     void handleOutput(OutputBehaviour &behaviour,
                       QString &prefix, QString &line);
+    void handleSinkWritable();
+    void restartIdleTimer();
+    void handleStdinReadyRead();
+    void handleStdinFinished();
+    void handleStdinDestroyed();
+
+private:
+    class OutputSink
+    {
+    public:
+        OutputSink();
+
+        QIODevice          *device;
+        int                 fd;
+        QSocketNotifier    *fd_notifier;
+        OutputCallback      callback;
+        void               *callback_data;
+    };
+
+    void setSinkFd(OutputSink &sink, int fd);
+    void resetSink(OutputSink &sink);
+    void writeToSink(OutputBehaviour behaviour,
+                     OutputSink &sink, QByteArray &buffer);
+    void drainSink(OutputSink &sink, QByteArray &buffer);
+    void writeToTail(LibsshQtTail &tail, QByteArray &buffer);
+    void releaseChannel(bool keep_output);
+    void discardOutput();
+    void startDeadlines();
+    void stopDeadlines();
+    void scheduleDeadline();
+    void handleKillTimer();
+    void handleTimeout(TimeoutReason reason);
+    void createStderr();
+    void readMergedOutput();
+    void appendChunk(LibsshQtChunks::Stream stream, int len, qint64 time);
+    void emitChunks();
+    void readStdinSource();
+    void writeStdinFile();
+    void releaseStdinFile();
 
 private:
     QTimer                  timer_;
     State                   state_;
     QString                 command_;
+    QByteArray              command_bytes_;
     int                     exit_code_;
+    bool                    finished_;
+
+    QBasicTimer             deadline_timer_;    //!< Nearest deadline
+    QElapsedTimer           deadline_clock_;    //!< Started when opened
+    qint64                  last_output_;
+    qint64                  kill_at_;
+    int                     timeout_;
+    int                     idle_timeout_;
+    int                     kill_grace_period_;
+    int                     kill_stage_;
+    TimeoutReason           timeout_reason_;
 
     OutputBehaviour         stdout_behaviour_;
     QString                 stdout_output_prefix_;
+    OutputSink              stdout_sink_;
+    LibsshQtTail            stdout_tail_;
 
-    LibsshQtProcessStderr  *stderr_;
+    LibsshQtProcessStderr  *stderr_;        //!< Created when needed
     OutputBehaviour         stderr_behaviour_;
     QString                 stderr_output_prefix_;
+    OutputSink              stderr_sink_;
+    LibsshQtTail            stderr_tail_;
+
+    bool                    merged_output_;
+    QByteArray              merged_data_;
+    QVector<LibsshQtChunks::Chunk> merged_chunks_;
+
+    QIODevice              *stdin_source_;
+    bool                    stdin_finished_;
+
+    bool                    stdin_file_;
+    const char             *stdin_map_;
+    qint64                  stdin_map_size_;
+    qint64                  stdin_map_pos_;
+    qint64                  stdin_map_dropped_;  //!< Released with madvise()
 };
 
 
@@ -112,6 +288,7 @@ class LibsshQtProcessStderr : public LibsshQtChannel
 public:
     explicit LibsshQtProcessStderr(LibsshQtProcess *parent);
     void close();
+    bool waitForReadyRead(int msecs);
 
 protected:
     bool open(OpenMode ignored = 0);
@@ -149,6 +326,12 @@ inline QDebug operator<<(QDebug dbg, const LibsshQtProcess::OutputBehaviour valu
     return dbg;
 }
 
+inline QDebug operator<<(QDebug dbg, const LibsshQtProcess::TimeoutReason value)
+{
+    dbg << LibsshQtProcess::enumToString(value);
+    return dbg;
+}
+
 #endif
 
 #endif // LIBSSHQTPROCESS_H
@@ -0,0 +1,161 @@
+
+#include "libsshqtresult.h"
+#include "libsshqtclient.h"
+#include "libsshqtprocess.h"
+
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// LibsshQtResult
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+LibsshQtResult::LibsshQtResult() :
+    ok(false),
+    exitCode(-1),
+    openTime(-1),
+    totalTime(-1)
+{
+}
+
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// LibsshQtAsyncCommand
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+LibsshQtAsyncCommand::LibsshQtAsyncCommand(LibsshQtClient    *client,
+                                           QString            command,
+                                           const QByteArray  &stdin_data) :
+    QObject(client),
+    client_(client),
+    stdin_data_(stdin_data)
+{
+    timer_.start();
+    result_.command = command;
+    interface_.reportStarted();
+
+    process_ = client->runCommand(command);
+    process_->setStdoutBehaviour(LibsshQtProcess::OutputManual);
+    process_->setStderrBehaviour(LibsshQtProcess::OutputManual);
+
+    connect(process_, SIGNAL(opened()),
+            this,     SLOT(handleOpened()));
+    connect(process_, SIGNAL(readyRead()),
+            this,     SLOT(handleStdout()));
+    connect(process_->stderr(), SIGNAL(readyRead()),
+            this,               SLOT(handleStderr()));
+    connect(process_, SIGNAL(finished(int)),
+            this,     SLOT(handleFinished(int)));
+    connect(process_, SIGNAL(closed()),
+            this,     SLOT(handleClosed()));
+    connect(process_, SIGNAL(error()),
+            this,     SLOT(handleError()));
+
+    // A silent command would never notice the cancel in its output handlers
+    connect(&watcher_, SIGNAL(canceled()),
+            this,      SLOT(handleCanceled()));
+    watcher_.setFuture(interface_.future());
+}
+
+LibsshQtAsyncCommand::~LibsshQtAsyncCommand()
+{
+    // Deleted with the client before the command finished. The process is a
+    // child of the client too and may already be gone, so it is not touched.
+    if ( ! interface_.isFinished()) {
+        result_.errorMessage = tr("Client was destroyed");
+        result_.totalTime    = timer_.elapsed();
+        interface_.reportResult(result_);
+        interface_.reportFinished();
+    }
+}
+
+QFuture<LibsshQtResult> LibsshQtAsyncCommand::future()
+{
+    return interface_.future();
+}
+
+void LibsshQtAsyncCommand::reportResult()
+{
+    if ( ! process_ ) return;
+
+    watcher_.disconnect(this);
+    result_.totalTime = timer_.elapsed();
+
+    // Recycling disconnects all signals of the process and closes the
+    // channel, so it is safe to do from inside process signal handlers.
+    client_->recycleProcess(process_);
+    process_ = 0;
+
+    interface_.reportResult(result_);
+    interface_.reportFinished();
+    deleteLater();
+}
+
+void LibsshQtAsyncCommand::handleOpened()
+{
+    result_.openTime = timer_.elapsed();
+
+    if ( ! stdin_data_.isEmpty()) {
+        process_->write(stdin_data_);
+        stdin_data_.clear();
+    }
+
+    // Commands reading stdin must not wait forever
+    process_->sendEof();
+}
+
+void LibsshQtAsyncCommand::handleStdout()
+{
+    result_.stdoutData += process_->readAll();
+
+    // Without an event loop the watcher never reports the cancel
+    if ( interface_.isCanceled()) {
+        handleCanceled();
+    }
+}
+
+void LibsshQtAsyncCommand::handleStderr()
+{
+    result_.stderrData += process_->stderr()->readAll();
+
+    if ( interface_.isCanceled()) {
+        handleCanceled();
+    }
+}
+
+void LibsshQtAsyncCommand::handleFinished(int exit_code)
+{
+    result_.ok       = true;
+    result_.exitCode = exit_code;
+    reportResult();
+}
+
+void LibsshQtAsyncCommand::handleError()
+{
+    if ( process_->timeoutReason() != LibsshQtProcess::TimeoutNone ) {
+        result_.errorMessage = tr("Command timed out");
+    } else if ( process_->isClientError()) {
+        result_.errorMessage = client_->errorCodeAndMessage();
+    } else {
+        result_.errorMessage = process_->errorCodeAndMessage();
+    }
+    reportResult();
+}
+
+/*!
+    closed() comes before finished() when the command exits. A disconnect of
+    the client only closes the process, the command never finishes.
+*/
+void LibsshQtAsyncCommand::handleClosed()
+{
+    if ( ! process_ || process_->isFinished()) return;
+
+    result_.errorMessage = tr("Process was closed before it finished");
+    reportResult();
+}
+
+void LibsshQtAsyncCommand::handleCanceled()
+{
+    result_.errorMessage = tr("Command was canceled");
+    reportResult();
+}
@@ -0,0 +1,87 @@
+#ifndef LIBSSHQTRESULT_H
+#define LIBSSHQTRESULT_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QString>
+#include <QElapsedTimer>
+#include <QFutureInterface>
+#include <QFutureWatcher>
+#include <QMetaType>
+
+class LibsshQtClient;
+class LibsshQtProcess;
+
+/*!
+
+    LibsshQtResult - Result of a command run with runCommandAsync()
+
+    If the command could not be run, ok is false, exitCode is -1 and
+    errorMessage describes the error. Output that was received before an
+    error is kept.
+
+*/
+class LibsshQtResult
+{
+public:
+    LibsshQtResult();
+
+    QString     command;
+    bool        ok;
+    int         exitCode;
+    QString     errorMessage;
+    QByteArray  stdoutData;
+    QByteArray  stderrData;
+    qint64      openTime;       //!< Milliseconds from start to open channel
+    qint64      totalTime;      //!< Milliseconds from start to finish
+};
+
+Q_DECLARE_METATYPE(LibsshQtResult)
+
+/*!
+
+    LibsshQtAsyncCommand - Runs a command for LibsshQtClient::runCommandAsync()
+
+    Collects the output of one LibsshQtProcess and reports it to a QFuture.
+    The object deletes itself once the result has been reported, and the
+    process is given back to the client for reuse. Canceling the future
+    closes the channel as soon as the event loop of the client runs, even if
+    the command produces no output. If the client is destroyed before the
+    command has finished, the future finishes with an error result.
+
+*/
+class LibsshQtAsyncCommand : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit LibsshQtAsyncCommand(LibsshQtClient    *client,
+                                  QString            command,
+                                  const QByteArray  &stdin_data);
+    ~LibsshQtAsyncCommand();
+
+    QFuture<LibsshQtResult> future();
+
+private:
+    void reportResult();
+
+private slots:
+    void handleOpened();
+    void handleStdout();
+    void handleStderr();
+    void handleFinished(int exit_code);
+    void handleClosed();
+    void handleError();
+    void handleCanceled();
+
+private:
+    LibsshQtClient                     *client_;
+    LibsshQtProcess                    *process_;
+    QByteArray                          stdin_data_;
+    QElapsedTimer                       timer_;
+    LibsshQtResult                      result_;
+    QFutureInterface<LibsshQtResult>    interface_;
+    QFutureWatcher<LibsshQtResult>      watcher_;
+};
+
+#endif // LIBSSHQTRESULT_H
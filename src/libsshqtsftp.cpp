@@ -0,0 +1,898 @@
+
+#include <QDebug>
+#include <QMetaEnum>
+#include <QtEndian>
+
+#include <sys/stat.h>
+#include <algorithm>
+
+#include "libsshqtsftp.h"
+#include "libsshqtclient.h"
+#include "libsshqtsubsystem.h"
+#include "libsshqtframer.h"
+#include "libsshqtdebug.h"
+
+// Packet types of SFTP version 3
+static const quint8 fxp_init      = 1;
+static const quint8 fxp_version   = 2;
+static const quint8 fxp_open      = 3;
+static const quint8 fxp_close     = 4;
+static const quint8 fxp_read      = 5;
+static const quint8 fxp_write     = 6;
+static const quint8 fxp_fsetstat  = 10;
+static const quint8 fxp_opendir   = 11;
+static const quint8 fxp_readdir   = 12;
+static const quint8 fxp_remove    = 13;
+static const quint8 fxp_mkdir     = 14;
+static const quint8 fxp_rmdir     = 15;
+static const quint8 fxp_stat      = 17;
+static const quint8 fxp_rename    = 18;
+static const quint8 fxp_status    = 101;
+static const quint8 fxp_handle    = 102;
+static const quint8 fxp_data      = 103;
+static const quint8 fxp_name      = 104;
+static const quint8 fxp_attrs     = 105;
+
+static const quint32 attr_extended = 0x80000000;
+
+static void appendU32(QByteArray &buffer, quint32 value)
+{
+    uchar data[4];
+    qToBigEndian(value, data);
+    buffer.append(reinterpret_cast<const char *>(data), 4);
+}
+
+static void appendU64(QByteArray &buffer, quint64 value)
+{
+    appendU32(buffer, quint32(value >> 32));
+    appendU32(buffer, quint32(value));
+}
+
+static void appendString(QByteArray &buffer, const QByteArray &value)
+{
+    appendU32(buffer, value.size());
+    buffer.append(value);
+}
+
+static void appendPermissions(QByteArray &buffer, int mode)
+{
+    appendU32(buffer, LibsshQtSftpAttributes::FlagPermissions);
+    appendU32(buffer, mode);
+}
+
+/*
+    Bounds checked reader for reply packets, ok is cleared if the packet
+    ends before the requested value.
+*/
+class LibsshQtSftpReader
+{
+public:
+    LibsshQtSftpReader(const QByteArray &packet, int pos) :
+        data(packet.constData()),
+        size(packet.size()),
+        pos(pos),
+        ok(true)
+    {
+    }
+
+    bool has(int len)
+    {
+        if ( ok && len >= 0 && size - pos >= len ) return true;
+        ok = false;
+        return false;
+    }
+
+    quint32 readU32()
+    {
+        if ( ! has(4)) return 0;
+        pos += 4;
+        return qFromBigEndian<quint32>(
+                    reinterpret_cast<const uchar *>(data + pos - 4));
+    }
+
+    quint64 readU64()
+    {
+        quint64 high = readU32();
+        return (high << 32) | readU32();
+    }
+
+    QByteArray readString()
+    {
+        quint32 len = readU32();
+        if ( len > quint32(size) || ! has(len)) return QByteArray();
+        pos += len;
+        return QByteArray(data + pos - len, len);
+    }
+
+    LibsshQtSftpAttributes readAttributes()
+    {
+        LibsshQtSftpAttributes attributes;
+        attributes.flags = readU32();
+
+        if ( attributes.flags & LibsshQtSftpAttributes::FlagSize ) {
+            attributes.size = readU64();
+        }
+        if ( attributes.flags & LibsshQtSftpAttributes::FlagUidGid ) {
+            attributes.uid = readU32();
+            attributes.gid = readU32();
+        }
+        if ( attributes.flags & LibsshQtSftpAttributes::FlagPermissions ) {
+            attributes.permissions = readU32();
+        }
+        if ( attributes.flags & LibsshQtSftpAttributes::FlagTimes ) {
+            attributes.atime = readU32();
+            attributes.mtime = readU32();
+        }
+        if ( attributes.flags & attr_extended ) {
+            quint32 count = readU32();
+            for ( quint32 i = 0; i < count && ok; i++ ) {
+                readString();
+                readString();
+            }
+        }
+
+        attributes.flags &= ~attr_extended;
+        return attributes;
+    }
+
+    const char *data;
+    int         size;
+    int         pos;
+    bool        ok;
+};
+
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// LibsshQtSftpAttributes
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+LibsshQtSftpAttributes::LibsshQtSftpAttributes() :
+    flags(0),
+    size(0),
+    uid(0),
+    gid(0),
+    permissions(0),
+    atime(0),
+    mtime(0)
+{
+}
+
+bool LibsshQtSftpAttributes::isDirectory() const
+{
+    return ( flags & FlagPermissions ) && S_ISDIR(permissions);
+}
+
+bool LibsshQtSftpAttributes::isRegularFile() const
+{
+    return ( flags & FlagPermissions ) && S_ISREG(permissions);
+}
+
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// LibsshQtSftpRequest
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+LibsshQtSftpRequest::LibsshQtSftpRequest(Type type,
+                                         QString path,
+                                         LibsshQtSftp *parent) :
+    QObject(parent),
+    sftp_(parent),
+    id_(0),
+    pending_(false),
+    type_(type),
+    path_(path),
+    finished_(false),
+    error_(false),
+    status_(StatusOk),
+    offset_(0),
+    at_end_(false),
+    closing_(false)
+{
+}
+
+LibsshQtSftpRequest::~LibsshQtSftpRequest()
+{
+    // Keep the id so that the reply is recognized and ignored
+    if ( pending_ ) {
+        sftp_->requests_[id_] = 0;
+    }
+}
+
+const char *LibsshQtSftpRequest::enumToString(const Type value)
+{
+    return staticMetaObject.enumerator(
+                staticMetaObject.indexOfEnumerator("Type"))
+                    .valueToKey(value);
+}
+
+const char *LibsshQtSftpRequest::enumToString(const Status value)
+{
+    return staticMetaObject.enumerator(
+                staticMetaObject.indexOfEnumerator("Status"))
+                    .valueToKey(value);
+}
+
+LibsshQtSftpRequest::Type LibsshQtSftpRequest::type() const
+{
+    return type_;
+}
+
+/*!
+    Get the path the request was made for, empty for requests which operate
+    on a handle.
+*/
+QString LibsshQtSftpRequest::path() const
+{
+    return path_;
+}
+
+bool LibsshQtSftpRequest::isFinished() const
+{
+    return finished_;
+}
+
+bool LibsshQtSftpRequest::isError() const
+{
+    return error_;
+}
+
+/*!
+    Get the SFTP status code of the reply, see Status. Requests which fail
+    because the channel was closed have StatusConnectionLost.
+*/
+int LibsshQtSftpRequest::statusCode() const
+{
+    return status_;
+}
+
+QString LibsshQtSftpRequest::errorMessage() const
+{
+    return error_message_;
+}
+
+/*!
+    Get the handle of a file opened with LibsshQtSftp::open(), or the handle
+    given to close(), read() or write().
+*/
+QByteArray LibsshQtSftpRequest::handle() const
+{
+    return handle_;
+}
+
+quint64 LibsshQtSftpRequest::offset() const
+{
+    return offset_;
+}
+
+/*!
+    Get the data returned by a read request, the server may return less data
+    than was requested even if the end of file was not reached.
+*/
+QByteArray LibsshQtSftpRequest::data() const
+{
+    return data_;
+}
+
+/*!
+    Was the read request at or past the end of file?
+*/
+bool LibsshQtSftpRequest::atEnd() const
+{
+    return at_end_;
+}
+
+LibsshQtSftpAttributes LibsshQtSftpRequest::attributes() const
+{
+    return attributes_;
+}
+
+/*!
+    Get the entries of a directory read with LibsshQtSftp::readDir(), "."
+    and ".." are not included.
+*/
+QList<LibsshQtSftpEntry> LibsshQtSftpRequest::entries() const
+{
+    return entries_;
+}
+
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// LibsshQtSftp
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+LibsshQtSftp::LibsshQtSftp(LibsshQtClient *parent) :
+    QObject(parent),
+    debug_prefix_(LibsshQt::debugPrefix(this)),
+    debug_output_(parent->isDebugEnabled()),
+    client_(parent),
+    channel_(0),
+    state_(StateClosed),
+    server_version_(0),
+    next_id_(1)
+{
+    LIBSSHQT_DEBUG("Constructor");
+
+    connect(client_, SIGNAL(debugChanged()),
+            this,    SLOT(handleDebugChanged()));
+}
+
+LibsshQtSftp::~LibsshQtSftp()
+{
+    LIBSSHQT_DEBUG("Destructor");
+
+    if ( channel_ ) {
+        channel_->disconnect(this);
+        delete channel_;
+        channel_ = 0;
+    }
+
+    // Requests are deleted after requests_, by the QObject destructor
+    foreach ( LibsshQtSftpRequest *request, requests_ ) {
+        if ( request ) request->pending_ = false;
+    }
+}
+
+const char *LibsshQtSftp::enumToString(const State value)
+{
+    return staticMetaObject.enumerator(
+                staticMetaObject.indexOfEnumerator("State"))
+                    .valueToKey(value);
+}
+
+LibsshQtClient *LibsshQtSftp::client()
+{
+    return client_;
+}
+
+LibsshQtSftp::State LibsshQtSftp::state() const
+{
+    return state_;
+}
+
+/*!
+    Get the protocol version announced by the server, 0 until the channel
+    has been opened.
+*/
+int LibsshQtSftp::serverVersion() const
+{
+    return server_version_;
+}
+
+/*!
+    Get the number of requests which have not received a reply yet.
+*/
+int LibsshQtSftp::pendingCount() const
+{
+    return requests_.count();
+}
+
+/*!
+    Open a remote file, the handle of the file is available from the request
+    once it has finished. Mode is used if the file is created.
+*/
+LibsshQtSftpRequest *LibsshQtSftp::open(QString path, OpenFlags flags, int mode)
+{
+    LibsshQtSftpRequest *request =
+            new LibsshQtSftpRequest(LibsshQtSftpRequest::TypeOpen, path, this);
+
+    QByteArray payload;
+    appendString(payload, path.toLocal8Bit());
+    appendU32(payload, flags);
+    appendPermissions(payload, mode);
+
+    sendPacket(request, fxp_open, payload);
+    return request;
+}
+
+LibsshQtSftpRequest *LibsshQtSftp::close(const QByteArray &handle)
+{
+    LibsshQtSftpRequest *request =
+            new LibsshQtSftpRequest(LibsshQtSftpRequest::TypeClose,
+                                    QString(), this);
+    request->handle_ = handle;
+
+    QByteArray payload;
+    appendString(payload, handle);
+
+    sendPacket(request, fxp_close, payload);
+    return request;
+}
+
+/*!
+    Read at most length bytes starting from offset.
+*/
+LibsshQtSftpRequest *LibsshQtSftp::read(const QByteArray &handle,
+                                        quint64 offset,
+                                        quint32 length)
+{
+    LibsshQtSftpRequest *request =
+            new LibsshQtSftpRequest(LibsshQtSftpRequest::TypeRead,
+                                    QString(), this);
+    request->handle_ = handle;
+    request->offset_ = offset;
+
+    QByteArray payload;
+    payload.reserve(handle.size() + 16);
+    appendString(payload, handle);
+    appendU64(payload, offset);
+    appendU32(payload, length);
+
+    sendPacket(request, fxp_read, payload);
+    return request;
+}
+
+/*!
+    Write data starting from offset. Servers limit the packet size, keep
+    writes at most 32 KiB to be compatible with all servers.
+*/
+LibsshQtSftpRequest *LibsshQtSftp::write(const QByteArray &handle,
+                                         quint64 offset,
+                                         const QByteArray &data)
+{
+    LibsshQtSftpRequest *request =
+            new LibsshQtSftpRequest(LibsshQtSftpRequest::TypeWrite,
+                                    QString(), this);
+    request->handle_ = handle;
+    request->offset_ = offset;
+
+    QByteArray payload;
+    payload.reserve(handle.size() + data.size() + 16);
+    appendString(payload, handle);
+    appendU64(payload, offset);
+    appendString(payload, data);
+
+    sendPacket(request, fxp_write, payload);
+    return request;
+}
+
+/*!
+    Get the attributes of a remote file, symbolic links are followed.
+*/
+LibsshQtSftpRequest *LibsshQtSftp::stat(QString path)
+{
+    LibsshQtSftpRequest *request =
+            new LibsshQtSftpRequest(LibsshQtSftpRequest::TypeStat, path, this);
+
+    QByteArray payload;
+    appendString(payload, path.toLocal8Bit());
+
+    sendPacket(request, fxp_stat, payload);
+    return request;
+}
+
+/*!
+    Set the size of an open remote file, bytes past size are removed.
+*/
+LibsshQtSftpRequest *LibsshQtSftp::truncate(const QByteArray &handle,
+                                            quint64 size)
+{
+    LibsshQtSftpRequest *request =
+            new LibsshQtSftpRequest(LibsshQtSftpRequest::TypeTruncate,
+                                    QString(), this);
+    request->handle_ = handle;
+
+    QByteArray payload;
+    appendString(payload, handle);
+    appendU32(payload, LibsshQtSftpAttributes::FlagSize);
+    appendU64(payload, size);
+
+    sendPacket(request, fxp_fsetstat, payload);
+    return request;
+}
+
+/*!
+    Get all entries of a remote directory.
+*/
+LibsshQtSftpRequest *LibsshQtSftp::readDir(QString path)
+{
+    LibsshQtSftpRequest *request =
+            new LibsshQtSftpRequest(LibsshQtSftpRequest::TypeReadDir,
+                                    path, this);
+
+    QByteArray payload;
+    appendString(payload, path.toLocal8Bit());
+
+    sendPacket(request, fxp_opendir, payload);
+    return request;
+}
+
+/*!
+    Rename a remote file, fails if new_path exists.
+*/
+LibsshQtSftpRequest *LibsshQtSftp::rename(QString old_path, QString new_path)
+{
+    LibsshQtSftpRequest *request =
+            new LibsshQtSftpRequest(LibsshQtSftpRequest::TypeRename,
+                                    old_path, this);
+
+    QByteArray payload;
+    appendString(payload, old_path.toLocal8Bit());
+    appendString(payload, new_path.toLocal8Bit());
+
+    sendPacket(request, fxp_rename, payload);
+    return request;
+}
+
+LibsshQtSftpRequest *LibsshQtSftp::remove(QString path)
+{
+    LibsshQtSftpRequest *request =
+            new LibsshQtSftpRequest(LibsshQtSftpRequest::TypeRemove,
+                                    path, this);
+
+    QByteArray payload;
+    appendString(payload, path.toLocal8Bit());
+
+    sendPacket(request, fxp_remove, payload);
+    return request;
+}
+
+LibsshQtSftpRequest *LibsshQtSftp::mkdir(QString path, int mode)
+{
+    LibsshQtSftpRequest *request =
+            new LibsshQtSftpRequest(LibsshQtSftpRequest::TypeMkdir,
+                                    path, this);
+
+    QByteArray payload;
+    appendString(payload, path.toLocal8Bit());
+    appendPermissions(payload, mode);
+
+    sendPacket(request, fxp_mkdir, payload);
+    return request;
+}
+
+LibsshQtSftpRequest *LibsshQtSftp::rmdir(QString path)
+{
+    LibsshQtSftpRequest *request =
+            new LibsshQtSftpRequest(LibsshQtSftpRequest::TypeRmdir,
+                                    path, this);
+
+    QByteArray payload;
+    appendString(payload, path.toLocal8Bit());
+
+    sendPacket(request, fxp_rmdir, payload);
+    return request;
+}
+
+/*!
+    Open the SFTP channel. Making a request starts the channel
+    automatically.
+*/
+void LibsshQtSftp::start()
+{
+    if ( state_ != StateClosed &&
+         state_ != StateError ) return;
+
+    LIBSSHQT_DEBUG("Opening SFTP channel");
+
+    setState(StateOpening);
+    server_version_ = 0;
+
+    channel_ = client_->openSubsystem("sftp");
+    channel_->setFramer(new LibsshQtLengthFramer);
+
+    connect(channel_, SIGNAL(opened()),
+            this,     SLOT(handleOpened()));
+    connect(channel_, SIGNAL(messageReceived(QByteArray)),
+            this,     SLOT(handleMessage(QByteArray)));
+    connect(channel_, SIGNAL(closed()),
+            this,     SLOT(handleClosed()));
+    connect(channel_, SIGNAL(error()),
+            this,     SLOT(handleChannelError()));
+}
+
+/*!
+    Close the SFTP channel, requests which have not received a reply fail.
+    Open handles are closed by the server.
+*/
+void LibsshQtSftp::stop()
+{
+    if ( state_ != StateClosed ) {
+        releaseChannel();
+        failRequests(tr("SFTP channel was closed"));
+        setState(StateClosed);
+    }
+}
+
+void LibsshQtSftp::setState(State state)
+{
+    if ( state_ == state ) {
+        LIBSSHQT_DEBUG("State is already" << state);
+        return;
+    }
+
+    LIBSSHQT_DEBUG("Changing state to" << state);
+    state_ = state;
+
+    switch ( state_ ) {
+    case StateClosed:       emit closed();          break;
+    case StateOpening:                              break;
+    case StateInit:                                 break;
+    case StateOpen:         emit opened();          break;
+    case StateError:        emit error();           break;
+    }
+}
+
+void LibsshQtSftp::releaseChannel()
+{
+    if ( channel_ ) {
+        // Channel may be released from inside its own signal handlers
+        channel_->disconnect(this);
+        channel_->closeChannel();
+        channel_->deleteLater();
+        channel_ = 0;
+    }
+
+    unsent_.clear();
+}
+
+void LibsshQtSftp::sendPacket(LibsshQtSftpRequest *request,
+                              int type,
+                              const QByteArray &payload)
+{
+    quint32 id = next_id_++;
+
+    QByteArray packet;
+    packet.reserve(5 + payload.size());
+    packet.append(char(type));
+    appendU32(packet, id);
+    packet.append(payload);
+
+    requests_.insert(id, request);
+    request->id_      = id;
+    request->pending_ = true;
+
+    if ( state_ == StateOpen ) {
+        channel_->sendMessage(packet);
+    } else {
+        unsent_ << packet;
+        start();
+    }
+}
+
+void LibsshQtSftp::handleReply(LibsshQtSftpRequest *request,
+                               int type,
+                               const QByteArray &packet,
+                               int pos)
+{
+    LibsshQtSftpReader reader(packet, pos);
+
+    int status = LibsshQtSftpRequest::StatusOk;
+    QString message;
+
+    if ( type == fxp_status ) {
+        status  = reader.readU32();
+        message = QString::fromUtf8(reader.readString());
+    }
+
+    if ( ! reader.ok ) {
+        finishRequest(request, LibsshQtSftpRequest::StatusBadMessage,
+                      tr("Invalid status reply"));
+        return;
+    }
+
+    switch ( request->type_ ) {
+
+    case LibsshQtSftpRequest::TypeOpen:
+        if ( type == fxp_handle ) {
+            request->handle_ = reader.readString();
+        } else if ( type != fxp_status ) {
+            reader.ok = false;
+        }
+        break;
+
+    case LibsshQtSftpRequest::TypeRead:
+        if ( type == fxp_data ) {
+            request->data_ = reader.readString();
+        } else if ( type == fxp_status &&
+                    status == LibsshQtSftpRequest::StatusEof ) {
+            request->at_end_ = true;
+            status = LibsshQtSftpRequest::StatusOk;
+        } else if ( type != fxp_status ) {
+            reader.ok = false;
+        }
+        break;
+
+    case LibsshQtSftpRequest::TypeStat:
+        if ( type == fxp_attrs ) {
+            request->attributes_ = reader.readAttributes();
+        } else if ( type != fxp_status ) {
+            reader.ok = false;
+        }
+        break;
+
+    case LibsshQtSftpRequest::TypeReadDir:
+        // The directory is opened, read until EOF and closed, the request
+        // finishes when the close has been acknowledged
+        if ( request->closing_ ) {
+            if ( request->status_ != LibsshQtSftpRequest::StatusOk ) {
+                status  = request->status_;
+                message = request->error_message_;
+            }
+            break;
+        }
+
+        if ( type == fxp_handle ) {
+            request->handle_ = reader.readString();
+            if ( reader.ok ) {
+                QByteArray payload;
+                appendString(payload, request->handle_);
+                sendPacket(request, fxp_readdir, payload);
+                return;
+            }
+
+        } else if ( type == fxp_name ) {
+            quint32 count = reader.readU32();
+            for ( quint32 i = 0; i < count && reader.ok; i++ ) {
+                LibsshQtSftpEntry entry;
+                entry.name       = QString::fromLocal8Bit(reader.readString());
+                entry.longName   = QString::fromLocal8Bit(reader.readString());
+                entry.attributes = reader.readAttributes();
+                if ( entry.name != "." && entry.name != ".." ) {
+                    request->entries_ << entry;
+                }
+            }
+
+            if ( reader.ok ) {
+                QByteArray payload;
+                appendString(payload, request->handle_);
+                sendPacket(request, fxp_readdir, payload);
+                return;
+            }
+
+        } else if ( type == fxp_status && ! request->handle_.isEmpty()) {
+            if ( status != LibsshQtSftpRequest::StatusEof ) {
+                request->status_        = status;
+                request->error_message_ = message;
+            }
+
+            request->closing_ = true;
+            QByteArray payload;
+            appendString(payload, request->handle_);
+            sendPacket(request, fxp_close, payload);
+            return;
+
+        } else if ( type != fxp_status ) {
+            reader.ok = false;
+        }
+        break;
+
+    default:
+        if ( type != fxp_status ) {
+            reader.ok = false;
+        }
+        break;
+    }
+
+    if ( ! reader.ok ) {
+        finishRequest(request, LibsshQtSftpRequest::StatusBadMessage,
+                      tr("Invalid reply of type %1").arg(type));
+        return;
+    }
+
+    finishRequest(request, status, message);
+}
+
+void LibsshQtSftp::finishRequest(LibsshQtSftpRequest *request,
+                                 int status,
+                                 QString message)
+{
+    request->finished_ = true;
+    request->status_   = status;
+    request->error_    = status != LibsshQtSftpRequest::StatusOk;
+
+    if ( request->error_ ) {
+        if ( message.isEmpty()) {
+            message = tr("SFTP error %1").arg(status);
+        }
+        request->error_message_ = message;
+        LIBSSHQT_DEBUG("Request" << request->type_ << request->path_ <<
+                       "failed:" << message);
+        emit request->error();
+    } else {
+        request->error_message_.clear();
+        emit request->finished();
+    }
+
+    emit requestFinished(request);
+}
+
+void LibsshQtSftp::failRequests(QString message)
+{
+    QList<quint32> ids = requests_.keys();
+    std::sort(ids.begin(), ids.end());
+
+    QHash<quint32, LibsshQtSftpRequest *> failed = requests_;
+    requests_.clear();
+    unsent_.clear();
+
+    LIBSSHQT_DEBUG("Failing" << ids.count() << "requests:" << message);
+
+    foreach ( quint32 id, ids ) {
+        LibsshQtSftpRequest *request = failed.value(id);
+        if ( ! request ) continue;
+
+        request->pending_ = false;
+        finishRequest(request,
+                      LibsshQtSftpRequest::StatusConnectionLost, message);
+    }
+}
+
+void LibsshQtSftp::handleDebugChanged()
+{
+    debug_output_ = client_->isDebugEnabled();
+}
+
+void LibsshQtSftp::handleOpened()
+{
+    LIBSSHQT_DEBUG("Channel opened, sending init");
+
+    setState(StateInit);
+
+    QByteArray packet;
+    packet.append(char(fxp_init));
+    appendU32(packet, 3);
+    channel_->sendMessage(packet);
+}
+
+void LibsshQtSftp::handleMessage(const QByteArray &message)
+{
+    if ( message.isEmpty()) {
+        LIBSSHQT_CRITICAL("Received empty SFTP packet");
+        return;
+    }
+
+    int type = uchar(message.at(0));
+
+    if ( type == fxp_version ) {
+        LibsshQtSftpReader reader(message, 1);
+        server_version_ = reader.readU32();
+        LIBSSHQT_DEBUG("Server SFTP version:" << server_version_);
+
+        if ( state_ == StateInit ) {
+            setState(StateOpen);
+            QList<QByteArray> unsent = unsent_;
+            unsent_.clear();
+            foreach ( const QByteArray &packet, unsent ) {
+                if ( ! channel_ ) return;
+                channel_->sendMessage(packet);
+            }
+        }
+        return;
+    }
+
+    LibsshQtSftpReader reader(message, 1);
+    quint32 id = reader.readU32();
+
+    if ( ! reader.ok || ! requests_.contains(id)) {
+        LIBSSHQT_CRITICAL("Received reply to unknown request" << id);
+        return;
+    }
+
+    LibsshQtSftpRequest *request = requests_.take(id);
+    if ( ! request ) {
+        LIBSSHQT_DEBUG("Ignoring reply to deleted request" << id);
+        return;
+    }
+    request->pending_ = false;
+
+    handleReply(request, type, message, reader.pos);
+}
+
+void LibsshQtSftp::handleClosed()
+{
+    LIBSSHQT_DEBUG("SFTP channel closed");
+    stop();
+}
+
+void LibsshQtSftp::handleChannelError()
+{
+    QString message = channel_->errorCodeAndMessage();
+    LIBSSHQT_DEBUG("SFTP channel error:" << message);
+
+    releaseChannel();
+    failRequests(message);
+    setState(StateError);
+}
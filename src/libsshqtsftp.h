@@ -0,0 +1,286 @@
+#ifndef LIBSSHQTSFTP_H
+#define LIBSSHQTSFTP_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+
+class LibsshQtClient;
+class LibsshQtSubsystem;
+class LibsshQtSftp;
+
+/*!
+
+    LibsshQtSftpAttributes - File attributes of SFTP version 3
+
+    Only the fields included in flags are valid.
+
+*/
+class LibsshQtSftpAttributes
+{
+public:
+    enum Flag
+    {
+        FlagSize        = 0x00000001,
+        FlagUidGid      = 0x00000002,
+        FlagPermissions = 0x00000004,
+        FlagTimes       = 0x00000008
+    };
+
+    LibsshQtSftpAttributes();
+
+    bool isDirectory() const;
+    bool isRegularFile() const;
+
+    quint32     flags;
+    quint64     size;
+    quint32     uid;
+    quint32     gid;
+    quint32     permissions;    //!< Mode bits, including the file type
+    quint32     atime;          //!< Seconds since epoch
+    quint32     mtime;          //!< Seconds since epoch
+};
+
+/*!
+
+    LibsshQtSftpEntry - Directory entry returned by LibsshQtSftp::readDir()
+
+*/
+class LibsshQtSftpEntry
+{
+public:
+    QString                 name;
+    QString                 longName;   //!< ls -l style line from the server
+    LibsshQtSftpAttributes  attributes;
+};
+
+/*!
+
+    LibsshQtSftpRequest - An operation made with LibsshQtSftp
+
+    Once the server has replied to the request, finished() is emitted, or
+    error() if the operation failed or the SFTP channel was closed before
+    the reply arrived. LibsshQtSftp::requestFinished() is emitted after
+    either of them.
+
+    Requests are owned by LibsshQtSftp, use deleteLater() to free a request
+    after it has finished. If a request is deleted before its reply arrives,
+    the reply is ignored.
+
+*/
+class LibsshQtSftpRequest : public QObject
+{
+    Q_OBJECT
+    friend class LibsshQtSftp;
+
+public:
+    Q_ENUMS(Type)
+    enum Type
+    {
+        TypeOpen,
+        TypeClose,
+        TypeRead,
+        TypeWrite,
+        TypeStat,
+        TypeReadDir,
+        TypeRename,
+        TypeRemove,
+        TypeMkdir,
+        TypeRmdir,
+        TypeTruncate
+    };
+
+    Q_ENUMS(Status)
+    enum Status
+    {
+        StatusOk                = 0,
+        StatusEof               = 1,
+        StatusNoSuchFile        = 2,
+        StatusPermissionDenied  = 3,
+        StatusFailure           = 4,
+        StatusBadMessage        = 5,
+        StatusNoConnection      = 6,
+        StatusConnectionLost    = 7,
+        StatusOpUnsupported     = 8
+    };
+
+    ~LibsshQtSftpRequest();
+
+    static const char *enumToString(const Type value);
+    static const char *enumToString(const Status value);
+
+    Type type() const;
+    QString path() const;
+
+    bool isFinished() const;
+    bool isError() const;
+    int statusCode() const;
+    QString errorMessage() const;
+
+    QByteArray handle() const;
+    quint64 offset() const;
+    QByteArray data() const;
+    bool atEnd() const;
+    LibsshQtSftpAttributes attributes() const;
+    QList<LibsshQtSftpEntry> entries() const;
+
+signals:
+    void finished();
+    void error();
+
+private:
+    explicit LibsshQtSftpRequest(Type type, QString path,
+                                 LibsshQtSftp *parent);
+
+private:
+    LibsshQtSftp               *sftp_;
+    quint32                     id_;            //!< Of the last packet sent
+    bool                        pending_;       //!< Waiting for a reply
+    Type                        type_;
+    QString                     path_;
+    bool                        finished_;
+    bool                        error_;
+    int                         status_;
+    QString                     error_message_;
+
+    QByteArray                  handle_;        //!< TypeOpen, TypeReadDir
+    quint64                     offset_;        //!< TypeRead, TypeWrite
+    QByteArray                  data_;          //!< TypeRead
+    bool                        at_end_;        //!< TypeRead
+    LibsshQtSftpAttributes      attributes_;    //!< TypeStat
+    QList<LibsshQtSftpEntry>    entries_;       //!< TypeReadDir
+    bool                        closing_;       //!< TypeReadDir
+};
+
+/*!
+
+    LibsshQtSftp - Asynchronous SFTP client
+
+    LibsshQtSftp opens an "sftp" subsystem channel and speaks SFTP protocol
+    version 3 over it. The libssh SFTP functions block until the server has
+    replied, so the protocol is implemented here on top of
+    LibsshQtSubsystem, which is driven by the same socket notifiers and
+    doProcessState() signal as LibsshQtProcess. No function of this class
+    blocks the event loop.
+
+    Every operation returns a LibsshQtSftpRequest, which is finished when the
+    reply arrives. Operations can be made before the channel has been
+    opened, they are sent once the version exchange is done. Any number of
+    requests can be in flight at the same time, the server may answer them
+    in any order.
+
+    readDir() opens the directory, reads all entries and closes the
+    directory as one request. Reads past the end of a file finish with
+    atEnd() set and no data.
+
+*/
+class LibsshQtSftp : public QObject
+{
+    Q_OBJECT
+    friend class LibsshQtSftpRequest;
+
+public:
+    Q_ENUMS(State)
+    enum State
+    {
+        StateClosed,
+        StateOpening,
+        StateInit,
+        StateOpen,
+        StateError
+    };
+
+    Q_FLAGS(OpenFlag)
+    enum OpenFlag
+    {
+        OpenRead        = 0x01,
+        OpenWrite       = 0x02,
+        OpenAppend      = 0x04,
+        OpenCreate      = 0x08,
+        OpenTruncate    = 0x10,
+        OpenExclusive   = 0x20
+    };
+    Q_DECLARE_FLAGS(OpenFlags, OpenFlag)
+
+    explicit LibsshQtSftp(LibsshQtClient *parent);
+    ~LibsshQtSftp();
+
+    static const char *enumToString(const State value);
+
+    LibsshQtClient *client();
+    State state() const;
+    int serverVersion() const;
+    int pendingCount() const;
+
+    LibsshQtSftpRequest *open(QString path, OpenFlags flags, int mode = 0644);
+    LibsshQtSftpRequest *close(const QByteArray &handle);
+    LibsshQtSftpRequest *read(const QByteArray &handle,
+                              quint64 offset, quint32 length);
+    LibsshQtSftpRequest *write(const QByteArray &handle,
+                               quint64 offset, const QByteArray &data);
+    LibsshQtSftpRequest *stat(QString path);
+    LibsshQtSftpRequest *truncate(const QByteArray &handle, quint64 size);
+    LibsshQtSftpRequest *readDir(QString path);
+    LibsshQtSftpRequest *rename(QString old_path, QString new_path);
+    LibsshQtSftpRequest *remove(QString path);
+    LibsshQtSftpRequest *mkdir(QString path, int mode = 0755);
+    LibsshQtSftpRequest *rmdir(QString path);
+
+public slots:
+    void start();
+    void stop();
+
+signals:
+    void opened();
+    void closed();
+    void error();
+    void requestFinished(LibsshQtSftpRequest *request);
+
+private:
+    void setState(State state);
+    void releaseChannel();
+    void sendPacket(LibsshQtSftpRequest *request, int type,
+                    const QByteArray &payload);
+    void handleReply(LibsshQtSftpRequest *request, int type,
+                     const QByteArray &packet, int pos);
+    void finishRequest(LibsshQtSftpRequest *request, int status,
+                       QString message);
+    void failRequests(QString message);
+
+private slots:
+    void handleDebugChanged();
+    void handleOpened();
+    void handleMessage(const QByteArray &message);
+    void handleClosed();
+    void handleChannelError();
+
+private:
+    QString                                 debug_prefix_;
+    bool                                    debug_output_;
+
+    LibsshQtClient                         *client_;
+    LibsshQtSubsystem                      *channel_;
+    State                                   state_;
+    int                                     server_version_;
+
+    quint32                                 next_id_;
+    QHash<quint32, LibsshQtSftpRequest *>   requests_;
+    QList<QByteArray>                       unsent_;
+};
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(LibsshQtSftp::OpenFlags)
+
+
+// Include <QDebug> before "libsshqt.h" if you want to use these operators
+#ifdef QDEBUG_H
+
+inline QDebug operator<<(QDebug dbg, const LibsshQtSftp::State value)
+{
+    dbg << LibsshQtSftp::enumToString(value);
+    return dbg;
+}
+
+#endif
+
+#endif // LIBSSHQTSFTP_H
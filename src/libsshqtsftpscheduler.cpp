@@ -0,0 +1,527 @@
+
+#include <QDebug>
+#include <QFileInfo>
+#include <QPair>
+
+#include <algorithm>
+
+#include "libsshqtsftpscheduler.h"
+#include "libsshqtsftp.h"
+#include "libsshqtclient.h"
+#include "libsshqtdebug.h"
+
+LibsshQtSftpScheduler::FileResult::FileResult() :
+    direction(LibsshQtSftpTransfer::Upload),
+    size(-1),
+    finished(false),
+    ok(false),
+    bytesTransferred(0),
+    elapsed(-1)
+{
+}
+
+LibsshQtSftpScheduler::LibsshQtSftpScheduler(QObject *parent) :
+    QObject(parent),
+    debug_prefix_(LibsshQt::debugPrefix(this)),
+    debug_output_(false),
+    channels_per_client_(2),
+    max_per_channel_(16),
+    large_size_(1024 * 1024),
+    depth_(16),
+    chunk_size_(32 * 1024),
+    running_(false),
+    dispatching_(false),
+    finished_count_(0),
+    failed_count_(0),
+    total_size_(0),
+    bytes_transferred_(0),
+    elapsed_(0)
+{
+}
+
+LibsshQtSftpScheduler::~LibsshQtSftpScheduler()
+{
+    abort();
+}
+
+/*!
+    Add a client whose session is used for transfers. The client does not
+    have to be connected yet, but it must be able to connect without user
+    interaction.
+*/
+void LibsshQtSftpScheduler::addClient(LibsshQtClient *client)
+{
+    Q_ASSERT( ! running_ );
+    clients_ << client;
+
+    handleDebugChanged();
+    connect(client, SIGNAL(debugChanged()),
+            this,   SLOT(handleDebugChanged()));
+}
+
+/*!
+    Set the number of SFTP channels opened on each client, the default is 2.
+*/
+void LibsshQtSftpScheduler::setChannelsPerClient(int channels)
+{
+    Q_ASSERT( channels > 0 );
+    channels_per_client_ = qMax(1, channels);
+}
+
+/*!
+    Set the number of files transferred at the same time on each channel,
+    the default is 16.
+*/
+void LibsshQtSftpScheduler::setMaxTransfersPerChannel(int transfers)
+{
+    Q_ASSERT( transfers > 0 );
+    max_per_channel_ = qMax(1, transfers);
+
+    if ( running_ ) {
+        dispatch();
+    }
+}
+
+/*!
+    Set the size from which files are scheduled as large files, the default
+    is 1 MiB.
+*/
+void LibsshQtSftpScheduler::setLargeFileSize(qint64 bytes)
+{
+    Q_ASSERT( ! running_ );
+    large_size_ = bytes;
+}
+
+/*!
+    Set the pipeline depth of each file transfer, see
+    LibsshQtSftpTransfer::setPipelineDepth().
+*/
+void LibsshQtSftpScheduler::setPipelineDepth(int requests)
+{
+    Q_ASSERT( requests > 0 );
+    depth_ = qMax(1, requests);
+}
+
+void LibsshQtSftpScheduler::setChunkSize(int bytes)
+{
+    Q_ASSERT( bytes > 0 );
+    chunk_size_ = qMax(1, bytes);
+}
+
+int LibsshQtSftpScheduler::channelsPerClient() const
+{
+    return channels_per_client_;
+}
+
+int LibsshQtSftpScheduler::maxTransfersPerChannel() const
+{
+    return max_per_channel_;
+}
+
+qint64 LibsshQtSftpScheduler::largeFileSize() const
+{
+    return large_size_;
+}
+
+/*!
+    Add a file to upload, returns the index of the file.
+*/
+int LibsshQtSftpScheduler::addUpload(QString local_path, QString remote_path)
+{
+    Q_ASSERT( ! running_ );
+
+    FileResult file;
+    file.localPath  = local_path;
+    file.remotePath = remote_path;
+    file.direction  = LibsshQtSftpTransfer::Upload;
+
+    QFileInfo info(local_path);
+    if ( info.exists()) {
+        file.size = info.size();
+    }
+
+    files_ << file;
+    return files_.count() - 1;
+}
+
+/*!
+    Add a file to download, returns the index of the file. Give the size of
+    the remote file if it is known, so that large files can be scheduled
+    first.
+*/
+int LibsshQtSftpScheduler::addDownload(QString remote_path,
+                                       QString local_path,
+                                       qint64 size)
+{
+    Q_ASSERT( ! running_ );
+
+    FileResult file;
+    file.localPath  = local_path;
+    file.remotePath = remote_path;
+    file.direction  = LibsshQtSftpTransfer::Download;
+    file.size       = size;
+
+    files_ << file;
+    return files_.count() - 1;
+}
+
+void LibsshQtSftpScheduler::clearFiles()
+{
+    Q_ASSERT( ! running_ );
+    files_.clear();
+}
+
+bool LibsshQtSftpScheduler::isRunning() const
+{
+    return running_;
+}
+
+int LibsshQtSftpScheduler::fileCount() const
+{
+    return files_.count();
+}
+
+int LibsshQtSftpScheduler::runningCount() const
+{
+    return jobs_.count();
+}
+
+int LibsshQtSftpScheduler::finishedCount() const
+{
+    return finished_count_;
+}
+
+int LibsshQtSftpScheduler::failedCount() const
+{
+    return failed_count_;
+}
+
+/*!
+    Get the sum of the known file sizes.
+*/
+qint64 LibsshQtSftpScheduler::totalSize() const
+{
+    return total_size_;
+}
+
+qint64 LibsshQtSftpScheduler::bytesTransferred() const
+{
+    return bytes_transferred_;
+}
+
+qint64 LibsshQtSftpScheduler::elapsed() const
+{
+    return running_ ? timer_.elapsed() : elapsed_;
+}
+
+/*!
+    Get the aggregate throughput of all channels in bytes per second.
+*/
+double LibsshQtSftpScheduler::throughput() const
+{
+    return bytes_transferred_ * 1000.0 / qMax(qint64(1), elapsed());
+}
+
+LibsshQtSftpScheduler::FileResult LibsshQtSftpScheduler::result(int file) const
+{
+    return files_.value(file);
+}
+
+void LibsshQtSftpScheduler::start()
+{
+    if ( running_ ) {
+        LIBSSHQT_CRITICAL("Cannot start because scheduler is already running");
+        return;
+    }
+
+    if ( clients_.isEmpty()) {
+        LIBSSHQT_CRITICAL("Cannot start because no clients have been added");
+        return;
+    }
+
+    // Large files first, largest first, then small files in the order they
+    // were added, which keeps files of the same directory together
+    QList< QPair<qint64, int> > large;
+    QList<int> small;
+
+    total_size_ = 0;
+    for ( int i = 0; i < files_.count(); i++ ) {
+        FileResult &file = files_[i];
+        file.finished         = false;
+        file.ok               = false;
+        file.bytesTransferred = 0;
+        file.elapsed          = -1;
+        file.errorMessage.clear();
+
+        total_size_ += qMax(qint64(0), file.size);
+        if ( isLarge(i)) {
+            large << qMakePair(-file.size, i);
+        } else {
+            small << i;
+        }
+    }
+
+    // The (size, index) pairs are unique, so the order is stable anyway
+    std::sort(large.begin(), large.end());
+
+    queue_.clear();
+    for ( int i = 0; i < large.count(); i++ ) {
+        queue_ << large.at(i).second;
+    }
+    queue_ << small;
+
+    for ( int i = 0; i < clients_.count(); i++ ) {
+        for ( int j = 0; j < channels_per_client_; j++ ) {
+            Channel *channel       = new Channel;
+            channel->sftp          = new LibsshQtSftp(clients_.at(i));
+            channel->running       = 0;
+            channel->running_large = 0;
+            channel->running_bytes = 0;
+            channel->sftp->start();
+            channels_ << channel;
+        }
+    }
+
+    LIBSSHQT_DEBUG("Transferring" << files_.count() << "files," <<
+                   large.count() << "large, over" << channels_.count() <<
+                   "channels");
+
+    running_           = true;
+    finished_count_    = 0;
+    failed_count_      = 0;
+    bytes_transferred_ = 0;
+    elapsed_           = 0;
+    timer_.start();
+
+    dispatch();
+}
+
+/*!
+    Stop all transfers, files that have not been started are not started.
+    No further signals are emitted.
+*/
+void LibsshQtSftpScheduler::abort()
+{
+    if ( ! running_ ) return;
+
+    LIBSSHQT_DEBUG("Aborting" << jobs_.count() << "running transfers");
+
+    foreach ( LibsshQtSftpTransfer *transfer, jobs_.keys()) {
+        transfer->disconnect(this);
+        transfer->abort();
+        transfer->deleteLater();
+    }
+
+    jobs_.clear();
+    queue_.clear();
+    releaseChannels();
+
+    elapsed_ = timer_.elapsed();
+    running_ = false;
+}
+
+bool LibsshQtSftpScheduler::isLarge(int file) const
+{
+    return files_.at(file).size >= large_size_;
+}
+
+/*!
+    Get the channel for the next file, or 0 if no channel has room for it.
+    Large files go to the channel with the fewest bytes in flight, small
+    files to the channel with the fewest files in flight.
+*/
+LibsshQtSftpScheduler::Channel *LibsshQtSftpScheduler::channelFor(bool large)
+{
+    Channel *best = 0;
+
+    foreach ( Channel *channel, channels_ ) {
+        if ( channel->running >= max_per_channel_ ) continue;
+        if ( large && channel->running_large > 0 ) continue;
+
+        if ( ! best ||
+             ( large && channel->running_bytes < best->running_bytes ) ||
+             ( ! large && channel->running < best->running )) {
+            best = channel;
+        }
+    }
+
+    return best;
+}
+
+void LibsshQtSftpScheduler::dispatch()
+{
+    // Transfers that fail in start() finish inside this loop
+    if ( dispatching_ ) return;
+    dispatching_ = true;
+
+    int i = 0;
+    while ( running_ && i < queue_.count()) {
+        int file = queue_.at(i);
+        bool large = isLarge(file);
+
+        Channel *channel = channelFor(large);
+        if ( ! channel ) {
+            // A small file may still fit where a large one does not
+            if ( large ) {
+                i++;
+                continue;
+            }
+            break;
+        }
+
+        queue_.removeAt(i);
+        startFile(file, channel);
+    }
+
+    dispatching_ = false;
+
+    if ( running_ &&
+         queue_.isEmpty() &&
+         jobs_.isEmpty()) {
+        elapsed_ = timer_.elapsed();
+        running_ = false;
+        releaseChannels();
+
+        LIBSSHQT_DEBUG("All files finished," << failed_count_ << "failed," <<
+                       bytes_transferred_ << "bytes in" << elapsed_ << "ms");
+        emit allFinished();
+    }
+}
+
+void LibsshQtSftpScheduler::startFile(int file, Channel *channel)
+{
+    const FileResult &result = files_.at(file);
+
+    LibsshQtSftpTransfer *transfer =
+            new LibsshQtSftpTransfer(channel->sftp, this);
+    transfer->setChunkSize(chunk_size_);
+    transfer->setPipelineDepth(depth_);
+    if ( result.direction == LibsshQtSftpTransfer::Download ) {
+        transfer->setDownload(result.remotePath, result.localPath);
+    } else {
+        transfer->setUpload(result.localPath, result.remotePath);
+    }
+
+    Job job;
+    job.file     = file;
+    job.channel  = channel;
+    job.large    = isLarge(file);
+    job.reported = 0;
+    jobs_.insert(transfer, job);
+
+    channel->running++;
+    channel->running_bytes += qMax(qint64(0), result.size);
+    if ( job.large ) {
+        channel->running_large++;
+    }
+
+    connect(transfer, SIGNAL(progress(qint64,qint64)),
+            this,     SLOT(handleProgress(qint64,qint64)));
+    connect(transfer, SIGNAL(finished()),
+            this,     SLOT(handleTransferFinished()));
+    connect(transfer, SIGNAL(error()),
+            this,     SLOT(handleTransferError()));
+
+    emit fileStarted(file);
+    transfer->start();
+}
+
+void LibsshQtSftpScheduler::finishJob(LibsshQtSftpTransfer *transfer, bool ok)
+{
+    Job job = jobs_.take(transfer);
+    FileResult &result = files_[job.file];
+
+    Channel *channel = job.channel;
+    channel->running--;
+    channel->running_bytes -= qMax(qint64(0), result.size);
+    if ( job.large ) {
+        channel->running_large--;
+    }
+
+    result.finished         = true;
+    result.ok               = ok;
+    result.errorMessage     = transfer->errorMessage();
+    result.bytesTransferred = transfer->bytesTransferred();
+    result.elapsed          = transfer->elapsed();
+
+    // Sizes of downloads are known once they have been transferred
+    if ( result.size < 0 && ok ) {
+        result.size  = transfer->totalSize();
+        total_size_ += qMax(qint64(0), result.size);
+    }
+
+    bytes_transferred_ += transfer->bytesTransferred() - job.reported;
+
+    // The transfer may be finished from inside its own signal handlers
+    transfer->disconnect(this);
+    transfer->deleteLater();
+
+    finished_count_++;
+    if ( ok ) {
+        emit fileFinished(job.file);
+    } else {
+        failed_count_++;
+        LIBSSHQT_DEBUG("File" << result.remotePath << "failed:" <<
+                       result.errorMessage);
+        emit fileError(job.file, result.errorMessage);
+    }
+
+    if ( running_ ) {
+        dispatch();
+    }
+}
+
+void LibsshQtSftpScheduler::releaseChannels()
+{
+    foreach ( Channel *channel, channels_ ) {
+        // Channels may be released from inside their own signal handlers
+        channel->sftp->stop();
+        channel->sftp->deleteLater();
+        delete channel;
+    }
+
+    channels_.clear();
+}
+
+void LibsshQtSftpScheduler::handleDebugChanged()
+{
+    debug_output_ = false;
+    foreach ( LibsshQtClient *client, clients_ ) {
+        debug_output_ = debug_output_ || client->isDebugEnabled();
+    }
+}
+
+void LibsshQtSftpScheduler::handleProgress(qint64 bytes_transferred,
+                                           qint64 total_size)
+{
+    Q_UNUSED( total_size );
+
+    LibsshQtSftpTransfer *transfer =
+            qobject_cast<LibsshQtSftpTransfer *>(sender());
+
+    QHash<LibsshQtSftpTransfer *, Job>::iterator it = jobs_.find(transfer);
+    if ( it == jobs_.end()) return;
+
+    bytes_transferred_ += bytes_transferred - it->reported;
+    it->reported = bytes_transferred;
+
+    emit progress(bytes_transferred_, total_size_);
+}
+
+void LibsshQtSftpScheduler::handleTransferFinished()
+{
+    LibsshQtSftpTransfer *transfer =
+            qobject_cast<LibsshQtSftpTransfer *>(sender());
+    if ( jobs_.contains(transfer)) {
+        finishJob(transfer, true);
+    }
+}
+
+void LibsshQtSftpScheduler::handleTransferError()
+{
+    LibsshQtSftpTransfer *transfer =
+            qobject_cast<LibsshQtSftpTransfer *>(sender());
+    if ( jobs_.contains(transfer)) {
+        finishJob(transfer, false);
+    }
+}
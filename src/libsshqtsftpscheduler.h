@@ -0,0 +1,157 @@
+#ifndef LIBSSHQTSFTPSCHEDULER_H
+#define LIBSSHQTSFTPSCHEDULER_H
+
+#include <QObject>
+#include <QList>
+#include <QHash>
+#include <QElapsedTimer>
+
+#include "libsshqtsftptransfer.h"
+
+class LibsshQtClient;
+class LibsshQtSftp;
+
+/*!
+
+    LibsshQtSftpScheduler - Transfer many files over many SFTP channels
+
+    Copying a tree of small files one file at a time costs several round
+    trips per file. LibsshQtSftpScheduler runs the files of its list
+    concurrently over channelsPerClient() SFTP channels on every client
+    given to addClient(), each client being a separate SSH session and TCP
+    connection.
+
+    Files of at least largeFileSize() bytes are started first, largest
+    first, and each channel runs at most one of them at a time, so large
+    files are spread over the channels and finish at about the same time.
+    Small files fill the remaining capacity of the least loaded channels,
+    maxTransfersPerChannel() files per channel are in flight at the same
+    time, so the latency of small files overlaps. The size of a download is
+    only known if it was given to addDownload(), other downloads are treated
+    as small files.
+
+    fileFinished() or fileError() is emitted for every file, and the
+    result of each file is available from result(). allFinished() is emitted
+    when every file has been handled. Remote directories must exist.
+
+*/
+class LibsshQtSftpScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    class FileResult
+    {
+    public:
+        FileResult();
+
+        QString                         localPath;
+        QString                         remotePath;
+        LibsshQtSftpTransfer::Direction direction;
+        qint64                          size;           //!< -1 if not known
+        bool                            finished;
+        bool                            ok;
+        QString                         errorMessage;
+        qint64                          bytesTransferred;
+        qint64                          elapsed;        //!< Milliseconds
+    };
+
+    explicit LibsshQtSftpScheduler(QObject *parent = 0);
+    ~LibsshQtSftpScheduler();
+
+    void addClient(LibsshQtClient *client);
+    void setChannelsPerClient(int channels);
+    void setMaxTransfersPerChannel(int transfers);
+    void setLargeFileSize(qint64 bytes);
+    void setPipelineDepth(int requests);
+    void setChunkSize(int bytes);
+
+    int channelsPerClient() const;
+    int maxTransfersPerChannel() const;
+    qint64 largeFileSize() const;
+
+    int addUpload(QString local_path, QString remote_path);
+    int addDownload(QString remote_path, QString local_path, qint64 size = -1);
+    void clearFiles();
+
+    bool isRunning() const;
+    int fileCount() const;
+    int runningCount() const;
+    int finishedCount() const;
+    int failedCount() const;
+    qint64 totalSize() const;
+    qint64 bytesTransferred() const;
+    qint64 elapsed() const;
+    double throughput() const;
+    FileResult result(int file) const;
+
+public slots:
+    void start();
+    void abort();
+
+signals:
+    void fileStarted(int file);
+    void fileFinished(int file);
+    void fileError(int file, QString message);
+    void progress(qint64 bytes_transferred, qint64 total_size);
+    void allFinished();
+
+private:
+    class Channel
+    {
+    public:
+        LibsshQtSftp   *sftp;
+        int             running;
+        int             running_large;
+        qint64          running_bytes;
+    };
+
+    class Job
+    {
+    public:
+        int             file;
+        Channel        *channel;
+        bool            large;
+        qint64          reported;   //!< Bytes included in bytes_transferred_
+    };
+
+    bool isLarge(int file) const;
+    Channel *channelFor(bool large);
+    void dispatch();
+    void startFile(int file, Channel *channel);
+    void finishJob(LibsshQtSftpTransfer *transfer, bool ok);
+    void releaseChannels();
+
+private slots:
+    void handleDebugChanged();
+    void handleProgress(qint64 bytes_transferred, qint64 total_size);
+    void handleTransferFinished();
+    void handleTransferError();
+
+private:
+    QString                                 debug_prefix_;
+    bool                                    debug_output_;
+
+    QList<LibsshQtClient *>                 clients_;
+    int                                     channels_per_client_;
+    int                                     max_per_channel_;
+    qint64                                  large_size_;
+    int                                     depth_;
+    int                                     chunk_size_;
+
+    QList<FileResult>                       files_;
+    QList<int>                              queue_;
+    QList<Channel *>                        channels_;
+    QHash<LibsshQtSftpTransfer *, Job>      jobs_;
+
+    bool                                    running_;
+    bool                                    dispatching_;
+    int                                     finished_count_;
+    int                                     failed_count_;
+    qint64                                  total_size_;
+    qint64                                  bytes_transferred_;
+    QElapsedTimer                           timer_;
+    qint64                                  elapsed_;
+};
+
+#endif // LIBSSHQTSFTPSCHEDULER_H
@@ -0,0 +1,621 @@
+
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QThread>
+#include <QMetaType>
+
+#include "libsshqtsftpstriped.h"
+#include "libsshqtsftp.h"
+#include "libsshqtclient.h"
+#include "libsshqtdebug.h"
+
+LibsshQtSftpStriped::LibsshQtSftpStriped(QObject *parent) :
+    QObject(parent),
+    debug_prefix_(LibsshQt::debugPrefix(this)),
+    debug_output_(false),
+    password_set_(false),
+    direction_(LibsshQtSftpTransfer::Download),
+    stripes_(4),
+    min_stripe_size_(8 * 1024 * 1024),
+    chunk_size_(32 * 1024),
+    depth_(16),
+    running_(false),
+    stripes_used_(0),
+    total_size_(-1),
+    bytes_transferred_(0),
+    elapsed_(0)
+{
+    // Worker signals cross threads, so their arguments are queued
+    qRegisterMetaType<qint64>("qint64");
+}
+
+LibsshQtSftpStriped::~LibsshQtSftpStriped()
+{
+    abort();
+
+    // Sessions must not run in other threads after the object is gone, for
+    // example while static destructors run at application exit
+    foreach ( QThread *thread, released_threads_ ) {
+        if ( thread ) {
+            thread->wait();
+        }
+    }
+}
+
+/*!
+    Set the URL of the host, every session connects to the same URL.
+*/
+void LibsshQtSftpStriped::setUrl(const QUrl &url)
+{
+    Q_ASSERT( ! running_ );
+    url_ = url;
+}
+
+/*!
+    Set password for password authentication of every session.
+*/
+void LibsshQtSftpStriped::setPassword(QString password)
+{
+    password_set_ = true;
+    password_ = password;
+}
+
+void LibsshQtSftpStriped::setDebug(bool enabled)
+{
+    debug_output_ = enabled;
+}
+
+QUrl LibsshQtSftpStriped::url() const
+{
+    return url_;
+}
+
+/*!
+    Download remote_path to local_path, the local file is truncated.
+*/
+void LibsshQtSftpStriped::setDownload(QString remote_path, QString local_path)
+{
+    Q_ASSERT( ! running_ );
+    direction_   = LibsshQtSftpTransfer::Download;
+    remote_path_ = remote_path;
+    local_path_  = local_path;
+}
+
+/*!
+    Upload local_path to remote_path, the remote file is truncated.
+*/
+void LibsshQtSftpStriped::setUpload(QString local_path, QString remote_path)
+{
+    Q_ASSERT( ! running_ );
+    direction_   = LibsshQtSftpTransfer::Upload;
+    local_path_  = local_path;
+    remote_path_ = remote_path;
+}
+
+LibsshQtSftpTransfer::Direction LibsshQtSftpStriped::direction() const
+{
+    return direction_;
+}
+
+QString LibsshQtSftpStriped::localPath() const
+{
+    return local_path_;
+}
+
+QString LibsshQtSftpStriped::remotePath() const
+{
+    return remote_path_;
+}
+
+/*!
+    Set the maximum number of sessions and threads, the default is 4.
+*/
+void LibsshQtSftpStriped::setStripes(int stripes)
+{
+    Q_ASSERT( ! running_ );
+    Q_ASSERT( stripes > 0 );
+    stripes_ = qMax(1, stripes);
+}
+
+/*!
+    Set the smallest range given to a session, the default is 8 MiB.
+*/
+void LibsshQtSftpStriped::setMinStripeSize(qint64 bytes)
+{
+    Q_ASSERT( ! running_ );
+    Q_ASSERT( bytes > 0 );
+    min_stripe_size_ = qMax(qint64(1), bytes);
+}
+
+/*!
+    Set the chunk size of each stripe, see
+    LibsshQtSftpTransfer::setChunkSize().
+*/
+void LibsshQtSftpStriped::setChunkSize(int bytes)
+{
+    Q_ASSERT( ! running_ );
+    Q_ASSERT( bytes > 0 );
+    chunk_size_ = qMax(1, bytes);
+}
+
+/*!
+    Set the pipeline depth of each stripe, see
+    LibsshQtSftpTransfer::setPipelineDepth().
+*/
+void LibsshQtSftpStriped::setPipelineDepth(int requests)
+{
+    Q_ASSERT( ! running_ );
+    Q_ASSERT( requests > 0 );
+    depth_ = qMax(1, requests);
+}
+
+int LibsshQtSftpStriped::stripes() const
+{
+    return stripes_;
+}
+
+qint64 LibsshQtSftpStriped::minStripeSize() const
+{
+    return min_stripe_size_;
+}
+
+bool LibsshQtSftpStriped::isRunning() const
+{
+    return running_;
+}
+
+/*!
+    Get the number of ranges the file was split into, 0 until the size of
+    the file is known.
+*/
+int LibsshQtSftpStriped::stripesUsed() const
+{
+    return stripes_used_;
+}
+
+/*!
+    Get the size of the file, -1 until the size of a remote file is known.
+*/
+qint64 LibsshQtSftpStriped::totalSize() const
+{
+    return total_size_;
+}
+
+qint64 LibsshQtSftpStriped::bytesTransferred() const
+{
+    return bytes_transferred_;
+}
+
+qint64 LibsshQtSftpStriped::elapsed() const
+{
+    return running_ ? timer_.elapsed() : elapsed_;
+}
+
+/*!
+    Get the aggregate throughput of all stripes in bytes per second.
+*/
+double LibsshQtSftpStriped::throughput() const
+{
+    return bytes_transferred_ * 1000.0 / qMax(qint64(1), elapsed());
+}
+
+QString LibsshQtSftpStriped::errorMessage() const
+{
+    return error_message_;
+}
+
+void LibsshQtSftpStriped::start()
+{
+    if ( running_ ) {
+        LIBSSHQT_CRITICAL("Cannot start because striped transfer is "
+                          "already running");
+        return;
+    }
+
+    LIBSSHQT_DEBUG("Starting striped transfer of" << remote_path_ <<
+                   "with" << stripes_ << "sessions");
+
+    running_           = true;
+    stripes_used_      = 0;
+    total_size_        = -1;
+    bytes_transferred_ = 0;
+    elapsed_           = 0;
+    error_message_.clear();
+    timer_.start();
+
+    if ( direction_ == LibsshQtSftpTransfer::Upload ) {
+        QFileInfo info(local_path_);
+        if ( ! info.isFile()) {
+            fail(tr("Could not open %1: No such file").arg(local_path_));
+            return;
+        }
+        total_size_ = info.size();
+    }
+
+    // Sessions are connected in parallel, the first one also prepares the
+    // transfer
+    for ( int i = 0; i < stripes_; i++ ) {
+        Stripe *stripe      = new Stripe;
+        stripe->offset      = 0;
+        stripe->length      = -1;
+        stripe->transferred = 0;
+
+        LibsshQtSftpStripeWorker *worker = new LibsshQtSftpStripeWorker;
+        worker->debug_output_ = debug_output_;
+        worker->url_          = url_;
+        worker->password_set_ = password_set_;
+        worker->password_     = password_;
+        worker->direction_    = direction_;
+        worker->local_path_   = local_path_;
+        worker->remote_path_  = remote_path_;
+        worker->chunk_size_   = chunk_size_;
+        worker->depth_        = depth_;
+        stripe->worker = worker;
+
+        // Released threads delete themselves once they have stopped, so
+        // they have no parent
+        stripe->thread = new QThread;
+        worker->moveToThread(stripe->thread);
+
+        connect(stripe->thread, SIGNAL(started()),
+                worker,         SLOT(start()));
+        connect(stripe->thread, SIGNAL(finished()),
+                worker,         SLOT(deleteLater()));
+        connect(stripe->thread, SIGNAL(finished()),
+                stripe->thread, SLOT(deleteLater()));
+
+        connect(worker, SIGNAL(prepared(qint64)),
+                this,   SLOT(handlePrepared(qint64)));
+        connect(worker, SIGNAL(progress(qint64)),
+                this,   SLOT(handleProgress(qint64)));
+        connect(worker, SIGNAL(finished()),
+                this,   SLOT(handleStripeFinished()));
+        connect(worker, SIGNAL(failed(QString)),
+                this,   SLOT(handleStripeFailed(QString)));
+
+        running_stripes_ << stripe;
+        stripe->thread->start();
+    }
+
+    QMetaObject::invokeMethod(running_stripes_.first()->worker, "prepare",
+                              Qt::QueuedConnection);
+}
+
+/*!
+    Stop the transfer and close all sessions, no further signals are
+    emitted. Partially transferred files are left as they are.
+*/
+void LibsshQtSftpStriped::abort()
+{
+    if ( ! running_ ) return;
+
+    LIBSSHQT_DEBUG("Aborting striped transfer of" << remote_path_);
+
+    releaseStripes();
+    elapsed_ = timer_.elapsed();
+    running_ = false;
+}
+
+LibsshQtSftpStriped::Stripe *LibsshQtSftpStriped::stripeForSender()
+{
+    // Signals queued before a stripe was released may still arrive
+    foreach ( Stripe *stripe, running_stripes_ ) {
+        if ( stripe->worker == sender()) {
+            return stripe;
+        }
+    }
+    return 0;
+}
+
+/*!
+    Split the file into ranges once its size is known, and give one range to
+    each session.
+*/
+void LibsshQtSftpStriped::startRanges()
+{
+    // Ranges are multiples of the chunk size, so no request is split
+    qint64 count  = qBound(qint64(1), total_size_ / min_stripe_size_,
+                           qint64(running_stripes_.count()));
+    qint64 length = (total_size_ + count - 1) / count;
+    length = qMax(qint64(1), (length + chunk_size_ - 1) / chunk_size_) *
+             chunk_size_;
+    count  = qMax(qint64(1), (total_size_ + length - 1) / length);
+
+    stripes_used_ = count;
+    LIBSSHQT_DEBUG("Transferring" << total_size_ << "bytes in" << count <<
+                   "stripes of" << length << "bytes");
+
+    while ( running_stripes_.count() > count ) {
+        releaseStripe(running_stripes_.last());
+    }
+
+    for ( int i = 0; i < running_stripes_.count(); i++ ) {
+        Stripe *stripe = running_stripes_.at(i);
+        stripe->offset = i * length;
+
+        // The last range runs to the end, a download also gets bytes
+        // appended after the stat
+        stripe->length = i == count - 1 ? -1 : length;
+
+        QMetaObject::invokeMethod(stripe->worker, "transferRange",
+                                  Qt::QueuedConnection,
+                                  Q_ARG(qint64, stripe->offset),
+                                  Q_ARG(qint64, stripe->length));
+    }
+}
+
+/*!
+    Stop the thread of stripe without waiting for it. The worker and its
+    session are deleted in that thread, and the thread deletes itself once
+    it has finished. The destructor waits for threads that have not been
+    deleted yet.
+*/
+void LibsshQtSftpStriped::releaseStripe(Stripe *stripe)
+{
+    running_stripes_.removeOne(stripe);
+
+    released_threads_.removeAll(QPointer<QThread>());
+    released_threads_ << stripe->thread;
+
+    stripe->worker->disconnect(this);
+    stripe->thread->quit();
+    delete stripe;
+}
+
+void LibsshQtSftpStriped::releaseStripes()
+{
+    while ( ! running_stripes_.isEmpty()) {
+        releaseStripe(running_stripes_.last());
+    }
+}
+
+void LibsshQtSftpStriped::fail(QString message)
+{
+    LIBSSHQT_DEBUG("Striped transfer failed:" << message);
+
+    releaseStripes();
+    error_message_ = message;
+    elapsed_ = timer_.elapsed();
+    running_ = false;
+    emit error();
+}
+
+void LibsshQtSftpStriped::handlePrepared(qint64 size)
+{
+    if ( ! running_ || ! stripeForSender()) return;
+
+    if ( direction_ == LibsshQtSftpTransfer::Download ) {
+        total_size_ = size;
+
+        // Stripes write into the file at their offsets, so it is created
+        // with its final size
+        QFile file(local_path_);
+        if ( ! file.open(QIODevice::WriteOnly | QIODevice::Truncate) ||
+             ! file.resize(total_size_)) {
+            fail(tr("Could not create %1: %2")
+                 .arg(local_path_, file.errorString()));
+            return;
+        }
+    }
+
+    startRanges();
+}
+
+void LibsshQtSftpStriped::handleProgress(qint64 bytes_transferred)
+{
+    Stripe *stripe = stripeForSender();
+    if ( ! running_ || ! stripe ) return;
+
+    bytes_transferred_ += bytes_transferred - stripe->transferred;
+    stripe->transferred = bytes_transferred;
+
+    // A download that grew past the stat size
+    if ( bytes_transferred_ > total_size_ ) {
+        total_size_ = bytes_transferred_;
+    }
+
+    emit progress(bytes_transferred_, total_size_);
+}
+
+void LibsshQtSftpStriped::handleStripeFinished()
+{
+    Stripe *stripe = stripeForSender();
+    if ( ! running_ || ! stripe ) return;
+
+    LIBSSHQT_DEBUG("Stripe at" << stripe->offset << "finished");
+
+    // The session of a finished stripe is closed right away
+    releaseStripe(stripe);
+
+    if ( running_stripes_.isEmpty()) {
+        elapsed_ = timer_.elapsed();
+        running_ = false;
+
+        LIBSSHQT_DEBUG("Transferred" << bytes_transferred_ << "bytes in" <<
+                       elapsed_ << "ms");
+        emit finished();
+    }
+}
+
+void LibsshQtSftpStriped::handleStripeFailed(QString message)
+{
+    if ( ! running_ || ! stripeForSender()) return;
+    fail(message);
+}
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// LibsshQtSftpStripeWorker
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+LibsshQtSftpStripeWorker::LibsshQtSftpStripeWorker() :
+    QObject(0),
+    debug_prefix_(LibsshQt::debugPrefix(this)),
+    debug_output_(false),
+    password_set_(false),
+    direction_(LibsshQtSftpTransfer::Download),
+    chunk_size_(32 * 1024),
+    depth_(16),
+    client_(0),
+    sftp_(0),
+    transfer_(0),
+    request_(0)
+{
+}
+
+LibsshQtSftpStripeWorker::~LibsshQtSftpStripeWorker()
+{
+    // The transfer closes its handle through the SFTP channel, so it goes
+    // before the client
+    delete transfer_;
+}
+
+/*!
+    Connect the session, called in the thread of the worker.
+*/
+void LibsshQtSftpStripeWorker::start()
+{
+    LIBSSHQT_DEBUG("Connecting stripe session to" << url_);
+
+    client_ = new LibsshQtClient(this);
+    client_->setDebug(debug_output_);
+    client_->setUrl(url_);
+    client_->useDefaultAuths();
+    if ( password_set_ ) {
+        client_->setPassword(password_);
+    }
+
+    connect(client_, SIGNAL(unknownHost()),
+            this,    SLOT(handleClientFailed()));
+    connect(client_, SIGNAL(needPassword()),
+            this,    SLOT(handleClientFailed()));
+    connect(client_, SIGNAL(needKbiAnswers()),
+            this,    SLOT(handleClientFailed()));
+    connect(client_, SIGNAL(allAuthsFailed()),
+            this,    SLOT(handleClientFailed()));
+    connect(client_, SIGNAL(error()),
+            this,    SLOT(handleClientFailed()));
+
+    sftp_ = new LibsshQtSftp(client_);
+    connect(sftp_, SIGNAL(error()),
+            this,  SLOT(handleSftpError()));
+
+    client_->connectToHost();
+    sftp_->start();
+}
+
+/*!
+    Stat the remote file of a download, or create the remote file of an
+    upload, before any range is transferred.
+*/
+void LibsshQtSftpStripeWorker::prepare()
+{
+    if ( direction_ == LibsshQtSftpTransfer::Download ) {
+        request_ = sftp_->stat(remote_path_);
+    } else {
+        request_ = sftp_->open(remote_path_,
+                               LibsshQtSftp::OpenWrite |
+                               LibsshQtSftp::OpenCreate |
+                               LibsshQtSftp::OpenTruncate);
+    }
+
+    connect(request_, SIGNAL(finished()),
+            this,     SLOT(handleRequestDone()));
+    connect(request_, SIGNAL(error()),
+            this,     SLOT(handleRequestDone()));
+}
+
+void LibsshQtSftpStripeWorker::transferRange(qint64 offset, qint64 length)
+{
+    LIBSSHQT_DEBUG("Transferring range at" << offset << "length:" << length);
+
+    transfer_ = new LibsshQtSftpTransfer(sftp_, this);
+    if ( direction_ == LibsshQtSftpTransfer::Download ) {
+        transfer_->setDownload(remote_path_, local_path_);
+    } else {
+        transfer_->setUpload(local_path_, remote_path_);
+    }
+    transfer_->setRange(offset, length);
+    transfer_->setChunkSize(chunk_size_);
+    transfer_->setPipelineDepth(depth_);
+
+    connect(transfer_, SIGNAL(progress(qint64,qint64)),
+            this,      SLOT(handleTransferProgress(qint64)));
+    connect(transfer_, SIGNAL(finished()),
+            this,      SIGNAL(finished()));
+    connect(transfer_, SIGNAL(error()),
+            this,      SLOT(handleTransferError()));
+
+    transfer_->start();
+}
+
+void LibsshQtSftpStripeWorker::handleClientFailed()
+{
+    switch ( client_->state()) {
+    case LibsshQtClient::StateUnknownHost:
+        emit failed(client_->unknownHostMessage());
+        break;
+
+    case LibsshQtClient::StateAuthNeedPassword:
+    case LibsshQtClient::StateAuthKbiQuestions:
+    case LibsshQtClient::StateAuthAllFailed:
+        emit failed(tr("Authentication failed"));
+        break;
+
+    default:
+        emit failed(client_->errorCodeAndMessage());
+        break;
+    }
+}
+
+void LibsshQtSftpStripeWorker::handleSftpError()
+{
+    // Client errors are handled in handleClientFailed()
+    if ( client_->state() != LibsshQtClient::StateError ) {
+        emit failed(tr("Could not open SFTP channel"));
+    }
+}
+
+void LibsshQtSftpStripeWorker::handleRequestDone()
+{
+    LibsshQtSftpRequest *request = request_;
+    request_ = 0;
+    request->disconnect(this);
+    request->deleteLater();
+
+    if ( request->isError()) {
+        emit failed(QString("%1: %2")
+                    .arg(remote_path_, request->errorMessage()));
+        return;
+    }
+
+    if ( direction_ == LibsshQtSftpTransfer::Download ) {
+        if ( ! ( request->attributes().flags &
+                 LibsshQtSftpAttributes::FlagSize )) {
+            emit failed(tr("%1: Size of file is not known")
+                        .arg(remote_path_));
+            return;
+        }
+        emit prepared(request->attributes().size);
+
+    } else {
+        // Ranges are written through their own handles
+        LibsshQtSftpRequest *close = sftp_->close(request->handle());
+        connect(close, SIGNAL(finished()),
+                close, SLOT(deleteLater()));
+        connect(close, SIGNAL(error()),
+                close, SLOT(deleteLater()));
+        emit prepared(-1);
+    }
+}
+
+void LibsshQtSftpStripeWorker::handleTransferProgress(qint64 bytes_transferred)
+{
+    emit progress(bytes_transferred);
+}
+
+void LibsshQtSftpStripeWorker::handleTransferError()
+{
+    emit failed(transfer_->errorMessage());
+}
@@ -0,0 +1,193 @@
+#ifndef LIBSSHQTSFTPSTRIPED_H
+#define LIBSSHQTSFTPSTRIPED_H
+
+#include <QObject>
+#include <QList>
+#include <QPointer>
+#include <QUrl>
+#include <QElapsedTimer>
+
+#include "libsshqtsftptransfer.h"
+
+class QThread;
+class LibsshQtClient;
+class LibsshQtSftp;
+class LibsshQtSftpRequest;
+class LibsshQtSftpStripeWorker;
+
+/*!
+
+    LibsshQtSftpStriped - Transfer one file over many SSH sessions
+
+    Encryption and MAC of one SSH session run on one core, which limits the
+    throughput of a single session on fast links, and a single TCP flow may
+    not fill a long fat pipe. LibsshQtSftpStriped splits one file into
+    stripes() ranges and transfers each range with its own
+    LibsshQtSftpTransfer over its own LibsshQtClient, each client running in
+    its own QThread. Every range is written at its own offset of the
+    destination file.
+
+    The first session prepares the transfer: for a download it reads the
+    size of the remote file, the local file is then created with that size;
+    for an upload it creates or truncates the remote file. Ranges are at
+    least minStripeSize() bytes, so small files use fewer sessions. All
+    sessions are connected in parallel, sessions without a range are closed
+    once the ranges are known. Sessions are closed in their own threads
+    without blocking, the destructor waits for the threads that are still
+    closing.
+
+    Like LibsshQtFanout, sessions are never asked questions, if the host is
+    unknown or needs a password that has not been set with setPassword(),
+    the transfer fails with error(). libssh 0.8 or newer is needed for using
+    sessions from several threads.
+
+*/
+class LibsshQtSftpStriped : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit LibsshQtSftpStriped(QObject *parent = 0);
+    ~LibsshQtSftpStriped();
+
+    void setUrl(const QUrl &url);
+    void setPassword(QString password);
+    void setDebug(bool enabled);
+    QUrl url() const;
+
+    void setDownload(QString remote_path, QString local_path);
+    void setUpload(QString local_path, QString remote_path);
+    LibsshQtSftpTransfer::Direction direction() const;
+    QString localPath() const;
+    QString remotePath() const;
+
+    void setStripes(int stripes);
+    void setMinStripeSize(qint64 bytes);
+    void setChunkSize(int bytes);
+    void setPipelineDepth(int requests);
+    int stripes() const;
+    qint64 minStripeSize() const;
+
+    bool isRunning() const;
+    int stripesUsed() const;
+    qint64 totalSize() const;
+    qint64 bytesTransferred() const;
+    qint64 elapsed() const;
+    double throughput() const;
+    QString errorMessage() const;
+
+public slots:
+    void start();
+    void abort();
+
+signals:
+    void progress(qint64 bytes_transferred, qint64 total_size);
+    void finished();
+    void error();
+
+private:
+    class Stripe
+    {
+    public:
+        QThread                    *thread;
+        LibsshQtSftpStripeWorker   *worker;
+        qint64                      offset;
+        qint64                      length;     //!< -1 up to end of file
+        qint64                      transferred;
+    };
+
+    Stripe *stripeForSender();
+    void startRanges();
+    void releaseStripe(Stripe *stripe);
+    void releaseStripes();
+    void fail(QString message);
+
+private slots:
+    void handlePrepared(qint64 size);
+    void handleProgress(qint64 bytes_transferred);
+    void handleStripeFinished();
+    void handleStripeFailed(QString message);
+
+private:
+    QString                     debug_prefix_;
+    bool                        debug_output_;
+
+    QUrl                        url_;
+    bool                        password_set_;
+    QString                     password_;
+    LibsshQtSftpTransfer::Direction direction_;
+    QString                     local_path_;
+    QString                     remote_path_;
+    int                         stripes_;
+    qint64                      min_stripe_size_;
+    int                         chunk_size_;
+    int                         depth_;
+
+    bool                        running_;
+    QList<Stripe *>             running_stripes_;
+    QList<QPointer<QThread> >   released_threads_;
+    int                         stripes_used_;
+    qint64                      total_size_;
+    qint64                      bytes_transferred_;
+    QElapsedTimer               timer_;
+    qint64                      elapsed_;
+    QString                     error_message_;
+};
+
+
+/*!
+
+    LibsshQtSftpStripeWorker - One session of LibsshQtSftpStriped
+
+    Lives in its own thread, and creates its client, SFTP channel and
+    transfer in that thread. Used only by LibsshQtSftpStriped.
+
+*/
+class LibsshQtSftpStripeWorker : public QObject
+{
+    Q_OBJECT
+
+    friend class LibsshQtSftpStriped;
+
+public:
+    LibsshQtSftpStripeWorker();
+    ~LibsshQtSftpStripeWorker();
+
+public slots:
+    void start();
+    void prepare();
+    void transferRange(qint64 offset, qint64 length);
+
+signals:
+    void prepared(qint64 size);
+    void progress(qint64 bytes_transferred);
+    void finished();
+    void failed(QString message);
+
+private slots:
+    void handleClientFailed();
+    void handleSftpError();
+    void handleRequestDone();
+    void handleTransferProgress(qint64 bytes_transferred);
+    void handleTransferError();
+
+private:
+    QString                     debug_prefix_;
+    bool                        debug_output_;
+
+    QUrl                        url_;
+    bool                        password_set_;
+    QString                     password_;
+    LibsshQtSftpTransfer::Direction direction_;
+    QString                     local_path_;
+    QString                     remote_path_;
+    int                         chunk_size_;
+    int                         depth_;
+
+    LibsshQtClient             *client_;
+    LibsshQtSftp               *sftp_;
+    LibsshQtSftpTransfer       *transfer_;
+    LibsshQtSftpRequest        *request_;
+};
+
+#endif // LIBSSHQTSFTPSTRIPED_H
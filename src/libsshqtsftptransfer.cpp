@@ -0,0 +1,865 @@
+
+#include <QDebug>
+#include <QMetaEnum>
+#include <QCryptographicHash>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QtConcurrentRun>
+#include <QUrl>
+
+#include <stdio.h>
+
+#include "libsshqtsftptransfer.h"
+#include "libsshqtsftp.h"
+#include "libsshqtclient.h"
+#include "libsshqtdebug.h"
+
+static const quint64 journal_interval = 4 * 1024 * 1024;
+static const char journal_magic[] = "libsshqt-sftp-journal 1";
+
+static QString shellQuote(QString text)
+{
+    return "'" + text.replace("'", "'\\''") + "'";
+}
+
+/*!
+    Get the hex SHA-1 of length bytes of path starting at offset, the same
+    text sha1sum prints. Runs in a thread of QThreadPool.
+*/
+static QByteArray hashFile(QString path, quint64 offset, quint64 length)
+{
+    QFile file(path);
+    if ( ! file.open(QIODevice::ReadOnly) || ! file.seek(offset)) {
+        return QByteArray();
+    }
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    while ( length > 0 ) {
+        QByteArray data = file.read(qMin(length, quint64(1024 * 1024)));
+        if ( data.isEmpty()) {
+            return QByteArray();
+        }
+        hash.addData(data);
+        length -= data.size();
+    }
+
+    return hash.result().toHex();
+}
+
+LibsshQtSftpTransfer::LibsshQtSftpTransfer(LibsshQtSftp *sftp,
+                                           QObject *parent) :
+    QObject(parent),
+    debug_prefix_(LibsshQt::debugPrefix(this)),
+    debug_output_(false),
+    sftp_(sftp),
+    direction_(Download),
+    chunk_size_(32 * 1024),
+    depth_(16),
+    range_offset_(0),
+    range_length_(-1),
+    state_(StateIdle),
+    total_size_(-1),
+    transferred_(0),
+    next_offset_(0),
+    eof_offset_(Q_UINT64_C(0xFFFFFFFFFFFFFFFF)),
+    elapsed_(0),
+    stat_request_(0),
+    open_request_(0),
+    truncate_request_(0),
+    close_request_(0),
+    resumed_offset_(0),
+    completed_(0),
+    journaled_(0),
+    local_hash_(0),
+    remote_hash_(0)
+{
+    debug_output_ = sftp_->client()->isDebugEnabled();
+    connect(sftp_->client(), SIGNAL(debugChanged()),
+            this,            SLOT(handleDebugChanged()));
+}
+
+LibsshQtSftpTransfer::~LibsshQtSftpTransfer()
+{
+    abort();
+}
+
+const char *LibsshQtSftpTransfer::enumToString(const State value)
+{
+    return staticMetaObject.enumerator(
+                staticMetaObject.indexOfEnumerator("State"))
+                    .valueToKey(value);
+}
+
+/*!
+    Download remote_path to local_path, the local file is truncated unless a
+    range is set.
+*/
+void LibsshQtSftpTransfer::setDownload(QString remote_path, QString local_path)
+{
+    direction_   = Download;
+    remote_path_ = remote_path;
+    local_path_  = local_path;
+}
+
+/*!
+    Upload local_path to remote_path, the remote file is truncated unless a
+    range is set.
+*/
+void LibsshQtSftpTransfer::setUpload(QString local_path, QString remote_path)
+{
+    direction_   = Upload;
+    local_path_  = local_path;
+    remote_path_ = remote_path;
+}
+
+LibsshQtSftpTransfer::Direction LibsshQtSftpTransfer::direction() const
+{
+    return direction_;
+}
+
+QString LibsshQtSftpTransfer::localPath() const
+{
+    return local_path_;
+}
+
+QString LibsshQtSftpTransfer::remotePath() const
+{
+    return remote_path_;
+}
+
+/*!
+    Transfer only length bytes starting at offset, or everything from offset
+    to the end of file if length is -1. The bytes are written at the same
+    offset of the destination file, which is neither truncated nor resized,
+    so several transfers can fill different ranges of one file.
+    setRange(0, -1) transfers the whole file again.
+*/
+void LibsshQtSftpTransfer::setRange(quint64 offset, qint64 length)
+{
+    range_offset_ = offset;
+    range_length_ = length;
+}
+
+quint64 LibsshQtSftpTransfer::rangeOffset() const
+{
+    return range_offset_;
+}
+
+qint64 LibsshQtSftpTransfer::rangeLength() const
+{
+    return range_length_;
+}
+
+/*!
+    Save the progress of the transfer to journal_path, and resume from it
+    on start() if the journal describes the same transfer. An empty path
+    disables the journal.
+*/
+void LibsshQtSftpTransfer::setJournal(QString journal_path)
+{
+    journal_path_ = journal_path;
+}
+
+QString LibsshQtSftpTransfer::journalPath() const
+{
+    return journal_path_;
+}
+
+/*!
+    Get the offset the transfer was resumed from, 0 if the transfer started
+    from the beginning of the file or range. bytesTransferred() does not
+    include the resumed part.
+*/
+quint64 LibsshQtSftpTransfer::resumedOffset() const
+{
+    return resumed_offset_;
+}
+
+/*!
+    Set the size of each read or write request, the default is 32 KiB. Most
+    servers accept larger requests, but some cap them to 32 KiB.
+*/
+void LibsshQtSftpTransfer::setChunkSize(int bytes)
+{
+    Q_ASSERT( bytes > 0 );
+    chunk_size_ = qMax(1, bytes);
+}
+
+int LibsshQtSftpTransfer::chunkSize() const
+{
+    return chunk_size_;
+}
+
+/*!
+    Set the number of requests kept in flight, the default is 16. The
+    throughput of a transfer is at most chunkSize() * pipelineDepth() per
+    round trip time.
+*/
+void LibsshQtSftpTransfer::setPipelineDepth(int requests)
+{
+    Q_ASSERT( requests > 0 );
+    depth_ = qMax(1, requests);
+
+    if ( state_ == StateRunning ) {
+        fillPipeline();
+    }
+}
+
+int LibsshQtSftpTransfer::pipelineDepth() const
+{
+    return depth_;
+}
+
+LibsshQtSftpTransfer::State LibsshQtSftpTransfer::state() const
+{
+    return state_;
+}
+
+/*!
+    Get the size of the file, -1 until the size of a remote file is known.
+*/
+qint64 LibsshQtSftpTransfer::totalSize() const
+{
+    return total_size_;
+}
+
+qint64 LibsshQtSftpTransfer::bytesTransferred() const
+{
+    return transferred_;
+}
+
+/*!
+    Get the milliseconds from start() to the end of the transfer, or to now
+    if the transfer is running.
+*/
+qint64 LibsshQtSftpTransfer::elapsed() const
+{
+    if ( state_ == StateVerifying ||
+         state_ == StateOpening ||
+         state_ == StateRunning ||
+         state_ == StateClosing ) {
+        return timer_.elapsed();
+    }
+    return elapsed_;
+}
+
+QString LibsshQtSftpTransfer::errorMessage() const
+{
+    return error_message_;
+}
+
+void LibsshQtSftpTransfer::start()
+{
+    if ( state_ == StateVerifying ||
+         state_ == StateOpening ||
+         state_ == StateRunning ||
+         state_ == StateClosing ) {
+        LIBSSHQT_CRITICAL("Cannot start because transfer is already running");
+        return;
+    }
+
+    LIBSSHQT_DEBUG("Starting transfer of" << remote_path_ <<
+                   "depth:" << depth_ << "chunk size:" << chunk_size_);
+
+    total_size_     = -1;
+    transferred_    = 0;
+    eof_offset_     = Q_UINT64_C(0xFFFFFFFFFFFFFFFF);
+    elapsed_        = 0;
+    resumed_offset_ = 0;
+    completed_      = 0;
+    journaled_      = 0;
+    error_message_.clear();
+    handle_.clear();
+    gaps_.clear();
+    done_.clear();
+    timer_.start();
+
+    quint64 completed = readJournal();
+    if ( completed <= range_offset_ ) {
+        open();
+        return;
+    }
+
+    // The journal may be ahead of the data that reached the disk, so the
+    // completed part is compared on both hosts before it is skipped
+    quint64 length = completed - range_offset_;
+    LIBSSHQT_DEBUG("Verifying" << length << "bytes listed in the journal");
+
+    resumed_offset_ = completed;
+    setState(StateVerifying);
+
+    local_hash_ = new QFutureWatcher<QByteArray>(this);
+    connect(local_hash_, SIGNAL(finished()),
+            this,        SLOT(handleHashed()));
+    local_hash_->setFuture(QtConcurrent::run(hashFile, local_path_,
+                                             range_offset_, length));
+
+    QString command = QString("tail -c +%1 %2 | head -c %3 | sha1sum")
+            .arg(range_offset_ + 1)
+            .arg(shellQuote(remote_path_))
+            .arg(length);
+
+    remote_hash_ = new QFutureWatcher<LibsshQtResult>(this);
+    connect(remote_hash_, SIGNAL(finished()),
+            this,         SLOT(handleHashed()));
+    remote_hash_->setFuture(sftp_->client()->runCommandAsync(command));
+}
+
+/*!
+    Stop the transfer, no further signals are emitted. Partially transferred
+    files are left as they are, and the journal is saved.
+*/
+void LibsshQtSftpTransfer::abort()
+{
+    if ( state_ != StateVerifying &&
+         state_ != StateOpening &&
+         state_ != StateRunning &&
+         state_ != StateClosing ) return;
+
+    LIBSSHQT_DEBUG("Aborting transfer of" << remote_path_);
+
+    cleanup();
+    setState(StateIdle);
+}
+
+bool LibsshQtSftpTransfer::isRanged() const
+{
+    return range_offset_ > 0 || range_length_ >= 0;
+}
+
+/*!
+    Get the offset following the last byte of the range.
+*/
+quint64 LibsshQtSftpTransfer::rangeEnd() const
+{
+    if ( range_length_ < 0 ) {
+        return Q_UINT64_C(0xFFFFFFFFFFFFFFFF);
+    }
+    return range_offset_ + range_length_;
+}
+
+/*!
+    Get the first offset that is transferred.
+*/
+quint64 LibsshQtSftpTransfer::startOffset() const
+{
+    return qMax(range_offset_, resumed_offset_);
+}
+
+/*!
+    Open the local file and send the requests that open the remote file.
+*/
+void LibsshQtSftpTransfer::open()
+{
+    next_offset_ = startOffset();
+    completed_   = startOffset();
+    journaled_   = startOffset();
+
+    // Ranges and resumed transfers must keep the other bytes of the file
+    bool keep = isRanged() || resumed_offset_ > 0;
+
+    file_.setFileName(local_path_);
+
+    if ( direction_ == Download ) {
+        // WriteOnly truncates the file
+        QIODevice::OpenMode mode = keep ?
+                    QIODevice::ReadWrite :
+                    QIODevice::WriteOnly | QIODevice::Truncate;
+
+        if ( ! file_.open(mode | QIODevice::Unbuffered)) {
+            fail(tr("Could not open %1: %2")
+                 .arg(local_path_, file_.errorString()));
+            return;
+        }
+
+        // Stat and open are sent together, they cost one round trip
+        setState(StateOpening);
+        stat_request_ = sftp_->stat(remote_path_);
+        open_request_ = sftp_->open(remote_path_, LibsshQtSftp::OpenRead);
+        track(stat_request_);
+        track(open_request_);
+
+    } else {
+        if ( ! file_.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) {
+            fail(tr("Could not open %1: %2")
+                 .arg(local_path_, file_.errorString()));
+            return;
+        }
+
+        total_size_ = file_.size();
+
+        if ( next_offset_ > 0 &&
+             next_offset_ < quint64(total_size_) &&
+             ! file_.seek(next_offset_)) {
+            fail(tr("Could not seek %1: %2")
+                 .arg(local_path_, file_.errorString()));
+            return;
+        }
+
+        LibsshQtSftp::OpenFlags flags = LibsshQtSftp::OpenWrite |
+                                        LibsshQtSftp::OpenCreate;
+        if ( ! keep ) {
+            flags |= LibsshQtSftp::OpenTruncate;
+        }
+
+        setState(StateOpening);
+        open_request_ = sftp_->open(remote_path_, flags);
+        track(open_request_);
+    }
+}
+
+void LibsshQtSftpTransfer::setState(State state)
+{
+    if ( state_ == state ) {
+        LIBSSHQT_DEBUG("State is already" << state);
+        return;
+    }
+
+    LIBSSHQT_DEBUG("Changing state to" << state);
+    state_ = state;
+
+    switch ( state_ ) {
+    case StateIdle:                                 break;
+    case StateVerifying:                            break;
+    case StateOpening:                              break;
+    case StateRunning:                              break;
+    case StateClosing:                              break;
+    case StateFinished:     emit finished();        break;
+    case StateError:        emit error();           break;
+    }
+}
+
+void LibsshQtSftpTransfer::fail(QString message)
+{
+    LIBSSHQT_DEBUG("Transfer failed:" << message);
+
+    error_message_ = message;
+    cleanup();
+    setState(StateError);
+}
+
+/*!
+    Release all requests, hashes and the remote handle, close the local file
+    and save the journal.
+*/
+void LibsshQtSftpTransfer::cleanup()
+{
+    if ( local_hash_ ) {
+        local_hash_->disconnect(this);
+        local_hash_->deleteLater();
+        local_hash_ = 0;
+    }
+    if ( remote_hash_ ) {
+        // The command closes its channel once it sees the cancel
+        remote_hash_->disconnect(this);
+        remote_hash_->cancel();
+        remote_hash_->deleteLater();
+        remote_hash_ = 0;
+    }
+
+    foreach ( LibsshQtSftpRequest *request, in_flight_.keys()) {
+        release(request);
+    }
+    in_flight_.clear();
+    gaps_.clear();
+
+    if ( stat_request_ )  release(stat_request_);
+    if ( open_request_ )  release(open_request_);
+    if ( truncate_request_ ) release(truncate_request_);
+    if ( close_request_ ) release(close_request_);
+    stat_request_     = 0;
+    open_request_     = 0;
+    truncate_request_ = 0;
+    close_request_    = 0;
+
+    if ( ! handle_.isEmpty()) {
+        release(sftp_->close(handle_));
+        handle_.clear();
+    }
+
+    file_.close();
+    elapsed_ = timer_.elapsed();
+    writeJournal();
+}
+
+/*!
+    Get the end of the completed part from the journal, or 0 if there is no
+    journal or it describes another transfer.
+*/
+quint64 LibsshQtSftpTransfer::readJournal()
+{
+    if ( journal_path_.isEmpty()) return 0;
+
+    QFile file(journal_path_);
+    if ( ! file.open(QIODevice::ReadOnly)) return 0;
+
+    QList<QByteArray> lines = file.readAll().split('\n');
+    if ( lines.count() < 7 || lines.at(0) != journal_magic ) {
+        LIBSSHQT_DEBUG("Ignoring invalid journal" << journal_path_);
+        return 0;
+    }
+
+    bool ok = true;
+    quint64 completed = lines.at(6).toULongLong(&ok);
+
+    if ( ! ok ||
+         lines.at(1).toInt() != direction_ ||
+         QUrl::fromPercentEncoding(lines.at(2)) != remote_path_ ||
+         QUrl::fromPercentEncoding(lines.at(3)) != local_path_ ||
+         lines.at(4).toULongLong() != range_offset_ ||
+         lines.at(5).toLongLong() != range_length_ ) {
+        LIBSSHQT_DEBUG("Journal" << journal_path_ <<
+                       "describes another transfer");
+        return 0;
+    }
+
+    // The local file must still hold the completed part
+    if ( quint64(QFileInfo(local_path_).size()) < completed ) return 0;
+
+    return completed;
+}
+
+/*!
+    Save the end of the completed part, if it has moved since the journal
+    was last saved. The journal is replaced with rename(), so a crash leaves
+    either the old or the new journal.
+*/
+void LibsshQtSftpTransfer::writeJournal()
+{
+    if ( journal_path_.isEmpty() || completed_ <= journaled_ ) return;
+
+    QString temp_path = journal_path_ + ".tmp";
+    QFile file(temp_path);
+    if ( ! file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        LIBSSHQT_DEBUG("Could not write journal" << temp_path << ":" <<
+                       file.errorString());
+        return;
+    }
+
+    QTextStream stream(&file);
+    stream << journal_magic << '\n'
+           << int(direction_) << '\n'
+           << QUrl::toPercentEncoding(remote_path_) << '\n'
+           << QUrl::toPercentEncoding(local_path_) << '\n'
+           << range_offset_ << '\n'
+           << range_length_ << '\n'
+           << completed_ << '\n';
+    stream.flush();
+    file.close();
+
+    if ( ::rename(QFile::encodeName(temp_path).constData(),
+                  QFile::encodeName(journal_path_).constData()) != 0 ) {
+        LIBSSHQT_DEBUG("Could not replace journal" << journal_path_);
+        return;
+    }
+
+    journaled_ = completed_;
+}
+
+void LibsshQtSftpTransfer::removeJournal()
+{
+    if ( ! journal_path_.isEmpty()) {
+        QFile::remove(journal_path_);
+    }
+}
+
+/*!
+    Mark offset to end as transferred, and move the end of the contiguous
+    completed part. Replies arrive in any order, so later ranges wait in
+    done_ until the ranges before them have completed.
+*/
+void LibsshQtSftpTransfer::complete(quint64 offset, quint64 end)
+{
+    if ( journal_path_.isEmpty() || end <= offset ) return;
+
+    done_.insert(offset, end);
+    while ( done_.contains(completed_)) {
+        completed_ = done_.take(completed_);
+    }
+
+    if ( completed_ - journaled_ >= journal_interval ) {
+        writeJournal();
+    }
+}
+
+void LibsshQtSftpTransfer::track(LibsshQtSftpRequest *request)
+{
+    connect(request, SIGNAL(finished()),
+            this,    SLOT(handleRequestDone()));
+    connect(request, SIGNAL(error()),
+            this,    SLOT(handleRequestDone()));
+}
+
+/*!
+    Free request once LibsshQtSftp no longer refers to it.
+*/
+void LibsshQtSftpTransfer::release(LibsshQtSftpRequest *request)
+{
+    request->disconnect(this);
+
+    if ( request->isFinished()) {
+        request->deleteLater();
+    } else {
+        connect(request, SIGNAL(finished()),
+                request, SLOT(deleteLater()));
+        connect(request, SIGNAL(error()),
+                request, SLOT(deleteLater()));
+    }
+}
+
+void LibsshQtSftpTransfer::fillPipeline()
+{
+    while ( state_ == StateRunning &&
+            in_flight_.count() < depth_ ) {
+        bool issued = direction_ == Download ? issueRead() : issueWrite();
+        if ( ! issued ) break;
+    }
+
+    if ( state_ == StateRunning &&
+         in_flight_.isEmpty()) {
+        closeRemote();
+    }
+}
+
+bool LibsshQtSftpTransfer::issueRead()
+{
+    // Ranges past the end of file do not need to be read again
+    while ( ! gaps_.isEmpty() &&
+            gaps_.first().offset >= eof_offset_ ) {
+        gaps_.removeFirst();
+    }
+
+    Range range;
+    if ( ! gaps_.isEmpty()) {
+        range = gaps_.takeFirst();
+
+    } else {
+        // A read at the stat size finds out if the file has grown
+        if ( next_offset_ >= eof_offset_ ||
+             next_offset_ >= rangeEnd() ||
+             ( total_size_ >= 0 && next_offset_ > quint64(total_size_))) {
+            return false;
+        }
+
+        range.offset = next_offset_;
+        range.length = qMin(quint64(chunk_size_), rangeEnd() - next_offset_);
+        next_offset_ += range.length;
+    }
+
+    LibsshQtSftpRequest *request = sftp_->read(handle_, range.offset,
+                                               range.length);
+    in_flight_.insert(request, range);
+    track(request);
+    return true;
+}
+
+bool LibsshQtSftpTransfer::issueWrite()
+{
+    quint64 end = qMin(quint64(total_size_), rangeEnd());
+    if ( next_offset_ >= end ) {
+        return false;
+    }
+
+    QByteArray data = file_.read(qMin(quint64(chunk_size_),
+                                      end - next_offset_));
+    if ( data.isEmpty()) {
+        fail(tr("Could not read %1: %2")
+             .arg(local_path_, file_.errorString()));
+        return false;
+    }
+
+    Range range;
+    range.offset = next_offset_;
+    range.length = data.size();
+    next_offset_ += data.size();
+
+    LibsshQtSftpRequest *request = sftp_->write(handle_, range.offset, data);
+    in_flight_.insert(request, range);
+    track(request);
+    return true;
+}
+
+void LibsshQtSftpTransfer::handleReadReply(LibsshQtSftpRequest *request,
+                                           const Range &range)
+{
+    QByteArray data = request->data();
+
+    if ( ! data.isEmpty()) {
+        if ( ! file_.seek(range.offset) ||
+             file_.write(data) != data.size()) {
+            fail(tr("Could not write %1: %2")
+                 .arg(local_path_, file_.errorString()));
+            return;
+        }
+
+        transferred_ += data.size();
+    }
+
+    quint64 end = range.offset + data.size();
+    complete(range.offset, end);
+    if ( total_size_ >= 0 && end > quint64(total_size_)) {
+        total_size_ = end;
+    }
+
+    if ( request->atEnd()) {
+        eof_offset_ = qMin(eof_offset_, range.offset);
+
+    } else if ( quint32(data.size()) < range.length ) {
+        // A short read that ends at the stat size is trusted to be the end
+        // of file, which saves a round trip for every file smaller than
+        // the chunk size
+        if ( total_size_ >= 0 && end == quint64(total_size_)) {
+            eof_offset_ = qMin(eof_offset_, end);
+        } else {
+            Range gap;
+            gap.offset = end;
+            gap.length = range.length - data.size();
+            gaps_ << gap;
+        }
+    }
+}
+
+void LibsshQtSftpTransfer::closeRemote()
+{
+    LIBSSHQT_DEBUG("All data transferred, closing" << remote_path_);
+
+    setState(StateClosing);
+
+    // A resumed upload does not truncate when opening, remove the old
+    // bytes past the end of the local file
+    if ( direction_ == Upload && ! isRanged() && resumed_offset_ > 0 ) {
+        truncate_request_ = sftp_->truncate(handle_, total_size_);
+        track(truncate_request_);
+        return;
+    }
+
+    sendClose();
+}
+
+void LibsshQtSftpTransfer::sendClose()
+{
+    close_request_ = sftp_->close(handle_);
+    handle_.clear();
+    track(close_request_);
+}
+
+void LibsshQtSftpTransfer::handleDebugChanged()
+{
+    debug_output_ = sftp_->client()->isDebugEnabled();
+}
+
+void LibsshQtSftpTransfer::handleRequestDone()
+{
+    LibsshQtSftpRequest *request =
+            qobject_cast<LibsshQtSftpRequest *>(sender());
+    if ( ! request ) return;
+
+    release(request);
+
+    if ( request->isError()) {
+        if ( request == stat_request_ )  stat_request_  = 0;
+        if ( request == open_request_ )  open_request_  = 0;
+        if ( request == truncate_request_ ) truncate_request_ = 0;
+        if ( request == close_request_ ) close_request_ = 0;
+        in_flight_.remove(request);
+        fail(QString("%1: %2").arg(remote_path_, request->errorMessage()));
+        return;
+    }
+
+    if ( request == stat_request_ ) {
+        stat_request_ = 0;
+        if ( request->attributes().flags & LibsshQtSftpAttributes::FlagSize ) {
+            total_size_ = request->attributes().size;
+        }
+
+    } else if ( request == open_request_ ) {
+        open_request_ = 0;
+        handle_ = request->handle();
+
+    } else if ( request == truncate_request_ ) {
+        truncate_request_ = 0;
+        sendClose();
+        return;
+
+    } else if ( request == close_request_ ) {
+        close_request_ = 0;
+
+        // A resumed download keeps the old local file, remove the old bytes
+        // past the end of the remote file
+        if ( direction_ == Download && ! isRanged() && resumed_offset_ > 0 ) {
+            qint64 size = eof_offset_ < quint64(total_size_) ?
+                        qint64(eof_offset_) : total_size_;
+            if ( ! file_.resize(size)) {
+                fail(tr("Could not truncate %1: %2")
+                     .arg(local_path_, file_.errorString()));
+                return;
+            }
+        }
+
+        file_.close();
+        elapsed_ = timer_.elapsed();
+        removeJournal();
+
+        LIBSSHQT_DEBUG("Transferred" << transferred_ << "bytes in" <<
+                       elapsed_ << "ms");
+        setState(StateFinished);
+        return;
+
+    } else if ( in_flight_.contains(request)) {
+        Range range = in_flight_.take(request);
+
+        if ( direction_ == Download ) {
+            handleReadReply(request, range);
+        } else {
+            transferred_ += range.length;
+            complete(range.offset, range.offset + range.length);
+        }
+
+        if ( state_ != StateRunning ) return;
+        emit progress(transferred_, total_size_);
+    }
+
+    if ( state_ == StateOpening &&
+         ! stat_request_ &&
+         ! open_request_ ) {
+        setState(StateRunning);
+    }
+
+    if ( state_ == StateRunning ) {
+        fillPipeline();
+    }
+}
+
+/*!
+    Resume after the journaled part if both hashes are ready and match.
+*/
+void LibsshQtSftpTransfer::handleHashed()
+{
+    if ( ! local_hash_->isFinished() ||
+         ! remote_hash_->isFinished()) return;
+
+    QByteArray     local  = local_hash_->result();
+    LibsshQtResult remote = remote_hash_->result();
+
+    local_hash_->disconnect(this);
+    remote_hash_->disconnect(this);
+    local_hash_->deleteLater();
+    remote_hash_->deleteLater();
+    local_hash_  = 0;
+    remote_hash_ = 0;
+
+    if ( ! local.isEmpty() &&
+         remote.ok &&
+         remote.exitCode == 0 &&
+         remote.stdoutData.left(local.size()) == local ) {
+        LIBSSHQT_DEBUG("Resuming transfer at" << resumed_offset_);
+
+    } else {
+        LIBSSHQT_DEBUG("Journaled part differs, transferring everything:" <<
+                       local << remote.stdoutData << remote.errorMessage);
+        resumed_offset_ = 0;
+        removeJournal();
+    }
+
+    open();
+}
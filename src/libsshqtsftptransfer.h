@@ -0,0 +1,192 @@
+#ifndef LIBSSHQTSFTPTRANSFER_H
+#define LIBSSHQTSFTPTRANSFER_H
+
+#include <QObject>
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QElapsedTimer>
+#include <QFutureWatcher>
+
+#include "libsshqtresult.h"
+
+class LibsshQtSftp;
+class LibsshQtSftpRequest;
+
+/*!
+
+    LibsshQtSftpTransfer - Pipelined download or upload of one file
+
+    A transfer that waits for each read or write reply before sending the
+    next request moves one chunk per round trip, so over a 50 ms link 32 KiB
+    chunks limit the throughput to 640 KiB/s regardless of the bandwidth.
+    LibsshQtSftpTransfer keeps pipelineDepth() requests in flight, and issues
+    a new request whenever a reply arrives.
+
+    Replies to reads may arrive in any order, each reply is written to its
+    own offset of the local file. If the server returns less data than was
+    requested, the rest of the range is requested again. Downloads end at
+    the first offset the server reports as end of file.
+
+    The transfer uses the given LibsshQtSftp, which may be shared by many
+    transfers. The SFTP channel is started if it is not open.
+
+    With setJournal() the transfer can be resumed. The end of the
+    contiguous completed part of the file is saved to the journal every few
+    MiB and when the transfer fails or is aborted. The next start() hashes
+    the completed part on both hosts, with sha1sum on the remote host, and
+    continues after it if the hashes match. Otherwise the whole file is
+    transferred again. The journal is removed once the transfer finishes,
+    and a resumed destination file is truncated to the size of the source.
+
+*/
+class LibsshQtSftpTransfer : public QObject
+{
+    Q_OBJECT
+
+public:
+    Q_ENUMS(Direction)
+    enum Direction
+    {
+        Download,
+        Upload
+    };
+
+    Q_ENUMS(State)
+    enum State
+    {
+        StateIdle,
+        StateVerifying,
+        StateOpening,
+        StateRunning,
+        StateClosing,
+        StateFinished,
+        StateError
+    };
+
+    explicit LibsshQtSftpTransfer(LibsshQtSftp *sftp, QObject *parent = 0);
+    ~LibsshQtSftpTransfer();
+
+    static const char *enumToString(const State value);
+
+    void setDownload(QString remote_path, QString local_path);
+    void setUpload(QString local_path, QString remote_path);
+    Direction direction() const;
+    QString localPath() const;
+    QString remotePath() const;
+
+    void setRange(quint64 offset, qint64 length = -1);
+    quint64 rangeOffset() const;
+    qint64 rangeLength() const;
+
+    void setJournal(QString journal_path);
+    QString journalPath() const;
+    quint64 resumedOffset() const;
+
+    void setChunkSize(int bytes);
+    int chunkSize() const;
+    void setPipelineDepth(int requests);
+    int pipelineDepth() const;
+
+    State state() const;
+    qint64 totalSize() const;
+    qint64 bytesTransferred() const;
+    qint64 elapsed() const;
+    QString errorMessage() const;
+
+public slots:
+    void start();
+    void abort();
+
+signals:
+    void progress(qint64 bytes_transferred, qint64 total_size);
+    void finished();
+    void error();
+
+private:
+    class Range
+    {
+    public:
+        quint64 offset;
+        quint32 length;
+    };
+
+    bool isRanged() const;
+    quint64 rangeEnd() const;
+    quint64 startOffset() const;
+    void open();
+    void setState(State state);
+    void fail(QString message);
+    void cleanup();
+    quint64 readJournal();
+    void writeJournal();
+    void removeJournal();
+    void complete(quint64 offset, quint64 end);
+    void track(LibsshQtSftpRequest *request);
+    void release(LibsshQtSftpRequest *request);
+    void fillPipeline();
+    bool issueRead();
+    bool issueWrite();
+    void handleReadReply(LibsshQtSftpRequest *request, const Range &range);
+    void closeRemote();
+    void sendClose();
+
+private slots:
+    void handleDebugChanged();
+    void handleRequestDone();
+    void handleHashed();
+
+private:
+    QString                                 debug_prefix_;
+    bool                                    debug_output_;
+
+    LibsshQtSftp                           *sftp_;
+    Direction                               direction_;
+    QString                                 local_path_;
+    QString                                 remote_path_;
+    int                                     chunk_size_;
+    int                                     depth_;
+    quint64                                 range_offset_;
+    qint64                                  range_length_;
+    QString                                 journal_path_;
+
+    State                                   state_;
+    QFile                                   file_;
+    QByteArray                              handle_;
+    qint64                                  total_size_;
+    qint64                                  transferred_;
+    quint64                                 next_offset_;
+    quint64                                 eof_offset_;
+    QElapsedTimer                           timer_;
+    qint64                                  elapsed_;
+    QString                                 error_message_;
+
+    LibsshQtSftpRequest                    *stat_request_;
+    LibsshQtSftpRequest                    *open_request_;
+    LibsshQtSftpRequest                    *truncate_request_;
+    LibsshQtSftpRequest                    *close_request_;
+    QHash<LibsshQtSftpRequest *, Range>     in_flight_;
+    QList<Range>                            gaps_;
+
+    quint64                                 resumed_offset_;
+    quint64                                 completed_;
+    quint64                                 journaled_;
+    QMap<quint64, quint64>                  done_;
+    QFutureWatcher<QByteArray>             *local_hash_;
+    QFutureWatcher<LibsshQtResult>         *remote_hash_;
+};
+
+
+// Include <QDebug> before "libsshqt.h" if you want to use these operators
+#ifdef QDEBUG_H
+
+inline QDebug operator<<(QDebug dbg, const LibsshQtSftpTransfer::State value)
+{
+    dbg << LibsshQtSftpTransfer::enumToString(value);
+    return dbg;
+}
+
+#endif
+
+#endif // LIBSSHQTSFTPTRANSFER_H
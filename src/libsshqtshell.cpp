@@ -0,0 +1,399 @@
+
+#include <QDebug>
+#include <QUuid>
+
+#include "libsshqtshell.h"
+#include "libsshqtclient.h"
+#include "libsshqtprocess.h"
+#include "libsshqtdebug.h"
+
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// LibsshQtShellCommand
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+LibsshQtShellCommand::LibsshQtShellCommand(QString command,
+                                           QString token,
+                                           LibsshQtShell *parent) :
+    QObject(parent),
+    command_(command),
+    token_(token),
+    stdout_marker_(QString("\n%1 ").arg(token).toLatin1()),
+    stderr_marker_(QString("\n%1\n").arg(token).toLatin1()),
+    stdout_done_(false),
+    stderr_done_(false),
+    error_(false),
+    exit_code_(-1),
+    stdout_read_(0),
+    stderr_read_(0)
+{
+}
+
+QString LibsshQtShellCommand::command() const
+{
+    return command_;
+}
+
+bool LibsshQtShellCommand::isFinished() const
+{
+    return stdout_done_ && stderr_done_;
+}
+
+bool LibsshQtShellCommand::isError() const
+{
+    return error_;
+}
+
+/*!
+    Get the exit code of the command, -1 if the command has not finished.
+*/
+int LibsshQtShellCommand::exitCode() const
+{
+    return exit_code_;
+}
+
+QByteArray LibsshQtShellCommand::stdoutData() const
+{
+    return stdout_;
+}
+
+QByteArray LibsshQtShellCommand::stderrData() const
+{
+    return stderr_;
+}
+
+/*!
+    Get the stdout received since the last call.
+*/
+QByteArray LibsshQtShellCommand::readStdout()
+{
+    QByteArray data = stdout_.mid(stdout_read_);
+    stdout_read_ = stdout_.size();
+    return data;
+}
+
+/*!
+    Get the stderr received since the last call.
+*/
+QByteArray LibsshQtShellCommand::readStderr()
+{
+    QByteArray data = stderr_.mid(stderr_read_);
+    stderr_read_ = stderr_.size();
+    return data;
+}
+
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// LibsshQtShell
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+LibsshQtShell::LibsshQtShell(LibsshQtClient *parent) :
+    QObject(parent),
+    debug_prefix_(LibsshQt::debugPrefix(this)),
+    debug_output_(parent->isDebugEnabled()),
+    client_(parent),
+    process_(0),
+    shell_("/bin/sh"),
+    command_count_(0)
+{
+    connect(client_, SIGNAL(debugChanged()),
+            this,    SLOT(handleDebugChanged()));
+
+    // The token only has to be unlikely to appear in command output
+    token_ = QUuid::createUuid().toString();
+    token_.remove('{').remove('}').remove('-');
+    token_.prepend("LIBSSHQT_");
+
+    LIBSSHQT_DEBUG("Constructor, sentinel token is" << token_);
+}
+
+LibsshQtShell::~LibsshQtShell()
+{
+    LIBSSHQT_DEBUG("Destructor");
+
+    if ( process_ ) {
+        process_->disconnect(this);
+        delete process_;
+        process_ = 0;
+    }
+}
+
+/*!
+    Set the shell that is started on the remote host, the default is /bin/sh.
+    The shell must be a POSIX compatible shell.
+*/
+void LibsshQtShell::setShell(QString shell)
+{
+    shell_ = shell;
+}
+
+QString LibsshQtShell::shell() const
+{
+    return shell_;
+}
+
+bool LibsshQtShell::isOpen() const
+{
+    return process_ && process_->state() == LibsshQtProcess::StateOpen;
+}
+
+/*!
+    Get the number of commands that have not finished yet.
+*/
+int LibsshQtShell::queuedCount() const
+{
+    return unsent_.count() + running_.count();
+}
+
+/*!
+    Queue command to be run in the shell, the shell is opened if it is not
+    open already.
+
+    The command must be a complete shell command, a command with unbalanced
+    quotes or braces consumes the sentinels and the commands that follow it.
+*/
+LibsshQtShellCommand *LibsshQtShell::runCommand(QString command)
+{
+    QString token = QString("%1_%2").arg(token_).arg(++command_count_);
+    LibsshQtShellCommand *cmd = new LibsshQtShellCommand(command, token, this);
+
+    LIBSSHQT_DEBUG("Queuing command" << command);
+
+    if ( isOpen()) {
+        writeCommand(cmd);
+    } else {
+        unsent_.enqueue(cmd);
+        openShell();
+    }
+
+    return cmd;
+}
+
+/*!
+    Open the remote shell, commands queued with runCommand() are sent when
+    the shell has been opened.
+*/
+void LibsshQtShell::openShell()
+{
+    if ( process_ ) return;
+
+    LIBSSHQT_DEBUG("Opening shell" << shell_);
+
+    stdout_buffer_.clear();
+    stderr_buffer_.clear();
+
+    process_ = client_->runCommand(shell_);
+    process_->setStdoutBehaviour(LibsshQtProcess::OutputManual);
+    process_->setStderrBehaviour(LibsshQtProcess::OutputManual);
+
+    connect(process_, SIGNAL(opened()),
+            this,     SLOT(handleOpened()));
+    connect(process_, SIGNAL(readyRead()),
+            this,     SLOT(handleStdout()));
+    connect(process_->stderr(), SIGNAL(readyRead()),
+            this,               SLOT(handleStderr()));
+    connect(process_, SIGNAL(finished(int)),
+            this,     SLOT(handleClosed()));
+    connect(process_, SIGNAL(closed()),
+            this,     SLOT(handleClosed()));
+    connect(process_, SIGNAL(error()),
+            this,     SLOT(handleError()));
+}
+
+/*!
+    Close the remote shell, all unfinished commands fail with error().
+*/
+void LibsshQtShell::closeShell()
+{
+    if ( ! process_ ) return;
+
+    LIBSSHQT_DEBUG("Closing shell");
+
+    // Shell may be closed from inside process signal handlers
+    process_->disconnect(this);
+    process_->stderr()->disconnect(this);
+    process_->closeChannel();
+    process_->deleteLater();
+    process_ = 0;
+
+    failCommands();
+    emit closed();
+}
+
+void LibsshQtShell::writeCommand(LibsshQtShellCommand *command)
+{
+    // The command is run in a brace group so that the stdin redirection
+    // applies to all of it, and $? is the status of the whole command.
+    // Sentinels start with a newline so that they start a line even if the
+    // output of the command does not end with one, the newline is part of
+    // the marker and is not added to the command output.
+    QString script = QString(
+                "{ %1\n"
+                "} </dev/null\n"
+                "printf '\\n%s %d\\n' '%2' \"$?\"\n"
+                "printf '\\n%s\\n' '%2' 1>&2\n")
+            .arg(command->command_, command->token_);
+
+    process_->write(script.toLocal8Bit());
+    running_.enqueue(command);
+}
+
+void LibsshQtShell::failCommands()
+{
+    QList<LibsshQtShellCommand *> failed;
+    failed << running_ << unsent_;
+    running_.clear();
+    unsent_.clear();
+
+    foreach ( LibsshQtShellCommand *command, failed ) {
+        LIBSSHQT_DEBUG("Command failed:" << command->command_);
+        command->error_ = true;
+        emit command->error();
+    }
+}
+
+/*!
+    Move data before marker from buffer to output.
+
+    Returns true if the marker was found. If rest is given, the marker is only
+    accepted once the rest of the marker line has been received, and the rest
+    of the line is stored to rest. If the marker was not found, all data that
+    cannot be the start of a marker is moved to output.
+*/
+bool LibsshQtShell::findMarker(QByteArray &buffer,
+                               const QByteArray &marker,
+                               QByteArray &output,
+                               QByteArray *rest)
+{
+    int pos = buffer.indexOf(marker);
+
+    if ( pos < 0 ) {
+        int keep = qMin(buffer.size(), marker.size() - 1);
+        output.append(buffer.constData(), buffer.size() - keep);
+        buffer.remove(0, buffer.size() - keep);
+        return false;
+    }
+
+    output.append(buffer.constData(), pos);
+    buffer.remove(0, pos);
+
+    int end = marker.size();
+    if ( rest ) {
+        end = buffer.indexOf('\n', marker.size());
+        if ( end < 0 ) {
+            return false;
+        }
+        *rest = buffer.mid(marker.size(), end - marker.size());
+        end++;
+    }
+
+    buffer.remove(0, end);
+    return true;
+}
+
+void LibsshQtShell::handleDebugChanged()
+{
+    debug_output_ = client_->isDebugEnabled();
+}
+
+void LibsshQtShell::handleOpened()
+{
+    LIBSSHQT_DEBUG("Shell opened, sending" << unsent_.count() << "commands");
+
+    while ( ! unsent_.isEmpty()) {
+        writeCommand(unsent_.dequeue());
+    }
+
+    emit opened();
+}
+
+void LibsshQtShell::handleStdout()
+{
+    stdout_buffer_.append(process_->readAll());
+
+    while ( ! running_.isEmpty()) {
+        LibsshQtShellCommand *command = running_.head();
+
+        if ( ! command->stdout_done_ ) {
+            QByteArray rest;
+            int old_size = command->stdout_.size();
+            bool found = findMarker(stdout_buffer_, command->stdout_marker_,
+                                    command->stdout_, &rest);
+
+            // Receivers may close the shell, which fails the command
+            if ( command->stdout_.size() > old_size ) {
+                emit command->stdoutReady();
+                if ( running_.isEmpty() || running_.head() != command ) {
+                    return;
+                }
+            }
+            if ( ! found ) {
+                return;
+            }
+
+            bool ok = false;
+            command->exit_code_ = rest.toInt(&ok);
+            if ( ! ok ) {
+                command->exit_code_ = -1;
+            }
+            command->stdout_done_ = true;
+        }
+
+        if ( ! command->stderr_done_ ) {
+            return;
+        }
+
+        running_.dequeue();
+        LIBSSHQT_DEBUG("Command finished:" << command->command_ <<
+                       "exit code:" << command->exit_code_);
+        emit command->finished(command->exit_code_);
+    }
+}
+
+void LibsshQtShell::handleStderr()
+{
+    stderr_buffer_.append(process_->stderr()->readAll());
+
+    // Stderr of later commands can only be matched after the stdout sentinel
+    // of the current command, so stderr is parsed one command at a time and
+    // handleStdout() finishes the commands.
+    for ( int i = 0; i < running_.count(); i++ ) {
+        LibsshQtShellCommand *command = running_.at(i);
+        if ( command->stderr_done_ ) continue;
+
+        int old_size = command->stderr_.size();
+        bool found = findMarker(stderr_buffer_, command->stderr_marker_,
+                                command->stderr_, 0);
+
+        if ( command->stderr_.size() > old_size ) {
+            emit command->stderrReady();
+            if ( i >= running_.count() || running_.at(i) != command ) {
+                return;
+            }
+        }
+        if ( ! found ) {
+            break;
+        }
+        command->stderr_done_ = true;
+    }
+
+    if ( ! running_.isEmpty() &&
+         running_.head()->stderr_done_ ) {
+        handleStdout();
+    }
+}
+
+void LibsshQtShell::handleClosed()
+{
+    LIBSSHQT_DEBUG("Shell exited");
+    closeShell();
+}
+
+void LibsshQtShell::handleError()
+{
+    LIBSSHQT_DEBUG("Shell error:" << process_->errorCodeAndMessage());
+    closeShell();
+    emit error();
+}
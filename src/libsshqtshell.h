@@ -0,0 +1,146 @@
+#ifndef LIBSSHQTSHELL_H
+#define LIBSSHQTSHELL_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QQueue>
+
+class LibsshQtClient;
+class LibsshQtProcess;
+class LibsshQtShell;
+
+/*!
+
+    LibsshQtShellCommand - A command run with LibsshQtShell
+
+    Output is streamed like the output of LibsshQtProcess, stdoutReady() and
+    stderrReady() are emitted as soon as output of the command arrives, and
+    readStdout() and readStderr() return the output that has not been read
+    yet. Unlike LibsshQtProcess the command is not a QIODevice, all output is
+    also collected to stdoutData() and stderrData(). finished() is emitted
+    with the exit code of the command once all output has been received. If
+    the shell exits or fails before the command has finished, error() is
+    emitted instead.
+
+    Commands are owned by the shell, use deleteLater() to free a command after
+    it has finished.
+
+*/
+class LibsshQtShellCommand : public QObject
+{
+    Q_OBJECT
+    friend class LibsshQtShell;
+
+public:
+    QString command() const;
+    bool isFinished() const;
+    bool isError() const;
+    int exitCode() const;
+
+    QByteArray stdoutData() const;
+    QByteArray stderrData() const;
+    QByteArray readStdout();
+    QByteArray readStderr();
+
+signals:
+    void stdoutReady();
+    void stderrReady();
+    void finished(int exit_code);
+    void error();
+
+private:
+    explicit LibsshQtShellCommand(QString command, QString token,
+                                  LibsshQtShell *parent);
+
+private:
+    QString     command_;
+    QString     token_;
+    QByteArray  stdout_marker_;
+    QByteArray  stderr_marker_;
+    bool        stdout_done_;
+    bool        stderr_done_;
+    bool        error_;
+    int         exit_code_;
+    QByteArray  stdout_;
+    QByteArray  stderr_;
+    int         stdout_read_;
+    int         stderr_read_;
+};
+
+/*!
+
+    LibsshQtShell - Run many commands through one remote shell
+
+    LibsshQtShell keeps one /bin/sh channel open and runs the commands given
+    to runCommand() in it one after another. Opening a channel and sending an
+    exec request costs several round trips, a command written to an already
+    open shell costs none, so running many small commands through a shell is
+    much faster than running each one with LibsshQtProcess.
+
+    Commands are written to the shell as soon as the shell is open, the shell
+    executes them in order. The output of each command is followed by a
+    unique sentinel on both stdout and stderr, the stdout sentinel also
+    contains the exit code of the command. Commands read their stdin from
+    /dev/null, so they cannot consume the commands that follow them.
+
+    All commands share the shell environment, a command that changes the
+    working directory or sets variables affects later commands, and a command
+    that exits the shell fails all commands queued after it.
+
+*/
+class LibsshQtShell : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit LibsshQtShell(LibsshQtClient *parent);
+    ~LibsshQtShell();
+
+    void setShell(QString shell);
+    QString shell() const;
+
+    bool isOpen() const;
+    int queuedCount() const;
+
+    LibsshQtShellCommand *runCommand(QString command);
+
+public slots:
+    void openShell();
+    void closeShell();
+
+signals:
+    void opened();
+    void closed();
+    void error();
+
+private:
+    void writeCommand(LibsshQtShellCommand *command);
+    void failCommands();
+    bool findMarker(QByteArray &buffer, const QByteArray &marker,
+                    QByteArray &output, QByteArray *rest);
+
+private slots:
+    void handleDebugChanged();
+    void handleOpened();
+    void handleStdout();
+    void handleStderr();
+    void handleClosed();
+    void handleError();
+
+private:
+    QString                         debug_prefix_;
+    bool                            debug_output_;
+
+    LibsshQtClient                 *client_;
+    LibsshQtProcess                *process_;
+    QString                         shell_;
+    QString                         token_;
+    quint64                         command_count_;
+
+    QQueue<LibsshQtShellCommand *>  unsent_;
+    QQueue<LibsshQtShellCommand *>  running_;
+    QByteArray                      stdout_buffer_;
+    QByteArray                      stderr_buffer_;
+};
+
+#endif // LIBSSHQTSHELL_H
@@ -0,0 +1,368 @@
+
+#include <QDebug>
+#include <QMetaEnum>
+
+#include "libsshqtsubsystem.h"
+#include "libsshqtclient.h"
+#include "libsshqtdebug.h"
+
+LibsshQtSubsystem::LibsshQtSubsystem(LibsshQtClient *parent) :
+    LibsshQtChannel(false, parent, parent),
+    state_(StateClosed),
+    framer_(0)
+{
+    debug_prefix_ = LibsshQt::debugPrefix(this);
+
+    LIBSSHQT_DEBUG("Constructor");
+
+    timer_.setSingleShot(true);
+    timer_.setInterval(0);
+
+    connect(&timer_, SIGNAL(timeout()),        this, SLOT(processState()));
+    connect(parent,  SIGNAL(error()),          this, SLOT(handleClientError()));
+    connect(parent,  SIGNAL(doProcessState()), this, SLOT(processState()));
+    connect(parent,  SIGNAL(doCleanup()),      this, SLOT(closeChannel()));
+}
+
+LibsshQtSubsystem::~LibsshQtSubsystem()
+{
+    LIBSSHQT_DEBUG("Destructor");
+    closeChannel();
+    delete framer_;
+}
+
+const char *LibsshQtSubsystem::enumToString(const State value)
+{
+    return staticMetaObject.enumerator(
+                staticMetaObject.indexOfEnumerator("State"))
+                    .valueToKey(value);
+}
+
+void LibsshQtSubsystem::setSubsystem(QString subsystem)
+{
+    subsystem_ = subsystem;
+    LIBSSHQT_DEBUG("Setting subsystem to" << subsystem);
+}
+
+QString LibsshQtSubsystem::subsystem() const
+{
+    return subsystem_;
+}
+
+/*!
+    Split received data into messages with framer, LibsshQtSubsystem takes
+    ownership of the framer and deletes the previous framer. Set framer to 0
+    to read the data with the QIODevice API.
+
+    Data that was already given to the previous framer is not parsed again.
+*/
+void LibsshQtSubsystem::setFramer(LibsshQtFramer *framer)
+{
+    if ( framer_ == framer ) return;
+
+    delete framer_;
+    framer_ = framer;
+
+    if ( framer_ ) {
+        connect(this, SIGNAL(readyRead()),
+                this, SLOT(handleReadyRead()),
+                Qt::UniqueConnection);
+        handleReadyRead();
+    } else {
+        disconnect(this, SIGNAL(readyRead()),
+                   this, SLOT(handleReadyRead()));
+    }
+}
+
+LibsshQtFramer *LibsshQtSubsystem::framer() const
+{
+    return framer_;
+}
+
+/*!
+    Write message to the channel with framing added by the framer.
+*/
+bool LibsshQtSubsystem::sendMessage(const QByteArray &message)
+{
+    if ( ! framer_ ) {
+        LIBSSHQT_CRITICAL("Cannot send message because framer is not set");
+        return false;
+    }
+
+    if ( state_ != StateOpen ) {
+        LIBSSHQT_CRITICAL("Cannot send message because state is" << state_);
+        return false;
+    }
+
+    QByteArray framed = framer_->frame(message);
+    if ( framed.isEmpty()) {
+        LIBSSHQT_CRITICAL("Framer cannot frame message of" << message.size() <<
+                          "bytes");
+        return false;
+    }
+
+    return write(framed) == framed.size();
+}
+
+LibsshQtSubsystem::State LibsshQtSubsystem::state() const
+{
+    return state_;
+}
+
+bool LibsshQtSubsystem::open(OpenMode ignored)
+{
+    Q_UNUSED( ignored );
+    openChannel();
+    return true;
+}
+
+/*!
+    If the channel has been successfully opened this function calls sendEof()
+    otherwise closeChannel() is called.
+*/
+void LibsshQtSubsystem::close()
+{
+    if ( state_ == StateOpen ) {
+        sendEof();
+    } else {
+        closeChannel();
+    }
+}
+
+/*!
+    Open SSH channel and request the subsystem.
+*/
+void LibsshQtSubsystem::openChannel()
+{
+    if ( state_ == StateClosed ) {
+        if ( framer_ ) {
+            framer_->reset();
+        }
+
+        setState(StateWaitClient);
+        timer_.start();
+    }
+}
+
+/*!
+    Close the SSH channel immediately, any possible data in buffers is
+    discarded.
+*/
+void LibsshQtSubsystem::closeChannel()
+{
+    if ( state_ != StateClosed &&
+         state_ != StateClosing ) {
+
+        // Prevent recursion
+        setState(StateClosing);
+
+        emit readChannelFinished();
+
+        if ( channel_ ) {
+            if ( ssh_channel_is_open(channel_) != 0 ) {
+                ssh_channel_close(channel_);
+            }
+
+            ssh_channel_free(channel_);
+            channel_ = 0;
+        }
+
+        QIODevice::close();
+
+        read_buffer_.clear();
+        write_buffer_.clear();
+        eof_state_ = EofNotSent;
+
+        setState(StateClosed);
+    }
+}
+
+void LibsshQtSubsystem::setState(State state)
+{
+    if ( state_ == state ) {
+        LIBSSHQT_DEBUG("State is already" << state);
+        return;
+    }
+
+    LIBSSHQT_DEBUG("Changing state to" << state);
+    state_ = state;
+
+    // Free the channel slot for queued channels
+    if ( state_ == StateClosed ||
+         state_ == StateError ||
+         state_ == StateClientError ) {
+        client_->releaseChannelSlot(this);
+    }
+
+    switch ( state_ ) {
+    case StateClosed:       emit closed();          break;
+    case StateClosing:                              break;
+    case StateWaitClient:                           break;
+    case StateOpening:                              break;
+    case StateRequest:                              break;
+    case StateOpen:         emit opened();          break;
+    case StateError:        emit error();           break;
+    case StateClientError:  emit error();           break;
+    }
+}
+
+void LibsshQtSubsystem::queueCheckIo()
+{
+    timer_.start();
+}
+
+bool LibsshQtSubsystem::runPendingWork()
+{
+    if ( timer_.isActive()) {
+        timer_.stop();
+        processState();
+        return true;
+    }
+    return false;
+}
+
+void LibsshQtSubsystem::processState()
+{
+    switch ( state_ ) {
+
+    case StateClosed:
+    case StateClosing:
+    case StateError:
+    case StateClientError:
+        return;
+
+    case StateWaitClient:
+    {
+        if ( client_->state() == LibsshQtClient::StateOpened &&
+             client_->requestChannelSlot(this)) {
+            setState(StateOpening);
+            timer_.start();
+        }
+        return;
+    } break;
+
+    case StateOpening:
+    {
+        if ( ! channel_ ) {
+            channel_ = ssh_channel_new(client_->sshSession());
+            if ( ! channel_ ) {
+                LIBSSHQT_FATAL("Could not create SSH channel");
+            }
+        }
+
+        int rc = ssh_channel_open_session(channel_);
+
+        switch ( rc ) {
+        case SSH_AGAIN:
+            client_->enableWritableNotifier();
+            return;
+
+        case SSH_ERROR:
+            LIBSSHQT_DEBUG("Channel open error:" << errorCodeAndMessage());
+            setState(StateError);
+            return;
+
+        case SSH_OK:
+            setState(StateRequest);
+            timer_.start();
+            return;
+
+        default:
+            LIBSSHQT_CRITICAL("Unknown result code" << rc <<
+                              "received from ssh_channel_open_session()");
+            return;
+        }
+    } break;
+
+    case StateRequest:
+    {
+        int rc = ssh_channel_request_subsystem(channel_,
+                                               qPrintable(subsystem_));
+
+        switch ( rc ) {
+        case SSH_AGAIN:
+            client_->enableWritableNotifier();
+            return;
+
+        case SSH_ERROR:
+            LIBSSHQT_DEBUG("Subsystem request error:" << errorCodeAndMessage());
+            setState(StateError);
+            return;
+
+        case SSH_OK:
+            // Set Unbuffered to disable QIODevice buffers.
+            if ( ! QIODevice::open( ReadWrite | Unbuffered )) {
+                LIBSSHQT_FATAL("QIODevice::open() failed");
+            }
+
+            LIBSSHQT_DEBUG("Subsystem" << subsystem_ << "opened");
+            setState(StateOpen);
+            timer_.start();
+            return;
+
+        default:
+            LIBSSHQT_CRITICAL("Unknown result code" << rc <<
+                              "received from ssh_channel_request_subsystem()");
+            return;
+        }
+    } break;
+
+    case StateOpen:
+    {
+        checkIo();
+
+        if ( state_ == StateOpen &&
+             read_buffer_.isEmpty() &&
+             ( ssh_channel_is_open(channel_) == 0 ||
+               ssh_channel_is_eof(channel_) != 0 )) {
+            LIBSSHQT_DEBUG("Subsystem channel EOF");
+            closeChannel();
+        }
+        return;
+    } break;
+
+    } // End switch
+
+    Q_ASSERT_X(false, __func__, "Case was not handled properly");
+}
+
+void LibsshQtSubsystem::handleClientError()
+{
+    setState(StateClientError);
+}
+
+void LibsshQtSubsystem::handleReadyRead()
+{
+    if ( ! framer_ || read_buffer_.isEmpty()) return;
+
+    bool was_full = read_buffer_.size() >= buffer_size_;
+
+    QList<QByteArray> messages;
+    bool ok = framer_->parse(read_buffer_.constData(), read_buffer_.size(),
+                             messages);
+    read_buffer_.clear();
+
+    foreach ( const QByteArray &message, messages ) {
+        emit messageReceived(message);
+
+        // Channel was closed from a signal handler
+        if ( state_ != StateOpen ) return;
+    }
+
+    if ( ! ok ) {
+        LIBSSHQT_CRITICAL("Invalid message framing received from subsystem" <<
+                          subsystem_);
+        setState(StateError);
+
+        // The rest of the stream cannot be parsed, free the channel
+        if ( state_ == StateError ) {
+            closeChannel();
+        }
+        return;
+    }
+
+    // Channel reading stopped when the read buffer was full
+    if ( was_full ) {
+        queueCheckIo();
+    }
+}
@@ -0,0 +1,101 @@
+#ifndef LIBSSHQTSUBSYSTEM_H
+#define LIBSSHQTSUBSYSTEM_H
+
+#include <QObject>
+#include <QTimer>
+#include <QIODevice>
+#include "libsshqtchannel.h"
+#include "libsshqtframer.h"
+
+/*!
+
+    LibsshQtSubsystem - Channel for a named subsystem
+
+    LibsshQtSubsystem opens a session channel and requests a subsystem, for
+    example "sftp" or "netconf", instead of executing a command. Once
+    opened, the channel is a QIODevice with the same buffered nonblocking I/O
+    as LibsshQtProcess.
+
+    If a framer has been set with setFramer(), received data is split into
+    messages by the framer and each message is emitted with
+    messageReceived(), and sendMessage() adds framing to outgoing messages.
+    Without a framer data is read and written with the QIODevice API. The
+    framer can be changed while the channel is open, for example when a
+    NETCONF session switches from end-of-message to chunked framing after
+    the hello exchange.
+
+*/
+class LibsshQtSubsystem : public LibsshQtChannel
+{
+    Q_OBJECT
+
+public:
+    Q_ENUMS(State)
+    enum State {
+        StateClosed,
+        StateClosing,
+        StateWaitClient,
+        StateOpening,
+        StateRequest,
+        StateOpen,
+        StateError,
+        StateClientError
+    };
+
+    explicit LibsshQtSubsystem(LibsshQtClient *parent);
+    ~LibsshQtSubsystem();
+
+    static const char *enumToString(const State value);
+
+    void setSubsystem(QString subsystem);
+    QString subsystem() const;
+
+    void setFramer(LibsshQtFramer *framer);
+    LibsshQtFramer *framer() const;
+    bool sendMessage(const QByteArray &message);
+
+    State state() const;
+
+    bool open(OpenMode ignored = 0);
+    void close();
+
+public slots:
+    void openChannel();
+    void closeChannel();
+
+signals:
+    void opened();
+    void closed();
+    void error();
+    void messageReceived(const QByteArray &message);
+
+protected:
+    void setState(State state);
+    void queueCheckIo();
+    bool runPendingWork();
+
+private slots:
+    void processState();
+    void handleClientError();
+    void handleReadyRead();
+
+private:
+    QTimer                  timer_;
+    State                   state_;
+    QString                 subsystem_;
+    LibsshQtFramer         *framer_;
+};
+
+
+// Include <QDebug> before "libsshqt.h" if you want to use these operators
+#ifdef QDEBUG_H
+
+inline QDebug operator<<(QDebug dbg, const LibsshQtSubsystem::State value)
+{
+    dbg << LibsshQtSubsystem::enumToString(value);
+    return dbg;
+}
+
+#endif
+
+#endif // LIBSSHQTSUBSYSTEM_H
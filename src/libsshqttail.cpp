@@ -0,0 +1,172 @@
+
+#include <string.h>
+
+#include "libsshqttail.h"
+
+LibsshQtTail::LibsshQtTail() :
+    max_bytes_(DefaultMaxBytes),
+    total_(0),
+    max_lines_(0),
+    newlines_seen_(0)
+{
+    setMaxSize(DefaultMaxBytes, DefaultMaxLines);
+}
+
+/*!
+    Set the number of bytes and lines to keep, existing data is cleared. The
+    ring buffer is not reallocated if its size does not change.
+*/
+void LibsshQtTail::setMaxSize(int max_bytes, int max_lines)
+{
+    Q_ASSERT( max_bytes > 0 );
+    Q_ASSERT( max_lines >= 0 );
+
+    max_bytes_ = qMax(1, max_bytes);
+    max_lines_ = qMax(0, max_lines);
+
+    // Allocated again by the next append()
+    if ( ring_.size() != max_bytes_ ) {
+        ring_.clear();
+    }
+    clear();
+}
+
+int LibsshQtTail::maxBytes() const
+{
+    return max_bytes_;
+}
+
+int LibsshQtTail::maxLines() const
+{
+    return max_lines_;
+}
+
+void LibsshQtTail::append(const char *data, int len)
+{
+    if ( len <= 0 ) return;
+
+    if ( ring_.isEmpty()) {
+        ring_.resize(max_bytes_);
+    }
+    int capacity = ring_.size();
+
+    // Only the last capacity bytes can ever be read back
+    int skip = len > capacity ? len - capacity : 0;
+    const char *begin = data + skip;
+    const char *end   = data + len;
+    qint64      pos   = total_ + skip;
+
+    // Copy to the ring buffer, wrapping around at most once
+    int ring_pos = pos % capacity;
+    int first    = qMin<int>(end - begin, capacity - ring_pos);
+    memcpy(ring_.data() + ring_pos, begin, first);
+    memcpy(ring_.data(), begin + first, ( end - begin ) - first);
+
+    // Index newlines, one more than max_lines_ is needed to find the start
+    // of the oldest line. The byte before the copied data may be the newline
+    // that ends the previous line.
+    const char *scan = skip > 0 ? begin - 1 : begin;
+    while ( max_lines_ > 0 && scan < end ) {
+        const char *newline =
+                static_cast< const char* >( memchr(scan, '\n', end - scan));
+        if ( ! newline ) {
+            break;
+        }
+
+        newlines_.append(pos + ( newline - begin ));
+        newlines_seen_++;
+        if ( newlines_.count() > max_lines_ + 1 ) {
+            newlines_.removeFirst();
+        }
+        scan = newline + 1;
+    }
+
+    total_ += len;
+}
+
+void LibsshQtTail::clear()
+{
+    total_ = 0;
+    newlines_.clear();
+    newlines_seen_ = 0;
+}
+
+/*!
+    Get the total number of bytes appended since the last clear().
+*/
+qint64 LibsshQtTail::totalBytes() const
+{
+    return total_;
+}
+
+/*!
+    Get the last maxBytes() bytes.
+*/
+QByteArray LibsshQtTail::data() const
+{
+    if ( total_ == 0 ) {
+        return QByteArray();
+    }
+
+    int    capacity  = ring_.size();
+    int    available = qMin<qint64>(total_, capacity);
+    int    ring_pos  = ( total_ - available ) % capacity;
+
+    QByteArray bytes;
+    bytes.resize(available);
+
+    int first = qMin(available, capacity - ring_pos);
+    memcpy(bytes.data(), ring_.constData() + ring_pos, first);
+    memcpy(bytes.data() + first, ring_.constData(), available - first);
+    return bytes;
+}
+
+/*!
+    Get at most maxLines() last lines without newline characters. An
+    incomplete last line is included.
+*/
+QList<QByteArray> LibsshQtTail::lines() const
+{
+    QList<QByteArray> result;
+    if ( total_ == 0 ) {
+        return result;
+    }
+
+    QByteArray bytes      = data();
+    qint64     ring_start = total_ - bytes.size();
+    qint64     line_end   = total_;
+    int        i          = newlines_.count() - 1;
+
+    // No incomplete line if the data ends with a newline
+    if ( i >= 0 && newlines_.at(i) == total_ - 1 ) {
+        line_end = newlines_.at(i);
+        i--;
+    }
+
+    while ( result.count() < max_lines_ ) {
+        qint64 line_start;
+        if ( i >= 0 ) {
+            line_start = newlines_.at(i) + 1;
+        } else if ( newlines_seen_ == newlines_.count()) {
+            line_start = 0;
+        } else {
+            // Start of the line is no longer known
+            break;
+        }
+
+        if ( line_start < ring_start ) {
+            break;
+        }
+
+        result.prepend(bytes.mid(line_start - ring_start,
+                                 line_end - line_start));
+        if ( i < 0 ) {
+            break;
+        }
+
+        line_end = newlines_.at(i);
+        i--;
+    }
+
+    return result;
+}
@@ -0,0 +1,51 @@
+#ifndef LIBSSHQTTAIL_H
+#define LIBSSHQTTAIL_H
+
+#include <QByteArray>
+#include <QList>
+
+/*!
+
+    LibsshQtTail - Fixed size capture of the end of a stream
+
+    LibsshQtTail keeps the last maxBytes() bytes of all data appended to it in
+    a ring buffer, and the positions of the last maxLines() newlines, so that
+    the last lines can be extracted later. Memory use does not depend on the
+    amount of data appended.
+
+    A line is only returned by lines() if it is completely inside the ring
+    buffer. The ring buffer is allocated when data is first appended.
+
+*/
+class LibsshQtTail
+{
+public:
+    enum
+    {
+        DefaultMaxBytes = 1024 * 16,
+        DefaultMaxLines = 100
+    };
+
+    LibsshQtTail();
+
+    void setMaxSize(int max_bytes, int max_lines);
+    int maxBytes() const;
+    int maxLines() const;
+
+    void append(const char *data, int len);
+    void clear();
+
+    qint64 totalBytes() const;
+    QByteArray data() const;
+    QList<QByteArray> lines() const;
+
+private:
+    QByteArray      ring_;
+    int             max_bytes_;
+    qint64          total_;
+    int             max_lines_;
+    QList<qint64>   newlines_;
+    qint64          newlines_seen_;
+};
+
+#endif // LIBSSHQTTAIL_H
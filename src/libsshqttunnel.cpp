@@ -0,0 +1,441 @@
+
+#include <QDebug>
+#include <QMetaEnum>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+
+#include "libsshqttunnel.h"
+#include "libsshqtclient.h"
+#include "libsshqtdebug.h"
+
+LibsshQtTunnel::LibsshQtTunnel(LibsshQtClient *jump_client,
+                               QString         hostname,
+                               quint16         port,
+                               QObject        *parent) :
+    LibsshQtChannel(false, jump_client, parent),
+    state_(StateClosed),
+    hostname_(hostname),
+    port_(port),
+    session_socket_(-1),
+    local_socket_(-1),
+    local_eof_(false),
+    remote_eof_(false),
+    read_notifier_(0),
+    write_notifier_(0)
+{
+    debug_prefix_ = LibsshQt::debugPrefix(this);
+
+    LIBSSHQT_DEBUG("Constructor, jump client is:" <<
+                   LIBSSHQT_HEXNAME(jump_client));
+
+    timer_.setSingleShot(true);
+    timer_.setInterval(0);
+
+    connect(&timer_,     SIGNAL(timeout()),        this, SLOT(processState()));
+    connect(jump_client, SIGNAL(error()),          this, SLOT(handleClientError()));
+    connect(jump_client, SIGNAL(doProcessState()), this, SLOT(processState()));
+    connect(jump_client, SIGNAL(doCleanup()),      this, SLOT(closeTunnel()));
+}
+
+LibsshQtTunnel::~LibsshQtTunnel()
+{
+    LIBSSHQT_DEBUG("Destructor");
+    closeTunnel();
+    destroySocketPair();
+}
+
+const char *LibsshQtTunnel::enumToString(const State value)
+{
+    return staticMetaObject.enumerator(
+                staticMetaObject.indexOfEnumerator("State"))
+                    .valueToKey(value);
+}
+
+QString LibsshQtTunnel::hostname() const
+{
+    return hostname_;
+}
+
+quint16 LibsshQtTunnel::port() const
+{
+    return port_;
+}
+
+/*!
+    Get the socket which should be given to libssh with SSH_OPTIONS_FD.
+
+    The ownership of the socket is transferred to the caller, libssh closes
+    the socket when the session is disconnected. The socket exists as soon as
+    openTunnel() has created the socket pair, before the channel is open, so
+    it can be given to libssh while the tunnel is still opening. Returns -1
+    if the socket has already been taken, or if openTunnel() has not been
+    called or the tunnel has been closed.
+*/
+socket_t LibsshQtTunnel::takeSessionSocket()
+{
+    socket_t socket = session_socket_;
+    session_socket_ = -1;
+    return socket;
+}
+
+LibsshQtTunnel::State LibsshQtTunnel::state() const
+{
+    return state_;
+}
+
+/*!
+    Create the local socket pair and start opening the direct-tcpip channel.
+*/
+void LibsshQtTunnel::openTunnel()
+{
+    if ( state_ == StateClosed ) {
+        if ( ! createSocketPair()) {
+            setState(StateError);
+            return;
+        }
+
+        setState(StateWaitClient);
+        timer_.start();
+    }
+}
+
+/*!
+    Close the channel and the local socket immediately, any possible data in
+    buffers is discarded.
+*/
+void LibsshQtTunnel::closeTunnel()
+{
+    if ( state_ != StateClosed &&
+         state_ != StateClosing ) {
+
+        // Prevent recursion
+        setState(StateClosing);
+
+        if ( channel_ ) {
+            if ( ssh_channel_is_open(channel_) != 0 ) {
+                ssh_channel_close(channel_);
+            }
+
+            ssh_channel_free(channel_);
+            channel_ = 0;
+        }
+
+        destroySocketPair();
+        QIODevice::close();
+
+        read_buffer_.clear();
+        write_buffer_.clear();
+        eof_state_ = EofNotSent;
+
+        setState(StateClosed);
+    }
+}
+
+void LibsshQtTunnel::setState(State state)
+{
+    if ( state_ == state ) {
+        LIBSSHQT_DEBUG("State is already" << state);
+        return;
+    }
+
+    LIBSSHQT_DEBUG("Changing state to" << state);
+    state_ = state;
+
+    switch ( state_ ) {
+    case StateClosed:       emit closed();          break;
+    case StateClosing:                              break;
+    case StateWaitClient:                           break;
+    case StateOpening:                              break;
+    case StateOpen:         emit opened();          break;
+    case StateError:        emit error();           break;
+    case StateClientError:  emit error();           break;
+    }
+}
+
+void LibsshQtTunnel::queueCheckIo()
+{
+    timer_.start();
+}
+
+bool LibsshQtTunnel::runPendingWork()
+{
+    if ( timer_.isActive()) {
+        timer_.stop();
+        processState();
+        return true;
+    }
+    return false;
+}
+
+bool LibsshQtTunnel::createSocketPair()
+{
+    Q_ASSERT( local_socket_ == -1 );
+
+    int fds[2];
+    if ( socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0 ) {
+        LIBSSHQT_CRITICAL("Could not create socket pair:" << strerror(errno));
+        return false;
+    }
+
+    // libssh manages the blocking mode of its own socket
+    int flags = fcntl(fds[1], F_GETFL, 0);
+    fcntl(fds[1], F_SETFL, flags | O_NONBLOCK);
+
+    session_socket_ = fds[0];
+    local_socket_   = fds[1];
+    local_eof_      = false;
+    remote_eof_     = false;
+
+    LIBSSHQT_DEBUG("Created socket pair" << session_socket_ << local_socket_);
+
+    read_notifier_ = new QSocketNotifier(local_socket_,
+                                         QSocketNotifier::Read,
+                                         this);
+    read_notifier_->setEnabled(false);
+    connect(read_notifier_, SIGNAL(activated(int)),
+            this, SLOT(handleSocketReadable(int)));
+
+    write_notifier_ = new QSocketNotifier(local_socket_,
+                                          QSocketNotifier::Write,
+                                          this);
+    write_notifier_->setEnabled(false);
+    connect(write_notifier_, SIGNAL(activated(int)),
+            this, SLOT(handleSocketWritable(int)));
+
+    return true;
+}
+
+void LibsshQtTunnel::destroySocketPair()
+{
+    if ( read_notifier_ ) {
+        read_notifier_->disconnect(this);
+        read_notifier_->setEnabled(false);
+        read_notifier_->deleteLater();
+        read_notifier_ = 0;
+    }
+
+    if ( write_notifier_ ) {
+        write_notifier_->disconnect(this);
+        write_notifier_->setEnabled(false);
+        write_notifier_->deleteLater();
+        write_notifier_ = 0;
+    }
+
+    if ( local_socket_ != -1 ) {
+        ::close(local_socket_);
+        local_socket_ = -1;
+    }
+
+    // Session socket is only closed here if libssh never took it
+    if ( session_socket_ != -1 ) {
+        ::close(session_socket_);
+        session_socket_ = -1;
+    }
+}
+
+/*!
+    Read data sent by the tunneled session into the channel write buffer.
+*/
+void LibsshQtTunnel::readFromSocket()
+{
+    while ( ! local_eof_ && write_buffer_.size() < write_size_ ) {
+
+        int old_size = write_buffer_.size();
+        int room = write_size_ - old_size;
+        write_buffer_.resize(old_size + room);
+
+        ssize_t rc = ::read(local_socket_, write_buffer_.data() + old_size, room);
+        if ( rc > 0 ) {
+            write_buffer_.resize(old_size + rc);
+            continue;
+        }
+
+        write_buffer_.resize(old_size);
+        if ( rc == 0 ) {
+            LIBSSHQT_DEBUG("Tunneled session closed the socket");
+            local_eof_ = true;
+            sendEof();
+
+        } else if ( errno == EINTR ) {
+            continue;
+
+        } else if ( errno != EAGAIN && errno != EWOULDBLOCK ) {
+            LIBSSHQT_DEBUG("Socket read error:" << strerror(errno));
+            local_eof_ = true;
+            sendEof();
+        }
+        break;
+    }
+
+    if ( ! write_buffer_.isEmpty()) {
+        client_->enableWritableNotifier();
+    }
+
+    if ( read_notifier_ ) {
+        read_notifier_->setEnabled(! local_eof_ &&
+                                   write_buffer_.size() < write_size_);
+    }
+}
+
+/*!
+    Write data read from the channel to the tunneled session.
+*/
+void LibsshQtTunnel::writeToSocket()
+{
+    bool was_full = read_buffer_.size() >= buffer_size_;
+
+    while ( ! read_buffer_.isEmpty()) {
+        ssize_t rc = ::send(local_socket_,
+                            read_buffer_.constData(),
+                            read_buffer_.size(),
+                            MSG_NOSIGNAL);
+        if ( rc > 0 ) {
+            read_buffer_.remove(0, rc);
+
+        } else if ( rc < 0 && errno == EINTR ) {
+            continue;
+
+        } else if ( rc < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK )) {
+            write_notifier_->setEnabled(true);
+            break;
+
+        } else {
+            // The tunneled session is gone, nobody will read the data
+            LIBSSHQT_DEBUG("Socket write error:" << strerror(errno));
+            read_buffer_.clear();
+            local_eof_ = true;
+            sendEof();
+            break;
+        }
+    }
+
+    // Channel reading stopped when the read buffer was full
+    if ( was_full && read_buffer_.size() < buffer_size_ ) {
+        queueCheckIo();
+    }
+}
+
+void LibsshQtTunnel::processState()
+{
+    switch ( state_ ) {
+
+    case StateClosed:
+    case StateClosing:
+    case StateError:
+    case StateClientError:
+        return;
+
+    case StateWaitClient:
+    {
+        if ( client_->state() == LibsshQtClient::StateClosed ) {
+            LIBSSHQT_DEBUG("Connecting jump client");
+            client_->connectToHost();
+
+        } else if ( client_->state() == LibsshQtClient::StateOpened ) {
+            setState(StateOpening);
+            timer_.start();
+        }
+        return;
+    } break;
+
+    case StateOpening:
+    {
+        if ( ! channel_ ) {
+            channel_ = ssh_channel_new(client_->sshSession());
+            if ( ! channel_ ) {
+                LIBSSHQT_FATAL("Could not create SSH channel");
+            }
+        }
+
+        int rc = ssh_channel_open_forward(channel_,
+                                          qPrintable(hostname_), port_,
+                                          "127.0.0.1", 0);
+
+        switch ( rc ) {
+        case SSH_AGAIN:
+            client_->enableWritableNotifier();
+            return;
+
+        case SSH_ERROR:
+            LIBSSHQT_DEBUG("Tunnel open error:" << errorCodeAndMessage());
+            setState(StateError);
+            return;
+
+        case SSH_OK:
+            // Set Unbuffered to disable QIODevice buffers.
+            if ( ! QIODevice::open( ReadWrite | Unbuffered )) {
+                LIBSSHQT_FATAL("QIODevice::open() failed");
+            }
+
+            LIBSSHQT_DEBUG("Tunnel open to" << hostname_ << port_);
+            setState(StateOpen);
+            readFromSocket();
+            timer_.start();
+            return;
+
+        default:
+            LIBSSHQT_CRITICAL("Unknown result code" << rc <<
+                              "received from ssh_channel_open_forward()");
+            return;
+        }
+    } break;
+
+    case StateOpen:
+    {
+        checkIo();
+        writeToSocket();
+        readFromSocket();
+
+        if ( state_ != StateOpen ) {
+            return;
+        }
+
+        // Pass remote EOF to the tunneled session
+        if ( ! remote_eof_ &&
+             read_buffer_.isEmpty() &&
+             ( ssh_channel_is_open(channel_) == 0 ||
+               ssh_channel_is_eof(channel_) != 0 )) {
+            LIBSSHQT_DEBUG("Tunnel channel EOF");
+            shutdown(local_socket_, SHUT_WR);
+            remote_eof_ = true;
+        }
+
+        if ( remote_eof_ &&
+             local_eof_ &&
+             write_buffer_.isEmpty() ) {
+            closeTunnel();
+        }
+        return;
+    } break;
+
+    } // End switch
+
+    Q_ASSERT_X(false, __func__, "Case was not handled properly");
+}
+
+void LibsshQtTunnel::handleClientError()
+{
+    setState(StateClientError);
+}
+
+void LibsshQtTunnel::handleSocketReadable(int socket)
+{
+    Q_UNUSED( socket );
+
+    read_notifier_->setEnabled(false);
+    readFromSocket();
+    queueCheckIo();
+}
+
+void LibsshQtTunnel::handleSocketWritable(int socket)
+{
+    Q_UNUSED( socket );
+
+    write_notifier_->setEnabled(false);
+    writeToSocket();
+}
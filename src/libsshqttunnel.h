@@ -0,0 +1,111 @@
+#ifndef LIBSSHQTTUNNEL_H
+#define LIBSSHQTTUNNEL_H
+
+#include <QObject>
+#include <QTimer>
+#include <QIODevice>
+#include <QSocketNotifier>
+#include "libsshqtchannel.h"
+
+/*!
+
+    LibsshQtTunnel - direct-tcpip channel bridged to a local socket
+
+    LibsshQtTunnel opens a direct-tcpip channel through a LibsshQtClient (the
+    jump host) to the given host and port, and copies data between the channel
+    and one end of a local socket pair. The other end of the socket pair is
+    given to libssh with SSH_OPTIONS_FD, so another LibsshQtClient can run its
+    SSH session through the tunnel.
+
+    LibsshQtClient creates tunnels automatically when a jump client has been
+    set with LibsshQtClient::setJumpClient(), you should not normally need to
+    use this class directly.
+
+    If the jump client is closed when the tunnel is opened, the tunnel calls
+    connectToHost() on the jump client. Many tunnels can share one jump client,
+    so that only one SSH handshake is made with the jump host.
+
+*/
+class LibsshQtTunnel : public LibsshQtChannel
+{
+    Q_OBJECT
+
+public:
+    Q_ENUMS(State)
+    enum State {
+        StateClosed,
+        StateClosing,
+        StateWaitClient,
+        StateOpening,
+        StateOpen,
+        StateError,
+        StateClientError
+    };
+
+    explicit LibsshQtTunnel(LibsshQtClient *jump_client,
+                            QString         hostname,
+                            quint16         port,
+                            QObject        *parent);
+    ~LibsshQtTunnel();
+
+    static const char *enumToString(const State value);
+
+    QString hostname() const;
+    quint16 port() const;
+    socket_t takeSessionSocket();
+
+    State state() const;
+
+public slots:
+    void openTunnel();
+    void closeTunnel();
+
+signals:
+    void opened();
+    void closed();
+    void error();
+
+protected:
+    void setState(State state);
+    void queueCheckIo();
+    bool runPendingWork();
+
+private:
+    bool createSocketPair();
+    void destroySocketPair();
+    void readFromSocket();
+    void writeToSocket();
+
+private slots:
+    void processState();
+    void handleClientError();
+    void handleSocketReadable(int socket);
+    void handleSocketWritable(int socket);
+
+private:
+    QTimer                  timer_;
+    State                   state_;
+    QString                 hostname_;
+    quint16                 port_;
+
+    socket_t                session_socket_;
+    socket_t                local_socket_;
+    bool                    local_eof_;
+    bool                    remote_eof_;
+    QSocketNotifier        *read_notifier_;
+    QSocketNotifier        *write_notifier_;
+};
+
+
+// Include <QDebug> before "libsshqt.h" if you want to use these operators
+#ifdef QDEBUG_H
+
+inline QDebug operator<<(QDebug dbg, const LibsshQtTunnel::State value)
+{
+    dbg << LibsshQtTunnel::enumToString(value);
+    return dbg;
+}
+
+#endif
+
+#endif // LIBSSHQTTUNNEL_H
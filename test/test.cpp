@@ -3,9 +3,27 @@
 #include <QtCore/QString>
 #include <QtTest/QtTest>
 #include <QtConcurrentRun>
+#include <QFutureWatcher>
+#include <QtEndian>
 
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include "libsshqtagent.h"
 #include "libsshqtclient.h"
+#include "libsshqtcoro.h"
 #include "libsshqtprocess.h"
+#include "libsshqtfanout.h"
+#include "libsshqtfilesink.h"
+#include "libsshqtframer.h"
+#include "libsshqtpipe.h"
+#include "libsshqtsftp.h"
+#include "libsshqtsftpscheduler.h"
+#include "libsshqtsftpstriped.h"
+#include "libsshqtsftptransfer.h"
+#include "libsshqtshell.h"
+#include "libsshqtsubsystem.h"
 
 
 
@@ -399,86 +417,2444 @@ TestCaseIOStderr::TestCaseIOStderr(TestCaseOpts *opts) :
 
 
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-// Test
+// TestCaseSink
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 
-class Test : public QObject
+/*!
+   Test that raw output sinks receive all output unmodified.
+*/
+class TestCaseSink : public TestCaseBase
 {
     Q_OBJECT
 
 public:
-    Test();
+    TestCaseSink(TestCaseOpts *opts);
+    static void stderrCallback(const char *data, int len, void *user_data);
 
-private Q_SLOTS:
-    void testConnect();
-    void testReadlineStdin();
-    void testReadlineStderr();
-    void testIoStdout();
-    void testIoStderr();
+public slots:
+    void finished(int exit_code);
 
-private:
-    TestCaseOpts opts;
+public:
+    QBuffer    stdout_buffer;
+    QByteArray stderr_data;
+    QByteArray expected;
 };
 
-Test::Test()
+TestCaseSink::TestCaseSink(TestCaseOpts *opts) :
+    TestCaseBase(opts)
 {
-    const char conf_file[] = "./libsshqt-test-config";
-    const QString conf_help = QString(
-                "Please create configuration file:\n"
-                "\n"
-                "    %1\n"
-                "\n"
-                "with the contents:\n"
-                "\n"
-                "    ssh://user@hostname:port/\n"
-                "    password\n")
-                .arg(conf_file);
+    for ( int i = 1; i <= 100000; i++ ) {
+        expected += QByteArray::number(i) + '\n';
+    }
 
-    QFile file;
-    file.setFileName(conf_file);
-    if ( ! file.open(QIODevice::ReadOnly)) {
-        qFatal("\nError: Could not open test configuration file: %s\n\n%s",
-               conf_file, qPrintable(conf_help));
+    stdout_buffer.open(QIODevice::WriteOnly);
+
+    LibsshQtProcess *process = client->runCommand("seq 100000; seq 100000 1>&2");
+    process->setStdoutSink(&stdout_buffer);
+    process->setStderrSink(&TestCaseSink::stderrCallback, this);
+
+    connect(process, SIGNAL(finished(int)),
+            this,    SLOT(finished(int)));
+}
+
+void TestCaseSink::stderrCallback(const char *data, int len, void *user_data)
+{
+    static_cast< TestCaseSink* >( user_data )->stderr_data.append(data, len);
+}
+
+void TestCaseSink::finished(int exit_code)
+{
+    if ( exit_code == 0 &&
+         stdout_buffer.data() == expected &&
+         stderr_data == expected ) {
+        testSuccess();
+    } else {
+        qDebug() << "Received" << stdout_buffer.data().size() << "and"
+                 << stderr_data.size() << "bytes, expected" << expected.size();
+        testFailed();
     }
+}
 
-    QStringList config = QString(file.readAll()).split('\n');
-    if ( ! config.length() == 2 ) {
-        qFatal("\nError: Could not read SSH url and password from: %s\n\n%s",
-               conf_file, qPrintable(conf_help));
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// TestCaseSinkFd
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+/*!
+   Test that a non-blocking file descriptor sink receives all data, also the
+   data that is left when the command finishes while the pipe is full.
+*/
+class TestCaseSinkFd : public TestCaseBase
+{
+    Q_OBJECT
+
+public:
+    TestCaseSinkFd(TestCaseOpts *opts);
+    ~TestCaseSinkFd();
+    static QByteArray readPipe(int fd);
+
+public slots:
+    void finished(int exit_code);
+
+public:
+    int                 fds[2];
+    QFuture<QByteArray> reader;
+    QByteArray          expected;
+};
+
+TestCaseSinkFd::TestCaseSinkFd(TestCaseOpts *opts) :
+    TestCaseBase(opts)
+{
+    for ( int i = 1; i <= 100000; i++ ) {
+        expected += QByteArray::number(i) + '\n';
     }
 
-    opts.url = config.at(0);
-    opts.password = config.at(1);
+    if ( ::pipe(fds) != 0 ) {
+        qFatal("Could not create pipe");
+    }
+    ::fcntl(fds[1], F_SETFL, ::fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+
+    // Start reading late so that the pipe fills up
+    reader = QtConcurrent::run(&TestCaseSinkFd::readPipe, fds[0]);
+
+    LibsshQtProcess *process = client->runCommand("seq 100000");
+    process->setStdoutSink(fds[1]);
+
+    connect(process, SIGNAL(finished(int)),
+            this,    SLOT(finished(int)));
 }
 
-void Test::testConnect()
+TestCaseSinkFd::~TestCaseSinkFd()
 {
-    TestCaseConnect testcase(&opts);
-    QVERIFY2(opts.loop.exec() == 0, "Could not connect to the SSH server");
+    if ( fds[1] >= 0 ) ::close(fds[1]);
+    reader.waitForFinished();
+    if ( fds[0] >= 0 ) ::close(fds[0]);
 }
 
-void Test::testReadlineStdin()
+QByteArray TestCaseSinkFd::readPipe(int fd)
 {
-    TestCaseReadlineStdout testcase(&opts);
-    QVERIFY2(opts.loop.exec() == 0, "Could not read lines correctly from STDOUT");
+    ::sleep(1);
+
+    QByteArray data;
+    char buffer[4096];
+    ssize_t rc;
+    while (( rc = ::read(fd, buffer, sizeof(buffer))) != 0 ) {
+        if ( rc > 0 ) data.append(buffer, rc);
+        else if ( errno != EINTR ) break;
+    }
+    return data;
 }
 
-void Test::testReadlineStderr()
+void TestCaseSinkFd::finished(int exit_code)
 {
-    TestCaseReadlineStderr testcase(&opts);
-    QVERIFY2(opts.loop.exec() == 0, "Could not read lines correctly from STDERR");
+    ::close(fds[1]);
+    fds[1] = -1;
+
+    QByteArray received = reader.result();
+    if ( exit_code == 0 && received == expected ) {
+        testSuccess();
+    } else {
+        qDebug() << "Received" << received.size() << "bytes, expected"
+                 << expected.size();
+        testFailed();
+    }
 }
 
-void Test::testIoStdout()
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// TestCaseLines
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+/*!
+   Test that linesReady() delivers every line in order and respects the
+   maximum batch size.
+*/
+class TestCaseLines : public TestCaseBase
 {
-    TestCaseIOStdout testcase(&opts);
-    QVERIFY2(opts.loop.exec() == 0, "Data corruption in STDOUT stream");
+    Q_OBJECT
+
+public:
+    TestCaseLines(TestCaseOpts *opts);
+
+public slots:
+    void linesReady(const LibsshQtLines &lines);
+    void finished(int exit_code);
+
+public:
+    int max_batch;
+    int line_count;
+    int next_value;
+};
+
+TestCaseLines::TestCaseLines(TestCaseOpts *opts) :
+    TestCaseBase(opts),
+    max_batch(100),
+    line_count(20000),
+    next_value(1)
+{
+    LibsshQtProcess *process =
+            client->runCommand(QString("seq %1").arg(line_count));
+    process->setStdoutBehaviour(LibsshQtProcess::OutputToLines);
+    process->setMaxLineBatch(max_batch);
+
+    connect(process, SIGNAL(linesReady(LibsshQtLines)),
+            this,    SLOT(linesReady(LibsshQtLines)));
+    connect(process, SIGNAL(finished(int)),
+            this,    SLOT(finished(int)));
 }
 
-void Test::testIoStderr()
+void TestCaseLines::linesReady(const LibsshQtLines &lines)
 {
-    TestCaseIOStderr testcase(&opts);
-    QVERIFY2(opts.loop.exec() == 0, "Data corruption in STDERR stream");
+    if ( lines.count() > max_batch ) {
+        qDebug() << "Too many lines in batch:" << lines.count();
+        testFailed();
+        return;
+    }
+
+    for ( int i = 0; i < lines.count(); i++ ) {
+        if ( lines.line(i).toInt() != next_value ) {
+            qDebug() << "Invalid line:" << lines.line(i)
+                     << "expected:" << next_value;
+            testFailed();
+            return;
+        }
+        next_value++;
+    }
+}
+
+void TestCaseLines::finished(int exit_code)
+{
+    if ( exit_code == 0 && next_value == line_count + 1 ) {
+        testSuccess();
+    } else {
+        qDebug() << "Invalid number of lines read:" << next_value - 1;
+        testFailed();
+    }
+}
+
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// TestCaseTail
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+/*!
+   Test that OutputToTail keeps the last lines of stdout and stderr.
+*/
+class TestCaseTail : public TestCaseBase
+{
+    Q_OBJECT
+
+public:
+    TestCaseTail(TestCaseOpts *opts);
+
+public slots:
+    void finished(int exit_code);
+
+public:
+    LibsshQtProcess *process;
+};
+
+TestCaseTail::TestCaseTail(TestCaseOpts *opts) :
+    TestCaseBase(opts)
+{
+    process = client->runCommand("seq 100000; seq 50000 1>&2; exit 3");
+    process->setStdoutBehaviour(LibsshQtProcess::OutputToTail);
+    process->setStderrBehaviour(LibsshQtProcess::OutputToTail);
+    process->setTailSize(64, 3);
+
+    connect(process, SIGNAL(finished(int)),
+            this,    SLOT(finished(int)));
+}
+
+void TestCaseTail::finished(int exit_code)
+{
+    QList<QByteArray> expected_stdout;
+    expected_stdout << "99998" << "99999" << "100000";
+
+    QList<QByteArray> expected_stderr;
+    expected_stderr << "49998" << "49999" << "50000";
+
+    if ( exit_code == 3 &&
+         process->stdoutTail().lines() == expected_stdout &&
+         process->stderrTail().lines() == expected_stderr &&
+         process->stdoutTail().data().size() == 64 ) {
+        testSuccess();
+    } else {
+        qDebug() << "Invalid tail:" << exit_code
+                 << process->stdoutTail().lines()
+                 << process->stderrTail().lines();
+        testFailed();
+    }
+}
+
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// TestCaseMerged
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+/*!
+   Test that merged output keeps stdout and stderr in order and does not
+   create a stderr object.
+*/
+class TestCaseMerged : public TestCaseBase
+{
+    Q_OBJECT
+
+public:
+    TestCaseMerged(TestCaseOpts *opts);
+
+public slots:
+    void outputReady(const LibsshQtChunks &chunks);
+    void finished(int exit_code);
+
+public:
+    LibsshQtProcess *process;
+    QByteArray streams;
+    QByteArray data;
+    qint64 last_time;
+    bool time_ok;
+};
+
+TestCaseMerged::TestCaseMerged(TestCaseOpts *opts) :
+    TestCaseBase(opts),
+    last_time(0),
+    time_ok(true)
+{
+    process = client->runCommand(
+                "printf out1; sleep 1; printf err 1>&2; sleep 1; printf out2");
+    process->setMergedOutput(true);
+
+    connect(process, SIGNAL(outputReady(LibsshQtChunks)),
+            this,    SLOT(outputReady(LibsshQtChunks)));
+    connect(process, SIGNAL(finished(int)),
+            this,    SLOT(finished(int)));
+}
+
+void TestCaseMerged::outputReady(const LibsshQtChunks &chunks)
+{
+    for ( int i = 0; i < chunks.count(); i++ ) {
+        char stream = chunks.stream(i) == LibsshQtChunks::Stdout ? 'o' : 'e';
+        if ( ! streams.endsWith(stream)) {
+            streams.append(stream);
+        }
+        data.append(chunks.chunk(i));
+
+        time_ok = time_ok && chunks.timestamp(i) >= last_time;
+        last_time = chunks.timestamp(i);
+    }
+}
+
+void TestCaseMerged::finished(int exit_code)
+{
+    if ( exit_code == 0 &&
+         streams == "oeo" &&
+         data == "out1errout2" &&
+         time_ok &&
+         process->findChild<LibsshQtProcessStderr *>() == 0 ) {
+        testSuccess();
+    } else {
+        qDebug() << "Invalid merged output:" << exit_code << streams << data
+                 << time_ok;
+        testFailed();
+    }
+}
+
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// TestCaseStdinSource
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+/*!
+   Test that all data of a stdin source reaches the process and EOF is sent
+   at the end of the source.
+*/
+class TestCaseStdinSource : public TestCaseBase
+{
+    Q_OBJECT
+
+public:
+    TestCaseStdinSource(TestCaseOpts *opts);
+
+public slots:
+    void finished(int exit_code);
+
+public:
+    LibsshQtProcess *process;
+    QBuffer source;
+    QByteArray expected;
+};
+
+TestCaseStdinSource::TestCaseStdinSource(TestCaseOpts *opts) :
+    TestCaseBase(opts)
+{
+    QByteArray data;
+    for ( int i = 0; data.size() < 1024 * 1024 * 4; i++ ) {
+        data.append(QByteArray::number(i)).append('\n');
+    }
+
+    expected = QByteArray::number(data.size()) + "\n";
+    source.setData(data);
+    source.open(QIODevice::ReadOnly);
+
+    process = client->runCommand("wc -c");
+    process->setStdoutBehaviour(LibsshQtProcess::OutputToTail);
+    process->setStdinSource(&source);
+
+    connect(process, SIGNAL(finished(int)),
+            this,    SLOT(finished(int)));
+    connect(process, SIGNAL(error()),
+            this,    SLOT(handleError()));
+}
+
+void TestCaseStdinSource::finished(int exit_code)
+{
+    QByteArray output = process->stdoutTail().data().trimmed() + "\n";
+
+    if ( exit_code == 0 && output == expected ) {
+        testSuccess();
+    } else {
+        qDebug() << "Invalid byte count:" << exit_code << output << expected;
+        testFailed();
+    }
+}
+
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// TestCasePipe
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+/*!
+   Test that LibsshQtPipe moves all output of one process to another when
+   the backlog limit is much smaller than the output.
+*/
+class TestCasePipe : public TestCaseBase
+{
+    Q_OBJECT
+
+public:
+    TestCasePipe(TestCaseOpts *opts);
+
+public slots:
+    void finished(int exit_code);
+
+public:
+    LibsshQtProcess *source;
+    LibsshQtProcess *sink;
+    LibsshQtPipe *pipe;
+};
+
+TestCasePipe::TestCasePipe(TestCaseOpts *opts) :
+    TestCaseBase(opts)
+{
+    source = client->runCommand("seq 200000");
+    sink   = client->runCommand("wc -l");
+    sink->setStdoutBehaviour(LibsshQtProcess::OutputToTail);
+
+    pipe = new LibsshQtPipe(source, sink, this);
+    pipe->setMaxBacklog(4096);
+
+    connect(sink, SIGNAL(finished(int)),
+            this, SLOT(finished(int)));
+    connect(pipe, SIGNAL(error()),
+            this, SLOT(handleError()));
+}
+
+void TestCasePipe::finished(int exit_code)
+{
+    QByteArray output = sink->stdoutTail().data().trimmed();
+
+    if ( exit_code == 0 &&
+         output == "200000" &&
+         pipe->isFinished() &&
+         pipe->bytesTransferred() == 1288895 ) {
+        testSuccess();
+    } else {
+        qDebug() << "Invalid pipe result:" << exit_code << output
+                 << pipe->bytesTransferred();
+        testFailed();
+    }
+}
+
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// TestCasePipeAbort
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+/*!
+   Test that LibsshQtPipe closes the sink without EOF when the source is
+   closed before its command exits, so that partial output is not taken
+   for complete output.
+*/
+class TestCasePipeAbort : public TestCaseBase
+{
+    Q_OBJECT
+
+public:
+    TestCasePipeAbort(TestCaseOpts *opts);
+
+public slots:
+    void sourceReadyRead();
+    void pipeFailed();
+
+public:
+    LibsshQtProcess *source;
+    LibsshQtProcess *sink;
+    LibsshQtPipe *pipe;
+};
+
+TestCasePipeAbort::TestCasePipeAbort(TestCaseOpts *opts) :
+    TestCaseBase(opts)
+{
+    source = client->runCommand("seq 100000000");
+    sink   = client->runCommand("cat > /dev/null");
+
+    pipe = new LibsshQtPipe(source, sink, this);
+
+    connect(source, SIGNAL(readyRead()),
+            this,   SLOT(sourceReadyRead()));
+    connect(pipe,   SIGNAL(error()),
+            this,   SLOT(pipeFailed()));
+    connect(pipe,   SIGNAL(finished()),
+            this,   SLOT(handleError()));
+}
+
+void TestCasePipeAbort::sourceReadyRead()
+{
+    if ( pipe->bytesTransferred() > 0 ) {
+        source->closeChannel();
+    }
+}
+
+void TestCasePipeAbort::pipeFailed()
+{
+    if ( sink->state() == LibsshQtProcess::StateClosed &&
+         sink->eofState() == LibsshQtChannel::EofNotSent &&
+         pipe->bytesTransferred() > 0 ) {
+        testSuccess();
+    } else {
+        qDebug() << "Invalid aborted pipe:" << sink->state()
+                 << sink->eofState() << pipe->bytesTransferred();
+        testFailed();
+    }
+}
+
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// TestCaseFileSink
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+/*!
+   Test that LibsshQtFileSink writes all output, including the unaligned end
+   of the output, when direct I/O is requested. Flushing and changing the
+   batch size while output is written must not turn direct I/O off.
+*/
+class TestCaseFileSink : public TestCaseBase
+{
+    Q_OBJECT
+
+public:
+    TestCaseFileSink(TestCaseOpts *opts);
+    ~TestCaseFileSink();
+
+public slots:
+    void opened();
+    void finished(int exit_code);
+
+public:
+    LibsshQtProcess *process;
+    LibsshQtFileSink *sink;
+    QString file_name;
+    bool direct_io;
+    bool direct_kept;
+};
+
+TestCaseFileSink::TestCaseFileSink(TestCaseOpts *opts) :
+    TestCaseBase(opts)
+{
+    file_name = QDir::temp().filePath("libsshqt-test-filesink");
+
+    sink = new LibsshQtFileSink(this);
+    sink->setBatchSize(64 * 1024);
+    sink->open(file_name, LibsshQtFileSink::DirectIo);
+    sink->preallocate(4 * 1024 * 1024);
+    direct_io = sink->isDirectIo();
+    direct_kept = false;
+
+    process = client->runCommand("seq 300000");
+    sink->attach(process);
+
+    connect(process, SIGNAL(opened()),
+            this,    SLOT(opened()));
+    connect(process, SIGNAL(finished(int)),
+            this,    SLOT(finished(int)));
+    connect(sink,    SIGNAL(error()),
+            this,    SLOT(handleError()));
+}
+
+TestCaseFileSink::~TestCaseFileSink()
+{
+    QFile::remove(file_name);
+}
+
+void TestCaseFileSink::opened()
+{
+    sink->flush();
+    sink->setBatchSize(128 * 1024);
+    direct_kept = sink->isDirectIo() == direct_io;
+}
+
+void TestCaseFileSink::finished(int exit_code)
+{
+    sink->close();
+
+    QFile file(file_name);
+    file.open(QIODevice::ReadOnly);
+    QByteArray data = file.readAll();
+
+    if ( exit_code == 0 &&
+         direct_kept &&
+         data.size() == 1988895 &&
+         sink->bytesWritten() == data.size() &&
+         data.endsWith("\n299999\n300000\n")) {
+        testSuccess();
+    } else {
+        qDebug() << "Invalid file sink output:" << exit_code << data.size()
+                 << sink->bytesWritten() << sink->errorString();
+        testFailed();
+    }
+}
+
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// TestCaseStdinFile
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+/*!
+   Test that a memory mapped stdin file is sent to the process completely
+   and EOF is sent at the end of the file.
+*/
+class TestCaseStdinFile : public TestCaseBase
+{
+    Q_OBJECT
+
+public:
+    TestCaseStdinFile(TestCaseOpts *opts);
+    ~TestCaseStdinFile();
+
+public slots:
+    void finished(int exit_code);
+
+public:
+    LibsshQtProcess *process;
+    QString file_name;
+    QByteArray expected;
+};
+
+TestCaseStdinFile::TestCaseStdinFile(TestCaseOpts *opts) :
+    TestCaseBase(opts)
+{
+    file_name = QDir::temp().filePath("libsshqt-test-stdinfile");
+
+    // Size is not a multiple of the page size on purpose
+    QByteArray block(1024 * 1024, 'x');
+    QFile file(file_name);
+    file.open(QIODevice::WriteOnly | QIODevice::Truncate);
+    for ( int i = 0; i < 8; i++ ) {
+        file.write(block);
+    }
+    file.write("tail\n");
+    file.close();
+
+    expected = QByteArray::number(8 * 1024 * 1024 + 5);
+
+    process = client->runCommand("wc -c");
+    process->setStdoutBehaviour(LibsshQtProcess::OutputToTail);
+    process->setStdinFile(file_name);
+
+    connect(process, SIGNAL(finished(int)),
+            this,    SLOT(finished(int)));
+    connect(process, SIGNAL(error()),
+            this,    SLOT(handleError()));
+}
+
+TestCaseStdinFile::~TestCaseStdinFile()
+{
+    QFile::remove(file_name);
+}
+
+void TestCaseStdinFile::finished(int exit_code)
+{
+    QByteArray output = process->stdoutTail().data().trimmed();
+
+    if ( exit_code == 0 && output == expected ) {
+        testSuccess();
+    } else {
+        qDebug() << "Invalid byte count:" << exit_code << output << expected;
+        testFailed();
+    }
+}
+
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// TestCaseTimeout
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+/*!
+   Test that a process which does not produce output and does not exit on
+   signals is stopped by the idle deadline, and that error() is emitted when
+   the channel is closed after the last grace period.
+*/
+class TestCaseTimeout : public TestCaseBase
+{
+    Q_OBJECT
+
+public:
+    TestCaseTimeout(TestCaseOpts *opts);
+
+public slots:
+    void stopped();
+
+public:
+    LibsshQtProcess *process;
+};
+
+TestCaseTimeout::TestCaseTimeout(TestCaseOpts *opts) :
+    TestCaseBase(opts)
+{
+    // The shell ignores TERM and sleep keeps stdout open after KILL, so the
+    // process is stopped only when the last grace period expires
+    process = client->runCommand("trap '' TERM; echo start; sleep 60");
+    process->setIdleTimeout(500);
+    process->setKillGracePeriod(500);
+
+    connect(process, SIGNAL(error()),
+            this,    SLOT(stopped()));
+    connect(process, SIGNAL(finished(int)),
+            this,    SLOT(handleError()));
+    connect(process, SIGNAL(closed()),
+            this,    SLOT(handleError()));
+}
+
+void TestCaseTimeout::stopped()
+{
+    process->disconnect(this);
+
+    if ( process->state() == LibsshQtProcess::StateError &&
+         process->timeoutReason() == LibsshQtProcess::TimeoutIdle ) {
+        testSuccess();
+    } else {
+        qDebug() << "Process was not stopped by idle deadline:"
+                 << process->timeoutReason();
+        testFailed();
+    }
+}
+
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// TestCaseProcessPool
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+/*!
+   Test that a recycled process is reused by runCommand() and that its
+   settings from the previous command have been reset.
+*/
+class TestCaseProcessPool : public TestCaseBase
+{
+    Q_OBJECT
+
+public:
+    TestCaseProcessPool(TestCaseOpts *opts);
+
+public slots:
+    void firstFinished(int exit_code);
+    void secondFinished(int exit_code);
+
+public:
+    LibsshQtProcess *first;
+    LibsshQtProcess *second;
+};
+
+TestCaseProcessPool::TestCaseProcessPool(TestCaseOpts *opts) :
+    TestCaseBase(opts),
+    second(0)
+{
+    first = client->runCommand("echo first; exit 1");
+    first->setStdoutBehaviour(LibsshQtProcess::OutputToTail);
+    first->setTimeout(60000);
+
+    connect(first, SIGNAL(finished(int)),
+            this,  SLOT(firstFinished(int)));
+}
+
+void TestCaseProcessPool::firstFinished(int exit_code)
+{
+    client->recycleProcess(first);
+
+    second = client->runCommand("echo second");
+    if ( exit_code != 1 ||
+         second != first ||
+         second->exitCode() != -1 ||
+         second->timeout() != 0 ||
+         ! second->stdoutTail().data().isEmpty()) {
+        qDebug() << "Process was not reset:" << exit_code
+                 << second->exitCode() << second->timeout();
+        testFailed();
+        return;
+    }
+
+    second->setStdoutBehaviour(LibsshQtProcess::OutputToTail);
+    connect(second, SIGNAL(finished(int)),
+            this,   SLOT(secondFinished(int)));
+}
+
+void TestCaseProcessPool::secondFinished(int exit_code)
+{
+    QByteArray data = second->stdoutTail().data();
+    if ( exit_code == 0 && data == "second\n" ) {
+        testSuccess();
+    } else {
+        qDebug() << "Invalid output from recycled process:" << exit_code << data;
+        testFailed();
+    }
+}
+
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// TestCaseShell
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+/*!
+   Test that commands run through LibsshQtShell get their own output and exit
+   codes, including output that does not end with a newline, and that output
+   is streamed with stdoutReady().
+*/
+class TestCaseShell : public TestCaseBase
+{
+    Q_OBJECT
+
+public:
+    TestCaseShell(TestCaseOpts *opts);
+
+public slots:
+    void stdoutReady();
+    void finished();
+
+public:
+    LibsshQtShell *shell;
+    QList<LibsshQtShellCommand *> commands;
+    QByteArray streamed;
+};
+
+TestCaseShell::TestCaseShell(TestCaseOpts *opts) :
+    TestCaseBase(opts),
+    shell(new LibsshQtShell(client))
+{
+    commands << shell->runCommand("echo first")
+             << shell->runCommand("printf second; printf err 1>&2; (exit 3)")
+             << shell->runCommand("cat; seq 1000 | tail -n 1");
+
+    connect(commands.at(2), SIGNAL(stdoutReady()),
+            this,           SLOT(stdoutReady()));
+
+    foreach ( LibsshQtShellCommand *command, commands ) {
+        connect(command, SIGNAL(finished(int)),
+                this,    SLOT(finished()));
+        connect(command, SIGNAL(error()),
+                this,    SLOT(handleError()));
+    }
+}
+
+void TestCaseShell::stdoutReady()
+{
+    streamed += commands.at(2)->readStdout();
+}
+
+void TestCaseShell::finished()
+{
+    foreach ( LibsshQtShellCommand *command, commands ) {
+        if ( ! command->isFinished()) return;
+    }
+
+    if ( commands.at(0)->exitCode() == 0 &&
+         commands.at(0)->stdoutData() == "first\n" &&
+         commands.at(1)->exitCode() == 3 &&
+         commands.at(1)->stdoutData() == "second" &&
+         commands.at(1)->stderrData() == "err" &&
+         commands.at(2)->exitCode() == 0 &&
+         commands.at(2)->stdoutData() == "1000\n" &&
+         streamed == "1000\n" ) {
+        testSuccess();
+    } else {
+        foreach ( LibsshQtShellCommand *command, commands ) {
+            qDebug() << "Invalid shell result:" << command->command()
+                     << command->exitCode() << command->stdoutData()
+                     << command->stderrData();
+        }
+        testFailed();
+    }
+}
+
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// TestCaseAsync
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+/*!
+   Test that runCommandAsync() futures get the output, exit code and stdin of
+   their commands, and that canceling the future of a silent command
+   finishes it.
+*/
+class TestCaseAsync : public TestCaseBase
+{
+    Q_OBJECT
+
+public:
+    TestCaseAsync(TestCaseOpts *opts);
+
+public slots:
+    void finished();
+
+public:
+    QFutureWatcher<LibsshQtResult> plain;
+    QFutureWatcher<LibsshQtResult> input;
+    QFutureWatcher<LibsshQtResult> silent;
+};
+
+TestCaseAsync::TestCaseAsync(TestCaseOpts *opts) :
+    TestCaseBase(opts)
+{
+    connect(&plain, SIGNAL(finished()),
+            this,   SLOT(finished()));
+    connect(&input, SIGNAL(finished()),
+            this,   SLOT(finished()));
+    connect(&silent, SIGNAL(finished()),
+            this,    SLOT(finished()));
+
+    plain.setFuture(client->runCommandAsync(
+                        "printf out; printf err 1>&2; exit 4"));
+    input.setFuture(client->runCommandAsync("cat", "hello stdin"));
+    silent.setFuture(client->runCommandAsync("sleep 3600"));
+    silent.cancel();
+}
+
+void TestCaseAsync::finished()
+{
+    if ( ! plain.isFinished() ||
+         ! input.isFinished() ||
+         ! silent.isFinished()) return;
+
+    LibsshQtResult p = plain.result();
+    LibsshQtResult i = input.result();
+
+    if ( silent.isCanceled() &&
+         p.ok && p.exitCode == 4 &&
+         p.stdoutData == "out" && p.stderrData == "err" &&
+         i.ok && i.exitCode == 0 &&
+         i.stdoutData == "hello stdin" && i.stderrData.isEmpty() &&
+         i.openTime >= 0 && i.totalTime >= i.openTime ) {
+        testSuccess();
+    } else {
+        qDebug() << "Invalid async result:"
+                 << p.exitCode << p.stdoutData << p.stderrData << p.errorMessage
+                 << i.exitCode << i.stdoutData << i.stderrData << i.errorMessage;
+        testFailed();
+    }
+}
+
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// TestCaseCoroutine
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+#if defined(__cpp_impl_coroutine)
+
+/*!
+   Test that a coroutine can connect the client, run a command with exec()
+   and read the output of a process one line at a time.
+
+   The class has no slots of its own, so it does not need moc, which would
+   not see the C++20 guard.
+*/
+class TestCaseCoroutine : public TestCaseBase
+{
+public:
+    TestCaseCoroutine(TestCaseOpts *opts);
+    LibsshQt::Task run();
+};
+
+TestCaseCoroutine::TestCaseCoroutine(TestCaseOpts *opts) :
+    TestCaseBase(opts)
+{
+    run();
+}
+
+LibsshQt::Task TestCaseCoroutine::run()
+{
+    if ( ! co_await LibsshQt::connectToHost(client)) {
+        testFailed();
+        co_return;
+    }
+
+    QString command = "printf out; printf err 1>&2; exit 3";
+    LibsshQtResult result = co_await LibsshQt::exec(client, command);
+
+    LibsshQtProcess *process = client->runCommand("seq 3");
+    process->setStdoutBehaviour(LibsshQtProcess::OutputManual);
+
+    QByteArray lines;
+    if ( co_await LibsshQt::started(process)) {
+        forever {
+            QByteArray line = co_await LibsshQt::readLine(process);
+            if ( line.isEmpty()) break;
+            lines += line;
+        }
+    }
+    client->recycleProcess(process);
+
+    if ( result.ok &&
+         result.exitCode == 3 &&
+         result.stdoutData == "out" &&
+         result.stderrData == "err" &&
+         lines == "1\n2\n3\n" ) {
+        testSuccess();
+    } else {
+        qDebug() << "Invalid coroutine result:" << result.ok
+                 << result.exitCode << result.stdoutData
+                 << result.stderrData << result.errorMessage << lines;
+        testFailed();
+    }
+}
+
+#endif // __cpp_impl_coroutine
+
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// TestCaseAgent
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+/*!
+   Test that pipelined agent requests receive correct replies in order.
+*/
+class TestCaseAgent : public TestCaseBase
+{
+    Q_OBJECT
+
+public:
+    TestCaseAgent(TestCaseOpts *opts);
+
+public slots:
+    void finished(const LibsshQtAgentReply &reply);
+
+public:
+    LibsshQtAgent *agent;
+    QByteArray data;
+    QList<quint32> ids;
+    QList<LibsshQtAgentReply> replies;
+};
+
+TestCaseAgent::TestCaseAgent(TestCaseOpts *opts) :
+    TestCaseBase(opts),
+    agent(new LibsshQtAgent(client))
+{
+    for ( int i = 0; i < 100000; i++ ) {
+        data.append(char(i));
+    }
+
+    connect(agent, SIGNAL(finished(LibsshQtAgentReply)),
+            this,  SLOT(finished(LibsshQtAgentReply)));
+
+    QString path = "/tmp/libsshqt-test-agent";
+    ids << agent->writeFile(path, data)
+        << agent->statFile(path)
+        << agent->readFile(path, 10, 20)
+        << agent->readFile(path)
+        << agent->exec("rm " + path + "; echo out; echo err 1>&2; exit 4")
+        << agent->statFile(path);
+}
+
+void TestCaseAgent::finished(const LibsshQtAgentReply &reply)
+{
+    replies << reply;
+    if ( replies.count() < ids.count()) return;
+
+    bool ok = true;
+    for ( int i = 0; i < ids.count(); i++ ) {
+        ok = ok && replies.at(i).id == ids.at(i);
+    }
+
+    if ( ok &&
+         replies.at(0).ok &&
+         replies.at(1).ok && replies.at(1).size == quint64(data.size()) &&
+         replies.at(2).ok && replies.at(2).data == data.mid(10, 20) &&
+         replies.at(3).ok && replies.at(3).data == data &&
+         replies.at(4).ok && replies.at(4).exitCode == 4 &&
+         replies.at(4).stdoutData == "out\n" &&
+         replies.at(4).stderrData == "err\n" &&
+         ! replies.at(5).ok ) {
+        testSuccess();
+    } else {
+        foreach ( LibsshQtAgentReply reply, replies ) {
+            qDebug() << "Agent reply:" << reply.id << reply.type << reply.ok
+                     << reply.errorMessage << reply.exitCode;
+        }
+        testFailed();
+    }
+}
+
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// TestCaseSubsystem
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+/*!
+   Framer for SFTP packets, which are prefixed with a 32-bit length.
+*/
+class TestSftpFramer : public LibsshQtFramer
+{
+public:
+    bool parse(const char *data, int len, QList<QByteArray> &messages)
+    {
+        pending.append(data, len);
+        while ( pending.size() >= 4 ) {
+            int packet_len = qFromBigEndian<quint32>(
+                        reinterpret_cast<const uchar *>(pending.constData()));
+            if ( pending.size() < 4 + packet_len ) break;
+            messages << pending.mid(4, packet_len);
+            pending.remove(0, 4 + packet_len);
+        }
+        return true;
+    }
+
+    QByteArray frame(const QByteArray &message) const
+    {
+        uchar len[4];
+        qToBigEndian<quint32>(message.size(), len);
+        return QByteArray(reinterpret_cast<const char *>(len), 4) + message;
+    }
+
+    void reset()
+    {
+        pending.clear();
+    }
+
+    QByteArray pending;
+};
+
+/*!
+   Test that a subsystem channel can be opened and that a custom framer
+   receives complete messages. SFTP is used since the test server is most
+   likely to support it.
+*/
+class TestCaseSubsystem : public TestCaseBase
+{
+    Q_OBJECT
+
+public:
+    TestCaseSubsystem(TestCaseOpts *opts);
+
+public slots:
+    void opened();
+    void messageReceived(const QByteArray &message);
+
+public:
+    LibsshQtSubsystem *subsystem;
+};
+
+TestCaseSubsystem::TestCaseSubsystem(TestCaseOpts *opts) :
+    TestCaseBase(opts)
+{
+    subsystem = client->openSubsystem("sftp");
+    subsystem->setFramer(new TestSftpFramer);
+
+    connect(subsystem, SIGNAL(opened()),
+            this,      SLOT(opened()));
+    connect(subsystem, SIGNAL(messageReceived(QByteArray)),
+            this,      SLOT(messageReceived(QByteArray)));
+    connect(subsystem, SIGNAL(error()),
+            this,      SLOT(handleError()));
+}
+
+void TestCaseSubsystem::opened()
+{
+    // SSH_FXP_INIT, version 3
+    subsystem->sendMessage(QByteArray("\x01\x00\x00\x00\x03", 5));
+}
+
+void TestCaseSubsystem::messageReceived(const QByteArray &message)
+{
+    // SSH_FXP_VERSION
+    if ( message.size() >= 5 && message.at(0) == 2 ) {
+        testSuccess();
+    } else {
+        qDebug() << "Invalid SFTP version packet:" << message.toHex();
+        testFailed();
+    }
+}
+
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// TestCaseSftp
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+/*!
+   Test the SFTP operations by writing a file, checking it with stat and
+   readDir, renaming it, reading it back and removing it. Each step is
+   started when the previous request has finished.
+*/
+class TestCaseSftp : public TestCaseBase
+{
+    Q_OBJECT
+
+public:
+    TestCaseSftp(TestCaseOpts *opts);
+
+public slots:
+    void requestFinished(LibsshQtSftpRequest *request);
+
+public:
+    LibsshQtSftp *sftp;
+    QString path;
+    QString renamed;
+    QByteArray content;
+    QByteArray handle;
+    int step;
+};
+
+TestCaseSftp::TestCaseSftp(TestCaseOpts *opts) :
+    TestCaseBase(opts),
+    step(0)
+{
+    path    = QString("libsshqt-test-sftp-%1").arg(qrand());
+    renamed = path + ".renamed";
+    content = "Hello SFTP\n";
+
+    sftp = new LibsshQtSftp(client);
+
+    connect(sftp, SIGNAL(requestFinished(LibsshQtSftpRequest*)),
+            this, SLOT(requestFinished(LibsshQtSftpRequest*)));
+    connect(sftp, SIGNAL(error()),
+            this, SLOT(handleError()));
+
+    sftp->open(path, LibsshQtSftp::OpenWrite |
+                     LibsshQtSftp::OpenCreate |
+                     LibsshQtSftp::OpenTruncate);
+}
+
+void TestCaseSftp::requestFinished(LibsshQtSftpRequest *request)
+{
+    request->deleteLater();
+
+    if ( request->isError()) {
+        qDebug() << "SFTP request failed in step" << step
+                 << request->errorMessage();
+        testFailed();
+        return;
+    }
+
+    bool found = false;
+    switch ( step++ ) {
+    case 0:
+        handle = request->handle();
+        sftp->write(handle, 0, content);
+        break;
+
+    case 1:
+        sftp->close(handle);
+        break;
+
+    case 2:
+        sftp->stat(path);
+        break;
+
+    case 3:
+        if ( ! request->attributes().isRegularFile() ||
+             request->attributes().size != quint64(content.size())) {
+            qDebug() << "Invalid attributes, size:"
+                     << request->attributes().size;
+            testFailed();
+            return;
+        }
+        sftp->readDir(".");
+        break;
+
+    case 4:
+        foreach ( const LibsshQtSftpEntry &entry, request->entries()) {
+            found = found || entry.name == path;
+        }
+        if ( ! found ) {
+            qDebug() << "File was not listed in directory";
+            testFailed();
+            return;
+        }
+        sftp->rename(path, renamed);
+        break;
+
+    case 5:
+        sftp->open(renamed, LibsshQtSftp::OpenRead);
+        break;
+
+    case 6:
+        handle = request->handle();
+        sftp->read(handle, 0, 1024);
+        break;
+
+    case 7:
+        if ( request->data() != content ) {
+            qDebug() << "Invalid file content:" << request->data();
+            testFailed();
+            return;
+        }
+        sftp->read(handle, content.size(), 1024);
+        break;
+
+    case 8:
+        if ( ! request->atEnd()) {
+            qDebug() << "Read past end of file returned data";
+            testFailed();
+            return;
+        }
+        sftp->close(handle);
+        break;
+
+    case 9:
+        sftp->remove(renamed);
+        break;
+
+    case 10:
+        testSuccess();
+        break;
+    }
+}
+
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// TestCaseSftpTransfer
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+/*!
+   Test that a pipelined upload and download reproduce the original file.
+   The file size is not a multiple of the chunk size, so the last reply is
+   a short read.
+*/
+class TestCaseSftpTransfer : public TestCaseBase
+{
+    Q_OBJECT
+
+public:
+    TestCaseSftpTransfer(TestCaseOpts *opts);
+    ~TestCaseSftpTransfer();
+
+public slots:
+    void uploaded();
+    void downloaded();
+    void removed();
+    void transferError();
+
+public:
+    LibsshQtSftp *sftp;
+    LibsshQtSftpTransfer *transfer;
+    QString remote_path;
+    QString upload_path;
+    QString download_path;
+    QByteArray content;
+};
+
+TestCaseSftpTransfer::TestCaseSftpTransfer(TestCaseOpts *opts) :
+    TestCaseBase(opts)
+{
+    remote_path   = QString("libsshqt-test-sftptransfer-%1").arg(qrand());
+    upload_path   = QDir::temp().filePath("libsshqt-test-sftpupload");
+    download_path = QDir::temp().filePath("libsshqt-test-sftpdownload");
+
+    for ( int i = 0; content.size() < 1000 * 1000; i++ ) {
+        content.append(QByteArray::number(i)).append('\n');
+    }
+
+    QFile file(upload_path);
+    file.open(QIODevice::WriteOnly | QIODevice::Truncate);
+    file.write(content);
+    file.close();
+
+    sftp = new LibsshQtSftp(client);
+    transfer = new LibsshQtSftpTransfer(sftp, this);
+    transfer->setChunkSize(8 * 1024);
+    transfer->setPipelineDepth(8);
+    transfer->setUpload(upload_path, remote_path);
+
+    connect(transfer, SIGNAL(finished()),
+            this,     SLOT(uploaded()));
+    connect(transfer, SIGNAL(error()),
+            this,     SLOT(transferError()));
+
+    transfer->start();
+}
+
+TestCaseSftpTransfer::~TestCaseSftpTransfer()
+{
+    QFile::remove(upload_path);
+    QFile::remove(download_path);
+}
+
+void TestCaseSftpTransfer::uploaded()
+{
+    transfer->disconnect(this);
+    transfer->setDownload(remote_path, download_path);
+
+    connect(transfer, SIGNAL(finished()),
+            this,     SLOT(downloaded()));
+    connect(transfer, SIGNAL(error()),
+            this,     SLOT(transferError()));
+
+    transfer->start();
+}
+
+void TestCaseSftpTransfer::downloaded()
+{
+    QFile file(download_path);
+    file.open(QIODevice::ReadOnly);
+    QByteArray data = file.readAll();
+
+    if ( data != content ||
+         transfer->bytesTransferred() != content.size()) {
+        qDebug() << "Downloaded file differs, size:" << data.size()
+                 << "transferred:" << transfer->bytesTransferred();
+        testFailed();
+        return;
+    }
+
+    LibsshQtSftpRequest *request = sftp->remove(remote_path);
+    connect(request, SIGNAL(finished()),
+            this,    SLOT(removed()));
+    connect(request, SIGNAL(error()),
+            this,    SLOT(removed()));
+}
+
+void TestCaseSftpTransfer::removed()
+{
+    testSuccess();
+}
+
+void TestCaseSftpTransfer::transferError()
+{
+    qDebug() << "Transfer failed:" << transfer->errorMessage();
+    testFailed();
+}
+
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// TestCaseSftpScheduler
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+/*!
+   Test that the scheduler uploads many small files and one large file over
+   several channels, and reports every file once.
+*/
+class TestCaseSftpScheduler : public TestCaseBase
+{
+    Q_OBJECT
+
+public:
+    TestCaseSftpScheduler(TestCaseOpts *opts);
+    ~TestCaseSftpScheduler();
+
+public slots:
+    void fileDone(int file);
+    void allFinished();
+    void cleanedUp();
+
+public:
+    LibsshQtSftpScheduler *scheduler;
+    QStringList local_files;
+    QString prefix;
+    qint64 total;
+    int done;
+};
+
+TestCaseSftpScheduler::TestCaseSftpScheduler(TestCaseOpts *opts) :
+    TestCaseBase(opts),
+    total(0),
+    done(0)
+{
+    prefix = QString("libsshqt-test-scheduler-%1-").arg(qrand());
+
+    scheduler = new LibsshQtSftpScheduler(this);
+    scheduler->addClient(client);
+    scheduler->setChannelsPerClient(2);
+    scheduler->setMaxTransfersPerChannel(8);
+    scheduler->setLargeFileSize(1024 * 1024);
+
+    for ( int i = 0; i <= 40; i++ ) {
+        QString name = prefix + QString::number(i);
+        QString local = QDir::temp().filePath(name);
+
+        // The last file is the large one
+        QByteArray data(i == 40 ? 1536 * 1024 : 100 + i, 'a' + i % 26);
+        QFile file(local);
+        file.open(QIODevice::WriteOnly | QIODevice::Truncate);
+        file.write(data);
+        file.close();
+
+        total += data.size();
+        local_files << local;
+        scheduler->addUpload(local, name);
+    }
+
+    connect(scheduler, SIGNAL(fileFinished(int)),
+            this,      SLOT(fileDone(int)));
+    connect(scheduler, SIGNAL(fileError(int,QString)),
+            this,      SLOT(fileDone(int)));
+    connect(scheduler, SIGNAL(allFinished()),
+            this,      SLOT(allFinished()));
+
+    scheduler->start();
+}
+
+TestCaseSftpScheduler::~TestCaseSftpScheduler()
+{
+    foreach ( QString local, local_files ) {
+        QFile::remove(local);
+    }
+}
+
+void TestCaseSftpScheduler::fileDone(int file)
+{
+    Q_UNUSED( file );
+    done++;
+}
+
+void TestCaseSftpScheduler::allFinished()
+{
+    if ( done != scheduler->fileCount() ||
+         scheduler->failedCount() != 0 ||
+         scheduler->bytesTransferred() != total ||
+         scheduler->totalSize() != total ) {
+        qDebug() << "Invalid scheduler result, files:" << done
+                 << "failed:" << scheduler->failedCount()
+                 << "bytes:" << scheduler->bytesTransferred() << total;
+        testFailed();
+        return;
+    }
+
+    LibsshQtProcess *process = client->runCommand(
+                QString("rm -f %1*").arg(prefix));
+    connect(process, SIGNAL(finished(int)),
+            this,    SLOT(cleanedUp()));
+    connect(process, SIGNAL(error()),
+            this,    SLOT(handleError()));
+}
+
+void TestCaseSftpScheduler::cleanedUp()
+{
+    testSuccess();
+}
+
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// TestCaseSftpStriped
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+/*!
+   Test that a file uploaded and downloaded in stripes over three sessions
+   is reproduced. The size is not a multiple of the stripe size, so the
+   last stripe is shorter than the others.
+*/
+class TestCaseSftpStriped : public TestCaseBase
+{
+    Q_OBJECT
+
+public:
+    TestCaseSftpStriped(TestCaseOpts *opts);
+    ~TestCaseSftpStriped();
+
+public slots:
+    void uploaded();
+    void downloaded();
+    void removed();
+    void transferError();
+
+public:
+    LibsshQtSftp *sftp;
+    LibsshQtSftpStriped *striped;
+    QString remote_path;
+    QString upload_path;
+    QString download_path;
+    QByteArray content;
+};
+
+TestCaseSftpStriped::TestCaseSftpStriped(TestCaseOpts *opts) :
+    TestCaseBase(opts)
+{
+    remote_path   = QString("libsshqt-test-sftpstriped-%1").arg(qrand());
+    upload_path   = QDir::temp().filePath("libsshqt-test-stripedupload");
+    download_path = QDir::temp().filePath("libsshqt-test-stripeddownload");
+
+    for ( int i = 0; content.size() < 3 * 1000 * 1000; i++ ) {
+        content.append(QByteArray::number(i)).append('\n');
+    }
+
+    QFile file(upload_path);
+    file.open(QIODevice::WriteOnly | QIODevice::Truncate);
+    file.write(content);
+    file.close();
+
+    sftp = new LibsshQtSftp(client);
+
+    striped = new LibsshQtSftpStriped(this);
+    striped->setUrl(opts->url);
+    striped->setPassword(opts->password);
+    striped->setStripes(3);
+    striped->setMinStripeSize(512 * 1024);
+    striped->setChunkSize(16 * 1024);
+    striped->setUpload(upload_path, remote_path);
+
+    connect(striped, SIGNAL(finished()),
+            this,    SLOT(uploaded()));
+    connect(striped, SIGNAL(error()),
+            this,    SLOT(transferError()));
+
+    striped->start();
+}
+
+TestCaseSftpStriped::~TestCaseSftpStriped()
+{
+    QFile::remove(upload_path);
+    QFile::remove(download_path);
+}
+
+void TestCaseSftpStriped::uploaded()
+{
+    if ( striped->stripesUsed() != 3 ) {
+        qDebug() << "Upload used" << striped->stripesUsed() << "stripes";
+        testFailed();
+        return;
+    }
+
+    striped->disconnect(this);
+    striped->setDownload(remote_path, download_path);
+
+    connect(striped, SIGNAL(finished()),
+            this,    SLOT(downloaded()));
+    connect(striped, SIGNAL(error()),
+            this,    SLOT(transferError()));
+
+    striped->start();
+}
+
+void TestCaseSftpStriped::downloaded()
+{
+    QFile file(download_path);
+    file.open(QIODevice::ReadOnly);
+    QByteArray data = file.readAll();
+
+    if ( data != content ||
+         striped->bytesTransferred() != content.size()) {
+        qDebug() << "Downloaded file differs, size:" << data.size()
+                 << "transferred:" << striped->bytesTransferred();
+        testFailed();
+        return;
+    }
+
+    LibsshQtSftpRequest *request = sftp->remove(remote_path);
+    connect(request, SIGNAL(finished()),
+            this,    SLOT(removed()));
+    connect(request, SIGNAL(error()),
+            this,    SLOT(removed()));
+}
+
+void TestCaseSftpStriped::removed()
+{
+    testSuccess();
+}
+
+void TestCaseSftpStriped::transferError()
+{
+    qDebug() << "Striped transfer failed:" << striped->errorMessage();
+    testFailed();
+}
+
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// TestCaseSftpResume
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+/*!
+   Test that an upload aborted after the first journal checkpoint resumes
+   from the journal, and that the resumed file is complete.
+*/
+class TestCaseSftpResume : public TestCaseBase
+{
+    Q_OBJECT
+
+public:
+    TestCaseSftpResume(TestCaseOpts *opts);
+    ~TestCaseSftpResume();
+
+public slots:
+    void uploadProgress(qint64 bytes_transferred);
+    void resume();
+    void uploaded();
+    void downloaded();
+    void removed();
+    void transferError();
+
+public:
+    LibsshQtSftp *sftp;
+    LibsshQtSftpTransfer *transfer;
+    QString remote_path;
+    QString upload_path;
+    QString download_path;
+    QString journal_path;
+    QByteArray content;
+};
+
+TestCaseSftpResume::TestCaseSftpResume(TestCaseOpts *opts) :
+    TestCaseBase(opts)
+{
+    remote_path   = QString("libsshqt-test-sftpresume-%1").arg(qrand());
+    upload_path   = QDir::temp().filePath("libsshqt-test-resumeupload");
+    download_path = QDir::temp().filePath("libsshqt-test-resumedownload");
+    journal_path  = QDir::temp().filePath("libsshqt-test-resumejournal");
+    QFile::remove(journal_path);
+
+    for ( int i = 0; content.size() < 6 * 1000 * 1000; i++ ) {
+        content.append(QByteArray::number(i)).append('\n');
+    }
+
+    QFile file(upload_path);
+    file.open(QIODevice::WriteOnly | QIODevice::Truncate);
+    file.write(content);
+    file.close();
+
+    sftp = new LibsshQtSftp(client);
+    transfer = new LibsshQtSftpTransfer(sftp, this);
+    transfer->setJournal(journal_path);
+    transfer->setUpload(upload_path, remote_path);
+
+    connect(transfer, SIGNAL(progress(qint64,qint64)),
+            this,     SLOT(uploadProgress(qint64)));
+    connect(transfer, SIGNAL(error()),
+            this,     SLOT(transferError()));
+
+    transfer->start();
+}
+
+TestCaseSftpResume::~TestCaseSftpResume()
+{
+    QFile::remove(upload_path);
+    QFile::remove(download_path);
+    QFile::remove(journal_path);
+}
+
+void TestCaseSftpResume::uploadProgress(qint64 bytes_transferred)
+{
+    // The journal is saved every 4 MiB
+    if ( bytes_transferred >= 5 * 1024 * 1024 ) {
+        transfer->abort();
+        QMetaObject::invokeMethod(this, "resume", Qt::QueuedConnection);
+    }
+}
+
+void TestCaseSftpResume::resume()
+{
+    if ( ! QFile::exists(journal_path)) {
+        qDebug() << "Aborted transfer did not save the journal";
+        testFailed();
+        return;
+    }
+
+    transfer->disconnect(this);
+    connect(transfer, SIGNAL(finished()),
+            this,     SLOT(uploaded()));
+    connect(transfer, SIGNAL(error()),
+            this,     SLOT(transferError()));
+
+    transfer->start();
+}
+
+void TestCaseSftpResume::uploaded()
+{
+    if ( transfer->resumedOffset() < 4 * 1024 * 1024 ||
+         transfer->resumedOffset() + transfer->bytesTransferred() !=
+             quint64(content.size()) ||
+         QFile::exists(journal_path)) {
+        qDebug() << "Upload was not resumed, offset:"
+                 << transfer->resumedOffset()
+                 << "transferred:" << transfer->bytesTransferred();
+        testFailed();
+        return;
+    }
+
+    transfer->disconnect(this);
+    transfer->setJournal(QString());
+    transfer->setDownload(remote_path, download_path);
+
+    connect(transfer, SIGNAL(finished()),
+            this,     SLOT(downloaded()));
+    connect(transfer, SIGNAL(error()),
+            this,     SLOT(transferError()));
+
+    transfer->start();
+}
+
+void TestCaseSftpResume::downloaded()
+{
+    QFile file(download_path);
+    file.open(QIODevice::ReadOnly);
+
+    if ( file.readAll() != content ) {
+        qDebug() << "Resumed upload corrupted the file";
+        testFailed();
+        return;
+    }
+
+    LibsshQtSftpRequest *request = sftp->remove(remote_path);
+    connect(request, SIGNAL(finished()),
+            this,    SLOT(removed()));
+    connect(request, SIGNAL(error()),
+            this,    SLOT(removed()));
+}
+
+void TestCaseSftpResume::removed()
+{
+    testSuccess();
+}
+
+void TestCaseSftpResume::transferError()
+{
+    qDebug() << "Transfer failed:" << transfer->errorMessage();
+    testFailed();
+}
+
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// TestBlocking
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+/*!
+   Run a command with the blocking API in a thread pool worker, which does
+   not run an event loop. Returns an empty string on success, otherwise a
+   description of the failure.
+*/
+QString testBlockingWorker(TestCaseOpts *opts)
+{
+    LibsshQtClient client;
+    client.setUrl(opts->url);
+    client.usePasswordAuth(true);
+    client.setPassword(opts->password);
+
+    if ( ! client.waitForConnected(30000)) {
+        return "Could not connect: " + client.errorCodeAndMessage();
+    }
+
+    LibsshQtProcess *process = client.runCommand("read line; echo \"$line\"");
+    process->setStdoutBehaviour(LibsshQtProcess::OutputManual);
+
+    if ( ! process->waitForStarted(30000)) {
+        return "Process did not start: " + process->errorCodeAndMessage();
+    }
+
+    process->write("blocking\n");
+
+    if ( ! process->waitForBytesWritten(30000)) {
+        return "Could not write to stdin";
+    }
+
+    QByteArray output;
+    while ( ! output.endsWith('\n') && process->waitForReadyRead(30000)) {
+        output += process->readAll();
+    }
+
+    if ( ! process->waitForFinished(30000)) {
+        return "Process did not finish";
+    }
+
+    if ( output != "blocking\n" || process->exitCode() != 0 ) {
+        return "Invalid output: " + QString(output);
+    }
+
+    // The output of a short command arrives together with EOF, it must
+    // still be readable after the process has finished
+    process = client.runCommand("echo x");
+    process->setStdoutBehaviour(LibsshQtProcess::OutputManual);
+
+    output.clear();
+    while ( process->waitForReadyRead(30000)) {
+        output += process->readAll();
+    }
+
+    if ( output != "x\n" ||
+         ! process->waitForFinished(30000) ||
+         process->exitCode() != 0 ) {
+        return "Invalid output from echo: " + QString(output);
+    }
+
+    process = client.runCommand("echo y 1>&2");
+    process->setStdoutBehaviour(LibsshQtProcess::OutputManual);
+    process->setStderrBehaviour(LibsshQtProcess::OutputManual);
+
+    output.clear();
+    while ( process->stderr()->waitForReadyRead(30000)) {
+        output += process->stderr()->readAll();
+    }
+
+    if ( output != "y\n" ||
+         ! process->waitForFinished(30000) ||
+         process->exitCode() != 0 ) {
+        return "Invalid stderr output: " + QString(output);
+    }
+
+    return QString();
+}
+
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// TestCaseJump
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+/*!
+   Test that a client can connect through a jump client. The test server is
+   used as its own jump host.
+*/
+class TestCaseJump : public TestCaseBase
+{
+    Q_OBJECT
+
+public:
+    TestCaseJump(TestCaseOpts *opts);
+
+public slots:
+    void finished(int exit_code);
+
+public:
+    LibsshQtClient *inner;
+};
+
+TestCaseJump::TestCaseJump(TestCaseOpts *opts) :
+    TestCaseBase(opts),
+    inner(new LibsshQtClient(this))
+{
+    inner->setUrl(opts->url);
+    inner->setJumpClient(client);
+    inner->usePasswordAuth(true);
+    inner->setPassword(opts->password);
+
+    connect(inner, SIGNAL(error()),
+            this,  SLOT(handleError()));
+    connect(inner, SIGNAL(allAuthsFailed()),
+            this,  SLOT(handleError()));
+
+    inner->connectToHost();
+
+    LibsshQtProcess *process = inner->runCommand("true");
+    process->setStdoutBehaviour(LibsshQtProcess::OutputToDevNull);
+    connect(process, SIGNAL(finished(int)),
+            this,    SLOT(finished(int)));
+}
+
+void TestCaseJump::finished(int exit_code)
+{
+    inner->disconnect(this);
+    if ( exit_code == 0 ) {
+        testSuccess();
+    } else {
+        testFailed();
+    }
+}
+
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// TestCaseChannelQueue
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+/*!
+   Test that more processes than the server allows sessions can be started at
+   once and that high priority processes are started first.
+*/
+class TestCaseChannelQueue : public TestCaseBase
+{
+    Q_OBJECT
+
+public:
+    TestCaseChannelQueue(TestCaseOpts *opts);
+
+public slots:
+    void opened();
+    void finished(int exit_code);
+
+public:
+    int process_count;
+    int finished_count;
+    int first_low_priority;
+    int opened_count;
+};
+
+TestCaseChannelQueue::TestCaseChannelQueue(TestCaseOpts *opts) :
+    TestCaseBase(opts),
+    process_count(50),
+    finished_count(0),
+    first_low_priority(-1),
+    opened_count(0)
+{
+    client->setMaxChannels(5);
+
+    for ( int i = 0; i < process_count; i++ ) {
+        int priority = i < process_count / 2 ? 0 : 1;
+        LibsshQtProcess *process = client->runCommand("sleep 0.1", priority);
+        process->setProperty("priority", priority);
+
+        connect(process, SIGNAL(opened()),
+                this,    SLOT(opened()));
+        connect(process, SIGNAL(finished(int)),
+                this,    SLOT(finished(int)));
+        connect(process, SIGNAL(error()),
+                this,    SLOT(handleError()));
+    }
+}
+
+void TestCaseChannelQueue::opened()
+{
+    opened_count++;
+    if ( client->openChannelCount() > client->maxChannels()) {
+        qDebug() << "Too many open channels:" << client->openChannelCount();
+        testFailed();
+
+    } else if ( sender()->property("priority").toInt() == 0 &&
+                first_low_priority == -1 ) {
+        first_low_priority = opened_count;
+    }
+}
+
+void TestCaseChannelQueue::finished(int exit_code)
+{
+    if ( exit_code != 0 ) {
+        testFailed();
+
+    } else if ( ++finished_count == process_count ) {
+        if ( first_low_priority > process_count / 2 ) {
+            testSuccess();
+        } else {
+            qDebug() << "Low priority process opened too early:"
+                     << first_low_priority;
+            testFailed();
+        }
+    }
+}
+
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// TestCaseFanout
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+/*!
+   Test that LibsshQtFanout runs the command on every host and that output
+   from every host is received.
+*/
+class TestCaseFanout : public QObject
+{
+    Q_OBJECT
+
+public:
+    TestCaseFanout(TestCaseOpts *opts);
+
+public slots:
+    void hostStdout(int host, QByteArray data);
+    void hostFinished(int host, int exit_code);
+    void hostError(int host, QString message);
+    void allFinished();
+
+public:
+    TestCaseOpts   * const opts;
+    LibsshQtFanout * const fanout;
+    QList<QByteArray>      output;
+    int                    failed;
+};
+
+TestCaseFanout::TestCaseFanout(TestCaseOpts *opts) :
+    opts(opts),
+    fanout(new LibsshQtFanout(this)),
+    failed(0)
+{
+    QList<QUrl> hosts;
+    for ( int i = 0; i < 4; i++ ) {
+        hosts << opts->url;
+        output << QByteArray();
+    }
+
+    fanout->setHosts(hosts);
+    fanout->setCommand("echo fanout");
+    fanout->setMaxConcurrent(2);
+    fanout->setPassword(opts->password);
+
+    connect(fanout, SIGNAL(hostStdout(int,QByteArray)),
+            this,   SLOT(hostStdout(int,QByteArray)));
+    connect(fanout, SIGNAL(hostFinished(int,int)),
+            this,   SLOT(hostFinished(int,int)));
+    connect(fanout, SIGNAL(hostError(int,QString)),
+            this,   SLOT(hostError(int,QString)));
+    connect(fanout, SIGNAL(allFinished()),
+            this,   SLOT(allFinished()));
+
+    fanout->start();
+}
+
+void TestCaseFanout::hostStdout(int host, QByteArray data)
+{
+    if ( fanout->runningCount() > 2 ) {
+        qDebug() << "Too many hosts running:" << fanout->runningCount();
+        failed++;
+    }
+    output[host] += data;
+}
+
+void TestCaseFanout::hostFinished(int host, int exit_code)
+{
+    if ( exit_code != 0 || output.at(host) != "fanout\n" ) {
+        qDebug() << "Invalid result from host" << host << exit_code
+                 << output.at(host);
+        failed++;
+    }
+}
+
+void TestCaseFanout::hostError(int host, QString message)
+{
+    qDebug() << "Host" << host << "failed:" << message;
+    failed++;
+}
+
+void TestCaseFanout::allFinished()
+{
+    opts->loop.exit(failed == 0 && fanout->finishedCount() == 4 ? 0 : -1);
+}
+
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// Test
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+class Test : public QObject
+{
+    Q_OBJECT
+
+public:
+    Test();
+
+private Q_SLOTS:
+    void testConnect();
+    void testReadlineStdin();
+    void testReadlineStderr();
+    void testIoStdout();
+    void testIoStderr();
+    void testSink();
+    void testSinkFd();
+    void testLines();
+    void testTail();
+    void testMerged();
+    void testStdinSource();
+    void testPipe();
+    void testPipeAbort();
+    void testFileSink();
+    void testStdinFile();
+    void testTimeout();
+    void testProcessPool();
+    void testShell();
+    void testAsync();
+    void testCoroutine();
+    void testAgent();
+    void testFramers();
+    void testSubsystem();
+    void testSftp();
+    void testSftpTransfer();
+    void testSftpScheduler();
+    void testSftpStriped();
+    void testSftpResume();
+    void testBlocking();
+    void testJump();
+    void testFanout();
+    void testChannelQueue();
+
+private:
+    TestCaseOpts opts;
+};
+
+Test::Test()
+{
+    const char conf_file[] = "./libsshqt-test-config";
+    const QString conf_help = QString(
+                "Please create configuration file:\n"
+                "\n"
+                "    %1\n"
+                "\n"
+                "with the contents:\n"
+                "\n"
+                "    ssh://user@hostname:port/\n"
+                "    password\n")
+                .arg(conf_file);
+
+    QFile file;
+    file.setFileName(conf_file);
+    if ( ! file.open(QIODevice::ReadOnly)) {
+        qFatal("\nError: Could not open test configuration file: %s\n\n%s",
+               conf_file, qPrintable(conf_help));
+    }
+
+    QStringList config = QString(file.readAll()).split('\n');
+    if ( ! config.length() == 2 ) {
+        qFatal("\nError: Could not read SSH url and password from: %s\n\n%s",
+               conf_file, qPrintable(conf_help));
+    }
+
+    opts.url = config.at(0);
+    opts.password = config.at(1);
+}
+
+void Test::testConnect()
+{
+    TestCaseConnect testcase(&opts);
+    QVERIFY2(opts.loop.exec() == 0, "Could not connect to the SSH server");
+}
+
+void Test::testReadlineStdin()
+{
+    TestCaseReadlineStdout testcase(&opts);
+    QVERIFY2(opts.loop.exec() == 0, "Could not read lines correctly from STDOUT");
+}
+
+void Test::testReadlineStderr()
+{
+    TestCaseReadlineStderr testcase(&opts);
+    QVERIFY2(opts.loop.exec() == 0, "Could not read lines correctly from STDERR");
+}
+
+void Test::testIoStdout()
+{
+    TestCaseIOStdout testcase(&opts);
+    QVERIFY2(opts.loop.exec() == 0, "Data corruption in STDOUT stream");
+}
+
+void Test::testIoStderr()
+{
+    TestCaseIOStderr testcase(&opts);
+    QVERIFY2(opts.loop.exec() == 0, "Data corruption in STDERR stream");
+}
+
+void Test::testSink()
+{
+    TestCaseSink testcase(&opts);
+    QVERIFY2(opts.loop.exec() == 0, "Raw output sinks did not receive all data");
+}
+
+void Test::testSinkFd()
+{
+    TestCaseSinkFd testcase(&opts);
+    QVERIFY2(opts.loop.exec() == 0, "Non-blocking fd sink did not receive all data");
+}
+
+void Test::testLines()
+{
+    TestCaseLines testcase(&opts);
+    QVERIFY2(opts.loop.exec() == 0, "Could not read line batches correctly");
+}
+
+void Test::testTail()
+{
+    TestCaseTail testcase(&opts);
+    QVERIFY2(opts.loop.exec() == 0, "Tail capture did not keep the last lines");
+}
+
+void Test::testMerged()
+{
+    TestCaseMerged testcase(&opts);
+    QVERIFY2(opts.loop.exec() == 0, "Merged output was not in order");
+}
+
+void Test::testStdinSource()
+{
+    TestCaseStdinSource testcase(&opts);
+    QVERIFY2(opts.loop.exec() == 0, "Stdin source was not sent to process");
+}
+
+void Test::testPipe()
+{
+    TestCasePipe testcase(&opts);
+    QVERIFY2(opts.loop.exec() == 0, "Pipe did not move all data");
+}
+
+void Test::testPipeAbort()
+{
+    TestCasePipeAbort testcase(&opts);
+    QVERIFY2(opts.loop.exec() == 0, "Pipe sent EOF after source was closed");
+}
+
+void Test::testFileSink()
+{
+    TestCaseFileSink testcase(&opts);
+    QVERIFY2(opts.loop.exec() == 0, "File sink did not write all output");
+}
+
+void Test::testStdinFile()
+{
+    TestCaseStdinFile testcase(&opts);
+    QVERIFY2(opts.loop.exec() == 0, "Stdin file was not sent to process");
+}
+
+void Test::testTimeout()
+{
+    TestCaseTimeout testcase(&opts);
+    QVERIFY2(opts.loop.exec() == 0, "Idle process was not stopped");
+}
+
+void Test::testProcessPool()
+{
+    TestCaseProcessPool testcase(&opts);
+    QVERIFY2(opts.loop.exec() == 0, "Recycled process did not run correctly");
+}
+
+void Test::testShell()
+{
+    TestCaseShell testcase(&opts);
+    QVERIFY2(opts.loop.exec() == 0, "Shell commands returned wrong results");
+}
+
+void Test::testAsync()
+{
+    TestCaseAsync testcase(&opts);
+    QVERIFY2(opts.loop.exec() == 0, "Async commands returned wrong results");
+}
+
+void Test::testCoroutine()
+{
+#if defined(__cpp_impl_coroutine)
+    TestCaseCoroutine testcase(&opts);
+    QVERIFY2(opts.loop.exec() == 0, "Coroutine got wrong results");
+#elif QT_VERSION >= 0x050000
+    QSKIP("Coroutines need a C++20 compiler");
+#else
+    QSKIP("Coroutines need a C++20 compiler", SkipAll);
+#endif
+}
+
+void Test::testAgent()
+{
+    TestCaseAgent testcase(&opts);
+    QVERIFY2(opts.loop.exec() == 0, "Agent requests returned wrong results");
+}
+
+void Test::testFramers()
+{
+    QByteArray netconf_data =
+            "<hello/>]]>]]><rpc/>]]>]]>"
+            "\n#4\n<rpc\n#19\n message-id=\"102\"/>\n##\n";
+
+    // Feed the data one byte at a time to test incremental parsing
+    QList<QByteArray> messages;
+    LibsshQtDelimiterFramer eom(LibsshQtDelimiterFramer::netconfDelimiter());
+    LibsshQtChunkedFramer chunked;
+
+    int split = netconf_data.indexOf("\n#");
+    for ( int i = 0; i < split; i++ ) {
+        QVERIFY( eom.parse(netconf_data.constData() + i, 1, messages));
+    }
+    for ( int i = split; i < netconf_data.size(); i++ ) {
+        QVERIFY( chunked.parse(netconf_data.constData() + i, 1, messages));
+    }
+
+    QCOMPARE( messages.count(), 3 );
+    QCOMPARE( messages.at(0), QByteArray("<hello/>"));
+    QCOMPARE( messages.at(1), QByteArray("<rpc/>"));
+    QCOMPARE( messages.at(2), QByteArray("<rpc message-id=\"102\"/>"));
+
+    QCOMPARE( chunked.frame("<rpc/>"), QByteArray("\n#6\n<rpc/>\n##\n"));
+    QVERIFY( chunked.frame(QByteArray()).isEmpty());
+    QCOMPARE( eom.frame("<rpc/>"), QByteArray("<rpc/>]]>]]>"));
+
+    QVERIFY( ! chunked.parse("\n#0\n", 4, messages));
+}
+
+void Test::testSubsystem()
+{
+    TestCaseSubsystem testcase(&opts);
+    QVERIFY2(opts.loop.exec() == 0, "Could not open sftp subsystem");
+}
+
+void Test::testSftp()
+{
+    TestCaseSftp testcase(&opts);
+    QVERIFY2(opts.loop.exec() == 0, "SFTP operations failed");
+}
+
+void Test::testSftpTransfer()
+{
+    TestCaseSftpTransfer testcase(&opts);
+    QVERIFY2(opts.loop.exec() == 0, "Pipelined transfer corrupted the file");
+}
+
+void Test::testSftpScheduler()
+{
+    TestCaseSftpScheduler testcase(&opts);
+    QVERIFY2(opts.loop.exec() == 0, "Scheduler did not transfer all files");
+}
+
+void Test::testSftpStriped()
+{
+    TestCaseSftpStriped testcase(&opts);
+    QVERIFY2(opts.loop.exec() == 0, "Striped transfer corrupted the file");
+}
+
+void Test::testSftpResume()
+{
+    TestCaseSftpResume testcase(&opts);
+    QVERIFY2(opts.loop.exec() == 0, "Transfer did not resume from journal");
+}
+
+void Test::testBlocking()
+{
+    QFuture<QString> future = QtConcurrent::run(testBlockingWorker, &opts);
+    QString result = future.result();
+    QVERIFY2(result.isEmpty(), qPrintable(result));
+}
+
+void Test::testJump()
+{
+    TestCaseJump testcase(&opts);
+    QVERIFY2(opts.loop.exec() == 0, "Could not connect through jump client");
+}
+
+void Test::testFanout()
+{
+    TestCaseFanout testcase(&opts);
+    QVERIFY2(opts.loop.exec() == 0, "Could not run command on all hosts");
+}
+
+void Test::testChannelQueue()
+{
+    TestCaseChannelQueue testcase(&opts);
+    QVERIFY2(opts.loop.exec() == 0, "Queued processes did not run correctly");
 }
 
 QTEST_MAIN(Test);
@@ -14,6 +14,9 @@ CONFIG   -= app_bundle
 
 TEMPLATE = app
 
+# The coroutine test needs C++20, it is skipped when built without it
+greaterThan(QT_MAJOR_VERSION, 4): CONFIG += c++2a
+
 
 SOURCES += test.cpp
 DEFINES += SRCDIR=\\\"$$PWD/\\\"